@@ -0,0 +1,1118 @@
+// bench/bench.c
+// Benchmark driver for the Robot Writer. It has its own main(), so it lives
+// outside the folder the program is built from; build it from the repository
+// root with every source file there except main.c, for example:
+//   gcc -O2 -I. bench/bench.c $(ls *.c | grep -v main.c) -o robotwriter-bench -lpthread -lm
+// Add -DBENCH_COUNT_ALLOCATIONS -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc
+// to count heap allocations made by the writer's own code (GNU ld; calls
+// inside the C library are not seen). Results are printed as JSON.
+#ifndef _WIN32
+#define _GNU_SOURCE     // posix_openpt() and cfmakeraw()
+#endif
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "font.h"
+#include "fontreg.h"
+#include "layout.h"
+#include "job.h"
+#include "scheduler.h"
+#include "pargen.h"
+#include "platform.h"
+#include "core.h"
+#include "sim.h"
+#include "stamp.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <pthread.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
+
+#define BENCH_DEFAULT_ITERATIONS 5
+#define BENCH_TEXT_HEIGHT 5.0f          // mm
+#define BENCH_WORD_LOOPS 200            // Passes over the corpus for the layout microbenchmark
+#define BENCH_JOIN_MM 0.1f              // Stroke joining tolerance, within reach of the drawing comparison
+#define BENCH_DRAWING_TOLERANCE_MM 0.05 // Grid cell of the drawing comparison
+#define BENCH_LABEL_COLUMNS 2           // Label grid of the copies benchmark, inside the A5 page margins
+#define BENCH_LABEL_ROWS 10
+#define BENCH_LABEL_PITCH_X 64.0f       // mm
+#define BENCH_LABEL_PITCH_Y 18.0f
+#define BENCH_FONT_CODES 20000          // Code points beyond ASCII in the font lookup benchmark
+#define BENCH_FONT_FIRST_CODE 0x4E00    // From the CJK ideographs, every third one
+#define BENCH_LOOKUP_LOOPS 100          // Passes over the code points per timed run
+#define BENCH_WORK_AREA "100x150"       // Machine limits inside the A5 pages, cutting off their right and bottom
+
+// Generated corpus, from a one-line label to a multi-page document
+typedef struct {
+    const char *name;
+    int words;
+    int words_per_paragraph;
+} CorpusEntry;
+
+static const CorpusEntry corpus[] = {
+    { "label", 3, 0 },
+    { "note", 60, 0 },
+    { "letter", 400, 80 },
+    { "document", 6000, 120 },
+};
+#define CORPUS_SIZE (sizeof(corpus) / sizeof(corpus[0]))
+
+static const char *const dictionary[] = {
+    "the", "robot", "writer", "draws", "each", "letter", "with", "a", "single", "stroke",
+    "pen", "moves", "over", "paper", "and", "lifts", "between", "words", "lines", "of",
+    "text", "are", "laid", "out", "to", "fit", "page", "Dear", "friend", "thank",
+    "you", "for", "your", "kind", "note", "We", "will", "meet", "on", "Monday",
+    "at", "10", "o'clock", "Best", "regards", "quick", "brown", "fox", "jumps", "lazy",
+    "dog", "Hello", "World", "invoice", "#4521", "total", "$12.50", "(paid)", "yes", "no"
+};
+#define DICTIONARY_SIZE (sizeof(dictionary) / sizeof(dictionary[0]))
+
+// Counting transports and allocation counting
+typedef struct {
+    unsigned long commands;
+    unsigned long bytes;
+} TransportCounters;
+
+static unsigned long allocation_count = 0;
+static int results_printed = 0;
+
+#ifdef BENCH_COUNT_ALLOCATIONS
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *pointer, size_t size);
+
+void *__wrap_malloc(size_t size) {
+    allocation_count++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    allocation_count++;
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *pointer, size_t size) {
+    allocation_count++;
+    return __real_realloc(pointer, size);
+}
+#endif
+
+static void print_allocations(unsigned long before, unsigned long runs) {
+#ifdef BENCH_COUNT_ALLOCATIONS
+    printf("\"allocations\": %.1f", (double)(allocation_count - before) / (double)runs);
+#else
+    (void)before;
+    (void)runs;
+    printf("\"allocations\": null");
+#endif
+}
+
+// Start one entry of the "benchmarks" array
+static void begin_result(const char *name) {
+    printf("%s    {\"name\": \"%s\", ", results_printed++ ? ",\n" : "", name);
+}
+
+static int null_send_command(Transport *transport, const char *command) {
+    TransportCounters *counters = transport->state;
+    counters->commands++;
+    counters->bytes += strlen(command);
+    return 0;
+}
+
+// Write a corpus entry to path; returns the number of glyphs in it, -1 on error
+static long write_corpus(const CorpusEntry *entry, const char *path) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        return -1;
+    }
+    unsigned int seed = 12345u;
+    long glyphs = 0;
+    for (int i = 0; i < entry->words; i++) {
+        seed = seed * 1103515245u + 12345u;
+        const char *word = dictionary[(seed >> 16) % DICTIONARY_SIZE];
+        glyphs += (long)strlen(word);
+        fputs(word, file);
+        if (entry->words_per_paragraph > 0 && (i + 1) % entry->words_per_paragraph == 0) {
+            fputs("\n\n", file);
+        } else {
+            fputc(' ', file);
+        }
+    }
+    fputc('\n', file);
+    return fclose(file) == 0 ? glyphs : -1;
+}
+
+static double elapsed_ns(uint64_t start) {
+    return (double)(monotonic_ns() - start);
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double first = *(const double *)a, second = *(const double *)b;
+    return first < second ? -1 : first > second;
+}
+
+static double median(double *values, int count) {
+    qsort(values, (size_t)count, sizeof(double), compare_doubles);
+    return values[count / 2];
+}
+
+static int bench_font_load(const char *font_path, int iterations) {
+    double times[64];
+    unsigned long before = allocation_count;
+    for (int i = 0; i < iterations; i++) {
+        uint64_t start = monotonic_ns();
+        if (load_font_file(font_path) != 0) {
+            return -1;
+        }
+        times[i] = elapsed_ns(start);
+    }
+    begin_result("font_load");
+    printf("\"ns_per_op\": %.0f, ", median(times, iterations));
+    print_allocations(before, (unsigned long)iterations);
+    printf("}");
+    return 0;
+}
+
+// calculate_word_width() and update_print_position() over every dictionary word
+static void bench_word_layout(float scale_factor, int iterations) {
+    double times[64];
+    float x = 0.0f, y = 0.0f, line_spacing = BASE_LINE_SPACING + 18.0f * scale_factor;
+    unsigned long words = BENCH_WORD_LOOPS * DICTIONARY_SIZE;
+    unsigned long before = allocation_count;
+
+    for (int i = 0; i < iterations; i++) {
+        uint64_t start = monotonic_ns();
+        for (int loop = 0; loop < BENCH_WORD_LOOPS; loop++) {
+            for (size_t w = 0; w < DICTIONARY_SIZE; w++) {
+                float width = calculate_word_width(dictionary[w], strlen(dictionary[w]), scale_factor);
+                update_print_position(&x, &y, width, line_spacing, MAX_LINE_WIDTH);
+                x += width + scale_factor * WORD_SPACING_FACTOR;
+            }
+        }
+        times[i] = elapsed_ns(start);
+    }
+    begin_result("word_layout");
+    printf("\"words\": %lu, \"ns_per_word\": %.1f, \"final_y\": %.1f, ",
+           words, median(times, iterations) / (double)words, y);
+    print_allocations(before, (unsigned long)iterations);
+    printf("}");
+}
+
+// print_gcode_for_character() for every printable glyph, formatted to a null transport
+static void bench_glyph_generation(float scale_factor, int iterations) {
+    double times[64];
+    TransportCounters counters = { 0, 0 };
+    Transport null_transport = { null_send_command, &counters, NULL, NULL, NULL };
+    Executor executor;
+    OpSink sink = { executor_emit, &executor };
+    unsigned long glyphs = 0;
+    unsigned long before = allocation_count;
+
+    set_generation_sink(&sink);
+    for (int i = 0; i < iterations; i++) {
+        executor_init(&executor, &null_transport, NULL, NULL);
+        counters.commands = counters.bytes = 0;
+        glyphs = 0;
+        start_generation();
+        uint64_t start = monotonic_ns();
+        for (int loop = 0; loop < BENCH_WORD_LOOPS; loop++) {
+            float x = 0.0f;
+            for (int c = 33; c < MAX_CHARACTERS; c++) {
+                if (print_gcode_for_character(c, scale_factor, x, -18.0f * scale_factor) == 0) {
+                    x += get_character_width(c, scale_factor);
+                    glyphs++;
+                }
+            }
+        }
+        flush_generation();
+        times[i] = elapsed_ns(start);
+    }
+    double ns = median(times, iterations);
+    begin_result("glyph_generation");
+    printf("\"glyphs\": %lu, \"ns_per_glyph\": %.1f, "
+           "\"commands_per_s\": %.0f, \"bytes_per_s\": %.0f, ",
+           glyphs, ns / (double)glyphs, counters.commands / ns * 1e9, counters.bytes / ns * 1e9);
+    print_allocations(before, (unsigned long)iterations);
+    printf("}");
+}
+
+// Write a font with a one-stroke glyph for every printable ASCII character and BENCH_FONT_CODES more
+static int write_large_font(const char *path) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        return -1;
+    }
+    for (int c = 32; c < MAX_CHARACTERS; c++) {
+        fprintf(file, "999 %d 2\n0 0 0\n10 0 1\n", c);
+    }
+    for (int i = 0; i < BENCH_FONT_CODES; i++) {
+        fprintf(file, "999 %d 2\n0 0 0\n10 0 1\n", BENCH_FONT_FIRST_CODE + 3 * i);
+    }
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+// Time passes of font_glyph() over codes[i] = first + step * i; returns ns per lookup
+static double time_lookups(const Font *font, int first, int step, int count, long *found) {
+    uint64_t start = monotonic_ns();
+    for (int loop = 0; loop < BENCH_LOOKUP_LOOPS; loop++) {
+        for (int i = 0; i < count; i++) {
+            const CharacterData *glyph = font_glyph(font, first + step * i);
+            *found += glyph ? glyph->num_movements : 0;
+        }
+    }
+    return elapsed_ns(start) / ((double)BENCH_LOOKUP_LOOPS * count);
+}
+
+// font_glyph() on a large font mapped from a registry: ASCII, hashed code points and code points it lacks
+static int bench_font_lookup(int iterations) {
+    const char *font_path = "bench_font.txt", *registry_path = "bench_fonts.rwfr", *name = "large";
+    if (write_large_font(font_path) != 0) {
+        return -1;
+    }
+    Font *font = font_load(font_path);
+    remove(font_path);
+    if (!font) {
+        return -1;
+    }
+    unsigned long image_bytes = font->image->size;
+    int glyph_count = font->glyph_count;
+    int result = font_registry_build(registry_path, &name, (const Font *const *)&font, 1);
+    font_free(font);
+
+    double open_times[64], ascii[64], hashed[64], missing[64];
+    long found = 0;
+    unsigned long before = allocation_count;
+    for (int i = 0; i < iterations && result == 0; i++) {
+        FontRegistry registry;
+        uint64_t start = monotonic_ns();
+        if (font_registry_open(&registry, registry_path) != 0) {
+            result = -1;
+            break;
+        }
+        open_times[i] = elapsed_ns(start);
+        const Font *mapped = font_registry_find(&registry, name);
+        ascii[i] = time_lookups(mapped, 32, 1, MAX_CHARACTERS - 32, &found);
+        hashed[i] = time_lookups(mapped, BENCH_FONT_FIRST_CODE, 3, BENCH_FONT_CODES, &found);
+        missing[i] = time_lookups(mapped, BENCH_FONT_FIRST_CODE + 1, 3, BENCH_FONT_CODES, &found);
+        font_registry_close(&registry);
+    }
+    remove(registry_path);
+    if (result != 0) {
+        return -1;
+    }
+    // Every lookup of a present glyph adds its 2 movements
+    long expected = 2L * BENCH_LOOKUP_LOOPS * (MAX_CHARACTERS - 32 + BENCH_FONT_CODES) * iterations;
+    begin_result("font_lookup");
+    printf("\"glyphs\": %d, \"image_bytes\": %lu, \"view_bytes\": %lu, \"registry_open_ns\": %.0f, "
+           "\"ns_per_ascii_lookup\": %.2f, \"ns_per_hashed_lookup\": %.2f, \"ns_per_missing_lookup\": %.2f, "
+           "\"all_found\": %s, ", glyph_count, image_bytes, (unsigned long)sizeof(Font), median(open_times, iterations),
+           median(ascii, iterations), median(hashed, iterations), median(missing, iterations),
+           found == expected ? "true" : "false");
+    print_allocations(before, (unsigned long)iterations);
+    printf("}");
+    return 0;
+}
+
+#ifndef _WIN32
+// Controller stand-in on the slave side of a pseudo-terminal: answers "ok" to every line
+typedef struct {
+    int master;
+    int slave;
+    pthread_t thread;
+    TransportCounters counters;
+} PtyLoopback;
+
+static void *loopback_main(void *arg) {
+    PtyLoopback *loopback = arg;
+    char buffer[4096];
+    ssize_t got;
+    while ((got = read(loopback->slave, buffer, sizeof(buffer))) > 0) {
+        for (ssize_t i = 0; i < got; i++) {
+            if (buffer[i] == '\n' && write(loopback->slave, "ok\r\n", 4) != 4) {
+                return NULL;
+            }
+        }
+    }
+    return NULL;
+}
+
+static int pty_send_command(Transport *transport, const char *command) {
+    PtyLoopback *loopback = transport->state;
+    size_t length = strlen(command);
+    loopback->counters.commands++;
+    loopback->counters.bytes += length;
+    if (write(loopback->master, command, length) != (ssize_t)length) {
+        return -1;
+    }
+    transport_mark_written(transport);
+    // Wait for the acknowledgement, as WaitForReply does on the real port
+    char reply[64];
+    size_t used = 0;
+    while (used < sizeof(reply)) {
+        ssize_t got = read(loopback->master, reply + used, 1);
+        if (got <= 0) {
+            return -1;
+        }
+        if (reply[used++] == '\n') {
+            return strncmp(reply, "ok", 2) == 0 ? 0 : -1;
+        }
+    }
+    return -1;
+}
+
+static int loopback_open(PtyLoopback *loopback) {
+    memset(loopback, 0, sizeof(*loopback));
+    loopback->master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (loopback->master < 0 || grantpt(loopback->master) != 0 || unlockpt(loopback->master) != 0) {
+        return -1;
+    }
+    loopback->slave = open(ptsname(loopback->master), O_RDWR | O_NOCTTY);
+    if (loopback->slave < 0) {
+        close(loopback->master);
+        return -1;
+    }
+
+    // Raw on both ends, like a serial line: no echo, no line discipline
+    struct termios settings;
+    int fds[2] = { loopback->master, loopback->slave };
+    for (int i = 0; i < 2; i++) {
+        if (tcgetattr(fds[i], &settings) == 0) {
+            cfmakeraw(&settings);
+            tcsetattr(fds[i], TCSANOW, &settings);
+        }
+    }
+    if (pthread_create(&loopback->thread, NULL, loopback_main, loopback) != 0) {
+        close(loopback->slave);
+        close(loopback->master);
+        return -1;
+    }
+    return 0;
+}
+
+static void loopback_close(PtyLoopback *loopback) {
+    close(loopback->master);
+    pthread_join(loopback->thread, NULL);
+    close(loopback->slave);
+}
+#endif
+
+// Records the operation stream for the plot time prediction, then executes it if there is an executor
+typedef struct {
+    Executor *executor;
+    MotionOp *ops;
+    size_t count;
+    size_t capacity;
+} RecordingSink;
+
+static int recording_emit(void *user_data, const MotionOp *op) {
+    RecordingSink *recording = user_data;
+    if (recording->count == recording->capacity) {
+        size_t grown = recording->capacity ? recording->capacity * 2 : 4096;
+        MotionOp *ops = realloc(recording->ops, grown * sizeof(*ops));
+        if (!ops) {
+            return -1;
+        }
+        recording->ops = ops;
+        recording->capacity = grown;
+    }
+    recording->ops[recording->count++] = *op;
+    return recording->executor ? executor_emit(recording->executor, op) : 0;
+}
+
+// Layout, generation and streaming of a whole document through a transport
+static int bench_end_to_end(const CorpusEntry *entry, const char *path, long glyphs, float scale_factor,
+                            const char *transport_name, Transport *transport, TransportCounters *counters,
+                            int iterations) {
+    double times[64];
+    RecordingSink recording = { NULL, NULL, 0, 0 };
+    OpSink sink = { recording_emit, &recording };
+    Executor executor;
+    unsigned long before = 0;
+    int result = 0;
+
+    // Iteration -1 warms up the caches and grows the recording buffer; it is not measured
+    for (int i = -1; i < iterations && result == 0; i++) {
+        if (i == 0) {
+            before = allocation_count;
+        }
+        executor_init(&executor, transport, NULL, NULL);
+        recording.executor = &executor;
+        recording.count = 0;
+        counters->commands = counters->bytes = 0;
+        set_generation_sink(&sink);
+        uint64_t start = monotonic_ns();
+        result = process_text_file(path, scale_factor);
+        if (i >= 0) {
+            times[i] = elapsed_ns(start);
+        }
+    }
+    if (result != 0) {
+        free(recording.ops);
+        return -1;
+    }
+
+    double ns = median(times, iterations);
+    char name[64];
+    snprintf(name, sizeof(name), "stream/%s/%s", entry->name, transport_name);
+    begin_result(name);
+    printf("\"glyphs\": %ld, \"operations\": %lu, \"commands\": %lu, "
+           "\"bytes\": %lu, \"wall_ms\": %.3f, \"ns_per_glyph\": %.1f, \"commands_per_s\": %.0f, "
+           "\"bytes_per_s\": %.0f, \"predicted_plot_s\": %.1f, ",
+           glyphs, (unsigned long)recording.count, counters->commands,
+           counters->bytes, ns / 1e6, ns / (double)glyphs, counters->commands / ns * 1e9,
+           counters->bytes / ns * 1e9, estimate_ops_ms(recording.ops, recording.count, 0) / 1000.0);
+    print_allocations(before, (unsigned long)iterations);
+    printf("}");
+    free(recording.ops);
+    return 0;
+}
+
+static int counting_emit(void *user_data, const MotionOp *op) {
+    (void)op;
+    (*(unsigned long *)user_data)++;
+    return 0;
+}
+
+// Layout and generation of a document on 1, 2, 4 and 8 generator threads, without a transport
+static int bench_parallel_generation(const CorpusEntry *entry, const char *path, long glyphs, float scale_factor,
+                                     int iterations) {
+    static const int thread_counts[] = { 1, 2, 4, 8 };
+    double single_ns = 0.0;
+    unsigned long single_ops = 0;
+    LayoutOptions options;
+    get_layout_options(&options);
+
+    for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+        double times[64];
+        unsigned long operations = 0;
+        OpSink sink = { counting_emit, &operations };
+        Generator generator;
+        generator_init(&generator, get_loaded_font(), &sink);
+        generator_set_threads(&generator, thread_counts[t]);
+        int result = 0;
+        for (int i = -1; i < iterations && result == 0; i++) {
+            operations = 0;
+            uint64_t start = monotonic_ns();
+            result = layout_text_file(&generator, &options, path, scale_factor);
+            if (i >= 0) {
+                times[i] = elapsed_ns(start);
+            }
+        }
+        generator_free(&generator);
+        if (result != 0) {
+            return -1;
+        }
+
+        double ns = median(times, iterations);
+        if (t == 0) {
+            single_ns = ns;
+            single_ops = operations;
+        }
+        char name[64];
+        snprintf(name, sizeof(name), "generate/%s/threads_%d", entry->name, thread_counts[t]);
+        begin_result(name);
+        printf("\"glyphs\": %ld, \"operations\": %lu, \"wall_ms\": %.3f, \"ns_per_glyph\": %.1f, "
+               "\"speedup\": %.2f, \"same_output\": %s}",
+               glyphs, operations, ns / 1e6, ns / (double)glyphs, single_ns / ns,
+               operations == single_ops ? "true" : "false");
+    }
+    return 0;
+}
+
+// Generates a document with the given feed planning and joining into recording, without a transport
+static int generate_recording(RecordingSink *recording, const char *path, float scale_factor,
+                              const FeedLimits *limits, float join_distance) {
+    OpSink sink = { recording_emit, recording };
+    LayoutOptions options;
+    get_layout_options(&options);
+    Generator generator;
+    generator_init(&generator, get_loaded_font(), &sink);
+    generator_set_feed_limits(&generator, limits);
+    generator_set_join_distance(&generator, join_distance);
+    recording->count = 0;
+    int result = layout_text_file(&generator, &options, path, scale_factor);
+    generator_free(&generator);
+    return result;
+}
+
+static unsigned long count_ops(const RecordingSink *recording, int code) {
+    unsigned long count = 0;
+    for (size_t i = 0; i < recording->count; i++) {
+        count += recording->ops[i].code == code;
+    }
+    return count;
+}
+
+// Predicted plot time of a document with one feed and with per-segment feed planning, at two text heights
+static int bench_feed_planning(const CorpusEntry *entry, const char *path, long glyphs) {
+    static const float heights[] = { 4.0f, 10.0f };
+    RecordingSink recording = { NULL, NULL, 0, 0 };
+
+    for (size_t h = 0; h < sizeof(heights) / sizeof(heights[0]); h++) {
+        double plot_ms[2];
+        unsigned long feed_changes = 0;
+        for (int planned = 0; planned < 2; planned++) {
+            FeedLimits limits;
+            feed_limits_init(&limits);
+            limits.enabled = planned;
+            if (generate_recording(&recording, path, heights[h] / 18.0f, &limits, 0.0f) != 0) {
+                free(recording.ops);
+                return -1;
+            }
+            plot_ms[planned] = estimate_ops_ms(recording.ops, recording.count, 0);
+            feed_changes = count_ops(&recording, IR_FEED);
+        }
+
+        char name[64];
+        snprintf(name, sizeof(name), "feed/%s/height_%.0f", entry->name, heights[h]);
+        begin_result(name);
+        printf("\"glyphs\": %ld, \"fixed_plot_s\": %.1f, \"planned_plot_s\": %.1f, \"speedup\": %.2f, "
+               "\"feed_changes\": %lu}", glyphs, plot_ms[0] / 1000.0, plot_ms[1] / 1000.0,
+               plot_ms[1] > 0.0 ? plot_ms[0] / plot_ms[1] : 0.0, feed_changes);
+    }
+    free(recording.ops);
+    return 0;
+}
+
+// Pen changes and predicted plot time without and with stroke joining across glyphs
+static int bench_stroke_joining(const CorpusEntry *entry, const char *path, long glyphs, float scale_factor) {
+    RecordingSink recording = { NULL, NULL, 0, 0 };
+    FeedLimits limits;
+    feed_limits_init(&limits);
+    double plot_ms[2];
+    unsigned long pen_changes[2];
+
+    for (int joined = 0; joined < 2; joined++) {
+        if (generate_recording(&recording, path, scale_factor, &limits, joined ? BENCH_JOIN_MM : 0.0f) != 0) {
+            free(recording.ops);
+            return -1;
+        }
+        plot_ms[joined] = estimate_ops_ms(recording.ops, recording.count, 0);
+        pen_changes[joined] = count_ops(&recording, IR_PEN);
+    }
+    free(recording.ops);
+
+    char name[64];
+    snprintf(name, sizeof(name), "join/%s/%.1fmm", entry->name, BENCH_JOIN_MM);
+    begin_result(name);
+    printf("\"glyphs\": %ld, \"pen_changes\": %lu, \"joined_pen_changes\": %lu, \"plot_s\": %.1f, "
+           "\"joined_plot_s\": %.1f, \"speedup\": %.2f}", glyphs, pen_changes[0], pen_changes[1],
+           plot_ms[0] / 1000.0, plot_ms[1] / 1000.0, plot_ms[1] > 0.0 ? plot_ms[0] / plot_ms[1] : 0.0);
+    return 0;
+}
+
+// Generator settings whose drawing is checked against plain generation
+typedef struct {
+    const char *name;
+    int boustrophedon;
+    int plan_feed;
+    float join_distance;
+    int threads;
+} DrawingVariant;
+
+static const DrawingVariant drawing_variants[] = {
+    { "serpentine", 1, 0, 0.0f, 1 },
+    { "feed", 0, 1, 0.0f, 1 },
+    { "join", 0, 0, BENCH_JOIN_MM, 1 },
+    { "threads_4", 0, 0, 0.0f, 4 },
+};
+#define DRAWING_VARIANTS (sizeof(drawing_variants) / sizeof(drawing_variants[0]))
+
+static int sim_emit(void *user_data, const MotionOp *op) {
+    Simulator *sim = user_data;
+    char line[64];
+    if (op->code == IR_PAGE) {
+        sim_page(sim);
+    } else if (format_motion_op(op, line) > 0) {
+        sim_line(sim, line);
+    }
+    return sim->failed ? -1 : 0;
+}
+
+// Generates a document with the variant's settings (plain with NULL) and runs its G-code on sim
+static int simulate_variant(Simulator *sim, const DrawingVariant *variant, const char *path, float scale_factor) {
+    OpSink sink = { sim_emit, sim };
+    LayoutOptions options;
+    get_layout_options(&options);
+    Generator generator;
+    generator_init(&generator, get_loaded_font(), &sink);
+    if (variant) {
+        generator_set_boustrophedon(&generator, variant->boustrophedon);
+        generator.feed_limits.enabled = variant->plan_feed;
+        generator_set_join_distance(&generator, variant->join_distance);
+        generator_set_threads(&generator, variant->threads);
+    }
+    sim_init(sim);
+    int result = layout_text_file(&generator, &options, path, scale_factor);
+    generator_free(&generator);
+    return result;
+}
+
+// Whether each optimisation leaves the drawing of a document unchanged (sim.h), and how long checking takes
+static int bench_drawing_check(const CorpusEntry *entry, const char *path, long glyphs, float scale_factor) {
+    Simulator plain, optimised;
+    if (simulate_variant(&plain, NULL, path, scale_factor) != 0) {
+        sim_free(&plain);
+        return -1;
+    }
+    int result = 0;
+    for (size_t v = 0; v < DRAWING_VARIANTS && result == 0; v++) {
+        SimComparison comparison;
+        uint64_t start = monotonic_ns();
+        result = simulate_variant(&optimised, &drawing_variants[v], path, scale_factor);
+        int differ = result == 0 ? sim_compare(&plain, &optimised, BENCH_DRAWING_TOLERANCE_MM, &comparison) : -1;
+        double ns = elapsed_ns(start);
+        sim_free(&optimised);
+        if (differ < 0) {
+            result = -1;
+            break;
+        }
+
+        char name[64];
+        snprintf(name, sizeof(name), "drawing/%s/%s", entry->name, drawing_variants[v].name);
+        begin_result(name);
+        printf("\"glyphs\": %ld, \"same_drawing\": %s, \"cells\": %lu, \"missing_cells\": %lu, "
+               "\"extra_cells\": %lu, \"check_ms\": %.1f}", glyphs, differ ? "false" : "true", comparison.cells_a,
+               comparison.only_a, comparison.only_b, ns / 1e6);
+    }
+    sim_free(&plain);
+    return result;
+}
+
+// Generates a document inside a work area (none if area is NULL) and returns how long it took in ns
+static double generate_in_area(const char *path, float scale_factor, const WorkArea *area, const OpSink *sink,
+                               Generator *generator, int *result) {
+    LayoutOptions options;
+    get_layout_options(&options);
+    generator_init(generator, get_loaded_font(), sink);
+    if (area) {
+        generator_set_work_area(generator, area);
+    }
+    uint64_t start = monotonic_ns();
+    *result = layout_text_file(generator, &options, path, scale_factor);
+    double ns = elapsed_ns(start);
+    generator_free(generator);
+    return ns;
+}
+
+// Runs the plain drawing's segments, clipped to the area with work_area_clip(), on expected
+static int clip_drawing(const Simulator *plain, const WorkArea *area, Simulator *expected) {
+    sim_init(expected);
+    for (size_t i = 0; i < plain->segment_count && !expected->failed; i++) {
+        const SimSegment *segment = &plain->segments[i];
+        float x0 = (float)segment->x0, y0 = (float)segment->y0, x1 = (float)segment->x1, y1 = (float)segment->y1;
+        while (expected->page < segment->page) {
+            sim_page(expected);
+        }
+        // What is left of a stroke that only touches the edge is below the G-code resolution of 1 µm
+        if (work_area_clip(area, &x0, &y0, &x1, &y1) != WORK_AREA_OUTSIDE &&
+            (fabsf(x1 - x0) >= 0.001f || fabsf(y1 - y0) >= 0.001f)) {
+            char line[96];
+            snprintf(line, sizeof(line), "S0 G0 X%.4f Y%.4f", x0, y0);
+            sim_line(expected, line);
+            snprintf(line, sizeof(line), "S1000 G1 X%.4f Y%.4f", x1, y1);
+            sim_line(expected, line);
+        }
+    }
+    sim_line(expected, "S0");
+    return expected->failed ? -1 : 0;
+}
+
+// Culling and clipping to a work area: cost, what was dropped, and whether the drawing is the plain one cut
+// at the edge; a failing work area should stop the job at its first overflow, well before a full generation
+static int bench_work_area(const CorpusEntry *entry, const char *path, long glyphs, float scale_factor,
+                           int iterations) {
+    WorkArea area, failing;
+    work_area_init(&area);
+    if (parse_work_area(BENCH_WORK_AREA, &area) != 0) {
+        return -1;
+    }
+    failing = area;
+    failing.fail = 1;
+
+    double plain_times[64], clipped_times[64], fail_times[64];
+    OpSink discard = { NULL, NULL };
+    Generator counts, failed;
+    int plain_result = 0, clipped_result = 0, fail_result = 0;
+    for (int i = 0; i < iterations; i++) {
+        plain_times[i] = generate_in_area(path, scale_factor, NULL, &discard, &counts, &plain_result);
+        clipped_times[i] = generate_in_area(path, scale_factor, &area, &discard, &counts, &clipped_result);
+        fail_times[i] = generate_in_area(path, scale_factor, &failing, &discard, &failed, &fail_result);
+    }
+    if (plain_result != 0 || clipped_result != 0 || fail_result == 0 || !failed.overflowed) {
+        return -1;
+    }
+
+    Simulator plain, expected, clipped;
+    OpSink sim_sink = { sim_emit, &clipped };
+    Generator unused;
+    SimComparison comparison;
+    int differ = -1;
+    sim_init(&clipped);
+    if (simulate_variant(&plain, NULL, path, scale_factor) == 0 && clip_drawing(&plain, &area, &expected) == 0) {
+        generate_in_area(path, scale_factor, &area, &sim_sink, &unused, &clipped_result);
+        if (clipped_result == 0) {
+            differ = sim_compare(&expected, &clipped, BENCH_DRAWING_TOLERANCE_MM, &comparison);
+        }
+    }
+    sim_free(&plain);
+    sim_free(&expected);
+    sim_free(&clipped);
+    if (differ < 0) {
+        return -1;
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "work_area/%s", entry->name);
+    begin_result(name);
+    printf("\"glyphs\": %ld, \"area\": \"%s\", \"culled_glyphs\": %lu, \"clipped_strokes\": %lu, "
+           "\"dropped_strokes\": %lu, \"plain_ms\": %.2f, \"clipped_ms\": %.2f, \"fail_ms\": %.3f, "
+           "\"same_drawing\": %s, \"missing_cells\": %lu, \"extra_cells\": %lu}", glyphs, BENCH_WORK_AREA,
+           counts.culled_glyphs, counts.clipped_strokes, counts.dropped_strokes, median(plain_times, iterations) / 1e6,
+           median(clipped_times, iterations) / 1e6, median(fail_times, iterations) / 1e6, differ ? "false" : "true",
+           comparison.only_a, comparison.only_b);
+    return 0;
+}
+
+// Moves every operation of one copy to its origin, for regenerating a label per copy
+typedef struct {
+    OpSink *next;
+    int32_t x;
+    int32_t y;
+} OffsetSink;
+
+static int offset_emit(void *user_data, const MotionOp *op) {
+    OffsetSink *offset = user_data;
+    MotionOp moved = *op;
+    if (op->code == IR_TRAVEL || op->code == IR_DRAW) {
+        moved.x += offset->x;
+        moved.y += offset->y;
+    }
+    return offset->next->emit(offset->next->user_data, &moved);
+}
+
+// Copies of a label laid out and generated for each copy at its origin, as separate runs would
+static int regenerate_copies(const JobSpec *spec, const StampOrigin *origins, int origin_count,
+                             unsigned long copies, OpSink *sink) {
+    OffsetSink offset = { sink, 0, 0 };
+    OpSink offset_sink = { offset_emit, &offset };
+    JobSpec block_spec = *spec;
+    PageSetup page = { BENCH_LABEL_PITCH_X, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+    block_spec.page = page;
+    for (unsigned long c = 0; c < copies; c++) {
+        if (c > 0 && c % (unsigned long)origin_count == 0) {
+            MotionOp page_break = { IR_PAGE, (int32_t)(c / (unsigned long)origin_count) + 1, 0 };
+            if (sink->emit(sink->user_data, &page_break) != 0) {
+                return -1;
+            }
+        }
+        offset.x = origins[c % (unsigned long)origin_count].x;
+        offset.y = origins[c % (unsigned long)origin_count].y;
+        if (generate_job(&block_spec, &offset_sink, 1) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Label copies regenerated one by one against one generated block stamped at every origin (stamp.h)
+static int bench_labels(const CorpusEntry *entry, const char *path, float scale_factor, int iterations) {
+    static const unsigned long copy_counts[] = { 1, 20, 200 };
+    StampOrigin origins[BENCH_LABEL_COLUMNS * BENCH_LABEL_ROWS];
+    PageSetup page;
+    JobSpec spec;
+    get_page_setup(&page);
+    job_spec_init(&spec, path, scale_factor);
+    spec.use_cache = 0;
+    int origin_count = stamp_grid(&page, BENCH_LABEL_COLUMNS, BENCH_LABEL_ROWS, BENCH_LABEL_PITCH_X,
+                                  BENCH_LABEL_PITCH_Y, origins);
+
+    for (size_t n = 0; n < sizeof(copy_counts) / sizeof(copy_counts[0]); n++) {
+        double regenerate_times[64], stamp_times[64];
+        unsigned long regenerate_ops = 0, stamp_ops = 0;
+        OpSink regenerate_sink = { counting_emit, &regenerate_ops };
+        OpSink stamp_sink = { counting_emit, &stamp_ops };
+        StampReport report;
+        int result = 0;
+        for (int i = -1; i < iterations && result == 0; i++) {
+            regenerate_ops = stamp_ops = 0;
+            uint64_t start = monotonic_ns();
+            result = regenerate_copies(&spec, origins, origin_count, copy_counts[n], &regenerate_sink);
+            double regenerate_ns = elapsed_ns(start);
+
+            StampBlock block;
+            start = monotonic_ns();
+            if (result == 0 && stamp_compile(&block, &spec, BENCH_LABEL_PITCH_X) == 0) {
+                result = stamp_copies(&block, origins, origin_count, copy_counts[n], &spec.pen, &stamp_sink, &report);
+                stamp_block_free(&block);
+            } else {
+                result = -1;
+            }
+            if (i >= 0) {
+                regenerate_times[i] = regenerate_ns;
+                stamp_times[i] = elapsed_ns(start);
+            }
+        }
+
+        // Both must draw the same labels; only the order and the moves between copies may differ
+        Simulator regenerated, stamped;
+        SimComparison comparison;
+        OpSink regenerated_sink = { sim_emit, &regenerated };
+        OpSink stamped_sink = { sim_emit, &stamped };
+        StampBlock block;
+        int differ = -1;
+        sim_init(&regenerated);
+        sim_init(&stamped);
+        if (result == 0 && regenerate_copies(&spec, origins, origin_count, copy_counts[n], &regenerated_sink) == 0 &&
+            stamp_compile(&block, &spec, BENCH_LABEL_PITCH_X) == 0) {
+            if (stamp_copies(&block, origins, origin_count, copy_counts[n], &spec.pen, &stamped_sink, NULL) == 0) {
+                differ = sim_compare(&regenerated, &stamped, BENCH_DRAWING_TOLERANCE_MM, &comparison);
+            }
+            stamp_block_free(&block);
+        }
+        sim_free(&regenerated);
+        sim_free(&stamped);
+        if (result != 0 || differ < 0) {
+            return -1;
+        }
+
+        double regenerate_ns = median(regenerate_times, iterations);
+        double stamp_ns = median(stamp_times, iterations);
+        char name[64];
+        snprintf(name, sizeof(name), "labels/%s/copies_%lu", entry->name, copy_counts[n]);
+        begin_result(name);
+        printf("\"copies\": %lu, \"sheets\": %d, \"regenerate_ms\": %.3f, \"stamp_ms\": %.3f, \"speedup\": %.1f, "
+               "\"regenerate_operations\": %lu, \"stamp_operations\": %lu, \"travel_mm\": %.1f, "
+               "\"given_order_travel_mm\": %.1f, \"same_drawing\": %s}", copy_counts[n], report.sheets,
+               regenerate_ns / 1e6, stamp_ns / 1e6, regenerate_ns / stamp_ns, regenerate_ops, stamp_ops,
+               report.travel_mm, report.given_travel_mm, differ ? "false" : "true");
+        if (differ) {
+            fprintf(stderr, "Stamped labels differ from regenerated ones on page %d near (%.2f, %.2f)\n",
+                    comparison.first_page, comparison.first_x, comparison.first_y);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// G-code text of a generator's operations, as the executor would send it
+typedef struct {
+    char *text;
+    size_t length;
+    size_t capacity;
+} GcodeText;
+
+static int gcode_text_emit(void *user_data, const MotionOp *op) {
+    GcodeText *gcode = user_data;
+    char line[64];
+    int length = format_motion_op(op, line);
+    if (gcode->length + (size_t)length > gcode->capacity) {
+        size_t grown = gcode->capacity ? gcode->capacity * 2 : 65536;
+        char *text = realloc(gcode->text, grown);
+        if (!text) {
+            return -1;
+        }
+        gcode->text = text;
+        gcode->capacity = grown;
+    }
+    memcpy(gcode->text + gcode->length, line, (size_t)length);
+    gcode->length += (size_t)length;
+    return 0;
+}
+
+// Compares the core's output with the generator's as it is written
+typedef struct {
+    const GcodeText *expected;
+    size_t position;
+    int same;
+} CoreComparison;
+
+static int core_compare_write(void *user_data, const char *bytes, size_t length) {
+    CoreComparison *comparison = user_data;
+    const GcodeText *expected = comparison->expected;
+    if (comparison->position + length > expected->length ||
+        memcmp(expected->text + comparison->position, bytes, length) != 0) {
+        comparison->same = 0;
+    }
+    comparison->position += length;
+    return 0;
+}
+
+static int read_whole_file(const char *path, char **text, size_t *length) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return -1;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    *text = size >= 0 ? malloc((size_t)size + 1) : NULL;
+    *length = *text ? fread(*text, 1, (size_t)size, file) : 0;
+    fclose(file);
+    return *text ? 0 : -1;
+}
+
+// The freestanding core (core.h) against the generator on the same document, and its footprint
+static int bench_core(const CorpusEntry *entry, const char *path, long glyphs, int iterations) {
+    double times[64];
+    GcodeText expected = { NULL, 0, 0 };
+    OpSink sink = { gcode_text_emit, &expected };
+    LayoutOptions layout;
+    get_layout_options(&layout);
+    Generator generator;
+    generator_init(&generator, get_loaded_font(), &sink);
+    int result = layout_text_file(&generator, &layout, path, BENCH_TEXT_HEIGHT / 18.0f);
+    generator_free(&generator);
+    char *text = NULL;
+    size_t length = 0;
+    if (result != 0 || read_whole_file(path, &text, &length) != 0) {
+        free(expected.text);
+        return -1;
+    }
+
+    const PageSetup *page = &layout.page;
+    CoreOptions options;
+    core_options_init(&options);
+    options.text_height = mm_to_microns(BENCH_TEXT_HEIGHT);
+    options.page_width = mm_to_microns(page->page_width);
+    options.page_height = mm_to_microns(page->page_height);
+    options.margin_left = mm_to_microns(page->margin_left);
+    options.margin_right = mm_to_microns(page->margin_right);
+    options.margin_top = mm_to_microns(page->margin_top);
+    options.margin_bottom = mm_to_microns(page->margin_bottom);
+    options.line_spacing = mm_to_microns(layout.base_line_spacing);
+    options.word_spacing = (int32_t)layout.word_spacing_factor;
+
+    CoreComparison comparison = { &expected, 0, 1 };
+    CoreSink core_sink = { core_compare_write, NULL, &comparison };
+    CoreWriter writer;
+    for (int i = 0; i < iterations && result == 0; i++) {
+        comparison.position = 0;
+        uint64_t start = monotonic_ns();
+        if (core_start(&writer, &core_font, &options, &core_sink) != 0 || core_write(&writer, text, length) != 0 ||
+            core_finish(&writer) != 0) {
+            result = -1;
+        }
+        times[i] = elapsed_ns(start);
+    }
+    int same = comparison.same && comparison.position == expected.length;
+    free(text);
+    free(expected.text);
+    if (result != 0) {
+        return -1;
+    }
+
+    size_t font_bytes = (CORE_FONT_GLYPHS + 1) * sizeof(uint16_t) + 2 * core_font.index[CORE_FONT_GLYPHS];
+    int current = core_font.hash == get_font_hash();
+    char name[64];
+    snprintf(name, sizeof(name), "core/%s", entry->name);
+    begin_result(name);
+    printf("\"glyphs\": %ld, \"ns_per_glyph\": %.1f, \"same_output\": %s, \"font_current\": %s, "
+           "\"font_bytes\": %lu, \"state_bytes\": %lu, \"font_budget\": %d, \"state_budget\": %d}",
+           glyphs, median(times, iterations) / (double)glyphs, same ? "true" : "false", current ? "true" : "false",
+           (unsigned long)font_bytes, (unsigned long)sizeof(CoreWriter), CORE_FONT_BUDGET, CORE_RAM_BUDGET);
+    if (!same || !current || font_bytes > CORE_FONT_BUDGET) {
+        fprintf(stderr, "Core check failed for %s: regenerate corefont.c with --export-core-font if the font changed\n",
+                entry->name);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *font_path = "SingleStrokeFont.txt";
+    int iterations = BENCH_DEFAULT_ITERATIONS;
+    int use_pty = 1;
+    static Metrics command_metrics;
+    Metrics *metrics = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--font") == 0 && i + 1 < argc) {
+            font_path = argv[++i];
+        } else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            iterations = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--no-pty") == 0) {
+            use_pty = 0;
+        } else if (strcmp(argv[i], "--metrics") == 0) {
+            // Instrument the streaming transports, to measure the overhead of the metrics
+            metrics_init(&command_metrics, "bench", "corpus", 0);
+            metrics = &command_metrics;
+        } else {
+            fprintf(stderr, "Usage: %s [--font FILE] [--iterations 1-64] [--no-pty] [--metrics]\n", argv[0]);
+            return -1;
+        }
+    }
+    if (iterations < 1 || iterations > 64) {
+        fprintf(stderr, "Iterations must be between 1 and 64\n");
+        return -1;
+    }
+
+    // A multi-page layout so the document entry exercises page breaks
+    PageSetup page = { 148.0f, 210.0f, 10.0f, 10.0f, 10.0f, 10.0f };
+    set_page_setup(&page);
+    const float scale_factor = BENCH_TEXT_HEIGHT / 18.0f;
+
+    printf("{\n  \"font\": \"%s\",\n  \"iterations\": %d,\n  \"text_height_mm\": %.1f,\n  \"metrics\": %s,\n"
+           "  \"benchmarks\": [\n", font_path, iterations, BENCH_TEXT_HEIGHT, metrics ? "true" : "false");
+    if (bench_font_load(font_path, iterations) != 0) {
+        fprintf(stderr, "Could not load font %s\n", font_path);
+        return -1;
+    }
+    bench_word_layout(scale_factor, iterations);
+    bench_glyph_generation(scale_factor, iterations);
+    if (bench_font_lookup(iterations) != 0) {
+        fprintf(stderr, "Could not build the font lookup benchmark's registry\n");
+        return -1;
+    }
+
+    TransportCounters null_counters = { 0, 0 };
+    Transport null_transport = { null_send_command, &null_counters, metrics, NULL, NULL };
+    int result = 0;
+    for (size_t i = 0; i < CORPUS_SIZE && result == 0; i++) {
+        char path[64];
+        snprintf(path, sizeof(path), "bench_%s.txt", corpus[i].name);
+        long glyphs = write_corpus(&corpus[i], path);
+        if (glyphs < 0) {
+            result = -1;
+            break;
+        }
+        result = bench_end_to_end(&corpus[i], path, glyphs, scale_factor, "null", &null_transport,
+                                  &null_counters, iterations);
+        if (result == 0) {
+            result = bench_feed_planning(&corpus[i], path, glyphs);
+        }
+        if (result == 0) {
+            result = bench_stroke_joining(&corpus[i], path, glyphs, scale_factor);
+        }
+        if (result == 0) {
+            result = bench_core(&corpus[i], path, glyphs, iterations);
+        }
+        if (result == 0) {
+            result = bench_drawing_check(&corpus[i], path, glyphs, scale_factor);
+        }
+        if (result == 0 && strcmp(corpus[i].name, "document") == 0) {
+            result = bench_work_area(&corpus[i], path, glyphs, scale_factor, iterations);
+        }
+        if (result == 0 && strcmp(corpus[i].name, "label") == 0) {
+            result = bench_labels(&corpus[i], path, scale_factor, iterations);
+        }
+        if (result == 0 && corpus[i].words >= 1000) {
+            result = bench_parallel_generation(&corpus[i], path, glyphs, scale_factor, iterations);
+        }
+#ifndef _WIN32
+        PtyLoopback loopback;
+        if (result == 0 && use_pty && loopback_open(&loopback) == 0) {
+            Transport pty_transport = { pty_send_command, &loopback, metrics, NULL, NULL };
+            result = bench_end_to_end(&corpus[i], path, glyphs, scale_factor, "pty", &pty_transport,
+                                      &loopback.counters, iterations);
+            loopback_close(&loopback);
+        }
+#endif
+        remove(path);
+    }
+    printf("\n  ]\n}\n");
+    return result == 0 ? 0 : -1;
+}
@@ -0,0 +1,134 @@
+// checkpoint.c
+#include <stdio.h>
+#include <string.h>
+#include "checkpoint.h"
+#include "hash.h"
+#include "platform.h"
+#include "debug.h"
+
+#define SLOT_DATA_SIZE 36       // sequence, key, op index, x, y, pen, feed, page
+#define SLOT_SIZE (SLOT_DATA_SIZE + 8)
+
+static void put_le(unsigned char *out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        out[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+static uint64_t get_le(const unsigned char *in, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value |= (uint64_t)in[i] << (8 * i);
+    }
+    return value;
+}
+
+static void encode_slot(unsigned char *slot, uint32_t sequence, const CheckpointState *state) {
+    put_le(slot, sequence, 4);
+    put_le(slot + 4, state->key, 8);
+    put_le(slot + 12, state->op_index, 4);
+    put_le(slot + 16, (uint32_t)state->x, 4);
+    put_le(slot + 20, (uint32_t)state->y, 4);
+    put_le(slot + 24, (uint32_t)state->pen, 4);
+    put_le(slot + 28, (uint32_t)state->feed, 4);
+    put_le(slot + 32, (uint32_t)state->page, 4);
+    put_le(slot + SLOT_DATA_SIZE, hash_bytes(HASH_INIT, slot, SLOT_DATA_SIZE), 8);
+}
+
+// Returns the slot's sequence number, or 0 if the slot is empty or torn
+static uint32_t decode_slot(const unsigned char *slot, CheckpointState *state) {
+    if (get_le(slot + SLOT_DATA_SIZE, 8) != hash_bytes(HASH_INIT, slot, SLOT_DATA_SIZE)) {
+        return 0;
+    }
+    state->key = get_le(slot + 4, 8);
+    state->op_index = (uint32_t)get_le(slot + 12, 4);
+    state->x = (int32_t)get_le(slot + 16, 4);
+    state->y = (int32_t)get_le(slot + 20, 4);
+    state->pen = (int32_t)get_le(slot + 24, 4);
+    state->feed = (int32_t)get_le(slot + 28, 4);
+    state->page = (int32_t)get_le(slot + 32, 4);
+    return (uint32_t)get_le(slot, 4);
+}
+
+int checkpoint_load(const char *path, uint64_t key, CheckpointState *state) {
+    unsigned char slots[2 * SLOT_SIZE];
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return -1;
+    }
+    size_t got = fread(slots, 1, sizeof(slots), file);
+    fclose(file);
+
+    uint32_t best = 0;
+    for (size_t i = 0; i + SLOT_SIZE <= got; i += SLOT_SIZE) {
+        CheckpointState candidate;
+        uint32_t sequence = decode_slot(slots + i, &candidate);
+        if (sequence > best && candidate.key == key) {
+            best = sequence;
+            *state = candidate;
+        }
+    }
+    return best > 0 ? 0 : -1;
+}
+
+static int write_record(Checkpoint *checkpoint) {
+    unsigned char slot[SLOT_SIZE];
+    checkpoint->sequence++;
+    encode_slot(slot, checkpoint->sequence, &checkpoint->latest);
+
+    long offset = (long)(checkpoint->sequence % 2) * SLOT_SIZE;
+    if (fseek(checkpoint->file, offset, SEEK_SET) != 0 ||
+        fwrite(slot, 1, sizeof(slot), checkpoint->file) != sizeof(slot) ||
+        sync_file(checkpoint->file) != 0) {
+        DEBUG_LOG("Error: Could not write checkpoint %s\n", checkpoint->path);
+        return -1;
+    }
+    checkpoint->last_sync_ns = monotonic_ns();
+    checkpoint->dirty = 0;
+    return 0;
+}
+
+int checkpoint_open(Checkpoint *checkpoint, const char *path, const CheckpointState *initial) {
+    memset(checkpoint, 0, sizeof(*checkpoint));
+    snprintf(checkpoint->path, sizeof(checkpoint->path), "%s", path);
+    checkpoint->file = fopen(path, "wb");
+    if (!checkpoint->file) {
+        DEBUG_LOG("Error: Could not create checkpoint %s\n", path);
+        return -1;
+    }
+    checkpoint->latest = *initial;
+    if (write_record(checkpoint) != 0) {
+        // An empty or torn file must not be mistaken for a checkpoint by --resume
+        fclose(checkpoint->file);
+        checkpoint->file = NULL;
+        remove(checkpoint->path);
+        return -1;
+    }
+    return 0;
+}
+
+void checkpoint_update(Checkpoint *checkpoint, const CheckpointState *state) {
+    checkpoint->latest = *state;
+    checkpoint->dirty = 1;
+    if (monotonic_ns() - checkpoint->last_sync_ns >= (uint64_t)CHECKPOINT_INTERVAL_MS * 1000000ULL) {
+        write_record(checkpoint);
+    }
+}
+
+int checkpoint_flush(Checkpoint *checkpoint) {
+    return checkpoint->dirty ? write_record(checkpoint) : 0;
+}
+
+void checkpoint_close(Checkpoint *checkpoint, int completed) {
+    if (!checkpoint->file) {
+        return;
+    }
+    if (!completed) {
+        checkpoint_flush(checkpoint);
+    }
+    fclose(checkpoint->file);
+    checkpoint->file = NULL;
+    if (completed) {
+        remove(checkpoint->path);
+    }
+}
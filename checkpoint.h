@@ -0,0 +1,91 @@
+/**
+ * @file checkpoint.h
+ * @brief Durable progress record for resuming interrupted jobs
+ *
+ * The executor records the job key, the number of acknowledged operations
+ * and the machine state after them. The file holds two slots written
+ * alternately, each with a checksum, so a crash in the middle of a write
+ * always leaves the previous record intact.
+ */
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/**
+ * @brief Minimum time between synced checkpoint writes
+ */
+#define CHECKPOINT_INTERVAL_MS 500
+
+/**
+ * @brief Machine and job progress at the last acknowledged operation
+ */
+typedef struct {
+    uint64_t key;       // Job key (see compute_job_key)
+    uint32_t op_index;  // Operations completed; resuming starts at this index
+    int32_t x;          // Position in micrometres
+    int32_t y;
+    int32_t pen;        // 1 down, 0 up, -1 unknown
+    int32_t feed;       // Feed in mm/min, 0 if the job never set one
+    int32_t page;       // Page being written
+} CheckpointState;
+
+/**
+ * @brief Open checkpoint file
+ */
+typedef struct {
+    FILE *file;
+    char path[512];
+    uint32_t sequence;          // Number of records written
+    uint64_t last_sync_ns;      // Time of the last synced write
+    CheckpointState latest;     // Most recent state, possibly not yet written
+    int dirty;                  // latest differs from what is on disk
+} Checkpoint;
+
+/**
+ * @brief Reads the newest valid record of a checkpoint file
+ *
+ * @param path Checkpoint file
+ * @param key Job key the record must belong to
+ * @param state Receives the record
+ * @return int 0 if a valid record was found, -1 otherwise
+ */
+int checkpoint_load(const char *path, uint64_t key, CheckpointState *state);
+
+/**
+ * @brief Creates (or truncates) a checkpoint file and writes an initial record
+ *
+ * @param checkpoint Checkpoint to initialise
+ * @param path File to create
+ * @param initial State to record straight away
+ * @return int 0 on success, -1 if the file could not be created or written (it is removed)
+ */
+int checkpoint_open(Checkpoint *checkpoint, const char *path, const CheckpointState *initial);
+
+/**
+ * @brief Records new progress, syncing to disk at most every CHECKPOINT_INTERVAL_MS
+ *
+ * @param checkpoint Open checkpoint
+ * @param state Progress to record
+ */
+void checkpoint_update(Checkpoint *checkpoint, const CheckpointState *state);
+
+/**
+ * @brief Writes and syncs the latest progress immediately
+ *
+ * @param checkpoint Open checkpoint
+ * @return int 0 on success, -1 on write failure
+ */
+int checkpoint_flush(Checkpoint *checkpoint);
+
+/**
+ * @brief Closes the checkpoint
+ *
+ * @param checkpoint Open checkpoint
+ * @param completed 1 if the job finished (the file is deleted), 0 to keep it for resuming
+ */
+void checkpoint_close(Checkpoint *checkpoint, int completed);
+
+#endif // CHECKPOINT_H
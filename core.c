@@ -0,0 +1,243 @@
+// core.c
+// Freestanding: nothing beyond <stddef.h> and <stdint.h>, see core.h
+#include "core.h"
+
+#define EIGHTEENTHS 18      // Sub-micrometre steps of every length below
+
+_Static_assert(sizeof(CoreWriter) <= CORE_RAM_BUDGET, "CoreWriter exceeds CORE_RAM_BUDGET");
+
+void core_options_init(CoreOptions *options) {
+    options->text_height = CORE_TEXT_HEIGHT;
+    options->page_width = CORE_PAGE_WIDTH;
+    options->page_height = 0;
+    options->margin_left = options->margin_right = 0;
+    options->margin_top = options->margin_bottom = 0;
+    options->line_spacing = CORE_LINE_SPACING;
+    options->word_spacing = CORE_WORD_SPACING;
+}
+
+static int glyph_movements(const CoreFont *font, int ascii_code) {
+    if (ascii_code < 0 || ascii_code >= CORE_FONT_GLYPHS) {
+        return 0;
+    }
+    return font->index[ascii_code + 1] - font->index[ascii_code];
+}
+
+int32_t core_character_width(const CoreFont *font, int ascii_code) {
+    int count = glyph_movements(font, ascii_code);
+    return count ? font->strokes[2 * (font->index[ascii_code] + count - 1)] : 0;
+}
+
+// Rounded half away from zero, as mm_to_microns() does
+static int32_t to_microns(int32_t value) {
+    return value >= 0 ? (value + EIGHTEENTHS / 2) / EIGHTEENTHS : -((EIGHTEENTHS / 2 - value) / EIGHTEENTHS);
+}
+
+static size_t put_text(char *out, const char *text) {
+    size_t length = 0;
+    while (text[length]) {
+        out[length] = text[length];
+        length++;
+    }
+    return length;
+}
+
+// "%ld.%03d" of format_motion_op()
+static size_t put_microns(char *out, int32_t microns) {
+    char digits[10];
+    size_t length = 0, count = 0;
+    uint32_t value = microns < 0 ? 0u - (uint32_t)microns : (uint32_t)microns;
+    if (microns < 0) {
+        out[length++] = '-';
+    }
+    do {
+        digits[count++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0 || count < 4);
+    while (count > 3) {
+        out[length++] = digits[--count];
+    }
+    out[length++] = '.';
+    while (count > 0) {
+        out[length++] = digits[--count];
+    }
+    return length;
+}
+
+static void send_line(CoreWriter *writer, size_t length) {
+    if (!writer->failed && writer->sink.write(writer->sink.user_data, writer->line, length) != 0) {
+        writer->failed = 1;
+    }
+}
+
+static void send_pen(CoreWriter *writer, int down) {
+    if (writer->pen != down) {
+        send_line(writer, put_text(writer->line, down ? "S1000\n" : "S0\n"));
+        writer->pen = down;
+    }
+}
+
+static void send_move(CoreWriter *writer, int draw, int32_t x, int32_t y) {
+    size_t length = put_text(writer->line, draw ? "G1 X" : "G0 X");
+    length += put_microns(writer->line + length, to_microns(x));
+    length += put_text(writer->line + length, " Y");
+    length += put_microns(writer->line + length, to_microns(y));
+    writer->line[length++] = '\n';
+    send_line(writer, length);
+    writer->pen_x = x;
+    writer->pen_y = y;
+}
+
+// Send the deferred pen-up move, if it goes anywhere
+static void flush_travel(CoreWriter *writer) {
+    if (writer->travel_pending && (writer->travel_x != writer->pen_x || writer->travel_y != writer->pen_y)) {
+        send_move(writer, 0, writer->travel_x, writer->travel_y);
+    }
+    writer->travel_pending = 0;
+}
+
+// generate_movement() without feed planning or joining
+static void generate_movement(CoreWriter *writer, int pen, int32_t x, int32_t y) {
+    if (!pen) {
+        send_pen(writer, 0);
+        writer->travel_pending = 1;
+        writer->travel_x = x;
+        writer->travel_y = y;
+        return;
+    }
+    flush_travel(writer);
+    send_pen(writer, 1);
+    send_move(writer, 1, x, y);
+}
+
+static void print_character(CoreWriter *writer, int ascii_code, int32_t x_offset, int32_t y_offset) {
+    int count = glyph_movements(writer->font, ascii_code);
+    if (count == 0) {
+        return;
+    }
+    const int8_t *mov = &writer->font->strokes[2 * writer->font->index[ascii_code]];
+    for (int i = 0; i < count; i++, mov += 2) {
+        int pen = mov[1] & 1;
+        int y = (mov[1] - pen) / 2;
+        generate_movement(writer, pen, x_offset + mov[0] * writer->unit, y_offset + y * writer->unit);
+    }
+}
+
+static void reset_position(CoreWriter *writer) {
+    writer->pen = -1;
+    writer->pen_x = writer->pen_y = 0;
+    writer->travel_pending = 0;
+}
+
+// Start a new page if the current line would run past the bottom margin
+static void fit_page(CoreWriter *writer) {
+    int32_t text_height = EIGHTEENTHS * writer->unit;
+    int32_t line_bottom = writer->y - (writer->line_advance - text_height);
+    if (writer->area_height <= 0 || line_bottom >= -writer->area_height) {
+        return;
+    }
+
+    writer->page_number++;
+    flush_travel(writer);
+    if (writer->sink.page && !writer->failed && writer->sink.page(writer->sink.user_data, writer->page_number) != 0) {
+        writer->failed = 1;
+    }
+    reset_position(writer);
+    writer->x = 0;
+    writer->y = -text_height;
+}
+
+// Place the buffered word greedily, then advance by spacing
+static void place_word(CoreWriter *writer, int32_t spacing) {
+    const CoreFont *font = writer->font;
+    int32_t width = 0;
+    for (size_t i = 0; i < writer->word_length; i++) {
+        width += core_character_width(font, (unsigned char)writer->word[i]) * writer->unit;
+    }
+
+    if (writer->pending_lines > 0) {
+        // Applied lazily so trailing newlines never move the pen
+        writer->x = 0;
+        writer->y -= writer->line_advance * writer->pending_lines;
+        writer->pending_lines = 0;
+        fit_page(writer);
+    }
+    // A word wider than the whole line stays on the current line if nothing precedes it
+    if (writer->x > 0 && writer->x + width > writer->line_width) {
+        writer->x = 0;
+        writer->y -= writer->line_advance;
+        fit_page(writer);
+    }
+
+    int32_t x = writer->margin_left + writer->x;
+    for (size_t i = 0; i < writer->word_length; i++) {
+        int ascii_code = (unsigned char)writer->word[i];
+        print_character(writer, ascii_code, x, writer->y - writer->margin_top);
+        x += core_character_width(font, ascii_code) * writer->unit;
+    }
+    writer->x = x - writer->margin_left + spacing;
+    writer->word_length = 0;
+}
+
+int core_start(CoreWriter *writer, const CoreFont *font, const CoreOptions *options, const CoreSink *sink) {
+    int32_t line_width = options->page_width - options->margin_left - options->margin_right;
+    int32_t area_height = options->page_height - options->margin_top - options->margin_bottom;
+    if (line_width <= 0 || (options->page_height > 0 && area_height <= 0) || options->text_height <= 0) {
+        return -1;
+    }
+
+    writer->font = font;
+    writer->sink = *sink;
+    writer->failed = 0;
+    writer->unit = options->text_height;
+    writer->margin_left = EIGHTEENTHS * options->margin_left;
+    writer->margin_top = EIGHTEENTHS * options->margin_top;
+    writer->line_width = EIGHTEENTHS * line_width;
+    writer->area_height = options->page_height > 0 ? EIGHTEENTHS * area_height : 0;
+    writer->line_advance = EIGHTEENTHS * (options->line_spacing + options->text_height);
+    writer->word_advance = options->word_spacing * writer->unit;
+    writer->x = 0;
+    writer->y = -EIGHTEENTHS * writer->unit;
+    writer->pending_lines = 0;
+    writer->page_number = 1;
+    writer->breaks = 0;
+    writer->after_cr = 0;
+    writer->word_length = 0;
+    reset_position(writer);
+    return 0;
+}
+
+int core_write(CoreWriter *writer, const char *text, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        char c = text[i];
+        // Whitespace and line breaks as the text reader sees them
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r') {
+            if (writer->word_length > 0) {
+                place_word(writer, writer->word_advance);
+            }
+            // "\r\n" counts once
+            writer->breaks += c == '\r' || (c == '\n' && !writer->after_cr);
+            writer->after_cr = c == '\r';
+            continue;
+        }
+        if (writer->breaks > 0) {
+            writer->pending_lines += writer->breaks == 1 ? 1 : CORE_PARAGRAPH_LINES;
+            writer->breaks = 0;
+        }
+        writer->after_cr = 0;
+        if (writer->word_length == CORE_MAX_WORD) {
+            // Too long to measure whole: the piece so far is placed without a space after it
+            place_word(writer, 0);
+        }
+        writer->word[writer->word_length++] = c;
+    }
+    return writer->failed ? -1 : 0;
+}
+
+int core_finish(CoreWriter *writer) {
+    if (writer->word_length > 0) {
+        place_word(writer, writer->word_advance);
+    }
+    flush_travel(writer);
+    return writer->failed ? -1 : 0;
+}
@@ -0,0 +1,183 @@
+/**
+ * @file core.h
+ * @brief Freestanding layout and G-code generation for a controller-side build
+ *
+ * The same greedy layout and glyph generation as process_text_file() and
+ * print_gcode_for_character() with default options, for a microcontroller
+ * next to the robot instead of a PC on the serial link. core.c and corefont.c
+ * only use <stddef.h> and <stdint.h>: no heap, no stdio, no floating point,
+ * and all state lives in a CoreWriter the caller provides.
+ *
+ * Text is fed in as bytes, from flash or as it arrives on a UART, and the
+ * G-code comes out line by line through a byte sink. Positions are kept in
+ * eighteenths of a micrometre, so a font unit (an eighteenth of the text
+ * height) scales exactly. The output is the PC generator's, except more
+ * than a metre from the origin, where its float positions may round a
+ * micrometre the other way. The font is the compact table in corefont.c,
+ * about 2 KB of flash, written from the font file by
+ * robotwriter --export-core-font.
+ *
+ * Not carried over: optimal line breaking, serpentine order, feed planning,
+ * stroke joining and pen dwells. A word longer than CORE_MAX_WORD bytes is
+ * laid out in pieces and may wrap inside.
+ */
+
+#ifndef CORE_H
+#define CORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Font table limits
+ */
+#define CORE_FONT_GLYPHS 128            // ASCII codes in the table
+
+/**
+ * @brief Buffers of a CoreWriter
+ */
+#define CORE_MAX_WORD 64                // Bytes of a word measured before it is placed
+#define CORE_MAX_LINE 32                // Longest G-code line, "G1 X-2147483.648 Y-2147483.648\n"
+
+/**
+ * @brief Footprint budget, checked at compile time and reported by the benchmark
+ */
+#define CORE_FONT_BUDGET 2560           // Bytes of font table in flash
+#define CORE_RAM_BUDGET 256             // Bytes of CoreWriter state
+
+/**
+ * @brief Defaults, the same as layout.h's, in micrometres and font units
+ */
+#define CORE_TEXT_HEIGHT 5000
+#define CORE_PAGE_WIDTH 100000          // MAX_LINE_WIDTH
+#define CORE_LINE_SPACING 5000          // BASE_LINE_SPACING
+#define CORE_WORD_SPACING 15            // Font units, WORD_SPACING_FACTOR
+#define CORE_PARAGRAPH_LINES 2          // Line advances for a paragraph break
+
+/**
+ * @brief A single-stroke font in flash
+ *
+ * Movement i of a glyph is strokes[2 * i] (x) and strokes[2 * i + 1]
+ * (y * 2 + pen), in font units; glyph c has the movements from index[c] up
+ * to index[c + 1].
+ */
+typedef struct {
+    const uint16_t *index;      // CORE_FONT_GLYPHS + 1 entries
+    const int8_t *strokes;
+    uint64_t hash;              // Font hash of the file it was written from (see get_font_hash())
+} CoreFont;
+
+/**
+ * @brief Where the G-code goes
+ */
+typedef struct {
+    int (*write)(void *user_data, const char *bytes, size_t length);  // One whole line; 0, or -1 on error
+    int (*page)(void *user_data, int next_page);    // Sheet change, may be NULL; 0, or -1 on error
+    void *user_data;
+} CoreSink;
+
+/**
+ * @brief Page and text geometry in micrometres
+ *
+ * As in PageSetup, the page's top-left corner is the robot origin and y
+ * grows negative down the page.
+ */
+typedef struct {
+    int32_t text_height;
+    int32_t page_width;
+    int32_t page_height;        // 0 for a single unlimited page
+    int32_t margin_left;
+    int32_t margin_right;
+    int32_t margin_top;
+    int32_t margin_bottom;
+    int32_t line_spacing;       // Between lines on top of the text height
+    int32_t word_spacing;       // In font units
+} CoreOptions;
+
+/**
+ * @brief Layout and generation state of one job
+ *
+ * Lengths are in eighteenths of a micrometre unless noted.
+ */
+typedef struct {
+    const CoreFont *font;
+    CoreSink sink;
+    int failed;                 // Set if the sink rejected a line or page
+    int32_t unit;               // One font unit, the text height in micrometres
+    int32_t margin_left;
+    int32_t margin_top;
+    int32_t line_width;
+    int32_t area_height;        // 0 if unlimited
+    int32_t line_advance;
+    int32_t word_advance;
+    int32_t x;                  // Cursor, relative to the top-left corner of the text area
+    int32_t y;
+    int pending_lines;          // Hard line breaks not yet applied
+    int page_number;
+    int breaks;                 // Line breaks in the current run of whitespace
+    int after_cr;               // The last byte was '\r'
+    size_t word_length;
+    int pen;                    // -1 unknown, 0 up, 1 down
+    int32_t pen_x;              // Last commanded position
+    int32_t pen_y;
+    int travel_pending;         // Pen-up move not yet sent
+    int32_t travel_x;
+    int32_t travel_y;
+    char word[CORE_MAX_WORD];
+    char line[CORE_MAX_LINE];
+} CoreWriter;
+
+/**
+ * @brief The font table of corefont.c
+ */
+extern const CoreFont core_font;
+
+/**
+ * @brief Sets the default options
+ *
+ * @param options Options to initialise
+ */
+void core_options_init(CoreOptions *options);
+
+/**
+ * @brief Returns the advance width of a glyph
+ *
+ * @param font Font to use
+ * @param ascii_code ASCII code of the character
+ * @return int32_t Width in font units, 0 if the font has no such glyph
+ */
+int32_t core_character_width(const CoreFont *font, int ascii_code);
+
+/**
+ * @brief Starts a job with the robot at the origin and the pen state unknown
+ *
+ * @param writer Writer to initialise
+ * @param font Font to draw with
+ * @param options Geometry; only read here
+ * @param sink Where the G-code goes
+ * @return int 0 on success, -1 if the margins leave no room for text
+ */
+int core_start(CoreWriter *writer, const CoreFont *font, const CoreOptions *options, const CoreSink *sink);
+
+/**
+ * @brief Lays out text and sends the G-code of every word it completes
+ *
+ * May be called with any split of the text; a word is placed once the
+ * whitespace after it, or core_finish(), is seen.
+ *
+ * @param writer Started writer
+ * @param text Bytes of the text
+ * @param length Number of bytes
+ * @return int 0 on success, -1 once the sink has failed
+ */
+int core_write(CoreWriter *writer, const char *text, size_t length);
+
+/**
+ * @brief Places the last word and sends the deferred pen-up move
+ *
+ * @param writer Started writer
+ * @return int 0 on success, -1 if the sink rejected anything during the job
+ */
+int core_finish(CoreWriter *writer);
+
+#endif // CORE_H
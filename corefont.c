@@ -0,0 +1,299 @@
+// corefont.c
+// Generated by robotwriter --export-core-font from the font file with hash
+// 03d0a15f93f49638; do not edit. 899 movements, see CoreFont in core.h.
+#include "core.h"
+
+static const uint16_t glyph_index[CORE_FONT_GLYPHS + 1] = {
+    0, 1, 27, 42, 42, 45, 48, 51, 54, 55, 56, 57, 58, 59, 60, 63,
+    66, 75, 85, 91, 97, 103, 109, 114, 123, 128, 137, 147, 158, 168, 176, 190,
+    197, 198, 203, 208, 217, 232, 245, 255, 259, 264, 269, 276, 281, 285, 288, 292,
+    295, 307, 313, 322, 336, 341, 352, 364, 368, 385, 397, 402, 408, 412, 417, 421,
+    431, 444, 450, 463, 472, 480, 488, 494, 505, 512, 519, 527, 534, 539, 545, 550,
+    560, 568, 580, 590, 603, 608, 615, 619, 625, 630, 636, 642, 647, 650, 655, 659,
+    662, 666, 678, 687, 694, 703, 713, 720, 731, 738, 744, 751, 758, 764, 775, 782,
+    790, 799, 809, 815, 824, 831, 837, 841, 847, 852, 857, 862, 870, 875, 883, 889,
+    899,
+};
+
+static const int8_t glyph_strokes[1798] = {
+    // 0
+    0, 0,
+    // 1
+    19, 0, 3, 1, 0, 7, 0, 49, 3, 55, 14, 55, 20, 54, 42, 55, 45, 49, 45, 7,
+    42, 1, 25, 1, 13, 18, 17, 55, 15, 36, 19, 37, 21, 33, 20, 19, 22, 0, 26, 37,
+    30, 37, 32, 33, 31, 23, 29, 19, 24, 19, 54, 0,
+    // 2
+    0, -14, 1, 15, 3, 33, 7, 37, 12, 33, 12, 21, 8, 17, 2, 17, 8, 16, 11, 15,
+    12, 7, 9, 1, 5, 1, 1, 7, 18, 0,
+    // 4
+    0, 0, 0, 9, 0, 0,
+    // 5
+    0, 0, 0, -7, 0, 0,
+    // 6
+    0, 0, -4, 1, 0, 0,
+    // 7
+    0, 0, 4, 1, 0, 0,
+    // 8
+    -18, 0,
+    // 9
+    0, -18,
+    // 10
+    0, -72,
+    // 11
+    0, 72,
+    // 12
+    0, 18,
+    // 13
+    0, 0,
+    // 14
+    -4, 0, 4, 1, 0, 0,
+    // 15
+    0, 8, 0, -7, 0, 0,
+    // 16
+    4, 8, -4, -7, 0, -10, 0, 11, -4, 8, 4, -7, 5, 0, -5, 1, 0, 0,
+    // 17
+    -2, -10, -5, -3, -5, 5, -2, 11, 2, 11, 5, 5, 5, -3, 2, -9, -2, -9, 0, 0,
+    // 18
+    0, 20, 6, 37, 12, 21, 6, 36, 6, 1, 18, 0,
+    // 19
+    6, 6, 0, 19, 6, 31, 0, 18, 12, 19, 18, 0,
+    // 20
+    0, 16, 6, 1, 12, 17, 6, 0, 6, 37, 18, 0,
+    // 21
+    6, 6, 12, 19, 6, 31, 0, 18, 12, 19, 18, 0,
+    // 22
+    0, 6, 3, 1, 6, 41, 13, 41, 18, 0,
+    // 23
+    3, 0, 4, 25, 9, 0, 9, 25, 0, 20, 4, 25, 9, 25, 12, 29, 18, 0,
+    // 24
+    0, 0, 6, 31, 12, 1, 0, 1, 18, 0,
+    // 25
+    0, -14, 2, 23, 1, 4, 6, 1, 10, 5, 11, 23, 10, 4, 13, 1, 18, 0,
+    // 26
+    6, 32, 4, 37, 4, 43, 6, 47, 9, 47, 11, 43, 11, 37, 9, 33, 6, 33, 18, 0,
+    // 27
+    0, 0, 4, 1, 1, 15, 1, 25, 4, 33, 9, 33, 12, 25, 12, 15, 9, 1, 13, 1,
+    18, 0,
+    // 28
+    0, -14, 3, 19, 7, 25, 11, 23, 13, 17, 13, 9, 10, 1, 5, 1, 2, 7, 18, 0,
+    // 29
+    0, 0, 4, 1, 2, 0, 2, 37, 0, 36, 12, 37, 12, 29, 18, 0,
+    // 30
+    7, 0, 2, 1, 0, 9, 0, 21, 2, 31, 5, 37, 10, 37, 12, 29, 12, 17, 10, 7,
+    7, 1, 0, 18, 12, 19, 18, 0,
+    // 31
+    0, 0, 6, 21, 0, 34, 3, 37, 9, 5, 12, 1, 18, 0,
+    // 32
+    18, 0,
+    // 33 '!'
+    6, 0, 6, 1, 6, 10, 6, 37, 18, 0,
+    // 34 '"'
+    3, 28, 4, 37, 7, 28, 8, 37, 18, 0,
+    // 35 '#'
+    2, 0, 4, 37, 8, 0, 10, 37, 0, 26, 12, 27, 0, 10, 12, 11, 18, 0,
+    // 36 '$'
+    0, 6, 3, 3, 9, 3, 12, 7, 12, 15, 9, 19, 3, 19, 0, 23, 0, 31, 3, 35,
+    9, 35, 12, 31, 6, 38, 6, -1, 18, 0,
+    // 37 '%'
+    0, 0, 12, 37, 6, 28, 3, 21, 0, 29, 3, 37, 6, 29, 9, 16, 12, 9, 9, 1,
+    6, 9, 9, 17, 18, 0,
+    // 38 '&'
+    12, 10, 8, 1, 2, 1, 0, 9, 9, 29, 7, 37, 3, 37, 1, 29, 12, 1, 18, 0,
+    // 39 '''
+    5, 28, 7, 37, 7, 37, 18, 0,
+    // 40 '('
+    12, -4, 6, 9, 6, 29, 12, 41, 18, 0,
+    // 41 ')'
+    0, -4, 6, 9, 6, 29, 0, 41, 18, 0,
+    // 42 '*'
+    3, 4, 9, 33, 3, 32, 9, 5, 0, 18, 12, 19, 18, 0,
+    // 43 '+'
+    6, 4, 6, 33, 0, 18, 12, 19, 18, 0,
+    // 44 ','
+    4, -8, 6, 3, 6, 3, 18, 0,
+    // 45 '-'
+    0, 18, 12, 19, 18, 0,
+    // 46 '.'
+    6, 0, 6, 1, 6, 1, 18, 0,
+    // 47 '/'
+    0, 0, 12, 37, 18, 0,
+    // 48 '0'
+    1, 4, 11, 33, 12, 24, 12, 13, 9, 1, 3, 1, 0, 13, 0, 25, 3, 37, 9, 37,
+    12, 25, 18, 0,
+    // 49 '1'
+    3, 0, 9, 1, 6, 0, 6, 37, 3, 31, 18, 0,
+    // 50 '2'
+    0, 30, 3, 37, 9, 37, 12, 31, 12, 23, 2, 11, 0, 1, 12, 1, 18, 0,
+    // 51 '3'
+    0, 32, 3, 37, 9, 37, 12, 31, 12, 23, 9, 19, 3, 19, 9, 18, 12, 15, 12, 7,
+    9, 1, 3, 1, 0, 5, 18, 0,
+    // 52 '4'
+    9, 0, 9, 37, 0, 13, 12, 13, 18, 0,
+    // 53 '5'
+    0, 4, 3, 1, 9, 1, 12, 5, 12, 17, 9, 21, 3, 21, 0, 19, 2, 37, 12, 37,
+    18, 0,
+    // 54 '6'
+    0, 14, 3, 21, 9, 21, 12, 15, 12, 7, 9, 1, 3, 1, 0, 7, 0, 21, 3, 31,
+    7, 37, 18, 0,
+    // 55 '7'
+    0, 36, 12, 37, 4, 1, 18, 0,
+    // 56 '8'
+    3, 20, 0, 27, 0, 33, 3, 39, 9, 39, 12, 33, 12, 27, 9, 21, 3, 21, 0, 15,
+    0, 7, 3, 1, 9, 1, 12, 7, 12, 15, 9, 21, 18, 0,
+    // 57 '9'
+    5, 0, 9, 7, 12, 17, 12, 31, 9, 37, 3, 37, 0, 31, 0, 23, 3, 17, 9, 17,
+    12, 23, 18, 0,
+    // 58 ':'
+    6, 8, 6, 9, 6, 28, 6, 29, 18, 0,
+    // 59 ';'
+    5, -8, 7, 1, 7, 1, 7, 20, 7, 21, 18, 0,
+    // 60 '<'
+    12, 0, 0, 19, 12, 37, 18, 0,
+    // 61 '='
+    0, 8, 12, 9, 0, 28, 12, 29, 18, 0,
+    // 62 '>'
+    0, 0, 12, 19, 0, 37, 18, 0,
+    // 63 '?'
+    0, 30, 3, 37, 9, 37, 12, 31, 12, 23, 6, 15, 6, 9, 6, 0, 6, 1, 18, 0,
+    // 64 '@'
+    12, 4, 10, 1, 3, 1, 0, 7, 0, 31, 3, 37, 9, 37, 12, 31, 12, 13, 5, 13,
+    5, 27, 12, 27, 18, 0,
+    // 65 'A'
+    0, 0, 6, 37, 12, 1, 3, 18, 9, 19, 18, 0,
+    // 66 'B'
+    0, 0, 0, 37, 9, 37, 12, 31, 12, 25, 9, 19, 0, 19, 9, 18, 12, 13, 12, 7,
+    9, 1, 0, 1, 18, 0,
+    // 67 'C'
+    12, 6, 9, 1, 3, 1, 0, 7, 0, 31, 3, 37, 9, 37, 12, 31, 18, 0,
+    // 68 'D'
+    0, 0, 0, 37, 9, 37, 12, 31, 12, 7, 9, 1, 0, 1, 18, 0,
+    // 69 'E'
+    0, 0, 0, 37, 12, 37, 0, 18, 9, 19, 0, 0, 12, 1, 18, 0,
+    // 70 'F'
+    0, 0, 0, 37, 12, 37, 0, 18, 9, 19, 18, 0,
+    // 71 'G'
+    12, 30, 9, 37, 3, 37, 0, 31, 0, 7, 3, 1, 9, 1, 12, 7, 12, 17, 5, 17,
+    18, 0,
+    // 72 'H'
+    0, 0, 0, 37, 12, 0, 12, 37, 0, 18, 12, 19, 18, 0,
+    // 73 'I'
+    2, 0, 10, 1, 6, 0, 6, 37, 2, 36, 10, 37, 18, 0,
+    // 74 'J'
+    0, 4, 3, 1, 5, 1, 8, 5, 8, 37, 4, 36, 12, 37, 18, 0,
+    // 75 'K'
+    0, 0, 0, 37, 12, 36, 0, 13, 3, 18, 12, 1, 18, 0,
+    // 76 'L'
+    0, 0, 0, 37, 0, 0, 12, 1, 18, 0,
+    // 77 'M'
+    0, 0, 0, 37, 6, 11, 12, 37, 12, 1, 18, 0,
+    // 78 'N'
+    0, 0, 0, 37, 12, 1, 12, 37, 18, 0,
+    // 79 'O'
+    3, 0, 0, 7, 0, 31, 3, 37, 9, 37, 12, 31, 12, 7, 9, 1, 3, 1, 18, 0,
+    // 80 'P'
+    0, 0, 0, 37, 9, 37, 12, 31, 12, 23, 9, 17, 0, 17, 18, 0,
+    // 81 'Q'
+    3, 0, 0, 7, 0, 31, 3, 37, 9, 37, 12, 31, 12, 7, 9, 1, 3, 1, 7, 10,
+    14, -3, 18, 0,
+    // 82 'R'
+    0, 0, 0, 37, 9, 37, 12, 31, 12, 23, 9, 17, 0, 17, 7, 16, 12, 1, 18, 0,
+    // 83 'S'
+    0, 4, 3, 1, 9, 1, 12, 7, 12, 13, 9, 19, 3, 19, 0, 25, 0, 31, 3, 37,
+    9, 37, 12, 33, 18, 0,
+    // 84 'T'
+    6, 0, 6, 37, 0, 36, 12, 37, 18, 0,
+    // 85 'U'
+    0, 36, 0, 7, 3, 1, 9, 1, 12, 7, 12, 37, 18, 0,
+    // 86 'V'
+    0, 36, 6, 1, 12, 37, 18, 0,
+    // 87 'W'
+    0, 36, 3, 1, 6, 29, 9, 1, 12, 37, 18, 0,
+    // 88 'X'
+    0, 0, 12, 37, 0, 36, 12, 1, 18, 0,
+    // 89 'Y'
+    6, 0, 6, 15, 0, 37, 6, 14, 12, 37, 18, 0,
+    // 90 'Z'
+    0, 0, 12, 37, 0, 37, 12, 0, 0, 1, 18, 0,
+    // 91 '['
+    12, 40, 6, 41, 6, -3, 12, -3, 18, 0,
+    // 92 '\'
+    0, 36, 12, 1, 18, 0,
+    // 93 ']'
+    0, -4, 6, -3, 6, 41, 0, 41, 18, 0,
+    // 94 '^'
+    0, 14, 6, 33, 12, 15, 18, 0,
+    // 95 '_'
+    -18, -10, 0, -9, 0, 0,
+    // 96 '`'
+    5, 36, 5, 37, 7, 29, 18, 0,
+    // 97 'a'
+    0, 20, 5, 25, 11, 21, 11, 5, 8, 1, 4, 1, 0, 5, 0, 11, 11, 13, 11, 4,
+    13, 1, 18, 0,
+    // 98 'b'
+    0, 0, 0, 37, 0, 18, 6, 23, 12, 19, 12, 5, 6, 1, 0, 5, 18, 0,
+    // 99 'c'
+    11, 18, 6, 23, 0, 19, 0, 5, 6, 1, 11, 5, 18, 0,
+    // 100 'd'
+    12, 4, 6, 1, 0, 5, 0, 19, 6, 23, 12, 19, 12, 36, 12, 1, 18, 0,
+    // 101 'e'
+    0, 12, 12, 15, 9, 25, 3, 25, 0, 19, 0, 5, 3, 1, 9, 1, 12, 5, 18, 0,
+    // 102 'f'
+    4, 0, 4, 33, 8, 37, 12, 33, 0, 18, 8, 19, 18, 0,
+    // 103 'g'
+    11, 4, 6, 1, 0, 5, 0, 19, 6, 23, 11, 19, 11, 22, 11, -9, 6, -13, 0, -9,
+    18, 0,
+    // 104 'h'
+    0, 0, 0, 37, 0, 18, 6, 23, 12, 19, 12, 1, 18, 0,
+    // 105 'i'
+    7, 0, 7, 23, 4, 23, 7, 36, 7, 37, 18, 0,
+    // 106 'j'
+    0, -10, 4, -13, 8, -9, 8, 23, 8, 36, 8, 37, 18, 0,
+    // 107 'k'
+    0, 0, 0, 37, 0, 10, 12, 23, 4, 14, 12, 1, 18, 0,
+    // 108 'l'
+    3, 0, 9, 1, 6, 0, 6, 37, 3, 37, 18, 0,
+    // 109 'm'
+    0, 0, 0, 25, 0, 18, 4, 25, 6, 19, 6, 1, 6, 18, 10, 25, 12, 19, 12, 1,
+    18, 0,
+    // 110 'n'
+    0, 0, 0, 23, 0, 16, 6, 23, 12, 17, 12, 1, 18, 0,
+    // 111 'o'
+    6, 0, 0, 5, 0, 19, 6, 23, 12, 19, 12, 5, 6, 1, 18, 0,
+    // 112 'p'
+    0, -14, 0, 23, 0, 18, 6, 23, 12, 19, 12, 5, 6, 1, 0, 5, 18, 0,
+    // 113 'q'
+    11, 4, 6, 1, 0, 5, 0, 19, 6, 23, 11, 19, 11, 22, 11, -11, 13, -15, 18, 0,
+    // 114 'r'
+    0, 0, 0, 23, 0, 16, 6, 23, 12, 17, 18, 0,
+    // 115 's'
+    0, 4, 6, 1, 12, 5, 12, 11, 0, 15, 0, 21, 6, 25, 12, 21, 18, 0,
+    // 116 't'
+    12, 4, 8, 1, 4, 5, 4, 37, 0, 22, 8, 23, 18, 0,
+    // 117 'u'
+    0, 22, 0, 5, 6, 1, 12, 5, 12, 23, 18, 0,
+    // 118 'v'
+    0, 22, 6, 1, 12, 23, 18, 0,
+    // 119 'w'
+    0, 22, 3, 1, 6, 17, 9, 1, 12, 23, 18, 0,
+    // 120 'x'
+    0, 0, 11, 23, 0, 22, 11, 1, 18, 0,
+    // 121 'y'
+    0, 22, 7, 3, 3, -14, 12, 23, 18, 0,
+    // 122 'z'
+    0, 22, 12, 23, 0, 1, 12, 1, 18, 0,
+    // 123 '{'
+    12, -4, 7, 3, 7, 13, 4, 19, 7, 25, 7, 35, 12, 41, 18, 0,
+    // 124 '|'
+    6, 0, 6, 13, 6, 24, 6, 37, 18, 0,
+    // 125 '}'
+    0, -4, 5, 3, 5, 13, 8, 19, 5, 25, 5, 35, 0, 41, 18, 0,
+    // 126 '~'
+    0, 0, 0, 107, 53, 107, 53, 1, 0, 1, 56, 0,
+    // 127
+    0, 0, 0, 37, 12, 19, 0, 1, 0, 6, 4, 7, 4, 31, 0, 31, 0, 12, 8, 13,
+};
+
+_Static_assert(sizeof(glyph_index) + sizeof(glyph_strokes) <= CORE_FONT_BUDGET,
+               "Font table exceeds CORE_FONT_BUDGET");
+
+const CoreFont core_font = { glyph_index, glyph_strokes, 0x03d0a15f93f49638ULL };
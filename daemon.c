@@ -0,0 +1,532 @@
+// daemon.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "daemon.h"
+#include "job.h"
+#include "platform.h"
+#include "trace.h"
+#include "debug.h"
+
+#ifdef _WIN32
+
+int run_daemon(const char *socket_path, Transport *transport) {
+    (void)socket_path;
+    (void)transport;
+    printf("Daemon mode needs Unix domain sockets and is not available on this platform\n");
+    return -1;
+}
+
+void set_daemon_fonts(const FontRegistry *registry) {
+    (void)registry;
+}
+
+int daemon_request(const char *socket_path, const char *request, char *reply, size_t reply_size) {
+    (void)socket_path;
+    (void)request;
+    (void)reply;
+    (void)reply_size;
+    return -1;
+}
+
+#else
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+typedef enum {
+    JOB_QUEUED = 0,
+    JOB_RUNNING,
+    JOB_PAUSED,
+    JOB_DONE,
+    JOB_FAILED,
+    JOB_CANCELLED
+} DaemonJobState;
+
+static const char *const state_names[] = { "queued", "running", "paused", "done", "failed", "cancelled" };
+
+typedef struct {
+    int in_use;
+    unsigned long id;
+    int priority;
+    float height;
+    int optimal_breaks;
+    int boustrophedon;
+    int plan_feed;
+    float join_distance;
+    PenTiming pen;
+    const Font *font;           // From the font registry, NULL for the loaded font
+    char path[DAEMON_LINE_SIZE];
+    DaemonJobState state;
+    int running;                // Owned by the worker, which may still use it after a cancel
+    unsigned long done;         // Operations of the compiled job executed so far
+    unsigned long total;        // Operations in the compiled job
+} DaemonJob;
+
+typedef struct {
+    int fd;
+    size_t length;
+    char line[DAEMON_LINE_SIZE];
+} DaemonClient;
+
+// Shared between the socket thread and the worker; guarded by lock
+static DaemonJob jobs[DAEMON_MAX_JOBS];
+static unsigned long next_job_id = 1;
+static int shutting_down = 0;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t changed = PTHREAD_COND_INITIALIZER;
+
+// Only used by the worker thread
+static Transport *robot = NULL;
+
+// Fonts jobs can choose by name (set_daemon_fonts)
+static const FontRegistry *fonts = NULL;
+
+// Free slot, or the oldest finished job the worker is done with when the table is full
+static DaemonJob *allocate_job(void) {
+    DaemonJob *oldest = NULL;
+    for (int i = 0; i < DAEMON_MAX_JOBS; i++) {
+        if (!jobs[i].in_use) {
+            return &jobs[i];
+        }
+        if (jobs[i].state >= JOB_DONE && !jobs[i].running && (!oldest || jobs[i].id < oldest->id)) {
+            oldest = &jobs[i];
+        }
+    }
+    return oldest;
+}
+
+static DaemonJob *find_job(unsigned long id) {
+    for (int i = 0; i < DAEMON_MAX_JOBS; i++) {
+        if (jobs[i].in_use && jobs[i].id == id) {
+            return &jobs[i];
+        }
+    }
+    return NULL;
+}
+
+// Highest priority first, then submission order
+static DaemonJob *next_queued_job(void) {
+    DaemonJob *best = NULL;
+    for (int i = 0; i < DAEMON_MAX_JOBS; i++) {
+        DaemonJob *job = &jobs[i];
+        if (job->in_use && job->state == JOB_QUEUED &&
+            (!best || job->priority > best->priority || (job->priority == best->priority && job->id < best->id))) {
+            best = job;
+        }
+    }
+    return best;
+}
+
+// The job a progress transport reports on and the executor that counts its operations
+typedef struct {
+    DaemonJob *job;
+    const Executor *executor;
+} DaemonProgress;
+
+// Forwards to the robot and publishes the operations done; fails once the job is cancelled
+static int progress_send(Transport *transport, const char *command) {
+    DaemonProgress *progress = transport->state;
+
+    pthread_mutex_lock(&lock);
+    progress->job->done = progress->executor->ops_done;
+    int cancelled = progress->job->state == JOB_CANCELLED;
+    pthread_mutex_unlock(&lock);
+    if (cancelled) {
+        return -1;
+    }
+    return transport_send(robot, command);
+}
+
+static int progress_drain(Transport *transport) {
+    (void)transport;
+    return transport_drain(robot);
+}
+
+static size_t progress_pending(Transport *transport) {
+    (void)transport;
+    return transport_pending(robot);
+}
+
+static void park_robot(void) {
+    transport_send(robot, "S0\n");
+    transport_send(robot, "G0 X0 Y0\n");
+    transport_drain(robot);
+}
+
+// Page-change hook: park and wait for a CONTINUE (or CANCEL) request
+static int daemon_page_break(int next_page, void *user_data) {
+    DaemonJob *job = user_data;
+    park_robot();
+
+    pthread_mutex_lock(&lock);
+    if (job->state == JOB_RUNNING) {
+        job->state = JOB_PAUSED;
+    }
+    printf("Job %lu paused before page %d\n", job->id, next_page);
+    while (job->state == JOB_PAUSED) {
+        pthread_cond_wait(&changed, &lock);
+    }
+    int cancelled = job->state == JOB_CANCELLED;
+    pthread_mutex_unlock(&lock);
+    return cancelled ? -1 : 0;
+}
+
+static void run_daemon_job(DaemonJob *job) {
+    JobSpec spec;
+    char ir_path[512];
+    IrReader reader;
+    uint64_t started_ns = monotonic_ns(), first_stroke_ns = 0;
+
+    job_spec_init(&spec, job->path, job->height / 18.0f);
+    spec.line_break_mode = job->optimal_breaks ? LINE_BREAK_OPTIMAL : LINE_BREAK_GREEDY;
+    spec.boustrophedon = job->boustrophedon;
+    spec.feed.enabled = job->plan_feed;
+    spec.join_distance = job->join_distance;
+    spec.pen = job->pen;
+    if (job->font) {
+        spec.font = job->font;
+    }
+
+    // Compile first so clients can see the size of the job
+    int result = compile_job(&spec, ir_path, sizeof(ir_path));
+    if (result >= 0 && ir_reader_open(&reader, ir_path) == 0) {
+        pthread_mutex_lock(&lock);
+        job->total = reader.op_count;
+        pthread_mutex_unlock(&lock);
+        ir_reader_close(&reader);
+    }
+
+    unsigned long done = 0;
+    if (result >= 0) {
+        Executor executor;
+        DaemonProgress progress = { job, &executor };
+        Transport counting = { progress_send, &progress, NULL, progress_drain, progress_pending };
+        executor_init(&executor, &counting, daemon_page_break, job);
+        result = run_job(&spec, &executor);
+        first_stroke_ns = executor.first_stroke_ns;
+        done = executor.ops_done;
+    }
+    park_robot();
+
+    pthread_mutex_lock(&lock);
+    // Operations that send nothing, such as page breaks, are only counted here
+    job->done = done;
+    if (job->state != JOB_CANCELLED) {
+        job->state = result == 0 ? JOB_DONE : JOB_FAILED;
+    }
+    job->running = 0;
+    if (first_stroke_ns) {
+        // Compile, cache lookup and the robot's first acknowledgements
+        printf("Job %lu %s, first stroke %.0f ms after it started\n", job->id, state_names[job->state],
+               (first_stroke_ns - started_ns) / 1e6);
+    } else {
+        printf("Job %lu %s\n", job->id, state_names[job->state]);
+    }
+    pthread_cond_broadcast(&changed);
+    pthread_mutex_unlock(&lock);
+}
+
+static void *worker_main(void *arg) {
+    (void)arg;
+    trace_set_thread_name("daemon worker");
+    pthread_mutex_lock(&lock);
+    for (;;) {
+        DaemonJob *job = NULL;
+        while (!shutting_down && !(job = next_queued_job())) {
+            pthread_cond_wait(&changed, &lock);
+        }
+        if (shutting_down) {
+            break;
+        }
+        job->state = JOB_RUNNING;
+        job->running = 1;
+        pthread_mutex_unlock(&lock);
+
+        run_daemon_job(job);
+
+        pthread_mutex_lock(&lock);
+    }
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+static int format_job(const DaemonJob *job, char *reply, size_t size) {
+    return snprintf(reply, size, "JOB %lu %s %lu %lu %d %s\n", job->id, state_names[job->state],
+                    job->done, job->total, job->priority, job->path);
+}
+
+// Handle one request line; called with the lock held
+static void handle_request(char *line, char *reply, size_t size) {
+    char command[16] = "";
+    unsigned long id = 0;
+    sscanf(line, "%15s", command);
+
+    if (strcmp(command, "SUBMIT") == 0) {
+        int priority, consumed = 0;
+        float height;
+        char path[DAEMON_LINE_SIZE];
+        if (sscanf(line, "SUBMIT %d %f %511s%n", &priority, &height, path, &consumed) != 3 ||
+            height < MIN_HEIGHT || height > MAX_HEIGHT) {
+            snprintf(reply, size, "ERR usage: SUBMIT <priority> <height_mm %.1f-%.1f> <file> [options]\n", MIN_HEIGHT,
+                     MAX_HEIGHT);
+            return;
+        }
+        const Font *font = NULL;
+        const char *font_option = strstr(line + consumed, "--font ");
+        if (font_option) {
+            char name[FONT_NAME_SIZE];
+            if (!fonts || sscanf(font_option + strlen("--font "), "%31s", name) != 1 ||
+                !(font = font_registry_find(fonts, name))) {
+                snprintf(reply, size, "ERR unknown font\n");
+                return;
+            }
+        }
+        float join_distance = 0.0f;
+        const char *join = strstr(line + consumed, "--join-strokes ");
+        if (join && (sscanf(join + strlen("--join-strokes "), "%f", &join_distance) != 1 ||
+                     join_distance < 0.0f || join_distance > JOIN_MAX_DISTANCE)) {
+            snprintf(reply, size, "ERR bad --join-strokes\n");
+            return;
+        }
+        PenTiming pen;
+        pen_timing_init(&pen);
+        const char *pen_option = strstr(line + consumed, "--pen-timing ");
+        if (pen_option && parse_pen_timing(pen_option + strlen("--pen-timing "), &pen) != 0) {
+            snprintf(reply, size, "ERR bad --pen-timing\n");
+            return;
+        }
+        DaemonJob *job = allocate_job();
+        if (!job) {
+            snprintf(reply, size, "ERR queue full\n");
+            return;
+        }
+        memset(job, 0, sizeof(*job));
+        job->in_use = 1;
+        job->id = next_job_id++;
+        job->priority = priority;
+        job->height = height;
+        job->font = font;
+        snprintf(job->path, sizeof(job->path), "%s", path);
+        job->optimal_breaks = strstr(line + consumed, "--optimal-breaks") != NULL;
+        job->boustrophedon = strstr(line + consumed, "--boustrophedon") != NULL;
+        job->plan_feed = strstr(line + consumed, "--plan-feed") != NULL;
+        job->join_distance = join_distance;
+        job->pen = pen;
+        job->state = JOB_QUEUED;
+        pthread_cond_broadcast(&changed);
+        snprintf(reply, size, "OK %lu\n", job->id);
+    } else if (strcmp(command, "STATUS") == 0 && sscanf(line, "STATUS %lu", &id) == 1) {
+        DaemonJob *job = find_job(id);
+        if (job) {
+            format_job(job, reply, size);
+        } else {
+            snprintf(reply, size, "ERR no such job\n");
+        }
+    } else if (strcmp(command, "LIST") == 0) {
+        // Whole lines only, always leaving room for the END line
+        size_t used = 0, room = size - sizeof("END\n");
+        for (int i = 0; i < DAEMON_MAX_JOBS; i++) {
+            if (jobs[i].in_use) {
+                int length = format_job(&jobs[i], reply + used, room - used);
+                if (length < 0 || (size_t)length >= room - used) {
+                    break;
+                }
+                used += (size_t)length;
+            }
+        }
+        snprintf(reply + used, size - used, "END\n");
+    } else if (strcmp(command, "CONTINUE") == 0 && sscanf(line, "CONTINUE %lu", &id) == 1) {
+        DaemonJob *job = find_job(id);
+        if (job && job->state == JOB_PAUSED) {
+            job->state = JOB_RUNNING;
+            pthread_cond_broadcast(&changed);
+            snprintf(reply, size, "OK %lu\n", id);
+        } else {
+            snprintf(reply, size, "ERR job is not paused\n");
+        }
+    } else if (strcmp(command, "CANCEL") == 0 && sscanf(line, "CANCEL %lu", &id) == 1) {
+        DaemonJob *job = find_job(id);
+        if (job && job->state <= JOB_PAUSED) {
+            job->state = JOB_CANCELLED;
+            pthread_cond_broadcast(&changed);
+            snprintf(reply, size, "OK %lu\n", id);
+        } else {
+            snprintf(reply, size, "ERR job is not active\n");
+        }
+    } else if (strcmp(command, "SHUTDOWN") == 0) {
+        shutting_down = 1;
+        // A job waiting at a page break would never continue; stop it so it can be resumed later
+        for (int i = 0; i < DAEMON_MAX_JOBS; i++) {
+            if (jobs[i].in_use && jobs[i].state == JOB_PAUSED) {
+                jobs[i].state = JOB_CANCELLED;
+            }
+        }
+        pthread_cond_broadcast(&changed);
+        snprintf(reply, size, "OK 0\n");
+    } else {
+        snprintf(reply, size, "ERR unknown request\n");
+    }
+}
+
+static int open_listener(const char *socket_path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        return -1;
+    }
+    strcpy(address.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    unlink(socket_path);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(fd, DAEMON_MAX_CLIENTS) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Read what the client sent and answer every complete line; returns -1 once it hangs up
+static int serve_client(DaemonClient *client) {
+    ssize_t got = read(client->fd, client->line + client->length, sizeof(client->line) - 1 - client->length);
+    if (got <= 0) {
+        return -1;
+    }
+    client->length += (size_t)got;
+
+    char *newline;
+    while ((newline = memchr(client->line, '\n', client->length)) != NULL) {
+        static char reply[DAEMON_MAX_JOBS * 160];
+        *newline = '\0';
+        pthread_mutex_lock(&lock);
+        handle_request(client->line, reply, sizeof(reply));
+        pthread_mutex_unlock(&lock);
+        if (write(client->fd, reply, strlen(reply)) < 0) {
+            return -1;
+        }
+        client->length -= (size_t)(newline + 1 - client->line);
+        memmove(client->line, newline + 1, client->length);
+    }
+    if (client->length == sizeof(client->line) - 1) {
+        return -1;      // Line too long
+    }
+    return 0;
+}
+
+void set_daemon_fonts(const FontRegistry *registry) {
+    fonts = registry;
+}
+
+int run_daemon(const char *socket_path, Transport *transport) {
+    int listener = open_listener(socket_path);
+    if (listener < 0) {
+        printf("Could not listen on %s\n", socket_path);
+        return -1;
+    }
+
+    robot = transport;
+    shutting_down = 0;
+    pthread_t worker;
+    if (pthread_create(&worker, NULL, worker_main, NULL) != 0) {
+        close(listener);
+        unlink(socket_path);
+        return -1;
+    }
+    printf("Robot Writer daemon listening on %s\n", socket_path);
+
+    DaemonClient clients[DAEMON_MAX_CLIENTS];
+    int client_count = 0;
+    int stop = 0;
+    while (!stop) {
+        struct pollfd fds[DAEMON_MAX_CLIENTS + 1];
+        fds[0].fd = listener;
+        fds[0].events = POLLIN;
+        for (int i = 0; i < client_count; i++) {
+            fds[i + 1].fd = clients[i].fd;
+            fds[i + 1].events = POLLIN;
+        }
+        if (poll(fds, (nfds_t)(client_count + 1), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        // Serve existing clients first so the indexes in fds stay valid
+        for (int i = client_count - 1; i >= 0; i--) {
+            if ((fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)) && serve_client(&clients[i]) != 0) {
+                close(clients[i].fd);
+                clients[i] = clients[--client_count];
+            }
+        }
+        if ((fds[0].revents & POLLIN) && client_count < DAEMON_MAX_CLIENTS) {
+            int fd = accept(listener, NULL, NULL);
+            if (fd >= 0) {
+                clients[client_count].fd = fd;
+                clients[client_count].length = 0;
+                client_count++;
+            }
+        }
+
+        pthread_mutex_lock(&lock);
+        stop = shutting_down;
+        pthread_mutex_unlock(&lock);
+    }
+
+    pthread_join(worker, NULL);
+    for (int i = 0; i < client_count; i++) {
+        close(clients[i].fd);
+    }
+    close(listener);
+    unlink(socket_path);
+    DEBUG_LOG("Daemon stopped\n");
+    return 0;
+}
+
+int daemon_request(const char *socket_path, const char *request, char *reply, size_t reply_size) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path) || reply_size == 0) {
+        return -1;
+    }
+    strcpy(address.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        write(fd, request, strlen(request)) < 0 || write(fd, "\n", 1) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    // LIST replies end with "END"; every other reply is a single line
+    int list = strncmp(request, "LIST", 4) == 0;
+    size_t used = 0;
+    for (;;) {
+        ssize_t got = read(fd, reply + used, reply_size - 1 - used);
+        if (got <= 0) {
+            break;
+        }
+        used += (size_t)got;
+        reply[used] = '\0';
+        if (used == reply_size - 1 || (list ? strstr(reply, "END\n") != NULL : strchr(reply, '\n') != NULL)) {
+            break;
+        }
+    }
+    reply[used] = '\0';
+    close(fd);
+    return used > 0 ? 0 : -1;
+}
+
+#endif // _WIN32
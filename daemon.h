@@ -0,0 +1,76 @@
+/**
+ * @file daemon.h
+ * @brief Long-running writer service with a local job queue
+ *
+ * The daemon keeps the font, the job cache and the open, initialised port
+ * resident and accepts jobs over a Unix domain socket. Requests and replies
+ * are single text lines:
+ *
+ *   SUBMIT <priority> <height_mm> <file> [--optimal-breaks] [--boustrophedon] [--plan-feed] [--join-strokes MM]
+ *                                   [--pen-timing LIFT,DROP[,CONTACT]] [--font NAME]
+ *                                   -> OK <id>
+ *   STATUS <id>                     -> JOB <id> <state> <done> <total> <priority> <file>
+ *   LIST                            -> one JOB line per job, then END
+ *   CONTINUE <id>                   -> OK <id>    (resume a job paused at a page break)
+ *   CANCEL <id>                     -> OK <id>    (stops a queued, running or paused job)
+ *   SHUTDOWN                        -> OK 0       (after the running job finishes)
+ *
+ * Failures reply "ERR <reason>". Higher priorities run first; equal
+ * priorities run in submission order. File names may not contain spaces.
+ * Heights are MIN_HEIGHT to MAX_HEIGHT mm. <done> and <total> count the
+ * operations of the compiled job, so a finished job reports total/total.
+ * --font picks a font of the registry given with set_daemon_fonts(); jobs
+ * without it use the loaded font.
+ * A cancelled or interrupted job keeps its checkpoint, so it can later be
+ * finished with --resume.
+ */
+
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <stddef.h>
+#include "transport.h"
+#include "fontreg.h"
+
+/**
+ * @brief Limits of the job table and request size
+ */
+#define DAEMON_MAX_JOBS 256
+#define DAEMON_MAX_CLIENTS 16
+#define DAEMON_LINE_SIZE 512
+
+/**
+ * @brief Runs the writer service until a SHUTDOWN request
+ *
+ * The font must already be loaded and the robot initialised. Every job
+ * starts and ends at the origin with the pen up.
+ *
+ * @param socket_path Path of the Unix domain socket to listen on
+ * @param transport Transport to the robot
+ * @return int 0 after a clean shutdown, -1 if the socket could not be set up
+ */
+int run_daemon(const char *socket_path, Transport *transport);
+
+/**
+ * @brief Sets the fonts SUBMIT --font chooses from
+ *
+ * Call before run_daemon(); the registry must stay open while it runs.
+ *
+ * @param registry Open font registry, or NULL for none
+ */
+void set_daemon_fonts(const FontRegistry *registry);
+
+/**
+ * @brief Sends one request line to a running daemon and reads the reply
+ *
+ * Reads a single line, or for LIST every line up to END.
+ *
+ * @param socket_path Path of the daemon's socket
+ * @param request Request line without trailing newline
+ * @param reply Receives the reply text
+ * @param reply_size Size of reply
+ * @return int 0 on success, -1 if the daemon could not be reached
+ */
+int daemon_request(const char *socket_path, const char *request, char *reply, size_t reply_size);
+
+#endif // DAEMON_H
@@ -0,0 +1,46 @@
+// feed.c
+#include <stdio.h>
+#include "feed.h"
+
+void feed_limits_init(FeedLimits *limits) {
+    limits->enabled = 0;
+    limits->min_feed = FEED_MIN_DEFAULT;
+    limits->max_feed = FEED_MAX_DEFAULT;
+}
+
+int parse_feed_limits(const char *text, FeedLimits *limits) {
+    float min_feed, max_feed;
+    if (sscanf(text, "%f,%f", &min_feed, &max_feed) != 2 || min_feed <= 0.0f || max_feed < min_feed) {
+        return -1;
+    }
+    limits->enabled = 1;
+    limits->min_feed = min_feed;
+    limits->max_feed = max_feed;
+    return 0;
+}
+
+int plan_segment_feed(const FeedLimits *limits, float length, float turn_in, float turn_out, float text_height) {
+    float min_feed = limits->min_feed;
+    float height = text_height / FEED_FULL_SPEED_HEIGHT_MM;
+    float ceiling = min_feed + (limits->max_feed - min_feed) * (height < 1.0f ? height : 1.0f);
+
+    // Short segments: no faster than covering the segment in FEED_SEGMENT_MS
+    float feed = length * 60000.0f / FEED_SEGMENT_MS;
+
+    // Corners: full speed straight on, down to min_feed for a reversal
+    float turn = turn_in < turn_out ? turn_in : turn_out;
+    float corner = min_feed + (ceiling - min_feed) * (1.0f + turn) * 0.5f;
+    if (corner < feed) {
+        feed = corner;
+    }
+    if (feed > ceiling) {
+        feed = ceiling;
+    }
+    if (feed < min_feed) {
+        feed = min_feed;
+    }
+
+    // Rounded down, but never below the floor
+    int rounded = (int)feed / FEED_STEP * FEED_STEP;
+    return rounded > (int)min_feed ? rounded : (int)min_feed;
+}
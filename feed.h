@@ -0,0 +1,75 @@
+/**
+ * @file feed.h
+ * @brief Per-segment feed planning for pen-down moves
+ *
+ * With one feed for every stroke, the speed is limited by the worst case:
+ * the tiny, sharp details of small text. The feed planner gives each pen-down
+ * segment its own feed from its length, the turns at the joins with the
+ * neighbouring segments of the same stroke and the text height, between the
+ * configured limits. Long straight strokes in large text run at max_feed;
+ * short segments and sharp corners slow down towards min_feed, which is the
+ * feed every stroke used to get and is legible at any size. Pen-up travel is
+ * always a rapid (G0) move and does not use the feed.
+ *
+ * Feeds are rounded down to FEED_STEP, and the generator only sends an F word
+ * when the rounded feed changes.
+ */
+
+#ifndef FEED_H
+#define FEED_H
+
+/**
+ * @brief Default limits, in mm/min
+ */
+#define FEED_MIN_DEFAULT 1000.0f        // The single feed set by initialize_robot()
+#define FEED_MAX_DEFAULT 3000.0f        // The rapid speed of the machine model (scheduler.h)
+
+/**
+ * @brief Planning model
+ */
+#define FEED_FULL_SPEED_HEIGHT_MM 10.0f // Smaller text gets a proportionally lower ceiling
+#define FEED_SEGMENT_MS 40.0f           // A segment is given at least this long, so short detail is slow
+#define FEED_STEP 250                   // mm/min; feeds are rounded down to a multiple
+
+/**
+ * @brief Feed planning settings
+ */
+typedef struct {
+    int enabled;            // 0: every pen-down move keeps the robot's feed
+    float min_feed;         // mm/min, for the shortest and sharpest detail
+    float max_feed;         // mm/min, for long straight strokes in large text
+} FeedLimits;
+
+/**
+ * @brief Fills limits with planning disabled and the default feeds
+ *
+ * @param limits Limits to fill
+ */
+void feed_limits_init(FeedLimits *limits);
+
+/**
+ * @brief Parses "MIN,MAX" in mm/min and enables planning
+ *
+ * @param text Limits, e.g. "1000,3000"
+ * @param limits Receives the limits
+ * @return int 0 on success, -1 unless 0 < MIN <= MAX
+ */
+int parse_feed_limits(const char *text, FeedLimits *limits);
+
+/**
+ * @brief Plans the feed of one pen-down segment
+ *
+ * A turn is given as the cosine of the angle between the segment and its
+ * neighbour: 1 straight on (or no neighbour, the pen stops there anyway), 0 a
+ * right angle, -1 a reversal.
+ *
+ * @param limits Enabled limits
+ * @param length Segment length in mm
+ * @param turn_in Cosine of the turn from the previous segment
+ * @param turn_out Cosine of the turn into the next segment
+ * @param text_height Height of the glyph in mm
+ * @return int Feed in mm/min, a multiple of FEED_STEP or min_feed
+ */
+int plan_segment_feed(const FeedLimits *limits, float length, float turn_in, float turn_out, float text_height);
+
+#endif // FEED_H
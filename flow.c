@@ -0,0 +1,230 @@
+// flow.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "flow.h"
+#include "serial.h"
+#include "platform.h"
+#include "debug.h"
+
+static int port_write(void *link, const char *data, size_t length) {
+    return WriteToPort(*(int *)link, data, (int)length);
+}
+
+static int port_read(void *link, char *buffer, size_t size) {
+    return ReadFromPort(*(int *)link, (unsigned char *)buffer, (int)size);
+}
+
+// Size the window from the last status report
+static void adapt_window(FlowTransport *flow) {
+    int rx_queued = FLOW_RX_BUFFER - flow->rx_free;
+    if (flow->planner_free > FLOW_PLANNER_SLACK) {
+        // The planner is running dry: send further ahead, and without delay
+        if (flow->window < FLOW_RX_BUFFER - 1) {
+            flow->window = flow->window + FLOW_WINDOW_STEP < FLOW_RX_BUFFER - 1 ?
+                flow->window + FLOW_WINDOW_STEP : FLOW_RX_BUFFER - 1;
+            flow->widened++;
+        }
+        flow->batch_limit = 1;
+    } else if (rx_queued > FLOW_RX_QUEUED_HIGH) {
+        // Lines wait behind a full planner: keep the next ones on the host
+        if (flow->window > FLOW_MIN_WINDOW) {
+            flow->window = flow->window - FLOW_WINDOW_STEP > FLOW_MIN_WINDOW ?
+                flow->window - FLOW_WINDOW_STEP : FLOW_MIN_WINDOW;
+            flow->narrowed++;
+        }
+        if (flow->batch_limit < FLOW_MAX_BATCH) {
+            flow->batch_limit++;
+        }
+    }
+}
+
+static void handle_reply(FlowTransport *flow, const char *line) {
+    if (strncmp(line, "ok", 2) == 0 || strncmp(line, "error", 5) == 0) {
+        if (line[0] == 'e') {
+            // The line is dropped; the ones after it still run
+            flow->errors++;
+            metrics_count_incident(flow->transport.metrics, METRICS_ERROR);
+            DEBUG_LOG("Controller reported %s\n", line);
+        }
+        if (flow->count > flow->batched) {
+            uint64_t latency = monotonic_ns() - flow->queued_ns[flow->head];
+            flow->latency_total_ns += latency;
+            if (latency > flow->latency_max_ns) {
+                flow->latency_max_ns = latency;
+            }
+            flow->wire_bytes -= flow->lengths[flow->head];
+            flow->head = (flow->head + 1) % FLOW_MAX_IN_FLIGHT;
+            flow->count--;
+        }
+    } else if (line[0] == '<') {
+        const char *buffers = strstr(line, "Bf:");
+        flow->status_pending = 0;
+        if (buffers && sscanf(buffers + 3, "%d,%d", &flow->planner_free, &flow->rx_free) == 2) {
+            flow->status_reports++;
+            adapt_window(flow);
+        }
+    } else if (strncmp(line, "ALARM", 5) == 0) {
+        // The controller dropped what was in flight: stop and leave the rest to --resume
+        printf("Controller alarm: %s\n", line);
+        metrics_count_incident(flow->transport.metrics, METRICS_ALARM);
+        flow->failed = 1;
+    }
+}
+
+// Read what has arrived and handle every complete line; returns the bytes read, -1 on failure
+static int read_replies(FlowTransport *flow) {
+    char buffer[256];
+    int n = flow->link.read(flow->link.link, buffer, sizeof(buffer));
+    for (int i = 0; i < n; i++) {
+        if (buffer[i] == '\n') {
+            flow->reply[flow->reply_length] = '\0';
+            handle_reply(flow, flow->reply);
+            flow->reply_length = 0;
+        } else if (buffer[i] != '\r' && flow->reply_length < sizeof(flow->reply) - 1) {
+            flow->reply[flow->reply_length++] = buffer[i];
+        }
+    }
+    return n;
+}
+
+static void request_status(FlowTransport *flow) {
+    uint64_t now = monotonic_ns();
+    // An unanswered request is repeated after ten periods
+    uint64_t wait_ns = (flow->status_pending ? 10ULL : 1ULL) * FLOW_STATUS_INTERVAL_MS * 1000000ULL;
+    if (flow->mode == FLOW_ADAPTIVE && now - flow->status_requested_ns >= wait_ns &&
+        flow->link.write(flow->link.link, "?", 1) == 0) {
+        flow->status_requested_ns = now;
+        flow->status_pending = 1;
+    }
+}
+
+static int write_batch(FlowTransport *flow) {
+    if (flow->batched == 0) {
+        return 0;
+    }
+    if (flow->link.write(flow->link.link, flow->batch, flow->batch_bytes) != 0) {
+        return -1;
+    }
+    flow->wire_bytes += flow->batch_bytes;
+    flow->batch_bytes = 0;
+    flow->batched = 0;
+    return 0;
+}
+
+// Wait until the controller acknowledges at least one more line
+static int wait_for_ack(FlowTransport *flow) {
+    size_t before = flow->count;
+    int timeout_ms = get_recovery_policy()->ack_timeout_ms;
+    uint64_t deadline = monotonic_ns() + (uint64_t)timeout_ms * 1000000ULL;
+    while (flow->count == before && !flow->failed) {
+        request_status(flow);
+        int n = read_replies(flow);
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            if (monotonic_ns() >= deadline) {
+                // Which lines arrived is unknown, so none can be sent again
+                printf("No acknowledgement after %d ms\n", timeout_ms);
+                metrics_count_incident(flow->transport.metrics, METRICS_TIMEOUT);
+                flow->failed = 1;
+                break;
+            }
+            sleep_ms(1);
+        }
+    }
+    return flow->failed ? -1 : 0;
+}
+
+static int flow_send_command(Transport *transport, const char *command) {
+    FlowTransport *flow = transport->state;
+    size_t length = strlen(command);
+    if (flow->failed || length == 0 || length > FLOW_RX_BUFFER - 1) {
+        return -1;
+    }
+
+    while (flow->count == FLOW_MAX_IN_FLIGHT ||
+           (flow->count > 0 && flow->wire_bytes + flow->batch_bytes + length > flow->window)) {
+        if (flow->batched > 0) {
+            if (write_batch(flow) != 0) {
+                return -1;
+            }
+        } else if (wait_for_ack(flow) != 0) {
+            return -1;
+        }
+    }
+
+    size_t slot = (flow->head + flow->count) % FLOW_MAX_IN_FLIGHT;
+    flow->lengths[slot] = length;
+    flow->queued_ns[slot] = monotonic_ns();
+    flow->count++;
+    flow->batched++;
+    memcpy(flow->batch + flow->batch_bytes, command, length);
+    flow->batch_bytes += length;
+    flow->lines++;
+    if (flow->batched >= (size_t)flow->batch_limit && write_batch(flow) != 0) {
+        return -1;
+    }
+    transport_mark_written(transport);
+    return 0;
+}
+
+static int flow_drain(Transport *transport) {
+    FlowTransport *flow = transport->state;
+    if (write_batch(flow) != 0) {
+        return -1;
+    }
+    while (flow->count > 0) {
+        if (wait_for_ack(flow) != 0) {
+            return -1;
+        }
+    }
+    return flow->failed ? -1 : 0;
+}
+
+static size_t flow_pending(Transport *transport) {
+    FlowTransport *flow = transport->state;
+    return flow->count;
+}
+
+void flow_transport_init(FlowTransport *flow, FlowMode mode, const FlowLink *link) {
+    memset(flow, 0, sizeof(*flow));
+    flow->transport.send_command = flow_send_command;
+    flow->transport.state = flow;
+    flow->transport.metrics = NULL;
+    flow->transport.drain = flow_drain;
+    flow->transport.pending = flow_pending;
+    flow->link = *link;
+    flow->mode = mode;
+    flow->window = FLOW_RX_BUFFER - 1;
+    flow->batch_limit = 1;
+    flow->planner_free = flow->rx_free = -1;
+}
+
+void flow_transport_init_port(FlowTransport *flow, FlowMode mode, int port) {
+    FlowLink link = { port_write, port_read, NULL };
+    flow_transport_init(flow, mode, &link);
+    flow->port = port;
+    flow->link.link = &flow->port;
+}
+
+int parse_flow_mode(const char *name, FlowMode *mode) {
+    if (strcmp(name, "fixed") == 0) {
+        *mode = FLOW_FIXED;
+    } else if (strcmp(name, "adaptive") == 0) {
+        *mode = FLOW_ADAPTIVE;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+void flow_print_summary(const FlowTransport *flow, const char *label) {
+    double acked = (double)(flow->lines - flow->count);
+    printf("%s: %s flow control, %lu lines, ack latency mean %.2f ms max %.2f ms, %lu errors; "
+           "%lu status reports, window %lu bytes (widened %lu, narrowed %lu times)\n", label,
+           flow->mode == FLOW_ADAPTIVE ? "adaptive" : "fixed", flow->lines,
+           acked > 0 ? flow->latency_total_ns / acked / 1e6 : 0.0, flow->latency_max_ns / 1e6, flow->errors,
+           flow->status_reports, (unsigned long)flow->window, flow->widened, flow->narrowed);
+}
@@ -0,0 +1,134 @@
+/**
+ * @file flow.h
+ * @brief Streaming transport with fixed or adaptive flow control
+ *
+ * Instead of waiting for each "ok", the streaming transport keeps several
+ * lines in flight and counts the bytes the controller has not acknowledged
+ * yet (Grbl's character-counting protocol), so the planner is refilled while
+ * the robot moves.
+ *
+ * FLOW_FIXED always fills the controller's receive buffer. FLOW_ADAPTIVE
+ * polls the status report ('?') while lines are in flight and reads its Bf
+ * field (planner blocks and receive buffer bytes free; enable it with Grbl's
+ * $10 buffer bit). While the planner runs low it widens the window and
+ * sends every line at once; while lines wait in the receive buffer behind a
+ * full planner it narrows the window, keeping later commands on the host,
+ * and collects several lines per write. Without Bf fields it behaves like
+ * FLOW_FIXED.
+ *
+ * Lines in flight cannot be matched to a late reply or replayed after an
+ * alarm, so a streamed job stops on an alarm or an acknowledgement timeout
+ * (see recovery.h) and is continued with --resume; error replies are counted
+ * and the job goes on.
+ */
+
+#ifndef FLOW_H
+#define FLOW_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "transport.h"
+
+/**
+ * @brief Controller buffers (Grbl 1.1 defaults)
+ */
+#define FLOW_RX_BUFFER 128              // Serial receive buffer in bytes; one byte stays free
+#define FLOW_MAX_IN_FLIGHT 64           // Lines sent but not yet acknowledged
+
+/**
+ * @brief Adaptive window tuning
+ */
+#define FLOW_MIN_WINDOW 32              // Bytes; a longer line is still sent once nothing is in flight
+#define FLOW_WINDOW_STEP 16             // Bytes added or removed per status report
+#define FLOW_PLANNER_SLACK 2            // More free planner blocks than this: the planner is running dry
+#define FLOW_RX_QUEUED_HIGH 48          // More bytes waiting in the receive buffer than this: too far ahead
+#define FLOW_MAX_BATCH 8                // Lines collected per write while the planner is full
+#define FLOW_STATUS_INTERVAL_MS 50      // Status polling period while lines are in flight
+
+/**
+ * @brief How the streaming window is sized
+ */
+typedef enum {
+    FLOW_FIXED = 0,
+    FLOW_ADAPTIVE
+} FlowMode;
+
+/**
+ * @brief Byte stream to the controller
+ */
+typedef struct {
+    int (*write)(void *link, const char *data, size_t length);     // 0 once every byte is written
+    int (*read)(void *link, char *buffer, size_t size);             // Bytes read, 0 if none yet, -1 on failure
+    void *link;
+} FlowLink;
+
+/**
+ * @brief Streaming transport and its statistics
+ */
+typedef struct {
+    Transport transport;
+    FlowLink link;
+    int port;                               // For flow_transport_init_port()
+    FlowMode mode;
+    size_t window;                          // Unacknowledged bytes allowed
+    int batch_limit;                        // Lines collected before a write
+    size_t lengths[FLOW_MAX_IN_FLIGHT];     // Unacknowledged lines, oldest at head
+    uint64_t queued_ns[FLOW_MAX_IN_FLIGHT];
+    size_t head;
+    size_t count;                           // Lines written or batched, not yet acknowledged
+    size_t batched;                         // The newest of them, still in batch
+    char batch[FLOW_RX_BUFFER];
+    size_t batch_bytes;
+    size_t wire_bytes;                      // Bytes written and not yet acknowledged
+    char reply[128];                        // Reply line being assembled
+    size_t reply_length;
+    int planner_free;                       // From the last status report, -1 before the first
+    int rx_free;
+    uint64_t status_requested_ns;           // When the last '?' was sent
+    int status_pending;                     // Its answer has not arrived yet
+    int failed;                             // The controller raised an alarm or stopped answering
+    unsigned long lines;
+    unsigned long errors;                   // "error:" replies
+    unsigned long status_reports;
+    unsigned long widened;
+    unsigned long narrowed;
+    uint64_t latency_total_ns;              // Queued to acknowledged, summed over lines
+    uint64_t latency_max_ns;
+} FlowTransport;
+
+/**
+ * @brief Initialises a streaming transport over a byte stream
+ *
+ * @param flow Transport to initialise
+ * @param mode Fixed or adaptive window
+ * @param link Byte stream to the controller
+ */
+void flow_transport_init(FlowTransport *flow, FlowMode mode, const FlowLink *link);
+
+/**
+ * @brief Initialises a streaming transport on a robot port (WriteToPort/ReadFromPort)
+ *
+ * @param flow Transport to initialise
+ * @param mode Fixed or adaptive window
+ * @param port COM number minus 1
+ */
+void flow_transport_init_port(FlowTransport *flow, FlowMode mode, int port);
+
+/**
+ * @brief Parses "fixed" or "adaptive"
+ *
+ * @param name Mode name
+ * @param mode Receives the mode
+ * @return int 0 on success, -1 for an unknown name
+ */
+int parse_flow_mode(const char *name, FlowMode *mode);
+
+/**
+ * @brief Prints line count, acknowledgement latency and window changes
+ *
+ * @param flow Transport after a run
+ * @param label Robot label
+ */
+void flow_print_summary(const FlowTransport *flow, const char *label);
+
+#endif // FLOW_H
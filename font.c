@@ -2,30 +2,59 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include "rs232.h"
+#include <math.h>
 #include "font.h"
-#include "serial.h"
+#include "hash.h"
+#include "pargen.h"
+#include "trace.h"
 
 
-CharacterData font_data[MAX_CHARACTERS];
+// Tables of a font without glyphs
+static const uint16_t empty_direct[FONT_DIRECT_CODES];
+static const uint32_t empty_displacements[2];
+static const FontSlot empty_slots[1];
+
+// Font and generator behind the single-job API (load_font_file(), place_glyph(), ...)
+static Font loaded_font = { NULL, empty_direct, empty_displacements, empty_slots, 31, 0, 0, HASH_INIT, NULL, NULL };
+static int font_loaded = 0;
+static Generator default_generator = { .font = &loaded_font, .pen_state = -1 };
+
+// Glyphs of a font file as read, before they are compiled into an image
+typedef struct {
+    CharacterData *glyphs;
+    size_t count;
+    size_t capacity;
+    uint64_t hash;
+} FontSource;
 
 // Initialize font data array
-void initialize_font_data(void) {
-    for (int i = 0; i < MAX_CHARACTERS; i++) {
-        font_data[i].ascii_code = i;
-        font_data[i].num_movements = 0;
-    }
+void initialize_font_data(Font *font) {
+    font->glyphs = NULL;
+    font->direct = empty_direct;
+    font->displacements = empty_displacements;
+    font->slots = empty_slots;
+    font->bucket_shift = 31;
+    font->slot_mask = 0;
+    font->glyph_count = 0;
+    font->hash = HASH_INIT;
+    font->image = NULL;
+    font->owned = NULL;
 }
 
 // Process character movement data from file
-int process_character_movements(FILE* file, int ascii_code, int num_movements) {
+int process_character_movements(CharacterData *char_data, FILE* file, uint64_t *hash) {
     char line[256];
-    
-    for (int i = 0; i < num_movements; i++) {
+
+    if (char_data->num_movements < 0 || char_data->num_movements > MAX_MOVEMENTS) {
+        DEBUG_LOG("Error: Character %d has %d movements\n", char_data->code, char_data->num_movements);
+        return -1;
+    }
+    for (int i = 0; i < char_data->num_movements; i++) {
         if (fgets(line, sizeof(line), file) == NULL) {
             DEBUG_LOG("Error: Unexpected end of file\n");
             return -1;
         }
+        *hash = hash_bytes(*hash, line, strlen(line));
 
         int x, y, pen;
         if (sscanf(line, "%d %d %d", &x, &y, &pen) != 3) {
@@ -33,43 +62,57 @@ int process_character_movements(FILE* file, int ascii_code, int num_movements) {
             return -1;
         }
 
-        font_data[ascii_code].movements[i].x = x;
-        font_data[ascii_code].movements[i].y = y;
-        font_data[ascii_code].movements[i].pen = pen;
-        
+        char_data->movements[i].x = x;
+        char_data->movements[i].y = y;
+        char_data->movements[i].pen = pen;
+
         DEBUG_LOG("  Movement %d: X=%d, Y=%d, Pen=%d\n", i, x, y, pen);
     }
     return 0;
 }
 
-int load_font_file(const char *filename) {
+// Parse a font file into source
+static int read_font_source(FontSource *source, const char *filename) {
     DEBUG_LOG("Opening font file: %s\n", filename);
-    
+
+    // Cleared first so the caller can free the glyphs whatever happens
+    memset(source, 0, sizeof(*source));
+    source->hash = HASH_INIT;
+
     FILE *file = fopen(filename, "r");
     if (!file) {
         DEBUG_LOG("Error: Could not open font file %s\n", filename);
         return -1;
     }
 
-    initialize_font_data();
-
     char line[256];
-    int ascii_code, num_movements;
+    int code, num_movements;
 
     while (fgets(line, sizeof(line), file) != NULL) {
-        if (sscanf(line, "999 %d %d", &ascii_code, &num_movements) == 2) {
-            DEBUG_LOG("Reading character ASCII %d with %d movements\n", ascii_code, num_movements);
+        source->hash = hash_bytes(source->hash, line, strlen(line));
+        if (sscanf(line, "999 %d %d", &code, &num_movements) == 2) {
+            DEBUG_LOG("Reading character %d with %d movements\n", code, num_movements);
 
-            if (ascii_code < 0 || ascii_code >= MAX_CHARACTERS) {
-                DEBUG_LOG("Error: Invalid ASCII code %d\n", ascii_code);
+            if (code < 0 || code > FONT_MAX_CODE) {
+                DEBUG_LOG("Error: Invalid code point %d\n", code);
                 fclose(file);
                 return -1;
             }
-            
-            font_data[ascii_code].ascii_code = ascii_code;
-            font_data[ascii_code].num_movements = num_movements;
+            if (source->count == source->capacity) {
+                size_t grown = source->capacity ? source->capacity * 2 : MAX_CHARACTERS;
+                CharacterData *glyphs = realloc(source->glyphs, grown * sizeof(*glyphs));
+                if (!glyphs) {
+                    fclose(file);
+                    return -1;
+                }
+                source->glyphs = glyphs;
+                source->capacity = grown;
+            }
 
-            if (process_character_movements(file, ascii_code, num_movements) != 0) {
+            CharacterData *char_data = &source->glyphs[source->count++];
+            char_data->code = code;
+            char_data->num_movements = num_movements;
+            if (process_character_movements(char_data, file, &source->hash) != 0) {
                 fclose(file);
                 return -1;
             }
@@ -81,98 +124,890 @@ int load_font_file(const char *filename) {
     return 0;
 }
 
-int print_gcode_for_character(int ascii_code, float scale_factor, float x_offset, float y_offset) {
-    char buffer[100];
-    
-    if (ascii_code < 0 || ascii_code >= MAX_CHARACTERS || font_data[ascii_code].num_movements == 0) {
-        DEBUG_LOG("Error: Invalid ASCII code or no movements for character %d\n", ascii_code);
+static uint32_t bucket_hash(uint32_t code) {
+    return code * 0x9e3779b1u;
+}
+
+static uint32_t slot_hash(uint32_t code) {
+    code = (code ^ (code >> 16)) * 0x85ebca6bu;
+    return code ^ (code >> 13);
+}
+
+static int compare_keys(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Give every bucket a displacement that sends its code points to free, distinct slots
+static int displace(const CharacterData *glyphs, const uint64_t *members, size_t member_count,
+                    uint32_t *displacements, FontSlot *slots, uint32_t bucket_bits, uint32_t slot_bits) {
+    uint32_t slot_mask = (1u << slot_bits) - 1;
+    uint32_t bucket_count = 1u << bucket_bits;
+    uint64_t *order = malloc(bucket_count * sizeof(*order));
+    size_t *first = calloc(bucket_count + 1, sizeof(*first));
+    if (!order || !first) {
+        free(order);
+        free(first);
+        return -1;
+    }
+
+    // members is sorted by bucket: find where each bucket starts, then place the largest buckets first
+    for (size_t i = 0; i < member_count; i++) {
+        first[(members[i] >> 32) + 1]++;
+    }
+    for (uint32_t b = 0; b < bucket_count; b++) {
+        first[b + 1] += first[b];
+        order[b] = ((uint64_t)(UINT32_MAX - (first[b + 1] - first[b])) << 32) | b;
+    }
+    qsort(order, bucket_count, sizeof(*order), compare_keys);
+
+    int result = 0;
+    for (uint32_t k = 0; k < bucket_count && result == 0; k++) {
+        uint32_t b = (uint32_t)order[k];
+        size_t size = first[b + 1] - first[b];
+        uint32_t d;
+        for (d = 0; d < FONT_MAX_DISPLACEMENT; d++) {
+            size_t placed = 0;
+            for (; placed < size; placed++) {
+                uint32_t glyph = (uint32_t)members[first[b] + placed];
+                FontSlot *slot = &slots[(slot_hash((uint32_t)glyphs[glyph].code) ^ d) & slot_mask];
+                if (slot->glyph) {
+                    break;
+                }
+                slot->code = (uint32_t)glyphs[glyph].code;
+                slot->glyph = glyph + 1;
+            }
+            if (placed == size) {
+                break;
+            }
+            // Undo the partial placement and try the next displacement
+            while (placed-- > 0) {
+                uint32_t glyph = (uint32_t)members[first[b] + placed];
+                FontSlot *slot = &slots[(slot_hash((uint32_t)glyphs[glyph].code) ^ d) & slot_mask];
+                slot->code = slot->glyph = 0;
+            }
+        }
+        displacements[b] = d;
+        result = d < FONT_MAX_DISPLACEMENT ? 0 : -1;
+    }
+    free(order);
+    free(first);
+    return result;
+}
+
+// Bounding box of every point a glyph moves to, in font units
+static void measure_glyph(CharacterData *glyph) {
+    glyph->min_x = glyph->min_y = glyph->max_x = glyph->max_y = 0;
+    for (int i = 0; i < glyph->num_movements; i++) {
+        const Movement *mov = &glyph->movements[i];
+        if (i == 0 || mov->x < glyph->min_x) {
+            glyph->min_x = mov->x;
+        }
+        if (i == 0 || mov->x > glyph->max_x) {
+            glyph->max_x = mov->x;
+        }
+        if (i == 0 || mov->y < glyph->min_y) {
+            glyph->min_y = mov->y;
+        }
+        if (i == 0 || mov->y > glyph->max_y) {
+            glyph->max_y = mov->y;
+        }
+    }
+}
+
+// Compile the glyphs read from a font file into one image; a code point defined twice keeps its last glyph
+static FontImage *compile_font_image(const FontSource *source) {
+    uint64_t *keys = malloc((source->count + 1) * sizeof(*keys));
+    if (!keys) {
+        return NULL;
+    }
+    for (size_t i = 0; i < source->count; i++) {
+        keys[i] = ((uint64_t)source->glyphs[i].code << 32) | i;
+    }
+    qsort(keys, source->count, sizeof(*keys), compare_keys);
+    size_t glyph_count = 0, hashed = 0;
+    for (size_t i = 0; i < source->count; i++) {
+        if (i + 1 == source->count || keys[i + 1] >> 32 != keys[i] >> 32) {
+            keys[glyph_count++] = keys[i];
+            hashed += (keys[i] >> 32) >= FONT_DIRECT_CODES;
+        }
+    }
+    if (glyph_count > FONT_MAX_GLYPHS) {
+        DEBUG_LOG("Error: Font has more than %d glyphs\n", FONT_MAX_GLYPHS);
+        free(keys);
+        return NULL;
+    }
+
+    uint32_t bucket_bits = 1, slot_bits = 1;
+    while ((1u << bucket_bits) * FONT_BUCKET_LOAD < hashed) {
+        bucket_bits++;
+    }
+    while ((1u << slot_bits) < 2 * hashed) {
+        slot_bits++;
+    }
+
+    FontImage *image = NULL;
+    uint64_t *members = malloc((hashed + 1) * sizeof(*members));
+    for (int attempt = 0; members && attempt < 4; attempt++, slot_bits++) {
+        size_t glyphs_offset = (sizeof(FontImage) + 7) & ~(size_t)7;
+        size_t direct_offset = glyphs_offset + glyph_count * sizeof(CharacterData);
+        size_t displacements_offset = (direct_offset + FONT_DIRECT_CODES * sizeof(uint16_t) + 7) & ~(size_t)7;
+        size_t slots_offset = displacements_offset + ((size_t)1 << bucket_bits) * sizeof(uint32_t);
+        size_t size = (slots_offset + ((size_t)1 << slot_bits) * sizeof(FontSlot) + 7) & ~(size_t)7;
+        image = calloc(1, size);
+        if (!image) {
+            break;
+        }
+        image->hash = source->hash;
+        image->size = (uint32_t)size;
+        image->glyph_count = (uint32_t)glyph_count;
+        image->glyphs_offset = (uint32_t)glyphs_offset;
+        image->direct_offset = (uint32_t)direct_offset;
+        image->displacements_offset = (uint32_t)displacements_offset;
+        image->slots_offset = (uint32_t)slots_offset;
+        image->bucket_bits = bucket_bits;
+        image->slot_bits = slot_bits;
+        image->glyph_size = sizeof(CharacterData);
+
+        char *base = (char *)image;
+        CharacterData *glyphs = (CharacterData *)(base + glyphs_offset);
+        uint16_t *direct = (uint16_t *)(base + direct_offset);
+        size_t member_count = 0;
+        for (size_t g = 0; g < glyph_count; g++) {
+            glyphs[g] = source->glyphs[(uint32_t)keys[g]];
+            measure_glyph(&glyphs[g]);
+            if (glyphs[g].code < FONT_DIRECT_CODES) {
+                direct[glyphs[g].code] = (uint16_t)(g + 1);
+            } else {
+                uint64_t bucket = bucket_hash((uint32_t)glyphs[g].code) >> (32 - bucket_bits);
+                members[member_count++] = (bucket << 32) | g;
+            }
+        }
+        qsort(members, member_count, sizeof(*members), compare_keys);
+        if (displace(glyphs, members, member_count, (uint32_t *)(base + displacements_offset),
+                     (FontSlot *)(base + slots_offset), bucket_bits, slot_bits) == 0) {
+            break;
+        }
+        // Rare: some bucket found no free slots; retry with a table twice the size
+        free(image);
+        image = NULL;
+    }
+    free(members);
+    free(keys);
+    return image;
+}
+
+// Parse and compile a font file into font, which owns the image
+static int read_font_file(Font *font, const char *filename) {
+    FontSource source;
+    FontImage *image = NULL;
+    if (read_font_source(&source, filename) == 0) {
+        image = compile_font_image(&source);
+    }
+    free(source.glyphs);
+    if (!image || font_attach(font, image, image->size) != 0) {
+        free(image);
+        return -1;
+    }
+    font->owned = image;
+    return 0;
+}
+
+// Every index the lookups and the generator follow must stay inside the image
+static int check_glyph_tables(const Font *font) {
+    for (int i = 0; i < FONT_DIRECT_CODES; i++) {
+        if (font->direct[i] > font->glyph_count) {
+            return -1;
+        }
+    }
+    for (uint32_t i = 0; i <= font->slot_mask; i++) {
+        if (font->slots[i].glyph > (uint32_t)font->glyph_count) {
+            return -1;
+        }
+    }
+    for (int i = 0; i < font->glyph_count; i++) {
+        if (font->glyphs[i].num_movements < 0 || font->glyphs[i].num_movements > MAX_MOVEMENTS) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int font_attach(Font *font, const void *image, size_t size) {
+    const FontImage *header = image;
+    if (((uintptr_t)image & 7) != 0 || size < sizeof(*header) || header->size > size ||
+        header->glyph_size != sizeof(CharacterData) ||
+        header->glyph_count > FONT_MAX_GLYPHS || header->bucket_bits < 1 || header->bucket_bits > 31 ||
+        header->slot_bits < 1 || header->slot_bits > 31 ||
+        header->glyphs_offset + (size_t)header->glyph_count * sizeof(CharacterData) > header->size ||
+        header->direct_offset + FONT_DIRECT_CODES * sizeof(uint16_t) > header->size ||
+        header->displacements_offset + ((size_t)1 << header->bucket_bits) * sizeof(uint32_t) > header->size ||
+        header->slots_offset + ((size_t)1 << header->slot_bits) * sizeof(FontSlot) > header->size) {
+        DEBUG_LOG("Error: Not a compiled font of this build\n");
+        return -1;
+    }
+    const char *base = image;
+    font->glyphs = (const CharacterData *)(base + header->glyphs_offset);
+    font->direct = (const uint16_t *)(base + header->direct_offset);
+    font->displacements = (const uint32_t *)(base + header->displacements_offset);
+    font->slots = (const FontSlot *)(base + header->slots_offset);
+    font->bucket_shift = 32 - (int)header->bucket_bits;
+    font->slot_mask = (1u << header->slot_bits) - 1;
+    font->glyph_count = (int)header->glyph_count;
+    font->hash = header->hash;
+    font->image = header;
+    font->owned = NULL;
+    if (check_glyph_tables(font) != 0) {
+        DEBUG_LOG("Error: Compiled font has glyph indexes or movement counts out of range\n");
+        return -1;
+    }
+    return 0;
+}
+
+const CharacterData *font_glyph(const Font *font, int code) {
+    uint32_t index;
+    if ((uint32_t)code < FONT_DIRECT_CODES) {
+        index = font->direct[code];
+    } else {
+        uint32_t displacement = font->displacements[bucket_hash((uint32_t)code) >> font->bucket_shift];
+        const FontSlot *slot = &font->slots[(slot_hash((uint32_t)code) ^ displacement) & font->slot_mask];
+        index = slot->code == (uint32_t)code ? slot->glyph : 0;
+    }
+    return index ? &font->glyphs[index - 1] : NULL;
+}
+
+int load_font_file(const char *filename) {
+    Font font;
+    int result = read_font_file(&font, filename);
+    free(loaded_font.owned);
+    if (result == 0) {
+        loaded_font = font;
+    } else {
+        initialize_font_data(&loaded_font);
+    }
+    font_loaded = result == 0;
+    return result;
+}
+
+void use_font(const Font *font) {
+    if (font != &loaded_font) {
+        free(loaded_font.owned);
+        loaded_font = *font;
+        loaded_font.owned = NULL;
+    }
+    font_loaded = 1;
+}
+
+uint64_t get_font_hash(void) {
+    return loaded_font.hash;
+}
+
+const Font *get_loaded_font(void) {
+    return font_loaded ? &loaded_font : NULL;
+}
+
+Font *font_load(const char *filename) {
+    Font *font = malloc(sizeof(*font));
+    if (font && read_font_file(font, filename) != 0) {
+        free(font);
+        font = NULL;
+    }
+    return font;
+}
+
+void font_free(Font *font) {
+    if (font) {
+        free(font->owned);
+    }
+    free(font);
+}
+
+int font_export_core(const Font *font, const char *path) {
+    int total = 0;
+    for (int c = 0; c < MAX_CHARACTERS; c++) {
+        const CharacterData *char_data = font_glyph(font, c);
+        for (int i = 0; char_data && i < char_data->num_movements; i++) {
+            const Movement *mov = &char_data->movements[i];
+            if (mov->x < -128 || mov->x > 127 || mov->y < -64 || mov->y > 63 || (mov->pen != 0 && mov->pen != 1)) {
+                DEBUG_LOG("Error: Movement %d of character %d does not fit the core font table\n", i, c);
+                return -1;
+            }
+        }
+        total += char_data ? char_data->num_movements : 0;
+    }
+
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        DEBUG_LOG("Error: Could not create %s\n", path);
+        return -1;
+    }
+    fprintf(file, "// corefont.c\n"
+                  "// Generated by robotwriter --export-core-font from the font file with hash\n"
+                  "// %016llx; do not edit. %d movements, see CoreFont in core.h.\n"
+                  "#include \"core.h\"\n\n"
+                  "static const uint16_t glyph_index[CORE_FONT_GLYPHS + 1] = {",
+            (unsigned long long)font->hash, total);
+    int offset = 0;
+    for (int c = 0; c <= MAX_CHARACTERS; c++) {
+        fprintf(file, "%s%d,", c % 16 ? " " : "\n    ", offset);
+        const CharacterData *char_data = c < MAX_CHARACTERS ? font_glyph(font, c) : NULL;
+        offset += char_data ? char_data->num_movements : 0;
+    }
+    fprintf(file, "\n};\n\nstatic const int8_t glyph_strokes[%d] = {\n", 2 * total);
+    for (int c = 0; c < MAX_CHARACTERS; c++) {
+        const CharacterData *char_data = font_glyph(font, c);
+        if (!char_data || char_data->num_movements == 0) {
+            continue;
+        }
+        if (c > 32 && c < 127) {
+            fprintf(file, "    // %d '%c'\n   ", c, c);
+        } else {
+            fprintf(file, "    // %d\n   ", c);
+        }
+        for (int i = 0; i < char_data->num_movements; i++) {
+            const Movement *mov = &char_data->movements[i];
+            fprintf(file, "%s %d, %d,", i > 0 && i % 10 == 0 ? "\n   " : "", mov->x, mov->y * 2 + mov->pen);
+        }
+        fprintf(file, "\n");
+    }
+    fprintf(file, "};\n\n"
+                  "_Static_assert(sizeof(glyph_index) + sizeof(glyph_strokes) <= CORE_FONT_BUDGET,\n"
+                  "               \"Font table exceeds CORE_FONT_BUDGET\");\n\n"
+                  "const CoreFont core_font = { glyph_index, glyph_strokes, 0x%016llxULL };\n",
+            (unsigned long long)font->hash);
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+float font_character_width(const Font *font, int code, float scale_factor) {
+    const CharacterData *char_data = font_glyph(font, code);
+    if (!char_data || char_data->num_movements == 0) {
+        return 0.0f;
+    }
+
+    int last_idx = char_data->num_movements - 1;
+    return char_data->movements[last_idx].x * scale_factor;
+}
+
+void generator_init(Generator *generator, const Font *font, const OpSink *sink) {
+    memset(generator, 0, sizeof(*generator));
+    generator->font = font;
+    if (sink) {
+        generator->sink = *sink;
+    }
+    generator->pen_state = -1;
+    feed_limits_init(&generator->feed_limits);
+    pen_timing_init(&generator->pen_timing);
+}
+
+void generator_free(Generator *generator) {
+    free(generator->line_glyphs);
+    free(generator->recorded);
+    free(generator->page_marks);
+    generator->line_glyphs = NULL;
+    generator->recorded = NULL;
+    generator->page_marks = NULL;
+    generator->line_count = generator->line_capacity = 0;
+    generator->recorded_count = generator->recorded_capacity = 0;
+    generator->page_mark_count = generator->page_mark_capacity = 0;
+}
+
+int generator_send_op(Generator *generator, const MotionOp *op) {
+    if (generator->sink.emit && generator->sink.emit(generator->sink.user_data, op) != 0) {
+        generator->sink_failed = 1;
+        return -1;
+    }
+    if (generator->pen_timing.enabled) {
+        MotionOp dwell = { IR_DWELL, pen_timer_dwell(&generator->pen_timer, op), 0 };
+        if (dwell.x > 0) {
+            return generator_send_op(generator, &dwell);
+        }
+    }
+    return 0;
+}
+
+static void emit_op(Generator *generator, int code, int32_t x, int32_t y) {
+    MotionOp op = { code, x, y };
+    generator_send_op(generator, &op);
+}
+
+static void send_pen(Generator *generator, int down) {
+    if (generator->pen_state != down) {
+        emit_op(generator, IR_PEN, down, 0);
+        generator->pen_state = down;
+    }
+}
+
+// Send the deferred pen lift and pen-up move, if it goes anywhere
+static void flush_travel(Generator *generator) {
+    if (generator->lift_pending) {
+        send_pen(generator, 0);
+        generator->lift_pending = 0;
+    }
+    if (generator->travel_pending &&
+        (generator->travel_x != generator->pen_x || generator->travel_y != generator->pen_y)) {
+        emit_op(generator, IR_TRAVEL, mm_to_microns(generator->travel_x), mm_to_microns(generator->travel_y));
+        generator->pen_x = generator->travel_x;
+        generator->pen_y = generator->travel_y;
+    }
+    generator->travel_pending = 0;
+}
+
+// Keep the pen down from the lift point to the start of the next glyph's first stroke
+static int join_stroke(Generator *generator) {
+    float distance = hypotf(generator->travel_x - generator->pen_x, generator->travel_y - generator->pen_y);
+    if (!generator->join_open || !generator->travel_pending || distance > generator->join_distance) {
+        return 0;
+    }
+    if (distance > 0.0f) {
+        emit_op(generator, IR_DRAW, mm_to_microns(generator->travel_x), mm_to_microns(generator->travel_y));
+        generator->pen_x = generator->travel_x;
+        generator->pen_y = generator->travel_y;
+    }
+    generator->lift_pending = generator->travel_pending = 0;
+    generator->joins++;
+    return 1;
+}
+
+// Pen-up moves are deferred so a run of them collapses into the last one; feed 0 keeps the current feed.
+// With joining, the pen lift is deferred too, until the next stroke shows whether it is needed.
+static void generate_movement(Generator *generator, int pen, float x, float y, int32_t feed) {
+    if (!pen) {
+        if (generator->join_distance > 0.0f && generator->pen_state == 1) {
+            generator->lift_pending = 1;
+        } else if (!generator->lift_pending) {
+            send_pen(generator, 0);
+        }
+        generator->travel_pending = 1;
+        generator->travel_x = x;
+        generator->travel_y = y;
+        return;
+    }
+    if (!generator->lift_pending || !join_stroke(generator)) {
+        flush_travel(generator);
+    }
+    generator->join_open = 0;
+    send_pen(generator, 1);
+    if (feed > 0 && feed != generator->feed) {
+        emit_op(generator, IR_FEED, feed, 0);
+        generator->feed = feed;
+    }
+    emit_op(generator, IR_DRAW, mm_to_microns(x), mm_to_microns(y));
+    generator->pen_x = x;
+    generator->pen_y = y;
+}
+
+// Cosine of the turn between segments (ax, ay) and (bx, by); 1 if either has no length
+static float turn_cosine(float ax, float ay, float bx, float by) {
+    float lengths = hypotf(ax, ay) * hypotf(bx, by);
+    return lengths > 0.0f ? (ax * bx + ay * by) / lengths : 1.0f;
+}
+
+// Feed of the pen-down movement i of a glyph, from its segment and the segments it joins
+static int32_t movement_feed(const Generator *generator, const CharacterData *char_data, int i, float scale_factor) {
+    const Movement *mov = char_data->movements;
+    if (!generator->feed_limits.enabled || i == 0) {
+        return 0;
+    }
+    float dx = (float)(mov[i].x - mov[i - 1].x), dy = (float)(mov[i].y - mov[i - 1].y);
+    float turn_in = 1.0f, turn_out = 1.0f;
+    if (i >= 2 && mov[i - 1].pen) {
+        turn_in = turn_cosine((float)(mov[i - 1].x - mov[i - 2].x), (float)(mov[i - 1].y - mov[i - 2].y), dx, dy);
+    }
+    if (i + 1 < char_data->num_movements && mov[i + 1].pen) {
+        turn_out = turn_cosine(dx, dy, (float)(mov[i + 1].x - mov[i].x), (float)(mov[i + 1].y - mov[i].y));
+    }
+    return plan_segment_feed(&generator->feed_limits, hypotf(dx, dy) * scale_factor, turn_in, turn_out,
+                             18.0f * scale_factor);
+}
+
+// Generate a glyph across the edge of the work area: pen-down moves are clipped at the edge and
+// pen-up moves go to the nearest point inside; returns the number of pen-down moves kept
+static int generate_clipped_glyph(Generator *generator, const CharacterData *char_data, float scale_factor,
+                                  float x_offset, float y_offset) {
+    const WorkArea *area = &generator->work_area;
+    float last_x = generator->travel_pending ? generator->travel_x : generator->pen_x;
+    float last_y = generator->travel_pending ? generator->travel_y : generator->pen_y;
+    int kept = 0;
+
+    for (int i = 0; i < char_data->num_movements; i++) {
+        const Movement *mov = &char_data->movements[i];
+        float x = (float)mov->x * scale_factor + x_offset;
+        float y = (float)mov->y * scale_factor + y_offset;
+        float start_x = last_x, start_y = last_y;
+        float x0 = last_x, y0 = last_y, x1 = x, y1 = y;
+        last_x = x;
+        last_y = y;
+
+        int clip = WORK_AREA_OUTSIDE;
+        if (mov->pen && isfinite(x0) && isfinite(y0)) {
+            clip = work_area_clip(area, &x0, &y0, &x1, &y1);
+        } else if (mov->pen) {
+            // Where the pen starts is not known (a parallel chunk): keep the move if it ends inside
+            clip = work_area_box(area, x, y, x, y);
+        }
+        if (clip == WORK_AREA_CLIPPED && fabsf(x1 - x0) < 0.001f && fabsf(y1 - y0) < 0.001f) {
+            // All that is left of a stroke that grazes the edge is under 1 µm: nothing to draw
+            clip = WORK_AREA_OUTSIDE;
+        }
+        if (clip == WORK_AREA_OUTSIDE) {
+            generator->dropped_strokes += mov->pen ? 1 : 0;
+            work_area_clamp(area, &x1, &y1);
+            generate_movement(generator, 0, x1, y1, 0);
+            continue;
+        }
+        if (clip == WORK_AREA_CLIPPED) {
+            generator->clipped_strokes++;
+            if (x0 != start_x || y0 != start_y) {
+                // Enters from outside: lift and travel to where it crosses the edge
+                generate_movement(generator, 0, x0, y0, 0);
+            }
+        }
+        generate_movement(generator, 1, x1, y1, movement_feed(generator, char_data, i, scale_factor));
+        kept++;
+    }
+    return kept;
+}
+
+int generator_print_character(Generator *generator, int code, float scale_factor,
+                              float x_offset, float y_offset) {
+    const Font *font = generator->font;
+    const CharacterData *char_data = font_glyph(font, code);
+    if (!char_data || char_data->num_movements == 0) {
+        DEBUG_LOG("Error: No glyph or no movements for character %d\n", code);
         return -1;
     }
 
-    CharacterData *char_data = &font_data[ascii_code];
-    DEBUG_LOG("Generating G-code for ASCII %d ('%c')\n", ascii_code, (char)ascii_code);
+    int placement = WORK_AREA_INSIDE;
+    if (generator->work_area.enabled) {
+        placement = work_area_box(&generator->work_area, (float)char_data->min_x * scale_factor + x_offset,
+                                  (float)char_data->min_y * scale_factor + y_offset,
+                                  (float)char_data->max_x * scale_factor + x_offset,
+                                  (float)char_data->max_y * scale_factor + y_offset);
+        if (placement != WORK_AREA_INSIDE && generator->work_area.fail) {
+            if (!generator->overflowed) {
+                DEBUG_LOG("Error: Character %d at X=%.3f, Y=%.3f leaves the work area\n", code, x_offset, y_offset);
+                generator->overflowed = 1;
+                generator->overflow_x = x_offset;
+                generator->overflow_y = y_offset;
+            }
+            generator->sink_failed = 1;
+            return -1;
+        }
+        if (placement == WORK_AREA_OUTSIDE) {
+            generator->culled_glyphs++;
+            return 0;
+        }
+    }
+
+    TRACE_BEGIN("print_gcode_for_character");
+    if (generator->join_distance > 0.0f) {
+        // Only a lift in the glyph just before, on the same line and touching this one, may be joined
+        float end = x_offset + font_character_width(font, code, scale_factor);
+        generator->join_open = generator->lift_pending && generator->last_glyph_valid &&
+                               generator->last_glyph_y == y_offset &&
+                               (generator->last_glyph_end == x_offset || end == generator->last_glyph_x);
+        generator->last_glyph_valid = 1;
+        generator->last_glyph_x = x_offset;
+        generator->last_glyph_end = end;
+        generator->last_glyph_y = y_offset;
+    }
+    DEBUG_LOG("Generating G-code for character %d\n", code);
 
+    if (placement == WORK_AREA_CLIPPED) {
+        if (generate_clipped_glyph(generator, char_data, scale_factor, x_offset, y_offset) == 0) {
+            generator->culled_glyphs++;
+        }
+        TRACE_END("print_gcode_for_character");
+        return 0;
+    }
     for (int i = 0; i < char_data->num_movements; i++) {
-        Movement *mov = &char_data->movements[i];
+        const Movement *mov = &char_data->movements[i];
         float scaled_x = (float)mov->x * scale_factor + x_offset;
         float scaled_y = (float)mov->y * scale_factor + y_offset;
-        
+
         DEBUG_PRINT_COORDS(scaled_x, scaled_y);
         DEBUG_PRINT_MOVEMENT(mov->pen);
 
-        if (i == 0 || mov->pen != char_data->movements[i-1].pen) {
-            sprintf(buffer, "S%d\n", mov->pen ? 1000 : 0);
-            SendCommands(buffer);
-        }
-
-        sprintf(buffer, "G%d X%.3f Y%.3f\n", mov->pen ? 1 : 0, scaled_x, scaled_y);
-        SendCommands(buffer);
+        generate_movement(generator, mov->pen, scaled_x, scaled_y,
+                          mov->pen ? movement_feed(generator, char_data, i, scale_factor) : 0);
     }
+    TRACE_END("print_gcode_for_character");
     return 0;
 }
 
-float calculate_word_width(const char* word, float scale_factor) {
-    float word_width = 0.0f;
-    for (size_t i = 0; i < strlen(word); i++) {
-        word_width += get_character_width((int)word[i], scale_factor);
+// Pen-up travel to draw a line's glyphs in the given order, starting and ending at (*x, *y)
+static float line_travel(const Generator *generator, int reverse, float *x, float *y) {
+    float travel = 0.0f;
+    int pending = 0;
+    float target_x = 0.0f, target_y = 0.0f;
+    size_t count = generator->line_count;
+
+    for (size_t k = 0; k < count; k++) {
+        const GlyphPlacement *glyph = &generator->line_glyphs[reverse ? count - 1 - k : k];
+        const CharacterData *char_data = font_glyph(generator->font, glyph->code);
+        if (!char_data) {
+            continue;
+        }
+        for (int i = 0; i < char_data->num_movements; i++) {
+            const Movement *mov = &char_data->movements[i];
+            float px = (float)mov->x * glyph->scale_factor + glyph->x_offset;
+            float py = (float)mov->y * glyph->scale_factor + glyph->y_offset;
+            if (!mov->pen) {
+                pending = 1;
+                target_x = px;
+                target_y = py;
+                continue;
+            }
+            if (pending) {
+                travel += hypotf(target_x - *x, target_y - *y);
+                pending = 0;
+            }
+            *x = px;
+            *y = py;
+        }
     }
-    return word_width;
+    return travel;
 }
 
-void update_print_position(float* x_offset, float* y_offset, float word_width, float line_spacing, float max_width) {
-    if (*x_offset + word_width > max_width) {
-        *x_offset = 0.0f;
-        *y_offset -= line_spacing;
-        DEBUG_LOG("New line: Y=%.3f\n", *y_offset);
+// Send the buffered line in whichever glyph order needs less pen-up travel
+static void flush_line(Generator *generator) {
+    size_t count = generator->line_count;
+    if (count == 0) {
+        return;
+    }
+
+    float rx = generator->chosen_x, ry = generator->chosen_y;
+    float fx = generator->chosen_x, fy = generator->chosen_y;
+    float reverse_travel = line_travel(generator, 1, &rx, &ry);
+    float same_start_forward = line_travel(generator, 0, &fx, &fy);
+    int reverse = reverse_travel < same_start_forward;
+
+    if (reverse) {
+        generator->chosen_travel += reverse_travel;
+        generator->chosen_x = rx;
+        generator->chosen_y = ry;
+    } else {
+        generator->chosen_travel += same_start_forward;
+        generator->chosen_x = fx;
+        generator->chosen_y = fy;
+    }
+    generator->forward_travel += line_travel(generator, 0, &generator->forward_x, &generator->forward_y);
+    DEBUG_LOG("Line of %lu glyphs sent %s\n", (unsigned long)count, reverse ? "right-to-left" : "left-to-right");
+
+    for (size_t k = 0; k < count; k++) {
+        const GlyphPlacement *glyph = &generator->line_glyphs[reverse ? count - 1 - k : k];
+        generator_print_character(generator, glyph->code, glyph->scale_factor,
+                                  glyph->x_offset, glyph->y_offset);
     }
+    generator->line_count = 0;
 }
 
-void print_word(const char* word, float scale_factor, float* x_offset, float* y_offset) {
-    for (size_t i = 0; i < strlen(word); i++) {
-        print_gcode_for_character((int)word[i], scale_factor, *x_offset, *y_offset);
-        *x_offset += get_character_width((int)word[i], scale_factor);
-        DEBUG_LOG("Character '%c' width: %.3f, New X offset: %.3f\n", 
-                 word[i], get_character_width((int)word[i], scale_factor), *x_offset);
+// Keep a glyph for generate_recorded_glyphs()
+static void record_glyph(Generator *generator, const GlyphPlacement *placement) {
+    if (generator->recorded_count == generator->recorded_capacity) {
+        size_t capacity = generator->recorded_capacity ? generator->recorded_capacity * 2 : 4096;
+        GlyphPlacement *glyphs = realloc(generator->recorded, capacity * sizeof(GlyphPlacement));
+        if (!glyphs) {
+            generator->sink_failed = 1;
+            return;
+        }
+        generator->recorded = glyphs;
+        generator->recorded_capacity = capacity;
     }
+    generator->recorded[generator->recorded_count++] = *placement;
 }
 
-void process_text_file(const char *filename, float scale_factor) {
-    DEBUG_PRINT_FILE(filename);
-    
-    FILE *file = fopen(filename, "r");
-    if (!file) {
-        DEBUG_LOG("Error: Could not open text file %s\n", filename);
+static void record_page_break(Generator *generator, int next_page) {
+    if (generator->page_mark_count == generator->page_mark_capacity) {
+        size_t capacity = generator->page_mark_capacity ? generator->page_mark_capacity * 2 : 16;
+        PageMark *marks = realloc(generator->page_marks, capacity * sizeof(PageMark));
+        if (!marks) {
+            generator->sink_failed = 1;
+            return;
+        }
+        generator->page_marks = marks;
+        generator->page_mark_capacity = capacity;
+    }
+    PageMark mark = { generator->recorded_count, next_page };
+    generator->page_marks[generator->page_mark_count++] = mark;
+}
+
+// Send a glyph now, or queue it on the current line in serpentine mode
+void generator_place_glyph(Generator *generator, int code, float scale_factor, float x_offset, float y_offset) {
+    if (generator->threads > 1) {
+        GlyphPlacement placement = { code, scale_factor, x_offset, y_offset };
+        record_glyph(generator, &placement);
+        return;
+    }
+    if (!generator->boustrophedon) {
+        generator_print_character(generator, code, scale_factor, x_offset, y_offset);
         return;
     }
+    if (generator->line_count > 0 && y_offset != generator->line_glyphs[0].y_offset) {
+        flush_line(generator);
+    }
+    if (generator->line_count == generator->line_capacity) {
+        size_t capacity = generator->line_capacity ? generator->line_capacity * 2 : 64;
+        GlyphPlacement *glyphs = realloc(generator->line_glyphs, capacity * sizeof(GlyphPlacement));
+        if (!glyphs) {
+            // Out of memory: keep going in plain left-to-right order
+            flush_line(generator);
+            generator_print_character(generator, code, scale_factor, x_offset, y_offset);
+            return;
+        }
+        generator->line_glyphs = glyphs;
+        generator->line_capacity = capacity;
+    }
+    GlyphPlacement placement = { code, scale_factor, x_offset, y_offset };
+    generator->line_glyphs[generator->line_count++] = placement;
+}
 
-    const float TEXT_HEIGHT = 18.0f * scale_factor;
-    const float LINE_SPACING = BASE_LINE_SPACING + TEXT_HEIGHT;
-    const float WORD_SPACING = scale_factor * WORD_SPACING_FACTOR;
-    
-    float x_offset = 0.0f;
-    float y_offset = -TEXT_HEIGHT;
-    
-    DEBUG_LOG("Initial position: X=%.3f, Y=%.3f\n", x_offset, y_offset);
-    DEBUG_LOG("Text height: %.3f, Line spacing: %.3f\n", TEXT_HEIGHT, LINE_SPACING);
+void generator_set_boustrophedon(Generator *generator, int enabled) {
+    generator->boustrophedon = enabled;
+}
+
+void generator_set_threads(Generator *generator, int threads) {
+    generator->threads = threads;
+}
+
+void generator_set_feed_limits(Generator *generator, const FeedLimits *limits) {
+    generator->feed_limits = *limits;
+}
+
+void generator_set_join_distance(Generator *generator, float distance) {
+    generator->join_distance = distance < JOIN_MAX_DISTANCE ? distance : JOIN_MAX_DISTANCE;
+}
 
-    char word[256];
-    while (fscanf(file, "%s", word) != EOF) {
-        float word_width = calculate_word_width(word, scale_factor);
-        update_print_position(&x_offset, &y_offset, word_width, LINE_SPACING, MAX_LINE_WIDTH);
-        print_word(word, scale_factor, &x_offset, &y_offset);
-        x_offset += WORD_SPACING;
-        DEBUG_LOG("Added word spacing: %.3f, New X offset: %.3f\n", WORD_SPACING, x_offset);
+void generator_set_pen_timing(Generator *generator, const PenTiming *timing) {
+    generator->pen_timing = *timing;
+}
+
+void generator_set_work_area(Generator *generator, const WorkArea *area) {
+    generator->work_area = *area;
+}
+
+void generator_reset_position(Generator *generator) {
+    generator->pen_state = -1;
+    generator->pen_x = generator->pen_y = 0.0f;
+    generator->travel_pending = 0;
+    generator->lift_pending = generator->join_open = generator->last_glyph_valid = 0;
+    generator->chosen_x = generator->chosen_y = generator->forward_x = generator->forward_y = 0.0f;
+}
+
+void generator_start(Generator *generator) {
+    generator_reset_position(generator);
+    generator->chosen_travel = generator->forward_travel = 0.0f;
+    generator->feed = 0;
+    generator->joins = 0;
+    generator->culled_glyphs = generator->clipped_strokes = generator->dropped_strokes = 0;
+    generator->overflowed = 0;
+    pen_timer_start(&generator->pen_timer, &generator->pen_timing);
+    generator->sink_failed = 0;
+    generator->recorded_count = generator->page_mark_count = 0;
+}
+
+void generator_flush(Generator *generator) {
+    flush_line(generator);
+    flush_travel(generator);
+}
+
+void generator_page_break(Generator *generator, int next_page) {
+    if (generator->threads > 1) {
+        record_page_break(generator, next_page);
+        return;
     }
+    generator_flush(generator);
+    emit_op(generator, IR_PAGE, next_page, 0);
+    generator_reset_position(generator);
+}
 
-    fclose(file);
+int generator_finish(Generator *generator) {
+    if (generator->threads > 1 && !generator->sink_failed && generate_recorded_glyphs(generator) != 0) {
+        generator->sink_failed = 1;
+    }
+    generator_flush(generator);
+    if (generator->join_distance > 0.0f) {
+        DEBUG_LOG("Stroke joining: %lu pen lifts saved\n", generator->joins);
+    }
+    return generator->sink_failed ? -1 : 0;
 }
 
-float get_character_width(int ascii_code, float scale_factor) {
-    if (ascii_code < 0 || ascii_code >= MAX_CHARACTERS || 
-        font_data[ascii_code].num_movements == 0) {
-        return 0.0f;
+void print_serpentine_savings(const Generator *generator) {
+    if (generator->boustrophedon) {
+        printf("Serpentine line order: %.1f mm pen-up travel, %.1f mm saved\n",
+               generator->chosen_travel, generator->forward_travel - generator->chosen_travel);
+    }
+}
+
+void print_work_area_report(const Generator *generator) {
+    if (generator->overflowed) {
+        printf("Text leaves the work area at X=%.1f, Y=%.1f mm; job stopped\n",
+               generator->overflow_x, generator->overflow_y);
+    } else if (generator->culled_glyphs || generator->clipped_strokes || generator->dropped_strokes) {
+        printf("Work area: %lu glyphs culled, %lu strokes clipped at the edge, %lu dropped\n",
+               generator->culled_glyphs, generator->clipped_strokes, generator->dropped_strokes);
     }
-    
-    int last_idx = font_data[ascii_code].num_movements - 1;
-    return font_data[ascii_code].movements[last_idx].x * scale_factor;
-}
\ No newline at end of file
+}
+
+Generator *get_default_generator(void) {
+    return &default_generator;
+}
+
+int print_gcode_for_character(int code, float scale_factor, float x_offset, float y_offset) {
+    return generator_print_character(&default_generator, code, scale_factor, x_offset, y_offset);
+}
+
+void place_glyph(int code, float scale_factor, float x_offset, float y_offset) {
+    generator_place_glyph(&default_generator, code, scale_factor, x_offset, y_offset);
+}
+
+void set_boustrophedon(int enabled) {
+    generator_set_boustrophedon(&default_generator, enabled);
+}
+
+void set_feed_limits(const FeedLimits *limits) {
+    generator_set_feed_limits(&default_generator, limits);
+}
+
+void set_join_distance(float distance) {
+    generator_set_join_distance(&default_generator, distance);
+}
+
+void set_work_area(const WorkArea *area) {
+    generator_set_work_area(&default_generator, area);
+}
+
+void set_pen_timing(const PenTiming *timing) {
+    generator_set_pen_timing(&default_generator, timing);
+}
+
+void set_generation_sink(const OpSink *sink) {
+    default_generator.sink = *sink;
+}
+
+void reset_generation_position(void) {
+    generator_reset_position(&default_generator);
+}
+
+void start_generation(void) {
+    generator_start(&default_generator);
+}
+
+void flush_generation(void) {
+    generator_flush(&default_generator);
+}
+
+void page_break_generation(int next_page) {
+    generator_page_break(&default_generator, next_page);
+}
+
+int finish_generation(void) {
+    int result = generator_finish(&default_generator);
+    print_serpentine_savings(&default_generator);
+    print_work_area_report(&default_generator);
+    return result;
+}
+
+float get_character_width(int code, float scale_factor) {
+    return font_character_width(&loaded_font, code, scale_factor);
+}
@@ -5,18 +5,48 @@
  * This file contains declarations for structures and functions that handle
  * font loading, character processing, and text-to-GCode conversion for the
  * Robot Writer system.
+ *
+ * A Font is immutable once loaded and may be shared by any number of
+ * threads. A Generator holds the state of one job's motion stream; each
+ * concurrent job needs its own. The functions without a Font or Generator
+ * parameter (load_font_file(), place_glyph(), ...) work on one built-in
+ * font and generator and are for single-job, single-thread use.
+ *
+ * Glyphs are looked up by Unicode code point. A Font is a view of a compiled
+ * font image: the glyphs in code point order, a direct table for the code
+ * points below FONT_DIRECT_CODES and a perfect hash table for the rest
+ * (hash and displace: one displacement per bucket makes every code point's
+ * slot unique), so finding a glyph never probes or searches.
+ * font_load() builds the image on the heap; a font registry (fontreg.h)
+ * keeps several images in one file that every process maps read-only.
  */
 
 #ifndef FONT_HANDLER_H
 #define FONT_HANDLER_H
 
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
 #include "debug.h"
+#include "ir.h"
+#include "feed.h"
+#include "pen.h"
+#include "workarea.h"
 
 /**
- * @brief Maximum number of ASCII characters supported
+ * @brief Number of ASCII codes, the range of the freestanding core (core.h)
  */
 #define MAX_CHARACTERS 128
 
+/**
+ * @brief Code point limits
+ */
+#define FONT_DIRECT_CODES 256       // Code points below this are looked up in a direct table
+#define FONT_MAX_CODE 0x10FFFF      // Highest Unicode code point
+#define FONT_MAX_GLYPHS 65535       // Glyphs in one font
+#define FONT_BUCKET_LOAD 4          // Code points per perfect hash bucket, on average
+#define FONT_MAX_DISPLACEMENT 65536 // Displacements tried for a bucket before the table is made larger
+
 /**
  * @brief Maximum number of movements per character
  * @note Adjust if font requires more complex characters
@@ -24,11 +54,10 @@
 #define MAX_MOVEMENTS 26
 
 /**
- * @brief Text formatting constants for layout control
+ * @brief Largest stroke joining distance in mm
+ * @note About a pen width: a longer connector would add visible ink between letters
  */
-#define BASE_LINE_SPACING 5.0f      // Base spacing between lines in mm
-#define WORD_SPACING_FACTOR 15.0f   // Multiplier for space between words
-#define MAX_LINE_WIDTH 100.0f       // Maximum width of text line in mm
+#define JOIN_MAX_DISTANCE 0.3f
 
 /**
  * @brief Structure to store a single movement command
@@ -46,14 +75,343 @@ typedef struct {
  * @brief Structure to store complete character data
  * 
  * Contains all information needed to draw a single character,
- * including its ASCII code and sequence of movements.
+ * including its code point and sequence of movements.
  */
 typedef struct {
-    int ascii_code;                     // ASCII code of the character
+    int code;                           // Unicode code point of the character
     int num_movements;                  // Number of movements in the character
+    int min_x, min_y, max_x, max_y;     // Box of every movement, set when the font is compiled
     Movement movements[MAX_MOVEMENTS];   // Array of movement commands
 } CharacterData;
 
+/**
+ * @brief Perfect hash table entry for a code point from FONT_DIRECT_CODES up
+ */
+typedef struct {
+    uint32_t code;
+    uint32_t glyph;         // Glyph index + 1, 0 for an empty slot
+} FontSlot;
+
+/**
+ * @brief Header of a compiled font image; all offsets are from its first byte
+ */
+typedef struct {
+    uint64_t hash;              // Hash of every line of the font file
+    uint32_t size;              // Bytes in the image
+    uint32_t glyph_count;
+    uint32_t glyphs_offset;     // CharacterData[glyph_count], in code point order
+    uint32_t direct_offset;     // uint16_t[FONT_DIRECT_CODES]: glyph index + 1, 0 if the font lacks it
+    uint32_t displacements_offset;  // uint32_t[1 << bucket_bits]
+    uint32_t slots_offset;      // FontSlot[1 << slot_bits]
+    uint32_t bucket_bits;
+    uint32_t slot_bits;
+    uint32_t glyph_size;        // sizeof(CharacterData) of the build that compiled it
+} FontImage;
+
+/**
+ * @brief A loaded single-stroke font, a read-only view of a compiled font image
+ */
+typedef struct {
+    const CharacterData *glyphs;    // In code point order
+    const uint16_t *direct;
+    const uint32_t *displacements;
+    const FontSlot *slots;
+    int bucket_shift;               // 32 - bucket_bits
+    uint32_t slot_mask;
+    int glyph_count;
+    uint64_t hash;                  // Hash of every line of the font file
+    const FontImage *image;
+    void *owned;                    // Heap image of font_load(), NULL for a mapped one
+} Font;
+
+/**
+ * @brief A glyph queued on the current line (serpentine order) or recorded for parallel generation
+ */
+typedef struct {
+    int code;
+    float scale_factor;
+    float x_offset;
+    float y_offset;
+} GlyphPlacement;
+
+/**
+ * @brief A page break recorded for parallel generation
+ */
+typedef struct {
+    size_t glyph_index;     // Number of glyphs recorded before the break
+    int next_page;
+} PageMark;
+
+/**
+ * @brief Motion generation state of one job
+ */
+typedef struct {
+    const Font *font;
+    OpSink sink;                    // Where operations go
+    int sink_failed;                // Set if the sink rejected an operation
+    int pen_state;                  // -1 unknown, 0 up, 1 down
+    float pen_x;                    // Last commanded position
+    float pen_y;
+    int travel_pending;             // Pen-up move not yet sent
+    float travel_x;
+    float travel_y;
+    int boustrophedon;              // Serpentine line order
+    GlyphPlacement *line_glyphs;    // Current line, serpentine order only
+    size_t line_count;
+    size_t line_capacity;
+    float chosen_x, chosen_y, chosen_travel;        // Travel of the order actually sent
+    float forward_x, forward_y, forward_travel;     // Travel had every line run left-to-right
+    int threads;                    // Above 1, glyphs are recorded and generated in parallel (pargen.h)
+    GlyphPlacement *recorded;       // Glyphs of the whole job, parallel mode only
+    size_t recorded_count;
+    size_t recorded_capacity;
+    PageMark *page_marks;
+    size_t page_mark_count;
+    size_t page_mark_capacity;
+    FeedLimits feed_limits;         // Per-segment feed planning (feed.h)
+    int32_t feed;                   // Last feed sent, 0 if none yet
+    float join_distance;            // mm; above 0, strokes are joined across glyphs of a word
+    int lift_pending;               // Pen lift not yet sent, joining only
+    int join_open;                  // The pending lift may be joined over
+    int last_glyph_valid;           // The previous glyph on this line, for joining
+    float last_glyph_x;
+    float last_glyph_end;           // Its x offset plus its width
+    float last_glyph_y;
+    unsigned long joins;            // Pen lifts saved by joining
+    PenTiming pen_timing;           // Servo dwells (pen.h)
+    PenTimer pen_timer;
+    WorkArea work_area;             // Machine limits (workarea.h)
+    unsigned long culled_glyphs;    // Glyphs with nothing drawn inside the work area
+    unsigned long clipped_strokes;  // Pen-down moves cut at its edge
+    unsigned long dropped_strokes;  // Pen-down moves wholly outside it, in glyphs partly inside
+    int overflowed;                 // A glyph left a failing work area
+    float overflow_x;               // Where that glyph was placed
+    float overflow_y;
+} Generator;
+
+/**
+ * @brief Loads a font file into a new Font
+ *
+ * @param filename Path to the font file
+ * @return Font* The font, to be released with font_free(), or NULL on failure
+ */
+Font *font_load(const char *filename);
+
+/**
+ * @brief Releases a font returned by font_load()
+ *
+ * @param font Font to free, may be NULL
+ */
+void font_free(Font *font);
+
+/**
+ * @brief Writes a font as the C source of a core font table (corefont.c, see core.h)
+ *
+ * @param font Font to export
+ * @param path Source file to create
+ * @return int 0 on success, -1 if a movement does not fit the table or the file could not be written
+ */
+int font_export_core(const Font *font, const char *path);
+
+/**
+ * @brief Makes a Font view of a compiled font image
+ *
+ * @param font Receives the view; it points into image, which must outlive it
+ * @param image Compiled font, e.g. from a font registry
+ * @param size Bytes available at image
+ * @return int 0 on success, -1 if the image is truncated or corrupt or was compiled by an incompatible build
+ */
+int font_attach(Font *font, const void *image, size_t size);
+
+/**
+ * @brief Finds the glyph of a code point
+ *
+ * @param font Font to search
+ * @param code Unicode code point
+ * @return const CharacterData* The glyph, or NULL if the font has none
+ */
+const CharacterData *font_glyph(const Font *font, int code);
+
+/**
+ * @brief Calculates the width of a character of a font at given scale
+ *
+ * @param font Font to use
+ * @param code Code point of the character
+ * @param scale_factor Scaling factor for character size
+ * @return float Width of the character in mm, 0.0 if the font has no glyph for it
+ */
+float font_character_width(const Font *font, int code, float scale_factor);
+
+/**
+ * @brief Initialises a generator
+ *
+ * @param generator Generator to initialise
+ * @param font Font to draw with; must outlive the generator
+ * @param sink Where operations go, may be NULL to set later
+ */
+void generator_init(Generator *generator, const Font *font, const OpSink *sink);
+
+/**
+ * @brief Releases the line buffer of a generator
+ *
+ * @param generator Generator to free
+ */
+void generator_free(Generator *generator);
+
+/**
+ * @brief Generator versions of the single-job functions below
+ *
+ * generator_print_character() is print_gcode_for_character(),
+ * generator_place_glyph() is place_glyph(), and so on, for the given generator.
+ */
+int generator_print_character(Generator *generator, int code, float scale_factor,
+                              float x_offset, float y_offset);
+void generator_place_glyph(Generator *generator, int code, float scale_factor, float x_offset, float y_offset);
+void generator_set_boustrophedon(Generator *generator, int enabled);
+
+/**
+ * @brief Sets how many threads generate the job's motion operations
+ *
+ * With more than one thread, placed glyphs and page breaks are only recorded
+ * until generator_finish(), which generates them on a thread pool and hands
+ * the operations to the sink in document order (see pargen.h). Nothing
+ * reaches the sink before then, so this suits compiling, not streaming.
+ *
+ * @param generator Generator to configure, before generator_start()
+ * @param threads Number of threads, 1 for plain sequential generation
+ */
+void generator_set_threads(Generator *generator, int threads);
+
+/**
+ * @brief Sets the per-segment feed planning of pen-down moves
+ *
+ * @param generator Generator to configure, before generator_start()
+ * @param limits Limits to copy; planning is off unless limits->enabled
+ */
+void generator_set_feed_limits(Generator *generator, const FeedLimits *limits);
+
+/**
+ * @brief Sets the stroke joining distance
+ *
+ * When a glyph's first stroke starts within the distance of where the
+ * previous glyph of the same word lifted the pen, the pen stays down and
+ * moves straight to it instead of lifting, travelling and dropping. The
+ * glyphs must touch (one ends where the other starts, in either order).
+ * The distance is a tolerance for strokes that meet, not a connector length:
+ * it is capped at JOIN_MAX_DISTANCE so joining never changes the letterforms.
+ *
+ * @param generator Generator to configure, before generator_start()
+ * @param distance Distance in mm, 0 to lift the pen between every glyph; above JOIN_MAX_DISTANCE is capped
+ */
+void generator_set_join_distance(Generator *generator, float distance);
+
+/**
+ * @brief Sets the pen servo timing used to insert dwells after pen changes
+ *
+ * @param generator Generator to configure, before generator_start()
+ * @param timing Timing to copy; no dwells unless timing->enabled
+ */
+void generator_set_pen_timing(Generator *generator, const PenTiming *timing);
+
+/**
+ * @brief Sets the work area that glyphs are culled and clipped to
+ *
+ * @param generator Generator to configure, before generator_start()
+ * @param area Area to copy; no limits unless area->enabled
+ */
+void generator_set_work_area(Generator *generator, const WorkArea *area);
+
+/**
+ * @brief Sends one operation to the sink, followed by any dwell the pen needs
+ *
+ * @param generator Generator whose sink and pen timer to use
+ * @param op Operation to send
+ * @return int 0 on success, -1 if the sink rejected it (also sets sink_failed)
+ */
+int generator_send_op(Generator *generator, const MotionOp *op);
+
+/**
+ * @brief Forgets where the pen is, as after a page change parks the robot
+ *
+ * The pen state becomes unknown and the position the origin; pending
+ * travel, lifts and stroke joins are dropped. Statistics are kept.
+ *
+ * @param generator Generator to reset
+ */
+void generator_reset_position(Generator *generator);
+
+/**
+ * @brief Prepares a generator for a new job
+ *
+ * Resets the position, the serpentine, joining and work area statistics,
+ * the pen timer and the sink failure flag. Call before the first glyph.
+ *
+ * @param generator Generator configured with generator_init() and its setters
+ */
+void generator_start(Generator *generator);
+
+/**
+ * @brief Sends the buffered serpentine line and the deferred pen lift and travel
+ *
+ * @param generator Generator in the middle of a job
+ */
+void generator_flush(Generator *generator);
+
+/**
+ * @brief Ends the current page and starts the next one
+ *
+ * Flushes what is buffered, sends IR_PAGE and resets the position. With
+ * several threads the break is recorded and sent by generator_finish().
+ *
+ * @param generator Generator in the middle of a job
+ * @param next_page Number of the page about to start
+ */
+void generator_page_break(Generator *generator, int next_page);
+
+/**
+ * @brief Ends a job: generates any recorded glyphs and flushes the rest
+ *
+ * Callers treat the job as complete, and cache it, only on 0.
+ *
+ * @param generator Generator started with generator_start()
+ * @return int 0 if every operation reached the sink, -1 if the sink rejected
+ *         one, a glyph left a failing work area or threaded generation failed
+ */
+int generator_finish(Generator *generator);
+
+/**
+ * @brief Prints the pen-up travel of a finished serpentine job and what the order saved
+ *
+ * Does nothing unless serpentine order is enabled. Kept out of
+ * generator_finish() so that callers with their own output can skip it.
+ *
+ * @param generator Generator that has finished a job
+ */
+void print_serpentine_savings(const Generator *generator);
+
+/**
+ * @brief Prints what a finished job lost to the work area, or where it left it
+ *
+ * Does nothing if the job stayed inside the area.
+ *
+ * @param generator Generator that has finished a job
+ */
+void print_work_area_report(const Generator *generator);
+
+/**
+ * @brief Returns the font read by load_font_file() or set with use_font()
+ *
+ * @return const Font* The font, or NULL if none has been loaded
+ */
+const Font *get_loaded_font(void);
+
+/**
+ * @brief Returns the built-in generator used by the single-job functions
+ *
+ * @return Generator* The generator, drawing with the font of load_font_file()
+ */
+Generator *get_default_generator(void);
+
 /**
  * @brief Loads font data from a specified file
  * 
@@ -62,80 +420,157 @@ typedef struct {
  */
 int load_font_file(const char *filename);
 
+/**
+ * @brief Makes an already loaded font, e.g. one from a font registry, the built-in font
+ *
+ * The font is not copied: it must outlive its use by the single-job functions
+ * and by get_loaded_font().
+ *
+ * @param font Font to use
+ */
+void use_font(const Font *font);
+
+/**
+ * @brief Returns the content hash of the loaded font file
+ * 
+ * @return uint64_t Hash of every line read by load_font_file()
+ */
+uint64_t get_font_hash(void);
+
 /**
  * @brief Generates and sends G-code for a single character
  * 
- * @param ascii_code ASCII code of the character to print
+ * The motion operations go to the sink set with set_generation_sink().
+ * 
+ * @param code Code point of the character to print
  * @param scale_factor Scaling factor for character size
  * @param x_offset X-position offset for character placement
  * @param y_offset Y-position offset for character placement
- * @return int 0 on success, -1 on invalid character or movement error
+ * @return int 0 on success, -1 if the font has no glyph for the character
  */
-int print_gcode_for_character(int ascii_code, float scale_factor, float x_offset, float y_offset);
+int print_gcode_for_character(int code, float scale_factor, float x_offset, float y_offset);
 
 /**
  * @brief Calculates the width of a character at given scale
  * 
- * @param ascii_code ASCII code of the character
+ * @param code Code point of the character
  * @param scale_factor Scaling factor for character size
  * @return float Width of the character in mm, 0.0 if invalid
  */
-float get_character_width(int ascii_code, float scale_factor);
+float get_character_width(int code, float scale_factor);
 
 /**
- * @brief Processes a text file and converts it to G-code
+ * @brief Enables serpentine (boustrophedon) execution order
+ * 
+ * Layout is unchanged, but each line's glyphs are buffered and sent either
+ * left-to-right or right-to-left, whichever needs less pen-up travel from
+ * where the previous line ended. Lines therefore alternate direction and the
+ * full-width return to the left margin disappears. finish_generation()
+ * reports the travel saved against plain left-to-right order.
  * 
- * @param filename Path to the text file to process
- * @param scale_factor Scaling factor for text size
+ * @param enabled 1 to enable, 0 for plain left-to-right order
  */
-void process_text_file(const char *filename, float scale_factor);
+void set_boustrophedon(int enabled);
 
 /**
- * @brief Helper function to calculate total width of a word
+ * @brief Enables per-segment feed planning (see feed.h)
  * 
- * @param word String containing the word to measure
- * @param scale_factor Scaling factor for text size
- * @return float Total width of the word in mm
+ * @param limits Limits to copy; planning is off unless limits->enabled
  */
-float calculate_word_width(const char* word, float scale_factor);
+void set_feed_limits(const FeedLimits *limits);
 
 /**
- * @brief Initializes the font data structure
+ * @brief Joins strokes across the glyphs of a word (see generator_set_join_distance())
  * 
- * Sets up initial state of font data array before loading font file
+ * @param distance Distance in mm, 0 to lift the pen between every glyph
  */
-void initialize_font_data(void);
+void set_join_distance(float distance);
 
 /**
- * @brief Processes movement data for a single character
+ * @brief Inserts the dwells the pen servo needs (see generator_set_pen_timing())
  * 
- * @param file Pointer to open font file
- * @param ascii_code ASCII code of character being processed
- * @param num_movements Number of movements to process
- * @return int 0 on success, -1 on error
+ * @param timing Timing to copy; no dwells unless timing->enabled
  */
-int process_character_movements(FILE* file, int ascii_code, int num_movements);
+void set_pen_timing(const PenTiming *timing);
 
 /**
- * @brief Updates print position for text layout
+ * @brief Culls and clips glyphs to the machine's work area (see generator_set_work_area())
  * 
- * @param x_offset Pointer to current X position
- * @param y_offset Pointer to current Y position
- * @param word_width Width of current word
- * @param line_spacing Spacing between lines
- * @param max_width Maximum line width
+ * @param area Area to copy; no limits unless area->enabled
  */
-void update_print_position(float* x_offset, float* y_offset, float word_width, 
-                         float line_spacing, float max_width);
+void set_work_area(const WorkArea *area);
 
 /**
- * @brief Prints a single word at the specified position
+ * @brief Queues or sends the G-code for one glyph placed by the layout
  * 
- * @param word String containing the word to print
- * @param scale_factor Scaling factor for text size
- * @param x_offset Pointer to current X position (updated after printing)
- * @param y_offset Pointer to current Y position
+ * @param code Code point of the character to print
+ * @param scale_factor Scaling factor for character size
+ * @param x_offset X-position of the glyph origin
+ * @param y_offset Y-position of the glyph baseline
+ */
+void place_glyph(int code, float scale_factor, float x_offset, float y_offset);
+
+/**
+ * @brief Selects where generated motion operations are sent
+ * 
+ * @param sink Sink to copy (an executor, an IR file writer, ...)
+ */
+void set_generation_sink(const OpSink *sink);
+
+/**
+ * @brief Resets the generator at the start of a job
+ * 
+ * Assumes the robot is at the origin with the pen state unknown and clears
+ * the travel statistics.
+ */
+void start_generation(void);
+
+/**
+ * @brief Sends any buffered line and deferred pen-up move
+ */
+void flush_generation(void);
+
+/**
+ * @brief Tells the generator the robot was moved back to the origin externally
+ * 
+ * The pen state is treated as unknown afterwards.
+ */
+void reset_generation_position(void);
+
+/**
+ * @brief Flushes the current page and emits an IR_PAGE operation
+ * 
+ * The executor runs the page-change hook when it reaches the operation; the
+ * hook leaves the robot at the origin, so the generator restarts from there.
+ * 
+ * @param next_page Number of the page about to start
+ */
+void page_break_generation(int next_page);
+
+/**
+ * @brief Flushes the generator at the end of a job and reports statistics
+ * 
+ * @return int 0 on success, -1 if the sink rejected any operation
+ */
+int finish_generation(void);
+
+/**
+ * @brief Initializes the font data structure
+ * 
+ * Makes font an empty font, with no glyphs, as before loading a font file
+ * 
+ * @param font Font to clear
+ */
+void initialize_font_data(Font *font);
+
+/**
+ * @brief Processes movement data for a single character
+ * 
+ * @param char_data Glyph being loaded; its code and num_movements are set by the caller
+ * @param file Pointer to open font file
+ * @param hash Running hash of the font file, updated with every line read
+ * @return int 0 on success, -1 on error
  */
-void print_word(const char* word, float scale_factor, float* x_offset, float* y_offset);
+int process_character_movements(CharacterData *char_data, FILE* file, uint64_t *hash);
 
 #endif // FONT_HANDLER_H
\ No newline at end of file
@@ -0,0 +1,190 @@
+// fontreg.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fontreg.h"
+#include "debug.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// Images start on 8-byte boundaries of the file, which is mapped page aligned
+static size_t align8(size_t offset) {
+    return (offset + 7) & ~(size_t)7;
+}
+
+static int write_padding(FILE *file, size_t from, size_t to) {
+    static const char zeros[8] = { 0 };
+    return to > from && fwrite(zeros, 1, to - from, file) != to - from ? -1 : 0;
+}
+
+int font_registry_build(const char *path, const char *const *names, const Font *const *fonts, int count) {
+    if (count < 1 || count > FONT_REGISTRY_MAX_FONTS) {
+        DEBUG_LOG("Error: A font registry holds 1 to %d fonts\n", FONT_REGISTRY_MAX_FONTS);
+        return -1;
+    }
+    FontRegistryHeader header = { { 0 }, FONT_REGISTRY_VERSION, (uint32_t)count, 0 };
+    memcpy(header.magic, FONT_REGISTRY_MAGIC, sizeof(header.magic));
+    FontRegistryEntry entries[FONT_REGISTRY_MAX_FONTS];
+    memset(entries, 0, sizeof(entries));
+
+    size_t offset = align8(sizeof(header) + (size_t)count * sizeof(FontRegistryEntry));
+    for (int i = 0; i < count; i++) {
+        size_t length = strlen(names[i]);
+        if (length == 0 || length >= FONT_NAME_SIZE) {
+            DEBUG_LOG("Error: Font name '%s' must be 1 to %d characters\n", names[i], FONT_NAME_SIZE - 1);
+            return -1;
+        }
+        for (int j = 0; j < i; j++) {
+            if (strcmp(names[j], names[i]) == 0) {
+                DEBUG_LOG("Error: Font name '%s' given twice\n", names[i]);
+                return -1;
+            }
+        }
+        memcpy(entries[i].name, names[i], length);
+        entries[i].offset = offset;
+        entries[i].size = fonts[i]->image->size;
+        offset = align8(offset + fonts[i]->image->size);
+    }
+
+    char temp_path[512];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+    FILE *file = fopen(temp_path, "wb");
+    if (!file) {
+        DEBUG_LOG("Error: Could not create %s\n", temp_path);
+        return -1;
+    }
+    size_t written = sizeof(header) + (size_t)count * sizeof(FontRegistryEntry);
+    int result = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                 fwrite(entries, sizeof(FontRegistryEntry), (size_t)count, file) == (size_t)count ? 0 : -1;
+    for (int i = 0; i < count && result == 0; i++) {
+        result = write_padding(file, written, (size_t)entries[i].offset);
+        if (result == 0 && fwrite(fonts[i]->image, 1, (size_t)entries[i].size, file) != entries[i].size) {
+            result = -1;
+        }
+        written = (size_t)(entries[i].offset + entries[i].size);
+    }
+    if (fclose(file) != 0) {
+        result = -1;
+    }
+    if (result == 0) {
+        remove(path);
+        result = rename(temp_path, path) == 0 ? 0 : -1;
+    }
+    if (result != 0) {
+        remove(temp_path);
+        DEBUG_LOG("Error: Failed to write font registry %s\n", path);
+        return -1;
+    }
+    DEBUG_LOG("Wrote font registry %s (%d fonts, %lu bytes)\n", path, count, (unsigned long)offset);
+    return 0;
+}
+
+// Map the whole file read-only; shared so every process reads the same page cache copy
+static int map_registry(FontRegistry *registry, const char *path) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return -1;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart < (LONGLONG)sizeof(FontRegistryHeader)) {
+        CloseHandle(file);
+        return -1;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping) {
+        CloseHandle(file);
+        return -1;
+    }
+    const void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return -1;
+    }
+    registry->file_handle = file;
+    registry->map_handle = mapping;
+    registry->data = view;
+    registry->size = (size_t)size.QuadPart;
+#else
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size < (off_t)sizeof(FontRegistryHeader)) {
+        close(fd);
+        return -1;
+    }
+    void *view = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED) {
+        return -1;
+    }
+    registry->data = view;
+    registry->size = (size_t)st.st_size;
+#endif
+    return 0;
+}
+
+int font_registry_open(FontRegistry *registry, const char *path) {
+    memset(registry, 0, sizeof(*registry));
+    if (map_registry(registry, path) != 0) {
+        DEBUG_LOG("Error: Could not map font registry %s\n", path);
+        return -1;
+    }
+
+    const FontRegistryHeader *header = (const FontRegistryHeader *)registry->data;
+    int valid = memcmp(header->magic, FONT_REGISTRY_MAGIC, sizeof(header->magic)) == 0 &&
+                header->version == FONT_REGISTRY_VERSION && header->font_count >= 1 &&
+                header->font_count <= FONT_REGISTRY_MAX_FONTS &&
+                sizeof(*header) + header->font_count * sizeof(FontRegistryEntry) <= registry->size;
+    if (valid) {
+        registry->entries = (const FontRegistryEntry *)(registry->data + sizeof(*header));
+        registry->font_count = (int)header->font_count;
+    }
+    for (int i = 0; valid && i < registry->font_count; i++) {
+        const FontRegistryEntry *entry = &registry->entries[i];
+        valid = memchr(entry->name, '\0', FONT_NAME_SIZE) != NULL && entry->offset <= registry->size &&
+                entry->size <= registry->size - entry->offset &&
+                font_attach(&registry->fonts[i], registry->data + entry->offset, (size_t)entry->size) == 0;
+    }
+    if (!valid) {
+        DEBUG_LOG("Error: %s is not a font registry of this build\n", path);
+        font_registry_close(registry);
+        return -1;
+    }
+    DEBUG_LOG("Mapped font registry %s (%d fonts, %lu bytes)\n", path, registry->font_count,
+              (unsigned long)registry->size);
+    return 0;
+}
+
+const Font *font_registry_find(const FontRegistry *registry, const char *name) {
+    for (int i = 0; i < registry->font_count; i++) {
+        if (!name || strcmp(registry->entries[i].name, name) == 0) {
+            return &registry->fonts[i];
+        }
+    }
+    return NULL;
+}
+
+void font_registry_close(FontRegistry *registry) {
+    if (registry->data) {
+#ifdef _WIN32
+        UnmapViewOfFile(registry->data);
+        CloseHandle(registry->map_handle);
+        CloseHandle(registry->file_handle);
+#else
+        munmap((void *)registry->data, registry->size);
+#endif
+    }
+    memset(registry, 0, sizeof(*registry));
+}
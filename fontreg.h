@@ -0,0 +1,105 @@
+/**
+ * @file fontreg.h
+ * @brief Shared, memory-mapped registry of compiled fonts
+ *
+ * A registry file holds several fonts under short names, each as the
+ * compiled image font_load() builds on the heap (see FontImage in font.h).
+ * Every writer process maps the file read-only and works on the images in
+ * place, so the glyph data is one copy in the page cache however many
+ * processes, robots and fonts use it; a process only keeps a small Font view
+ * per font. Jobs pick a font by name.
+ *
+ * Images are stored in the byte order and structure layout of the build
+ * that wrote them; a registry from an incompatible build is rejected when it
+ * is opened and has to be built again.
+ */
+
+#ifndef FONTREG_H
+#define FONTREG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "font.h"
+
+/**
+ * @brief Registry file identification and limits
+ */
+#define FONT_REGISTRY_MAGIC "RWFR"
+#define FONT_REGISTRY_VERSION 1
+#define FONT_REGISTRY_MAX_FONTS 32
+#define FONT_NAME_SIZE 32           // Bytes of a font name, NUL included
+
+/**
+ * @brief File header, followed by font_count entries and then the images
+ */
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t font_count;
+    uint32_t reserved;
+} FontRegistryHeader;
+
+/**
+ * @brief Name and place of one font in the file
+ */
+typedef struct {
+    char name[FONT_NAME_SIZE];
+    uint64_t offset;        // Of the image from the start of the file, a multiple of 8
+    uint64_t size;
+} FontRegistryEntry;
+
+/**
+ * @brief An open registry
+ */
+typedef struct {
+    const char *data;       // The mapped file
+    size_t size;
+    int font_count;
+    const FontRegistryEntry *entries;
+    Font fonts[FONT_REGISTRY_MAX_FONTS];    // Views of the mapped images
+#ifdef _WIN32
+    void *file_handle;      // Handles kept open for the lifetime of the mapping
+    void *map_handle;
+#endif
+} FontRegistry;
+
+/**
+ * @brief Writes a registry file holding the given fonts
+ *
+ * The file is written under a temporary name and renamed into place, so
+ * processes that have the old registry mapped keep working with it.
+ *
+ * @param path Registry file to create or replace
+ * @param names Name of each font, shorter than FONT_NAME_SIZE and unique
+ * @param fonts Loaded fonts, e.g. from font_load()
+ * @param count Number of fonts, 1 to FONT_REGISTRY_MAX_FONTS
+ * @return int 0 on success, -1 on a bad name or count or if the file could not be written
+ */
+int font_registry_build(const char *path, const char *const *names, const Font *const *fonts, int count);
+
+/**
+ * @brief Maps a registry file read-only and checks every font in it
+ *
+ * @param registry Registry to initialise
+ * @param path Registry file
+ * @return int 0 on success, -1 if missing, truncated, corrupt, or written by an incompatible build
+ */
+int font_registry_open(FontRegistry *registry, const char *path);
+
+/**
+ * @brief Finds a font by name
+ *
+ * @param registry Open registry
+ * @param name Font name, or NULL for the first font
+ * @return const Font* The font, valid until the registry is closed, or NULL if there is none by that name
+ */
+const Font *font_registry_find(const FontRegistry *registry, const char *name);
+
+/**
+ * @brief Unmaps a registry
+ *
+ * @param registry Registry to close
+ */
+void font_registry_close(FontRegistry *registry);
+
+#endif // FONTREG_H
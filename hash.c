@@ -0,0 +1,11 @@
+// hash.c
+#include "hash.h"
+
+uint64_t hash_bytes(uint64_t hash, const void *data, size_t length) {
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
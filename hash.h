@@ -0,0 +1,27 @@
+/**
+ * @file hash.h
+ * @brief 64-bit FNV-1a hashing used for content-addressed job and font keys
+ */
+
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Starting value for a new hash
+ */
+#define HASH_INIT 0xcbf29ce484222325ULL
+
+/**
+ * @brief Folds a block of bytes into a running hash
+ *
+ * @param hash Running hash (HASH_INIT for a new one)
+ * @param data Bytes to add
+ * @param length Number of bytes
+ * @return uint64_t Updated hash
+ */
+uint64_t hash_bytes(uint64_t hash, const void *data, size_t length);
+
+#endif // HASH_H
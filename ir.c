@@ -0,0 +1,214 @@
+// ir.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "ir.h"
+#include "debug.h"
+
+#define IR_HEADER_SIZE 20       // magic, version, reserved, key, op count
+
+int32_t mm_to_microns(float mm) {
+    return (int32_t)lroundf(mm * 1000.0f);
+}
+
+static void put_le(unsigned char *out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        out[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+static uint64_t get_le(const unsigned char *in, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value |= (uint64_t)in[i] << (8 * i);
+    }
+    return value;
+}
+
+static int write_header(IrWriter *writer) {
+    unsigned char header[IR_HEADER_SIZE];
+    memcpy(header, IR_MAGIC, 4);
+    put_le(header + 4, IR_VERSION, 2);
+    put_le(header + 6, 0, 2);
+    put_le(header + 8, writer->key, 8);
+    put_le(header + 16, writer->op_count, 4);
+    return fwrite(header, 1, sizeof(header), writer->file) == sizeof(header) ? 0 : -1;
+}
+
+int ir_writer_open(IrWriter *writer, const char *path, uint64_t key) {
+    memset(writer, 0, sizeof(*writer));
+    writer->file = fopen(path, "wb");
+    if (!writer->file) {
+        DEBUG_LOG("Error: Could not create IR file %s\n", path);
+        return -1;
+    }
+    writer->key = key;
+    if (write_header(writer) != 0) {
+        writer->failed = 1;
+    }
+    return 0;
+}
+
+// Zigzag varint: small magnitudes of either sign take one or two bytes
+static int put_varint(unsigned char *out, int32_t value) {
+    uint32_t zigzag = ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+    int length = 0;
+    while (zigzag >= 0x80) {
+        out[length++] = (unsigned char)(zigzag | 0x80);
+        zigzag >>= 7;
+    }
+    out[length++] = (unsigned char)zigzag;
+    return length;
+}
+
+int ir_write_op(IrWriter *writer, const MotionOp *op) {
+    unsigned char record[11];
+    int length = 0;
+
+    record[length++] = (unsigned char)op->code;
+    if (op->code == IR_TRAVEL || op->code == IR_DRAW) {
+        length += put_varint(record + length, op->x - writer->last_x);
+        length += put_varint(record + length, op->y - writer->last_y);
+        writer->last_x = op->x;
+        writer->last_y = op->y;
+    } else {
+        length += put_varint(record + length, op->x);
+    }
+
+    if (fwrite(record, 1, (size_t)length, writer->file) != (size_t)length) {
+        writer->failed = 1;
+        return -1;
+    }
+    writer->op_count++;
+    return 0;
+}
+
+int ir_writer_emit(void *user_data, const MotionOp *op) {
+    return ir_write_op((IrWriter *)user_data, op);
+}
+
+int ir_writer_close(IrWriter *writer) {
+    if (!writer->file) {
+        return -1;
+    }
+    if (fseek(writer->file, 0, SEEK_SET) != 0 || write_header(writer) != 0) {
+        writer->failed = 1;
+    }
+    if (fclose(writer->file) != 0) {
+        writer->failed = 1;
+    }
+    writer->file = NULL;
+    DEBUG_LOG("IR file closed: %lu operations\n", (unsigned long)writer->op_count);
+    return writer->failed ? -1 : 0;
+}
+
+int ir_reader_open(IrReader *reader, const char *path) {
+    unsigned char header[IR_HEADER_SIZE];
+
+    memset(reader, 0, sizeof(*reader));
+    reader->file = fopen(path, "rb");
+    if (!reader->file) {
+        return -1;
+    }
+    if (fread(header, 1, sizeof(header), reader->file) != sizeof(header) ||
+        memcmp(header, IR_MAGIC, 4) != 0 || get_le(header + 4, 2) != IR_VERSION) {
+        DEBUG_LOG("Error: %s is not a version %d IR file\n", path, IR_VERSION);
+        fclose(reader->file);
+        reader->file = NULL;
+        return -1;
+    }
+    reader->key = get_le(header + 8, 8);
+    reader->op_count = (uint32_t)get_le(header + 16, 4);
+    return 0;
+}
+
+static int get_varint(FILE *file, int32_t *value) {
+    uint32_t zigzag = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        int c = getc(file);
+        if (c == EOF) {
+            return -1;
+        }
+        zigzag |= (uint32_t)(c & 0x7F) << shift;
+        if (!(c & 0x80)) {
+            *value = (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int ir_read_op(IrReader *reader, MotionOp *op) {
+    if (reader->op_index == reader->op_count) {
+        return 0;
+    }
+
+    int code = getc(reader->file);
+    if (code < IR_PEN || code > IR_PAGE) {
+        DEBUG_LOG("Error: Corrupt IR record %lu\n", (unsigned long)reader->op_index);
+        return -1;
+    }
+    op->code = code;
+    op->y = 0;
+    if (code == IR_TRAVEL || code == IR_DRAW) {
+        int32_t dx, dy;
+        if (get_varint(reader->file, &dx) != 0 || get_varint(reader->file, &dy) != 0) {
+            return -1;
+        }
+        reader->last_x += dx;
+        reader->last_y += dy;
+        op->x = reader->last_x;
+        op->y = reader->last_y;
+    } else if (get_varint(reader->file, &op->x) != 0) {
+        return -1;
+    }
+
+    reader->op_index++;
+    return 1;
+}
+
+void ir_reader_close(IrReader *reader) {
+    if (reader->file) {
+        fclose(reader->file);
+        reader->file = NULL;
+    }
+}
+
+// Write micrometres as mm with three decimals, without going through float
+static int format_microns(char *buffer, int32_t microns) {
+    int64_t value = microns;
+    const char *sign = value < 0 ? "-" : "";
+    if (value < 0) {
+        value = -value;
+    }
+    return sprintf(buffer, "%s%ld.%03d", sign, (long)(value / 1000), (int)(value % 1000));
+}
+
+int format_motion_op(const MotionOp *op, char *buffer) {
+    int length;
+    switch (op->code) {
+    case IR_PEN:
+        return sprintf(buffer, "S%d\n", op->x ? 1000 : 0);
+    case IR_TRAVEL:
+    case IR_DRAW:
+        length = sprintf(buffer, "G%d X", op->code == IR_DRAW ? 1 : 0);
+        length += format_microns(buffer + length, op->x);
+        length += sprintf(buffer + length, " Y");
+        length += format_microns(buffer + length, op->y);
+        buffer[length++] = '\n';
+        buffer[length] = '\0';
+        return length;
+    case IR_FEED:
+        return sprintf(buffer, "F%ld\n", (long)op->x);
+    case IR_DWELL:
+        length = sprintf(buffer, "G4 P");
+        length += format_microns(buffer + length, op->x);
+        buffer[length++] = '\n';
+        buffer[length] = '\0';
+        return length;
+    default:
+        buffer[0] = '\0';
+        return 0;
+    }
+}
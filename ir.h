@@ -0,0 +1,150 @@
+/**
+ * @file ir.h
+ * @brief Binary stroke/motion IR shared by the generator, job files and executor
+ *
+ * The generator produces a stream of MotionOps. They can be sent to the
+ * robot straight away, or written to a compact IR file where consecutive
+ * coordinates are stored as zigzag varint deltas in micrometres. An IR file
+ * replays to exactly the same G-code as the live stream it was compiled from.
+ */
+
+#ifndef IR_H
+#define IR_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/**
+ * @brief IR file identification
+ */
+#define IR_MAGIC "RWIR"
+#define IR_VERSION 1
+
+/**
+ * @brief Motion operation codes
+ */
+typedef enum {
+    IR_PEN = 1,     // Pen state: x = 1 down, 0 up             -> S1000 / S0
+    IR_TRAVEL,      // Pen-up move to (x, y) micrometres        -> G0
+    IR_DRAW,        // Pen-down move to (x, y) micrometres      -> G1
+    IR_FEED,        // Feed rate: x = mm/min                    -> F
+    IR_DWELL,       // Pause: x = milliseconds                  -> G4
+    IR_PAGE         // Page break: x = number of the next page  (no G-code)
+} IrOpCode;
+
+/**
+ * @brief One motion operation
+ */
+typedef struct {
+    int code;       // IrOpCode
+    int32_t x;      // X in micrometres, or the operation's argument
+    int32_t y;      // Y in micrometres
+} MotionOp;
+
+/**
+ * @brief Consumer of a MotionOp stream
+ */
+typedef struct {
+    int (*emit)(void *user_data, const MotionOp *op);   // Returns 0, or -1 to report an error
+    void *user_data;
+} OpSink;
+
+/**
+ * @brief Streaming writer for an IR file
+ */
+typedef struct {
+    FILE *file;
+    uint64_t key;           // Job key stored in the header
+    uint32_t op_count;      // Operations written so far
+    int32_t last_x;         // Previous coordinates for delta encoding
+    int32_t last_y;
+    int failed;             // Set once a write fails
+} IrWriter;
+
+/**
+ * @brief Streaming reader for an IR file
+ */
+typedef struct {
+    FILE *file;
+    uint64_t key;           // Job key from the header
+    uint32_t op_count;      // Total operations in the file
+    uint32_t op_index;      // Operations read so far
+    int32_t last_x;
+    int32_t last_y;
+} IrReader;
+
+/**
+ * @brief Converts a position in mm to IR micrometres
+ *
+ * @param mm Position in mm
+ * @return int32_t Nearest micrometre
+ */
+int32_t mm_to_microns(float mm);
+
+/**
+ * @brief Creates an IR file and writes a provisional header
+ *
+ * @param writer Writer to initialise
+ * @param path File to create (truncated if it exists)
+ * @param key Job key recorded in the header
+ * @return int 0 on success, -1 if the file could not be created
+ */
+int ir_writer_open(IrWriter *writer, const char *path, uint64_t key);
+
+/**
+ * @brief Appends one operation
+ *
+ * @param writer Open writer
+ * @param op Operation to append
+ * @return int 0 on success, -1 on write error
+ */
+int ir_write_op(IrWriter *writer, const MotionOp *op);
+
+/**
+ * @brief OpSink callback that appends to an IrWriter passed as user_data
+ */
+int ir_writer_emit(void *user_data, const MotionOp *op);
+
+/**
+ * @brief Finalises the header and closes the file
+ *
+ * @param writer Writer to close
+ * @return int 0 if every write succeeded, -1 otherwise
+ */
+int ir_writer_close(IrWriter *writer);
+
+/**
+ * @brief Opens an IR file and validates its header
+ *
+ * @param reader Reader to initialise
+ * @param path File to open
+ * @return int 0 on success, -1 if missing, truncated or not an IR file
+ */
+int ir_reader_open(IrReader *reader, const char *path);
+
+/**
+ * @brief Reads the next operation
+ *
+ * @param reader Open reader
+ * @param op Receives the operation
+ * @return int 1 if an operation was read, 0 at end of file, -1 on corrupt data
+ */
+int ir_read_op(IrReader *reader, MotionOp *op);
+
+/**
+ * @brief Closes an IR file
+ *
+ * @param reader Reader to close
+ */
+void ir_reader_close(IrReader *reader);
+
+/**
+ * @brief Formats an operation as a G-code line
+ *
+ * @param op Operation to format
+ * @param buffer Receives the NUL-terminated line, including its newline (at least 64 bytes)
+ * @return int Length of the line, or 0 if the operation sends no G-code
+ */
+int format_motion_op(const MotionOp *op, char *buffer);
+
+#endif // IR_H
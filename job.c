@@ -0,0 +1,414 @@
+// job.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdatomic.h>
+#include "job.h"
+#include "font.h"
+#include "hash.h"
+#include "platform.h"
+#include "trace.h"
+#include "debug.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#define make_directory(path) _mkdir(path)
+#else
+#include <sys/stat.h>
+#define make_directory(path) mkdir(path, 0777)
+#endif
+
+// Numbers the temporary files of compiles that run at the same time
+static atomic_ulong compile_count;
+
+void job_spec_init(JobSpec *spec, const char *text_filename, float scale_factor) {
+    memset(spec, 0, sizeof(*spec));
+    spec->text_filename = text_filename;
+    spec->scale_factor = scale_factor;
+    spec->font = get_loaded_font();
+    spec->line_break_mode = LINE_BREAK_GREEDY;
+    spec->boustrophedon = 0;
+    feed_limits_init(&spec->feed);
+    spec->join_distance = 0.0f;
+    pen_timing_init(&spec->pen);
+    get_page_setup(&spec->page);
+    get_machine_work_area(&spec->work_area);
+    spec->threads = 1;
+    spec->use_cache = 1;
+    spec->resume = 0;
+}
+
+int compute_job_key(const JobSpec *spec, uint64_t *key) {
+    if (!spec->font) {
+        return -1;
+    }
+    FILE *file = fopen(spec->text_filename, "rb");
+    if (!file) {
+        return -1;
+    }
+
+    uint64_t hash = HASH_INIT;
+    unsigned char buffer[65536];
+    size_t got;
+    while ((got = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        hash = hash_bytes(hash, buffer, got);
+    }
+    int failed = ferror(file);
+    fclose(file);
+    if (failed) {
+        return -1;
+    }
+
+    const int version = IR_VERSION;
+    const int mode = (int)spec->line_break_mode;
+    hash = hash_bytes(hash, &version, sizeof(version));
+    hash = hash_bytes(hash, &spec->font->hash, sizeof(spec->font->hash));
+    hash = hash_bytes(hash, &spec->scale_factor, sizeof(spec->scale_factor));
+    hash = hash_bytes(hash, &mode, sizeof(mode));
+    hash = hash_bytes(hash, &spec->boustrophedon, sizeof(spec->boustrophedon));
+    hash = hash_bytes(hash, &spec->feed.enabled, sizeof(spec->feed.enabled));
+    if (spec->feed.enabled) {
+        hash = hash_bytes(hash, &spec->feed.min_feed, sizeof(float));
+        hash = hash_bytes(hash, &spec->feed.max_feed, sizeof(float));
+    }
+    hash = hash_bytes(hash, &spec->join_distance, sizeof(spec->join_distance));
+    hash = hash_bytes(hash, &spec->pen.enabled, sizeof(spec->pen.enabled));
+    if (spec->pen.enabled) {
+        hash = hash_bytes(hash, &spec->pen.lift_ms, sizeof(float));
+        hash = hash_bytes(hash, &spec->pen.drop_ms, sizeof(float));
+        hash = hash_bytes(hash, &spec->pen.contact_ms, sizeof(float));
+    }
+    hash = hash_bytes(hash, &spec->page.page_width, sizeof(float));
+    hash = hash_bytes(hash, &spec->page.page_height, sizeof(float));
+    hash = hash_bytes(hash, &spec->page.margin_left, sizeof(float));
+    hash = hash_bytes(hash, &spec->page.margin_right, sizeof(float));
+    hash = hash_bytes(hash, &spec->page.margin_top, sizeof(float));
+    hash = hash_bytes(hash, &spec->page.margin_bottom, sizeof(float));
+    hash = hash_bytes(hash, &spec->work_area.enabled, sizeof(spec->work_area.enabled));
+    if (spec->work_area.enabled) {
+        hash = hash_bytes(hash, &spec->work_area.fail, sizeof(spec->work_area.fail));
+        hash = hash_bytes(hash, &spec->work_area.min_x, sizeof(float));
+        hash = hash_bytes(hash, &spec->work_area.min_y, sizeof(float));
+        hash = hash_bytes(hash, &spec->work_area.max_x, sizeof(float));
+        hash = hash_bytes(hash, &spec->work_area.max_y, sizeof(float));
+    }
+
+    *key = hash;
+    return 0;
+}
+
+// Lay out and generate a job with generator, which the caller frees
+static int generate_with(Generator *generator, const JobSpec *spec, const OpSink *sink, int threads) {
+    LayoutOptions options;
+    get_layout_options(&options);
+    options.line_break_mode = spec->line_break_mode;
+    options.page = spec->page;
+
+    generator_init(generator, spec->font, sink);
+    generator_set_boustrophedon(generator, spec->boustrophedon);
+    generator_set_threads(generator, threads);
+    generator_set_feed_limits(generator, &spec->feed);
+    generator_set_join_distance(generator, spec->join_distance);
+    generator_set_pen_timing(generator, &spec->pen);
+    generator_set_work_area(generator, &spec->work_area);
+    return layout_text_file(generator, &options, spec->text_filename, spec->scale_factor);
+}
+
+int generate_job(const JobSpec *spec, const OpSink *sink, int threads) {
+    if (!spec->font) {
+        return -1;
+    }
+    Generator generator;
+    int result = generate_with(&generator, spec, sink, threads);
+    if (result == 0) {
+        print_serpentine_savings(&generator);
+    }
+    print_work_area_report(&generator);
+    generator_free(&generator);
+    return result;
+}
+
+// Compile a job whose key is already known
+static int compile_keyed_job(const JobSpec *spec, uint64_t key, char *ir_path, size_t ir_path_size) {
+    snprintf(ir_path, ir_path_size, "%s/%016llx.rwir", JOB_CACHE_DIR, (unsigned long long)key);
+
+    IrReader reader;
+    if (ir_reader_open(&reader, ir_path) == 0) {
+        int hit = reader.key == key;
+        ir_reader_close(&reader);
+        if (hit) {
+            DEBUG_LOG("Job cache hit: %s\n", ir_path);
+            return 1;
+        }
+    }
+
+    if (check_page_setup(&spec->page) != 0) {
+        return -1;
+    }
+    make_directory(JOB_CACHE_DIR);
+
+    // Compile to a temporary name so an interrupted compile never looks cached
+    char temp_path[512];
+    snprintf(temp_path, sizeof(temp_path), "%s.%lu.tmp", ir_path, atomic_fetch_add(&compile_count, 1));
+    IrWriter writer;
+    if (ir_writer_open(&writer, temp_path, key) != 0) {
+        return -1;
+    }
+    OpSink sink = { ir_writer_emit, &writer };
+    int result = generate_job(spec, &sink, spec->threads);
+    if (ir_writer_close(&writer) != 0) {
+        result = -1;
+    }
+
+    if (result == 0) {
+        remove(ir_path);
+        result = rename(temp_path, ir_path) == 0 ? 0 : -1;
+    }
+    if (result != 0) {
+        remove(temp_path);
+        DEBUG_LOG("Error: Failed to compile %s\n", spec->text_filename);
+        return -1;
+    }
+    DEBUG_LOG("Compiled %s to %s (%lu operations)\n", spec->text_filename, ir_path,
+              (unsigned long)writer.op_count);
+    return 0;
+}
+
+int compile_job(const JobSpec *spec, char *ir_path, size_t ir_path_size) {
+    uint64_t key;
+    if (compute_job_key(spec, &key) != 0) {
+        DEBUG_LOG("Error: Could not hash text file %s\n", spec->text_filename);
+        return -1;
+    }
+    return compile_keyed_job(spec, key, ir_path, ir_path_size);
+}
+
+void executor_init(Executor *executor, Transport *transport, PageBreakHook on_page_break, void *user_data) {
+    memset(executor, 0, sizeof(*executor));
+    executor->transport = transport;
+    executor->on_page_break = on_page_break;
+    executor->user_data = user_data;
+    executor->state.pen = -1;
+    executor->state.page = 1;
+    executor->started_ns = monotonic_ns();
+}
+
+// Send one operation outside the job stream and track its effect on the machine
+static int send_op(Executor *executor, int code, int32_t x, int32_t y) {
+    MotionOp op = { code, x, y };
+    char buffer[64];
+    if (format_motion_op(&op, buffer) > 0 && transport_send(executor->transport, buffer) != 0) {
+        return -1;
+    }
+    executor->commands_sent++;
+    return 0;
+}
+
+int executor_resume(Executor *executor, const CheckpointState *state, const PenTiming *pen) {
+    printf("Resuming job at operation %lu (page %d)\n", (unsigned long)state->op_index, (int)state->page);
+    // The pen falls from fully up, so the next stroke waits for the whole drop
+    int32_t drop = pen->enabled && pen->drop_ms > 0.0f ? (int32_t)ceilf(pen->drop_ms) : 0;
+    if (transport_send(executor->transport, RESUME_HOME_COMMAND) != 0 ||
+        send_op(executor, IR_PEN, 0, 0) != 0 ||
+        (state->feed > 0 && send_op(executor, IR_FEED, state->feed, 0) != 0) ||
+        send_op(executor, IR_TRAVEL, state->x, state->y) != 0 ||
+        (state->pen == 1 && (send_op(executor, IR_PEN, 1, 0) != 0 ||
+                             (drop > 0 && send_op(executor, IR_DWELL, drop, 0) != 0)))) {
+        return -1;
+    }
+    executor->state = *state;
+    executor->resume_from = state->op_index;
+    return 0;
+}
+
+// Checkpoint the newest operation whose commands the robot has acknowledged; later ones stay queued
+static void update_checkpoint(Executor *executor) {
+    size_t pending = transport_pending(executor->transport);
+    unsigned long acked = executor->commands_sent > pending ? executor->commands_sent - pending : 0;
+    const CheckpointState *latest = NULL;
+    while (executor->unacked_count > 0 && executor->unacked[executor->unacked_head].command <= acked) {
+        latest = &executor->unacked[executor->unacked_head].state;
+        executor->unacked_head = (executor->unacked_head + 1) % EXECUTOR_MAX_UNACKED;
+        executor->unacked_count--;
+    }
+    if (latest) {
+        checkpoint_update(executor->checkpoint, latest);
+    }
+}
+
+// Queue the state after the current operation until its commands are acknowledged
+static int queue_checkpoint(Executor *executor) {
+    if (executor->unacked_count > 0) {
+        size_t newest = (executor->unacked_head + executor->unacked_count - 1) % EXECUTOR_MAX_UNACKED;
+        if (executor->unacked[newest].command == executor->commands_sent) {
+            // Nothing sent since: acknowledged together
+            executor->unacked[newest].state = executor->state;
+            return 0;
+        }
+    }
+    if (executor->unacked_count == EXECUTOR_MAX_UNACKED) {
+        if (transport_drain(executor->transport) != 0) {
+            return -1;
+        }
+        update_checkpoint(executor);
+    }
+    size_t slot = (executor->unacked_head + executor->unacked_count) % EXECUTOR_MAX_UNACKED;
+    executor->unacked[slot].command = executor->commands_sent;
+    executor->unacked[slot].state = executor->state;
+    executor->unacked_count++;
+    return 0;
+}
+
+int executor_emit(void *user_data, const MotionOp *op) {
+    Executor *executor = user_data;
+    char buffer[64];
+
+    // Fast-forward over work a resumed job has already done
+    if (executor->ops_done < executor->resume_from) {
+        executor->ops_done++;
+        return 0;
+    }
+
+    if (op->code == IR_PAGE) {
+        // Let the robot finish the page before the hook parks it
+        if (transport_drain(executor->transport) != 0) {
+            return -1;
+        }
+        if (executor->on_page_break && executor->on_page_break(op->x, executor->user_data) != 0) {
+            return -1;
+        }
+        // The hook leaves the robot at the origin with the pen up
+        executor->state.x = executor->state.y = 0;
+        executor->state.pen = 0;
+        executor->state.page = op->x;
+    } else if (format_motion_op(op, buffer) > 0) {
+        if (transport_send(executor->transport, buffer) != 0) {
+            return -1;
+        }
+        executor->commands_sent++;
+        switch (op->code) {
+        case IR_PEN:
+            executor->state.pen = op->x;
+            if (op->x && !executor->first_stroke_ns) {
+                executor->first_stroke_ns = monotonic_ns();
+            }
+            break;
+        case IR_TRAVEL:
+        case IR_DRAW:
+            executor->state.x = op->x;
+            executor->state.y = op->y;
+            break;
+        case IR_FEED:
+            executor->state.feed = op->x;
+            break;
+        default:
+            break;
+        }
+    }
+
+    executor->ops_done++;
+    if (executor->checkpoint) {
+        executor->state.op_index = (uint32_t)executor->ops_done;
+        if (queue_checkpoint(executor) != 0) {
+            return -1;
+        }
+        update_checkpoint(executor);
+    }
+    return 0;
+}
+
+int execute_ir_file(const char *path, Executor *executor) {
+    IrReader reader;
+    if (ir_reader_open(&reader, path) != 0) {
+        DEBUG_LOG("Error: Could not open IR file %s\n", path);
+        return -1;
+    }
+
+    MotionOp op;
+    int status;
+    TRACE_BEGIN("execute_ir_file");
+    while ((status = ir_read_op(&reader, &op)) > 0) {
+        if (executor_emit(executor, &op) != 0) {
+            status = -1;
+            break;
+        }
+    }
+    TRACE_END("execute_ir_file");
+    ir_reader_close(&reader);
+    return status;
+}
+
+// Generate a streamed job without sending it, so one that leaves a failing work area stops before its first move
+static int check_work_area(const JobSpec *spec) {
+    if (!spec->font) {
+        return -1;
+    }
+    OpSink discard = { NULL, NULL };
+    Generator generator;
+    int result = generate_with(&generator, spec, &discard, spec->threads);
+    if (generator.overflowed) {
+        print_work_area_report(&generator);
+    }
+    generator_free(&generator);
+    return result;
+}
+
+int run_job(const JobSpec *spec, Executor *executor) {
+    uint64_t key = 0;
+    int keyed = strcmp(spec->text_filename, "-") != 0 && compute_job_key(spec, &key) == 0;
+    Checkpoint checkpoint;
+    int result;
+
+    if (keyed) {
+        char checkpoint_path[512];
+        snprintf(checkpoint_path, sizeof(checkpoint_path), "%s/%016llx.ckpt", JOB_CACHE_DIR, (unsigned long long)key);
+        make_directory(JOB_CACHE_DIR);
+
+        CheckpointState saved;
+        if (spec->resume) {
+            if (checkpoint_load(checkpoint_path, key, &saved) == 0) {
+                if (executor_resume(executor, &saved, &spec->pen) != 0) {
+                    return -1;
+                }
+            } else {
+                printf("No checkpoint for this job, starting from the beginning\n");
+            }
+        }
+        executor->state.key = key;
+        executor->state.op_index = (uint32_t)executor->resume_from;
+        if (checkpoint_open(&checkpoint, checkpoint_path, &executor->state) == 0) {
+            executor->checkpoint = &checkpoint;
+        }
+    }
+
+    if (keyed && spec->use_cache) {
+        char ir_path[512];
+        result = compile_keyed_job(spec, key, ir_path, sizeof(ir_path));
+        if (result >= 0) {
+            result = execute_ir_file(ir_path, executor);
+        }
+    } else if (keyed && spec->work_area.fail && check_work_area(spec) != 0) {
+        result = -1;
+    } else {
+        OpSink sink = { executor_emit, executor };
+        // Streamed jobs stay sequential so the first stroke is not held back
+        result = generate_job(spec, &sink, 1);
+    }
+    // The job is done once the robot has acknowledged all of it
+    if (transport_drain(executor->transport) != 0) {
+        result = -1;
+    }
+
+    if (executor->checkpoint) {
+        // Whatever was acknowledged before a failure is done; lines still in flight were dropped
+        update_checkpoint(executor);
+        checkpoint_close(executor->checkpoint, result == 0);
+        executor->checkpoint = NULL;
+        if (result != 0) {
+            printf("Job interrupted after %lu operations; run again with --resume to continue\n",
+                   executor->ops_done);
+        }
+    }
+    return result;
+}
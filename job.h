@@ -0,0 +1,189 @@
+/**
+ * @file job.h
+ * @brief Job compiler, IR cache and executor
+ *
+ * A job (text file, font, height and layout options) is compiled once into
+ * a binary IR file stored in a content-addressed cache, keyed by a hash of
+ * everything that affects the output. The executor streams an IR file, or a
+ * live generator stream, to a transport.
+ */
+
+#ifndef JOB_H
+#define JOB_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ir.h"
+#include "layout.h"
+#include "transport.h"
+#include "checkpoint.h"
+
+/**
+ * @brief Directory holding compiled jobs ("<key>.rwir") and checkpoints ("<key>.ckpt")
+ */
+#define JOB_CACHE_DIR "jobcache"
+
+/**
+ * @brief Command that re-establishes the machine origin before a resume
+ */
+#define RESUME_HOME_COMMAND "$H\n"
+
+/**
+ * @brief Everything that determines a job's output
+ */
+typedef struct {
+    const char *text_filename;      // Text to write, "-" for standard input
+    float scale_factor;             // Font units to mm
+    const Font *font;               // Loaded font, shared with other jobs
+    LineBreakMode line_break_mode;
+    int boustrophedon;              // Serpentine line order
+    FeedLimits feed;                // Per-segment feed planning
+    float join_distance;            // Stroke joining across glyphs in mm, 0 for none
+    PenTiming pen;                  // Servo dwells after pen changes
+    PageSetup page;
+    WorkArea work_area;             // Machine limits glyphs are culled and clipped to
+    int threads;                    // Generator threads when compiling (not part of the key)
+    int use_cache;                  // 0 to stream straight to the executor
+    int resume;                     // Continue from the job's checkpoint (not part of the key)
+} JobSpec;
+
+/**
+ * @brief Operations a streaming transport may have in flight before a checkpoint (above FLOW_MAX_IN_FLIGHT)
+ */
+#define EXECUTOR_MAX_UNACKED 128
+
+/**
+ * @brief Machine state after an operation whose command may not be acknowledged yet
+ */
+typedef struct {
+    unsigned long command;          // Executor commands sent up to and including the operation
+    CheckpointState state;
+} UnackedOp;
+
+/**
+ * @brief Called between pages, after everything on the finished page is sent
+ *
+ * The hook may pause for the operator or change the sheet. It must leave the
+ * robot at the origin with the pen up.
+ *
+ * @param next_page Number of the page about to start (the second page is 2)
+ * @param user_data Pointer registered with the executor
+ * @return int 0 to go on with the next page, -1 to stop the job before it
+ */
+typedef int (*PageBreakHook)(int next_page, void *user_data);
+
+/**
+ * @brief Streams motion operations to a transport
+ */
+typedef struct {
+    Transport *transport;           // Where commands are sent
+    PageBreakHook on_page_break;    // Run at IR_PAGE operations, may be NULL
+    void *user_data;                // Passed to on_page_break
+    unsigned long ops_done;         // Operations executed (or skipped while resuming) so far
+    unsigned long commands_sent;    // G-code lines sent so far (a streaming transport may still have some in flight)
+    unsigned long resume_from;      // Operations before this index are skipped, not sent
+    CheckpointState state;          // Machine state after the last operation sent
+    Checkpoint *checkpoint;         // Progress record, NULL if not checkpointing
+    UnackedOp unacked[EXECUTOR_MAX_UNACKED];    // Checkpoint states waiting for their commands' "ok", oldest at head
+    size_t unacked_head;
+    size_t unacked_count;
+    uint64_t started_ns;            // When the executor was set up
+    uint64_t first_stroke_ns;       // When the first pen-down command was acknowledged, 0 until then
+} Executor;
+
+/**
+ * @brief Fills a JobSpec with the loaded font and the current layout defaults
+ *
+ * @param spec Spec to fill
+ * @param text_filename Text file to write
+ * @param scale_factor Font units to mm
+ */
+void job_spec_init(JobSpec *spec, const char *text_filename, float scale_factor);
+
+/**
+ * @brief Computes the cache key of a job
+ *
+ * Hashes the text file contents, the loaded font, the scale and all options.
+ *
+ * @param spec Job to hash (the text must be a regular file)
+ * @param key Receives the key
+ * @return int 0 on success, -1 if the text could not be read
+ */
+int compute_job_key(const JobSpec *spec, uint64_t *key);
+
+/**
+ * @brief Lays out a job's text and generates its operations, with a generator of its own
+ *
+ * Safe to call for several jobs at once.
+ *
+ * @param spec Job to generate
+ * @param sink Where the operations go
+ * @param threads Generator threads
+ * @return int 0 on success, -1 on bad options, an unreadable file or a sink failure
+ */
+int generate_job(const JobSpec *spec, const OpSink *sink, int threads);
+
+/**
+ * @brief Compiles a job into a cached IR file unless it is already cached
+ *
+ * @param spec Job to compile
+ * @param ir_path Receives the path of the IR file
+ * @param ir_path_size Size of ir_path
+ * @return int 1 on a cache hit, 0 if compiled now, -1 on error
+ */
+int compile_job(const JobSpec *spec, char *ir_path, size_t ir_path_size);
+
+/**
+ * @brief Initialises an executor
+ *
+ * @param executor Executor to initialise
+ * @param transport Where commands are sent
+ * @param on_page_break Page-change hook, may be NULL
+ * @param user_data Passed to the hook
+ */
+void executor_init(Executor *executor, Transport *transport, PageBreakHook on_page_break, void *user_data);
+
+/**
+ * @brief Restores the machine state of a checkpoint and skips the work already done
+ *
+ * Re-homes, lifts the pen, restores the feed, travels to the checkpointed
+ * position and puts the pen back in its recorded state, waiting the full
+ * drop time when pen timing is on. Operations before the checkpoint are
+ * then consumed without sending anything.
+ *
+ * @param executor Executor about to run the job
+ * @param state Checkpoint to resume from
+ * @param pen Pen timing of the job
+ * @return int 0 on success, -1 on transport failure
+ */
+int executor_resume(Executor *executor, const CheckpointState *state, const PenTiming *pen);
+
+/**
+ * @brief OpSink callback that executes one operation on the Executor in user_data
+ */
+int executor_emit(void *user_data, const MotionOp *op);
+
+/**
+ * @brief Streams every operation of an IR file through the executor
+ *
+ * @param path IR file to execute
+ * @param executor Executor to use
+ * @return int 0 on success, -1 on a bad file or transport failure
+ */
+int execute_ir_file(const char *path, Executor *executor);
+
+/**
+ * @brief Compiles (or fetches from the cache) and executes a job
+ *
+ * Jobs read from standard input, or with use_cache off, are streamed from
+ * the generator straight into the executor. Progress of jobs read from a
+ * file is checkpointed to JOB_CACHE_DIR so that spec->resume can continue an
+ * interrupted run; the checkpoint is deleted when the job completes.
+ *
+ * @param spec Job to run
+ * @param executor Executor to use
+ * @return int 0 on success, -1 on failure
+ */
+int run_job(const JobSpec *spec, Executor *executor);
+
+#endif // JOB_H
@@ -0,0 +1,272 @@
+// layout.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "layout.h"
+#include "font.h"
+#include "textreader.h"
+#include "trace.h"
+#include "debug.h"
+
+// Layout cursor shared by the greedy and optimal paths of layout_text_file().
+// Positions are relative to the top-left corner of the text area.
+typedef struct {
+    Generator *generator;
+    const PageSetup *page;
+    float x_offset;
+    float y_offset;         // Baseline of the current line, negative down the page
+    float text_height;
+    float line_spacing;
+    float word_spacing;
+    float scale_factor;
+    float line_width;       // Usable width between the margins
+    float area_height;      // Usable height between the margins, 0 if unlimited
+    int pending_lines;      // Hard line breaks not yet applied
+    int page_number;
+} LayoutCursor;
+
+// Options of process_text_file(), the single-job API
+static LayoutOptions layout_options = {
+    LINE_BREAK_GREEDY, { MAX_LINE_WIDTH, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f }, BASE_LINE_SPACING, WORD_SPACING_FACTOR
+};
+
+void get_layout_options(LayoutOptions *options) {
+    *options = layout_options;
+}
+
+int check_page_setup(const PageSetup *setup) {
+    if (setup->page_width - setup->margin_left - setup->margin_right <= 0.0f ||
+        (setup->page_height > 0.0f && setup->page_height - setup->margin_top - setup->margin_bottom <= 0.0f)) {
+        DEBUG_LOG("Error: Page margins leave no room for text\n");
+        return -1;
+    }
+    return 0;
+}
+
+void set_line_break_mode(LineBreakMode mode) {
+    layout_options.line_break_mode = mode;
+}
+
+int set_page_setup(const PageSetup *setup) {
+    if (check_page_setup(setup) != 0) {
+        return -1;
+    }
+    layout_options.page = *setup;
+    return 0;
+}
+
+void get_page_setup(PageSetup *setup) {
+    *setup = layout_options.page;
+}
+
+static float word_width(const Font *font, const char *word, size_t length, float scale_factor) {
+    float width = 0.0f;
+    for (size_t i = 0; i < length;) {
+        width += font_character_width(font, (int)text_decode_utf8(word, length, &i), scale_factor);
+    }
+    return width;
+}
+
+float calculate_word_width(const char* word, size_t length, float scale_factor) {
+    return word_width(get_default_generator()->font, word, length, scale_factor);
+}
+
+void update_print_position(float* x_offset, float* y_offset, float word_width, float line_spacing, float max_width) {
+    // A word wider than the whole line stays on the current line if nothing precedes it
+    if (*x_offset > 0.0f && *x_offset + word_width > max_width) {
+        *x_offset = 0.0f;
+        *y_offset -= line_spacing;
+        DEBUG_LOG("New line: Y=%.3f\n", *y_offset);
+    }
+}
+
+static void generate_word(Generator *generator, const char *word, size_t length, float scale_factor,
+                          float *x_offset, float y_offset) {
+    TRACE_BEGIN("print_word");
+    for (size_t i = 0; i < length;) {
+        int code = (int)text_decode_utf8(word, length, &i);
+        float width = font_character_width(generator->font, code, scale_factor);
+        generator_place_glyph(generator, code, scale_factor, *x_offset, y_offset);
+        *x_offset += width;
+        DEBUG_LOG("Character %d width: %.3f, New X offset: %.3f\n", code, width, *x_offset);
+    }
+    TRACE_END("print_word");
+}
+
+void print_word(const char* word, size_t length, float scale_factor, float* x_offset, float* y_offset) {
+    generate_word(get_default_generator(), word, length, scale_factor, x_offset, *y_offset);
+}
+
+// Start a new page if the current line would run past the bottom margin
+static void fit_page(LayoutCursor *cursor) {
+    float line_bottom = cursor->y_offset - (cursor->line_spacing - cursor->text_height);
+    if (cursor->area_height <= 0.0f || line_bottom >= -cursor->area_height) {
+        return;
+    }
+
+    cursor->page_number++;
+    DEBUG_LOG("Page break: starting page %d\n", cursor->page_number);
+    generator_page_break(cursor->generator, cursor->page_number);
+
+    cursor->x_offset = 0.0f;
+    cursor->y_offset = -cursor->text_height;
+}
+
+// Apply hard breaks lazily so trailing newlines never move the pen
+static void apply_pending_lines(LayoutCursor *cursor) {
+    if (cursor->pending_lines > 0) {
+        cursor->x_offset = 0.0f;
+        cursor->y_offset -= cursor->line_spacing * (float)cursor->pending_lines;
+        cursor->pending_lines = 0;
+        DEBUG_LOG("Hard line break: Y=%.3f\n", cursor->y_offset);
+        fit_page(cursor);
+    }
+}
+
+// Print a word at the cursor, translated from text-area to page coordinates
+static void print_word_at_cursor(LayoutCursor *cursor, const char *word, size_t length) {
+    float x = cursor->page->margin_left + cursor->x_offset;
+    float y = cursor->y_offset - cursor->page->margin_top;
+    generate_word(cursor->generator, word, length, cursor->scale_factor, &x, y);
+    cursor->x_offset = x - cursor->page->margin_left + cursor->word_spacing;
+}
+
+// Print a word at the cursor, wrapping greedily when it does not fit
+static void place_word_greedy(LayoutCursor *cursor, const char *word, size_t length, float word_width) {
+    apply_pending_lines(cursor);
+    float line_y = cursor->y_offset;
+    update_print_position(&cursor->x_offset, &cursor->y_offset, word_width,
+                          cursor->line_spacing, cursor->line_width);
+    if (cursor->y_offset != line_y) {
+        fit_page(cursor);
+    }
+    print_word_at_cursor(cursor, word, length);
+    DEBUG_LOG("Added word spacing: %.3f, New X offset: %.3f\n", cursor->word_spacing, cursor->x_offset);
+}
+
+// Print the buffered paragraph with optimal breaks, or greedily when params is NULL
+static void print_paragraph(LayoutCursor *cursor, Paragraph *paragraph, const LineBreakParams *params) {
+    if (paragraph->count == 0) {
+        return;
+    }
+
+    if (!params) {
+        for (size_t i = 0; i < paragraph->count; i++) {
+            place_word_greedy(cursor, paragraph->text + paragraph->offsets[i],
+                              paragraph->lengths[i], paragraph->widths[i]);
+        }
+        paragraph_clear(paragraph);
+        return;
+    }
+
+    size_t lines = paragraph_break_lines(paragraph, params);
+    size_t next_line = 1;
+    apply_pending_lines(cursor);
+    for (size_t i = 0; i < paragraph->count; i++) {
+        if (next_line < lines && i == paragraph->line_starts[next_line]) {
+            cursor->x_offset = 0.0f;
+            cursor->y_offset -= cursor->line_spacing;
+            next_line++;
+            DEBUG_LOG("New line: Y=%.3f\n", cursor->y_offset);
+            fit_page(cursor);
+        }
+        print_word_at_cursor(cursor, paragraph->text + paragraph->offsets[i], paragraph->lengths[i]);
+    }
+    paragraph_clear(paragraph);
+}
+
+int layout_text_file(Generator *generator, const LayoutOptions *options, const char *filename, float scale_factor) {
+    DEBUG_PRINT_FILE(filename);
+
+    const PageSetup *page = &options->page;
+    if (check_page_setup(page) != 0) {
+        return -1;
+    }
+    TextReader reader;
+    if (text_reader_open(&reader, filename) != 0) {
+        DEBUG_LOG("Error: Could not open text file %s\n", filename);
+        return -1;
+    }
+    TRACE_BEGIN("process_text_file");
+
+    const float TEXT_HEIGHT = 18.0f * scale_factor;
+    const float LINE_SPACING = options->base_line_spacing + TEXT_HEIGHT;
+    const float WORD_SPACING = scale_factor * options->word_spacing_factor;
+    const float LINE_WIDTH = page->page_width - page->margin_left - page->margin_right;
+    const float AREA_HEIGHT = page->page_height > 0.0f ?
+        page->page_height - page->margin_top - page->margin_bottom : 0.0f;
+
+    LayoutCursor cursor = { generator, page, 0.0f, -TEXT_HEIGHT, TEXT_HEIGHT, LINE_SPACING, WORD_SPACING,
+                            scale_factor, LINE_WIDTH, AREA_HEIGHT, 0, 1 };
+
+    // The robot starts each job at the origin with the pen state not yet known
+    generator_start(generator);
+
+    DEBUG_LOG("Initial position: X=%.3f, Y=%.3f\n", cursor.x_offset, cursor.y_offset);
+    DEBUG_LOG("Text height: %.3f, Line spacing: %.3f\n", TEXT_HEIGHT, LINE_SPACING);
+
+    // Each line costs its pen-up return to the margin plus a lift; slack costs badness
+    const LineBreakParams params = {
+        LINE_WIDTH, WORD_SPACING, LINE_BREAK_BADNESS_WEIGHT, LINE_SPACING + LINE_BREAK_LIFT_COST
+    };
+    Paragraph paragraph;
+    paragraph_init(&paragraph);
+    int paragraph_overflowed = 0;
+
+    TextToken token;
+    int read = 0;
+    // A sink failure or a glyph outside a failing work area ends the job; the rest is not laid out
+    while (!generator->sink_failed && (read = text_reader_next(&reader, &token)) > 0) {
+        switch (token.type) {
+        case TOKEN_NEWLINE:
+        case TOKEN_PARAGRAPH:
+            print_paragraph(&cursor, &paragraph, &params);
+            paragraph_overflowed = 0;
+            cursor.pending_lines += token.type == TOKEN_NEWLINE ? 1 : PARAGRAPH_SPACING_LINES;
+            break;
+        case TOKEN_WORD: {
+            float width = word_width(generator->font, token.text, token.length, scale_factor);
+            if (options->line_break_mode == LINE_BREAK_OPTIMAL && !paragraph_overflowed) {
+                if (paragraph.count < LINE_BREAK_MAX_WORDS &&
+                    paragraph_add_word(&paragraph, token.text, token.length, width) == 0) {
+                    break;
+                }
+                // Too long to break optimally: lay out what is buffered greedily and stream the rest
+                DEBUG_LOG("Paragraph exceeds %d words, falling back to greedy breaks\n", LINE_BREAK_MAX_WORDS);
+                print_paragraph(&cursor, &paragraph, NULL);
+                paragraph_overflowed = 1;
+            }
+            place_word_greedy(&cursor, token.text, token.length, width);
+            break;
+        }
+        default:
+            // Runs of spaces collapse to the single word spacing added after each word
+            break;
+        }
+    }
+    if (read < 0) {
+        // A truncated document is not a finished job: nothing is flushed or cached
+        DEBUG_LOG("Error: Could not read text file %s\n", filename);
+        paragraph_free(&paragraph);
+        text_reader_close(&reader);
+        TRACE_END("process_text_file");
+        return -1;
+    }
+    print_paragraph(&cursor, &paragraph, &params);
+    int result = generator_finish(generator);
+    DEBUG_LOG("Layout finished on page %d\n", cursor.page_number);
+
+    paragraph_free(&paragraph);
+    text_reader_close(&reader);
+    TRACE_END("process_text_file");
+    return result;
+}
+
+int process_text_file(const char *filename, float scale_factor) {
+    int result = layout_text_file(get_default_generator(), &layout_options, filename, scale_factor);
+    if (result == 0) {
+        print_serpentine_savings(get_default_generator());
+    }
+    print_work_area_report(get_default_generator());
+    return result;
+}
@@ -0,0 +1,166 @@
+/**
+ * @file layout.h
+ * @brief Streaming text layout for the Robot Writer
+ *
+ * Turns the token stream from the text reader into placed glyphs: word
+ * wrapping, hard line and paragraph breaks, page size, margins and page
+ * breaks. Memory use is independent of document length: only the current
+ * paragraph (optimal line breaking) and the current line (serpentine order)
+ * are ever buffered, and pages are emitted as they are completed.
+ *
+ * layout_text_file() takes its options and generator explicitly and can run
+ * on several threads at once. process_text_file() and the setters below use
+ * the built-in options and generator and are for single-job use.
+ */
+
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <stddef.h>
+#include "linebreak.h"
+#include "font.h"
+
+/**
+ * @brief Text formatting constants for layout control
+ */
+#define BASE_LINE_SPACING 5.0f      // Base spacing between lines in mm
+#define WORD_SPACING_FACTOR 15.0f   // Multiplier for space between words
+#define MAX_LINE_WIDTH 100.0f       // Maximum width of text line in mm (default page width)
+#define PARAGRAPH_SPACING_LINES 2   // Line advances for a paragraph break (one blank line)
+#define MIN_HEIGHT 4.0f             // Text heights the font is drawn at, in mm
+#define MAX_HEIGHT 10.0f
+
+/**
+ * @brief Page geometry
+ *
+ * All sizes are in mm. The page's top-left corner is the robot origin; text
+ * is placed inside the margins and y grows negative down the page.
+ */
+typedef struct {
+    float page_width;           // Width of the page
+    float page_height;          // Height of the page, 0 for a single unlimited page
+    float margin_left;
+    float margin_right;
+    float margin_top;
+    float margin_bottom;
+} PageSetup;
+
+/**
+ * @brief Everything that controls how text is laid out
+ */
+typedef struct {
+    LineBreakMode line_break_mode;
+    PageSetup page;
+    float base_line_spacing;        // mm between lines on top of the text height
+    float word_spacing_factor;      // Space between words in font units
+} LayoutOptions;
+
+/**
+ * @brief Returns the options used by process_text_file()
+ *
+ * Starts as greedy breaking on a single unlimited page MAX_LINE_WIDTH wide,
+ * with BASE_LINE_SPACING and WORD_SPACING_FACTOR.
+ *
+ * @param options Receives a copy of the options
+ */
+void get_layout_options(LayoutOptions *options);
+
+/**
+ * @brief Checks that a page leaves room for text inside its margins
+ *
+ * @param setup Page setup to check
+ * @return int 0 if usable, -1 otherwise
+ */
+int check_page_setup(const PageSetup *setup);
+
+/**
+ * @brief Lays out a text file and generates its motion operations
+ *
+ * Same as process_text_file(), with explicit options and generator. Safe to
+ * call from several threads with different generators.
+ *
+ * @param generator Generator (and through it the font and sink) to use
+ * @param options Layout options
+ * @param filename Path to the text file to process, or "-" for standard input
+ * @param scale_factor Scaling factor for text size
+ * @return int 0 on success, -1 on bad options, an unreadable file or a sink failure
+ */
+int layout_text_file(Generator *generator, const LayoutOptions *options, const char *filename, float scale_factor);
+
+/**
+ * @brief Processes a text file and converts it to G-code
+ *
+ * Hard line breaks in the file start a new line and blank lines start a new
+ * paragraph; runs of spaces collapse to a single word spacing. A line that
+ * would cross the bottom margin starts a new page. Motion operations go to
+ * the sink set with set_generation_sink().
+ *
+ * @param filename Path to the text file to process, or "-" for standard input
+ * @param scale_factor Scaling factor for text size
+ * @return int 0 on success, -1 if the file could not be read or the sink failed
+ */
+int process_text_file(const char *filename, float scale_factor);
+
+/**
+ * @brief Selects how process_text_file() breaks paragraphs into lines
+ *
+ * LINE_BREAK_GREEDY (the default) wraps as soon as a word does not fit.
+ * LINE_BREAK_OPTIMAL buffers each paragraph and minimises badness plus
+ * per-line travel; paragraphs longer than LINE_BREAK_MAX_WORDS words fall
+ * back to greedy breaking.
+ *
+ * @param mode Line breaking strategy
+ */
+void set_line_break_mode(LineBreakMode mode);
+
+/**
+ * @brief Sets the page geometry used by process_text_file()
+ *
+ * The default is a single unlimited page MAX_LINE_WIDTH wide with no margins.
+ *
+ * @param setup Page setup to copy
+ * @return int 0 on success, -1 if the margins leave no room for text
+ */
+int set_page_setup(const PageSetup *setup);
+
+/**
+ * @brief Returns the page geometry currently in use
+ *
+ * @param setup Receives a copy of the page setup
+ */
+void get_page_setup(PageSetup *setup);
+
+/**
+ * @brief Helper function to calculate total width of a word
+ *
+ * @param word Characters of the word (need not be NUL-terminated)
+ * @param length Number of characters in the word
+ * @param scale_factor Scaling factor for text size
+ * @return float Total width of the word in mm
+ */
+float calculate_word_width(const char* word, size_t length, float scale_factor);
+
+/**
+ * @brief Updates print position for text layout
+ *
+ * @param x_offset Pointer to current X position
+ * @param y_offset Pointer to current Y position
+ * @param word_width Width of current word
+ * @param line_spacing Spacing between lines
+ * @param max_width Maximum line width
+ */
+void update_print_position(float* x_offset, float* y_offset, float word_width,
+                         float line_spacing, float max_width);
+
+/**
+ * @brief Prints a single word at the specified position
+ *
+ * @param word Characters of the word (need not be NUL-terminated)
+ * @param length Number of characters in the word
+ * @param scale_factor Scaling factor for text size
+ * @param x_offset Pointer to current X position (updated after printing)
+ * @param y_offset Pointer to current Y position
+ */
+void print_word(const char* word, size_t length, float scale_factor, float* x_offset, float* y_offset);
+
+#endif // LAYOUT_H
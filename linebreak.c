@@ -0,0 +1,124 @@
+// linebreak.c
+#include <stdlib.h>
+#include <string.h>
+#include "linebreak.h"
+#include "debug.h"
+
+void paragraph_init(Paragraph *paragraph) {
+    memset(paragraph, 0, sizeof(*paragraph));
+}
+
+// Grow the per-word arrays to hold at least one more word
+static int grow_words(Paragraph *paragraph) {
+    size_t capacity = paragraph->capacity ? paragraph->capacity * 2 : 64;
+    size_t *offsets = realloc(paragraph->offsets, capacity * sizeof(size_t));
+    if (offsets) paragraph->offsets = offsets;
+    size_t *lengths = realloc(paragraph->lengths, capacity * sizeof(size_t));
+    if (lengths) paragraph->lengths = lengths;
+    float *widths = realloc(paragraph->widths, capacity * sizeof(float));
+    if (widths) paragraph->widths = widths;
+    size_t *line_starts = realloc(paragraph->line_starts, capacity * sizeof(size_t));
+    if (line_starts) paragraph->line_starts = line_starts;
+    double *cost = realloc(paragraph->cost, (capacity + 1) * sizeof(double));
+    if (cost) paragraph->cost = cost;
+    size_t *previous = realloc(paragraph->previous, (capacity + 1) * sizeof(size_t));
+    if (previous) paragraph->previous = previous;
+
+    if (!offsets || !lengths || !widths || !line_starts || !cost || !previous) {
+        DEBUG_LOG("Error: Could not grow paragraph buffer\n");
+        return -1;
+    }
+    paragraph->capacity = capacity;
+    return 0;
+}
+
+int paragraph_add_word(Paragraph *paragraph, const char *word, size_t length, float width) {
+    if (paragraph->count == paragraph->capacity && grow_words(paragraph) != 0) {
+        return -1;
+    }
+    if (paragraph->text_length + length > paragraph->text_capacity) {
+        size_t capacity = paragraph->text_capacity ? paragraph->text_capacity : 1024;
+        while (capacity < paragraph->text_length + length) {
+            capacity *= 2;
+        }
+        char *text = realloc(paragraph->text, capacity);
+        if (!text) {
+            DEBUG_LOG("Error: Could not grow paragraph text\n");
+            return -1;
+        }
+        paragraph->text = text;
+        paragraph->text_capacity = capacity;
+    }
+
+    memcpy(paragraph->text + paragraph->text_length, word, length);
+    paragraph->offsets[paragraph->count] = paragraph->text_length;
+    paragraph->lengths[paragraph->count] = length;
+    paragraph->widths[paragraph->count] = width;
+    paragraph->text_length += length;
+    paragraph->count++;
+    return 0;
+}
+
+void paragraph_clear(Paragraph *paragraph) {
+    paragraph->count = 0;
+    paragraph->text_length = 0;
+}
+
+void paragraph_free(Paragraph *paragraph) {
+    free(paragraph->text);
+    free(paragraph->offsets);
+    free(paragraph->lengths);
+    free(paragraph->widths);
+    free(paragraph->line_starts);
+    free(paragraph->cost);
+    free(paragraph->previous);
+    paragraph_init(paragraph);
+}
+
+size_t paragraph_break_lines(Paragraph *paragraph, const LineBreakParams *params) {
+    const size_t n = paragraph->count;
+    const float *widths = paragraph->widths;
+    double *cost = paragraph->cost;
+    size_t *previous = paragraph->previous;
+
+    // cost[j] is the cheapest layout of words [0, j); the last line of it starts at previous[j]
+    cost[0] = 0.0;
+    for (size_t j = 1; j <= n; j++) {
+        cost[j] = -1.0;
+        float line_width = -params->space_width;
+
+        // Walk the candidate line start back from j-1 until the line no longer fits
+        for (size_t i = j; i-- > 0;) {
+            line_width += widths[i] + params->space_width;
+            if (line_width > params->max_width && i != j - 1) {
+                break;
+            }
+
+            double line_cost = params->line_penalty;
+            if (j != n && line_width < params->max_width) {
+                double slack = (double)(params->max_width - line_width) / params->max_width;
+                line_cost += params->badness_weight * slack * slack;
+            }
+
+            double total = cost[i] + line_cost;
+            if (cost[j] < 0.0 || total < cost[j]) {
+                cost[j] = total;
+                previous[j] = i;
+            }
+        }
+    }
+
+    // Recover the line starts by walking the chain back from the end
+    size_t lines = 0;
+    for (size_t j = n; j > 0; j = previous[j]) {
+        lines++;
+    }
+    size_t k = lines;
+    for (size_t j = n; j > 0; j = previous[j]) {
+        paragraph->line_starts[--k] = previous[j];
+    }
+
+    DEBUG_LOG("Optimal breaks: %lu words on %lu lines, cost %.3f\n",
+              (unsigned long)n, (unsigned long)lines, cost[n]);
+    return lines;
+}
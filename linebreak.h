@@ -0,0 +1,111 @@
+/**
+ * @file linebreak.h
+ * @brief Paragraph-level line breaking for the Robot Writer layout
+ *
+ * Buffers the words of one paragraph together with their precomputed widths
+ * and chooses line breaks by dynamic programming (Knuth-Plass style) so that
+ * the total of line badness and per-line robot travel is minimal.
+ */
+
+#ifndef LINEBREAK_H
+#define LINEBREAK_H
+
+#include <stddef.h>
+
+/**
+ * @brief Largest paragraph broken optimally; longer ones fall back to greedy
+ */
+#define LINE_BREAK_MAX_WORDS 2000
+
+/**
+ * @brief Default cost weights
+ */
+#define LINE_BREAK_BADNESS_WEIGHT 100.0f    // Cost of a line left completely empty (slack ratio 1.0)
+#define LINE_BREAK_LIFT_COST 10.0f          // Travel in mm equivalent to one pen lift at a line change
+
+/**
+ * @brief Line breaking strategies
+ */
+typedef enum {
+    LINE_BREAK_GREEDY = 0,      // Break as soon as the next word does not fit
+    LINE_BREAK_OPTIMAL          // Minimise badness plus travel over the whole paragraph
+} LineBreakMode;
+
+/**
+ * @brief Parameters of the line breaking cost function
+ *
+ * Every line costs line_penalty (the carriage-return travel and pen lift it
+ * causes on the robot). Every line except the last also costs
+ * badness_weight * (slack / max_width)^2 for the space left at its end.
+ */
+typedef struct {
+    float max_width;        // Available line width in mm
+    float space_width;      // Gap between adjacent words in mm
+    float badness_weight;   // Weight of squared relative slack
+    float line_penalty;     // Fixed cost per line in mm of travel
+} LineBreakParams;
+
+/**
+ * @brief Words of the paragraph being laid out
+ *
+ * Word bytes are copied into one arena so they outlive the reader's slices.
+ */
+typedef struct {
+    char *text;             // Concatenated word bytes
+    size_t text_length;     // Bytes used in text
+    size_t text_capacity;   // Bytes allocated for text
+    size_t *offsets;        // Start of each word within text
+    size_t *lengths;        // Length of each word
+    float *widths;          // Width of each word in mm
+    size_t *line_starts;    // Index of the first word of each line (after breaking)
+    double *cost;           // DP scratch: best cost of laying out the first i words
+    size_t *previous;       // DP scratch: start of the last line in that layout
+    size_t count;           // Number of words buffered
+    size_t capacity;        // Number of words allocated
+} Paragraph;
+
+/**
+ * @brief Initialises an empty paragraph buffer
+ *
+ * @param paragraph Paragraph to initialise
+ */
+void paragraph_init(Paragraph *paragraph);
+
+/**
+ * @brief Appends a copy of a word to the paragraph
+ *
+ * @param paragraph Paragraph to append to
+ * @param word Characters of the word (need not be NUL-terminated)
+ * @param length Number of characters in the word
+ * @param width Width of the word in mm
+ * @return int 0 on success, -1 if memory could not be allocated
+ */
+int paragraph_add_word(Paragraph *paragraph, const char *word, size_t length, float width);
+
+/**
+ * @brief Empties the paragraph, keeping its allocations for reuse
+ *
+ * @param paragraph Paragraph to clear
+ */
+void paragraph_clear(Paragraph *paragraph);
+
+/**
+ * @brief Releases all memory held by the paragraph
+ *
+ * @param paragraph Paragraph to free
+ */
+void paragraph_free(Paragraph *paragraph);
+
+/**
+ * @brief Chooses optimal line breaks for the buffered words
+ *
+ * Fills paragraph->line_starts. A word wider than max_width is placed on a
+ * line of its own.
+ *
+ * @param paragraph Paragraph holding at least one word
+ * @param params Cost function parameters
+ * @return size_t Number of lines
+ */
+size_t paragraph_break_lines(Paragraph *paragraph, const LineBreakParams *params);
+
+#endif // LINEBREAK_H
@@ -2,51 +2,413 @@
 #include <stdlib.h>
 #include <windows.h>
 #include <conio.h>
+#include <string.h>
 #include "rs232.h"
 #include "serial.h"
 #include "font.h"
+#include "fontreg.h"
+#include "layout.h"
+#include "job.h"
+#include "daemon.h"
+#include "scheduler.h"
+#include "pargen.h"
+#include "session.h"
+#include "flow.h"
+#include "recovery.h"
+#include "startup.h"
+#include "sim.h"
+#include "stamp.h"
+#include "platform.h"
+#include "trace.h"
 #include "debug.h"
 
 // Constants
 #define BAUD_RATE 115200
-#define MIN_HEIGHT 4.0f
-#define MAX_HEIGHT 10.0f
 
 // Function prototypes
 void SendCommands (char *buffer );
-void wake_up_robot(void);
+int wake_up_robot(void);
 void return_to_origin(void);
 float get_text_height(void);
 void initialize_robot(void);
-void process_text(const char *text_filename, float scale_factor);
+int process_text(JobSpec *job);
+int process_labels(JobSpec *job, unsigned long copies);
+int change_page(int next_page, void *user_data);
+int skip_rest_of_line(void);
+int run_robot_pool(JobSpec *job, const int *ports, int robot_count);
+void announce_unit(int robot, int page, void *user_data);
+int change_robot_sheet(int robot, int page, void *user_data);
+void start_metrics(Transport *transport, int robot, int port, const JobSpec *job);
+void finish_metrics(Transport *transport);
+void finish_trace(const char *path);
+void finish_recording(const char *path);
+void finish_flow(int robot, int port);
+int simulate_gcode(const char *path, const char *compare_path, double tolerance, const char *image_prefix);
+int load_fonts(void);
+int build_font_registry(const char *path, char *list);
 
-int main() {
+// Command instrumentation (--metrics), one per robot
+static int metrics_enabled = 0;
+static Metrics robot_metrics[SCHEDULER_MAX_ROBOTS];
+
+// The single robot: its serial port, streamed (--flow) or a recorded session played back (--replay-session)
+static Transport *robot_transport = &serial_transport;
+static ReplayTransport replay;
+
+// Bring-up and time-to-first-stroke of the single robot
+static StartupReport startup;
+
+// Streaming flow control (--flow), one per robot
+static int flow_enabled = 0;
+static FlowMode flow_mode = FLOW_FIXED;
+static FlowTransport robot_flows[SCHEDULER_MAX_ROBOTS];
+
+// Copies of one block (--labels or --origins), at these places on each sheet
+static StampOrigin label_origins[STAMP_MAX_ORIGINS];
+static int label_origin_count = 0;
+static float label_width = 0.0f;
+
+// Fonts shared by every writer process (--font-registry), and the one jobs use by default
+static const char *font_registry_path = NULL;
+static const char *font_name = NULL;
+static FontRegistry font_registry;
+
+int main(int argc, char *argv[]) {
 
     float text_height, scale_factor;
     char text_filename[256];
+    int status = 0;
 
     DEBUG_LOG("Starting Robot Writer program\n");
+    startup.launched_ns = monotonic_ns();
+
+    JobSpec job;
+    const char *print_ir = NULL;
+    const char *export_core = NULL;
+    const char *simulate_path = NULL;
+    const char *compare_path = NULL;
+    const char *image_prefix = NULL;
+    double tolerance = SIM_TOLERANCE_MM;
+    const char *daemon_socket = NULL;
+    int pool_ports[SCHEDULER_MAX_ROBOTS];
+    int pool_size = 0;
+    const char *trace_path = NULL;
+    const char *record_path = NULL;
+    const char *replay_path = NULL;
+    double replay_speed = 1.0;
+    int label_columns = 0, label_rows = 0;
+    float pitch_x = 0.0f, pitch_y = 0.0f;
+    const char *origins_path = NULL;
+    long copies = 0;
+    RecoveryPolicy recovery;
+    job_spec_init(&job, NULL, 0.0f);
+    recovery_policy_init(&recovery);
 
-    // Initialize serial communication
-    if (CanRS232PortBeOpened() == -1) {
-        DEBUG_LOG("Error: Unable to open the COM port\n");
-        printf("\nUnable to open the COM port (specified in serial.h)\n");
-        exit (0);
+    // Command line options
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--optimal-breaks") == 0) {
+            job.line_break_mode = LINE_BREAK_OPTIMAL;
+        } else if (strcmp(argv[i], "--boustrophedon") == 0) {
+            job.boustrophedon = 1;
+        } else if (strcmp(argv[i], "--join-strokes") == 0 && i + 1 < argc) {
+            job.join_distance = (float)atof(argv[++i]);
+            if (job.join_distance < 0.0f || job.join_distance > JOIN_MAX_DISTANCE) {
+                printf("Invalid join distance: %s (0 to %.1f mm)\n", argv[i], (double)JOIN_MAX_DISTANCE);
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--pen-timing") == 0 && i + 1 < argc) {
+            if (parse_pen_timing(argv[++i], &job.pen) != 0) {
+                printf("Invalid pen timing: %s (LIFT,DROP[,CONTACT] in ms)\n", argv[i]);
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--plan-feed") == 0) {
+            job.feed.enabled = 1;
+        } else if (strcmp(argv[i], "--feed-limits") == 0 && i + 1 < argc) {
+            if (parse_feed_limits(argv[++i], &job.feed) != 0) {
+                printf("Invalid feed limits: %s (MIN,MAX in mm/min)\n", argv[i]);
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--page") == 0 && i + 1 < argc &&
+                   sscanf(argv[i + 1], "%fx%f", &job.page.page_width, &job.page.page_height) == 2) {
+            i++;
+        } else if (strcmp(argv[i], "--margin") == 0 && i + 1 < argc) {
+            job.page.margin_left = job.page.margin_right = (float)atof(argv[++i]);
+            job.page.margin_top = job.page.margin_bottom = job.page.margin_left;
+        } else if (strcmp(argv[i], "--work-area") == 0 && i + 1 < argc) {
+            if (parse_work_area(argv[++i], &job.work_area) != 0) {
+                printf("Invalid work area: %s (WxH in mm)\n", argv[i]);
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--overflow") == 0 && i + 1 < argc) {
+            // What happens to text beyond the work area
+            const char *overflow = argv[++i];
+            if (strcmp(overflow, "clip") != 0 && strcmp(overflow, "fail") != 0) {
+                printf("Unknown overflow handling: %s (clip or fail)\n", overflow);
+                return -1;
+            }
+            job.work_area.fail = strcmp(overflow, "fail") == 0;
+        } else if (strcmp(argv[i], "--labels") == 0 && i + 1 < argc &&
+                   sscanf(argv[i + 1], "%dx%d", &label_columns, &label_rows) == 2) {
+            i++;
+        } else if (strcmp(argv[i], "--pitch") == 0 && i + 1 < argc &&
+                   sscanf(argv[i + 1], "%fx%f", &pitch_x, &pitch_y) == 2) {
+            i++;
+        } else if (strcmp(argv[i], "--origins") == 0 && i + 1 < argc) {
+            origins_path = argv[++i];
+        } else if (strcmp(argv[i], "--copies") == 0 && i + 1 < argc) {
+            copies = atol(argv[++i]);
+            if (copies < 1) {
+                printf("Invalid copy count: %s\n", argv[i]);
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            // Compile with this many generator threads
+            job.threads = atoi(argv[++i]);
+            if (job.threads < 1 || job.threads > PARGEN_MAX_THREADS) {
+                printf("Threads must be between 1 and %d\n", PARGEN_MAX_THREADS);
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--no-cache") == 0) {
+            job.use_cache = 0;
+        } else if (strcmp(argv[i], "--resume") == 0) {
+            job.resume = 1;
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (strcmp(argv[i], "--record-session") == 0 && i + 1 < argc) {
+            record_path = argv[++i];
+        } else if (strcmp(argv[i], "--replay-session") == 0 && i + 1 < argc) {
+            replay_path = argv[++i];
+        } else if (strcmp(argv[i], "--replay-speed") == 0 && i + 1 < argc) {
+            replay_speed = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--flow") == 0 && i + 1 < argc) {
+            if (parse_flow_mode(argv[++i], &flow_mode) != 0) {
+                printf("Unknown flow control: %s (fixed or adaptive)\n", argv[i]);
+                return -1;
+            }
+            flow_enabled = 1;
+        } else if (strcmp(argv[i], "--ack-timeout") == 0 && i + 1 < argc) {
+            recovery.ack_timeout_ms = atoi(argv[++i]);
+            if (recovery.ack_timeout_ms < 1) {
+                printf("Invalid acknowledgement timeout: %s\n", argv[i]);
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--retries") == 0 && i + 1 < argc) {
+            recovery.retries = atoi(argv[++i]);
+            if (recovery.retries < 0) {
+                printf("Invalid retry count: %s\n", argv[i]);
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--no-rehome") == 0) {
+            recovery.rehome = 0;
+        } else if (strcmp(argv[i], "--metrics") == 0) {
+            metrics_enabled = 1;
+        } else if (strcmp(argv[i], "--print-ir") == 0 && i + 1 < argc) {
+            print_ir = argv[++i];
+        } else if (strcmp(argv[i], "--font-registry") == 0 && i + 1 < argc) {
+            font_registry_path = argv[++i];
+        } else if (strcmp(argv[i], "--font") == 0 && i + 1 < argc) {
+            font_name = argv[++i];
+        } else if (strcmp(argv[i], "--build-font-registry") == 0 && i + 2 < argc) {
+            // Compile fonts into a registry file and stop
+            return build_font_registry(argv[i + 1], argv[i + 2]);
+        } else if (strcmp(argv[i], "--export-core-font") == 0 && i + 1 < argc) {
+            export_core = argv[++i];
+        } else if (strcmp(argv[i], "--simulate") == 0 && i + 1 < argc) {
+            simulate_path = argv[++i];
+        } else if (strcmp(argv[i], "--compare-with") == 0 && i + 1 < argc) {
+            compare_path = argv[++i];
+        } else if (strcmp(argv[i], "--image") == 0 && i + 1 < argc) {
+            image_prefix = argv[++i];
+        } else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+            tolerance = atof(argv[++i]);
+            if (tolerance <= 0.0) {
+                printf("Invalid tolerance: %s\n", argv[i]);
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--daemon") == 0 && i + 1 < argc) {
+            daemon_socket = argv[++i];
+        } else if (strcmp(argv[i], "--robots") == 0 && i + 1 < argc) {
+            // Comma-separated COM port numbers, one robot each
+            char *list = argv[++i];
+            while (pool_size < SCHEDULER_MAX_ROBOTS && *list) {
+                int com = (int)strtol(list, &list, 10);
+                if (com < 1) {
+                    break;
+                }
+                pool_ports[pool_size++] = com - 1;
+                list += *list == ',';
+            }
+            if (*list || pool_size == 0) {
+                printf("Invalid robot list: %s\n", argv[i]);
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--client") == 0 && i + 2 < argc) {
+            // Talk to a running daemon instead of the robot
+            char reply[DAEMON_MAX_JOBS * 160];
+            if (daemon_request(argv[i + 1], argv[i + 2], reply, sizeof(reply)) != 0) {
+                printf("Could not reach the daemon at %s\n", argv[i + 1]);
+                return -1;
+            }
+            printf("%s", reply);
+            return strncmp(reply, "ERR", 3) == 0 ? -1 : 0;
+        } else {
+            printf("Unknown option: %s\n", argv[i]);
+            printf("Usage: %s [--optimal-breaks] [--boustrophedon] [--join-strokes MM] [--plan-feed] [--feed-limits MIN,MAX]\n"
+                   "          [--pen-timing LIFT,DROP[,CONTACT]] [--page WxH] [--margin MM] [--threads N] [--no-cache]\n"
+                   "          [--resume] [--flow fixed|adaptive] [--ack-timeout MS] [--retries N] [--no-rehome]\n"
+                   "          [--metrics] [--trace FILE] [--font-registry FILE [--font NAME]]\n"
+                   "          [--work-area WxH [--overflow clip|fail]]\n"
+                   "       %s [options] --labels COLSxROWS --pitch WxH | --origins FILE [--copies N]\n"
+                   "       %s [options] --record-session FILE | --replay-session FILE [--replay-speed X]\n"
+                   "       %s [--page WxH] [--margin MM] [layout options] --robots COM,COM,...\n"
+                   "       %s --print-ir FILE.rwir\n"
+                   "       %s --export-core-font corefont.c\n"
+                   "       %s --build-font-registry FILE NAME=FONT.txt[,NAME=FONT.txt...]\n"
+                   "       %s --simulate FILE.gcode [--compare-with FILE.gcode] [--tolerance MM] [--image PREFIX]\n"
+                   "       %s [--page WxH] [--margin MM] [--work-area WxH] --daemon SOCKET\n"
+                   "       %s --client SOCKET \"REQUEST\"\n", argv[0], argv[0], argv[0], argv[0], argv[0], argv[0],
+                   argv[0], argv[0], argv[0], argv[0]);
+            return -1;
+        }
+    }
+    if (set_page_setup(&job.page) != 0) {
+        printf("Page margins leave no room for text\n");
+        return -1;
     }
+    set_recovery_policy(&recovery);
+    if (job.work_area.fail && !job.work_area.enabled) {
+        printf("--overflow needs --work-area\n");
+        return -1;
+    }
+    set_machine_work_area(&job.work_area);
+    if (font_name && !font_registry_path) {
+        printf("--font needs --font-registry\n");
+        return -1;
+    }
+    if (label_columns > 0 || origins_path) {
+        // Places of the copies; the block wraps at the label pitch, or at the page's text width
+        if (pool_size > 0 || daemon_socket) {
+            printf("--labels and --origins cannot be combined with --robots or --daemon\n");
+            return -1;
+        }
+        if (origins_path) {
+            label_origin_count = stamp_read_origins(origins_path, label_origins, STAMP_MAX_ORIGINS);
+            label_width = job.page.page_width - job.page.margin_left - job.page.margin_right;
+        } else if (pitch_x > 0.0f && pitch_y > 0.0f) {
+            label_origin_count = stamp_grid(&job.page, label_columns, label_rows, pitch_x, pitch_y, label_origins);
+            label_width = pitch_x;
+        } else {
+            printf("--labels needs --pitch WxH\n");
+            return -1;
+        }
+        if (label_origin_count < 1) {
+            printf("Invalid label positions (at most %d on a sheet)\n", STAMP_MAX_ORIGINS);
+            return -1;
+        }
+        if (copies == 0) {
+            copies = label_origin_count;
+        }
+    }
+    if (trace_path) {
+        trace_enable();
+        trace_set_thread_name("main");
+    }
+    if (replay_path) {
+        // The recorded controller stands in for the robot of a single-robot job
+        if (pool_size > 0 || daemon_socket || record_path || flow_enabled) {
+            printf("--replay-session cannot be combined with --robots, --daemon, --record-session or --flow\n");
+            return -1;
+        }
+        if (replay_transport_open(&replay, replay_path, -1, replay_speed) != 0) {
+            printf("Could not replay %s\n", replay_path);
+            return -1;
+        }
+        robot_transport = &replay.transport;
+    }
+    if (flow_enabled && pool_size == 0) {
+        flow_transport_init_port(&robot_flows[0], flow_mode, cport_nr);
+        robot_transport = &robot_flows[0].transport;
+    }
+    if (record_path && session_record_start(record_path) != 0) {
+        printf("Could not create %s\n", record_path);
+        return -1;
+    }
+
+    // Inspect a compiled job: print its G-code without touching the robot
+    if (print_ir) {
+        Executor executor;
+        executor_init(&executor, &stdout_transport, NULL, NULL);
+        return execute_ir_file(print_ir, &executor) == 0 ? 0 : -1;
+    }
+
+    // Check G-code offline (sim.h)
+    if (simulate_path) {
+        return simulate_gcode(simulate_path, compare_path, tolerance, image_prefix);
+    }
+
+    // Write the font table of the freestanding core (core.h)
+    if (export_core) {
+        if (load_fonts() != 0 || font_export_core(get_loaded_font(), export_core) != 0) {
+            printf("Could not export the font to %s\n", export_core);
+            return -1;
+        }
+        return 0;
+    }
+
+    // Several robots share the job page by page
+    if (pool_size > 0) {
+        int result = run_robot_pool(&job, pool_ports, pool_size);
+        finish_recording(record_path);
+        finish_trace(trace_path);
+        return result;
+    }
+
+    if (!replay_path) {
+        // Initialize serial communication
+        if (CanRS232PortBeOpened() == -1) {
+            DEBUG_LOG("Error: Unable to open the COM port\n");
+            printf("\nUnable to open the COM port (specified in serial.h)\n");
+            exit (0);
+        }
 
-    // Wake up the robot
-    wake_up_robot();
+        // Wake up the robot
+        if (wake_up_robot() != 0) {
+            CloseRS232Port();
+            return -1;
+        }
+    }
 
     // Load font file
-    if (load_font_file("SingleStrokeFont.txt") == -1) {
+    if (load_fonts() == -1) {
         DEBUG_LOG("Error: Failed to load font file\n");
         printf("Failed to load font file\n");
-        CloseRS232Port();
+        if (!replay_path) {
+            CloseRS232Port();
+        }
         return -1;
     }
 
+    // Serve queued jobs until a SHUTDOWN request
+    if (daemon_socket) {
+        initialize_robot();
+        start_metrics(robot_transport, 0, cport_nr, NULL);
+        int result = run_daemon(daemon_socket, robot_transport);
+        finish_metrics(robot_transport);
+        return_to_origin();
+        finish_flow(0, cport_nr);
+        CloseRS232Port();
+        finish_recording(record_path);
+        finish_trace(trace_path);
+        return result;
+    }
+
     // Get text height from user
     text_height = get_text_height();
+    if (text_height <= 0.0f) {
+        printf("No text height given\n");
+        status = -1;
+        goto finish;
+    }
     scale_factor = text_height / 18.0f;
     DEBUG_LOG("Using scale factor: %.3f\n", scale_factor);
 
@@ -55,35 +417,59 @@ int main() {
 
     // Get text file name from user
     printf("Enter the name of the text file to process: ");
-    scanf("%s", text_filename);
+    if (scanf("%255s", text_filename) != 1) {
+        printf("No text file given\n");
+        status = -1;
+        goto finish;
+    }
+    skip_rest_of_line();
 
     // Process the text file
-    process_text(text_filename, scale_factor);
+    job.text_filename = text_filename;
+    job.scale_factor = scale_factor;
+    job.font = get_loaded_font();
+    if (label_origin_count > 0) {
+        status = process_labels(&job, (unsigned long)copies);
+    } else {
+        status = process_text(&job);
+    }
 
+finish:
     // Return to origin and pen up before finishing
     return_to_origin();
+    finish_flow(0, cport_nr);
 
-    // Close the COM port
-    CloseRS232Port();
-    DEBUG_LOG("COM port closed\n");
-    printf("Program completed successfully\n");
-    return 0;
+    if (replay_path) {
+        replay_transport_report(&replay);
+        replay_transport_close(&replay);
+    } else {
+        // Close the COM port
+        CloseRS232Port();
+        DEBUG_LOG("COM port closed\n");
+    }
+    finish_recording(record_path);
+    finish_trace(trace_path);
+    if (status == 0) {
+        printf("Program completed successfully\n");
+    }
+    return status;
 }
 
 /**
  * Wakes up the robot by sending an initial command.
+ * @return 0 once the robot has answered, -1 if it did not.
  */
-void wake_up_robot(void) {
-    char buffer[100];
+int wake_up_robot(void) {
     DEBUG_LOG("Waking up robot\n");
     printf("\nAbout to wake up the robot\n");
 
-    sprintf(buffer, "\n");
-    PrintBuffer(&buffer[0]);
-    Sleep(100);
-    WaitForDollar();
+    if (startup_wake(cport_nr, &startup) != 0) {
+        printf("\nThe robot did not answer\n");
+        return -1;
+    }
 
     printf("\nThe robot is now ready to draw\n");
+    return 0;
 }
 
 /**
@@ -98,17 +484,41 @@ void return_to_origin(void) {
 
     sprintf(buffer, "G0 X0 Y0\n"); // Move to origin
     SendCommands(buffer);
+
+    // A streaming transport returns before the robot gets there
+    transport_drain(robot_transport);
+}
+
+/**
+ * Discards what is left of the current input line, Enter included.
+ * @return 0 once the line has ended, -1 if the input ended first.
+ */
+int skip_rest_of_line(void) {
+    int c;
+    while ((c = getchar()) != '\n') {
+        if (c == EOF) {
+            return -1;
+        }
+    }
+    return 0;
 }
 
 /**
  * Prompts the user to enter a valid text height and returns it.
- * @return The text height entered by the user.
+ * @return The text height entered by the user, 0 if the input ended first.
  */
 float get_text_height(void) {
     float height;
     do {
         printf("Enter text height (%.1f-%.1f mm): ", MIN_HEIGHT, MAX_HEIGHT);
-        scanf("%f", &height);
+        int read = scanf("%f", &height);
+        // The rest of the line, Enter included, must not answer a later prompt or page break
+        if (skip_rest_of_line() != 0 && read != 1) {
+            return 0.0f;
+        }
+        if (read != 1) {
+            height = 0.0f;
+        }
         if (height < MIN_HEIGHT || height > MAX_HEIGHT) {
             printf("Invalid height. Please enter a value between %.1f and %.1f mm\n", 
                    MIN_HEIGHT, MAX_HEIGHT);
@@ -121,33 +531,428 @@ float get_text_height(void) {
 
 /**
  * Initializes the robot by setting the pen to the starting position.
+ * Commands the controller reports as already in effect are skipped.
  */
 void initialize_robot(void) {
-    char buffer[100];
     DEBUG_LOG("Initializing robot\n");
 
-    sprintf(buffer, "G1 X0 Y0 F1000\n"); // Move to origin at a safe speed
-    SendCommands(buffer);
-    sprintf(buffer, "M3\n"); // Enable spindle (pen down)
-    SendCommands(buffer);
-    sprintf(buffer, "S0\n"); // Pen up
-    SendCommands(buffer);
+    // A replayed session has no port to ask
+    int port = robot_transport == &replay.transport ? -1 : cport_nr;
+    if (startup_initialise(robot_transport, port, transport_machine_state(robot_transport), &startup) != 0) {
+        printf("Failed to initialise the robot\n");
+    }
+}
+
+/**
+ * Compiles the text file (or fetches it from the job cache) and sends its G-code to the robot.
+ * @param job The text file, scale factor and layout options.
+ * @return 0 on success, -1 if the job failed or stopped.
+ */
+int process_text(JobSpec *job) {
+    Executor executor;
+    DEBUG_LOG("Processing text file: %s\n", job->text_filename);
+
+    executor_init(&executor, robot_transport, change_page, NULL);
+    start_metrics(robot_transport, 0, cport_nr, job);
+    int result = run_job(job, &executor);
+    if (result != 0) {
+        printf("Failed to process %s\n", job->text_filename);
+    }
+    finish_metrics(robot_transport);
+    char label[16];
+    snprintf(label, sizeof(label), "com%d", cport_nr + 1);
+    startup_print_report(&startup, label, executor.started_ns, executor.first_stroke_ns);
+    return result;
+}
+
+/**
+ * Generates the text once and sends copies of it to the robot at the label positions.
+ * @param job The text file, scale factor and layout options of one copy.
+ * @param copies Number of copies; more than fit on a sheet continue on the next.
+ * @return 0 on success, -1 if the labels could not be generated, placed or sent.
+ */
+int process_labels(JobSpec *job, unsigned long copies) {
+    Executor executor;
+    StampBlock block;
+    StampReport report;
+    int result = 0;
+    DEBUG_LOG("Processing labels: %s\n", job->text_filename);
+
+    if (stamp_compile(&block, job, label_width) != 0) {
+        printf("Failed to process %s\n", job->text_filename);
+        return -1;
+    }
+    // Copies are not clipped: every one must fit the work area before anything is sent
+    for (int i = 0; job->work_area.enabled && i < label_origin_count; i++) {
+        const StampOrigin *origin = &label_origins[i];
+        if (work_area_box(&job->work_area, (float)origin->x / 1000.0f, (float)(origin->y - block.height) / 1000.0f,
+                          (float)(origin->x + block.width) / 1000.0f, (float)origin->y / 1000.0f) != WORK_AREA_INSIDE) {
+            printf("Label %d at X=%.1f, Y=%.1f mm leaves the work area\n", i + 1, (double)origin->x / 1000.0,
+                   (double)origin->y / 1000.0);
+            stamp_block_free(&block);
+            return -1;
+        }
+    }
+    executor_init(&executor, robot_transport, change_page, NULL);
+    start_metrics(robot_transport, 0, cport_nr, job);
+    OpSink sink = { executor_emit, &executor };
+    if (stamp_copies(&block, label_origins, label_origin_count, copies, &job->pen, &sink, &report) != 0 ||
+        transport_drain(robot_transport) != 0) {
+        printf("Failed to process %s\n", job->text_filename);
+        result = -1;
+    } else {
+        printf("Labels: %lu copies on %d sheet(s) from %lu generated operations, %.1f mm pen-up travel "
+               "between copies (%.1f mm in the order given)\n", report.copies, report.sheets,
+               (unsigned long)block.count, report.travel_mm, report.given_travel_mm);
+    }
+    finish_metrics(robot_transport);
+    stamp_block_free(&block);
+    char label[16];
+    snprintf(label, sizeof(label), "com%d", cport_nr + 1);
+    startup_print_report(&startup, label, executor.started_ns, executor.first_stroke_ns);
+    return result;
+}
+
+/**
+ * Page-change hook: parks the robot and waits for the operator to load the next sheet.
+ * @param next_page Number of the page about to start.
+ * @param user_data Unused.
+ * @return 0 to continue, -1 if the input ended (the job stops and can be resumed).
+ */
+int change_page(int next_page, void *user_data) {
+    (void)user_data;
+    return_to_origin();
+    printf("Load sheet %d and press Enter to continue\n", next_page);
+    if (skip_rest_of_line() != 0) {
+        printf("No more input: stopping before sheet %d\n", next_page);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Writes a paged job on several robots, each on its own COM port and sheets.
+ * @param job Layout options; the height and text file are asked for as usual.
+ * @param ports Port numbers (COM number minus 1).
+ * @param robot_count Number of robots.
+ * @return 0 on success, -1 on failure.
+ */
+int run_robot_pool(JobSpec *job, const int *ports, int robot_count) {
+    PortTransport robots[SCHEDULER_MAX_ROBOTS];
+    Transport *transports[SCHEDULER_MAX_ROBOTS];
+    StartupReport reports[SCHEDULER_MAX_ROBOTS];
+    char text_filename[256];
+    char ir_path[512];
+    int opened = 0, result = -1;
+
+    for (opened = 0; opened < robot_count; opened++) {
+        if (CanPortBeOpened(ports[opened]) == -1) {
+            printf("\nUnable to open COM%d\n", ports[opened] + 1);
+            goto close_ports;
+        }
+        if (flow_enabled) {
+            flow_transport_init_port(&robot_flows[opened], flow_mode, ports[opened]);
+            transports[opened] = &robot_flows[opened].transport;
+        } else {
+            port_transport_init(&robots[opened], ports[opened]);
+            transports[opened] = &robots[opened].transport;
+        }
+    }
+
+    // Wake every robot
+    printf("\nAbout to wake up %d robots\n", robot_count);
+    for (int r = 0; r < robot_count; r++) {
+        reports[r].launched_ns = startup.launched_ns;
+        if (startup_wake(ports[r], &reports[r]) != 0) {
+            printf("\nRobot on COM%d did not answer\n", ports[r] + 1);
+            goto close_ports;
+        }
+    }
+
+    if (load_fonts() == -1) {
+        printf("Failed to load font file\n");
+        goto close_ports;
+    }
+    job->font = get_loaded_font();
+    float height = get_text_height();
+    if (height <= 0.0f) {
+        printf("No text height given\n");
+        goto close_ports;
+    }
+    job->scale_factor = height / 18.0f;
+
+    for (int r = 0; r < robot_count; r++) {
+        if (startup_initialise(transports[r], ports[r], transport_machine_state(transports[r]), &reports[r]) != 0 ||
+            transport_drain(transports[r]) != 0) {
+            goto close_ports;
+        }
+    }
+
+    printf("Enter the name of the text file to process: ");
+    if (scanf("%255s", text_filename) != 1) {
+        printf("No text file given\n");
+        goto close_ports;
+    }
+    skip_rest_of_line();
+    job->text_filename = text_filename;
+
+    Scheduler scheduler;
+    if (compile_job(job, ir_path, sizeof(ir_path)) < 0 || scheduler_load(&scheduler, ir_path) != 0) {
+        printf("Failed to process %s\n", text_filename);
+        goto close_ports;
+    }
+    for (int r = 0; r < robot_count; r++) {
+        start_metrics(transports[r], r, ports[r], job);
+    }
+    result = scheduler_run(&scheduler, transports, robot_count, announce_unit, change_robot_sheet, NULL);
+    scheduler_free(&scheduler);
+    for (int r = 0; r < robot_count; r++) {
+        char label[16];
+        snprintf(label, sizeof(label), "com%d", ports[r] + 1);
+        finish_metrics(transports[r]);
+        finish_flow(r, ports[r]);
+        startup_print_report(&reports[r], label, 0, 0);
+    }
+
+close_ports:
+    for (int r = 0; r < opened; r++) {
+        ClosePort(ports[r]);
+    }
+    return result;
+}
+
+/**
+ * Unit-start hook of the robot pool: tells the operator which page goes on which robot.
+ * @param robot Index of the robot in the pool.
+ * @param page Page about to be written.
+ * @param user_data Unused.
+ */
+void announce_unit(int robot, int page, void *user_data) {
+    (void)user_data;
+    printf("Robot %d: writing page %d\n", robot + 1, page);
+}
+
+/**
+ * Sheet-change hook of the robot pool: waits for the operator to put a fresh sheet on a parked robot.
+ * @param robot Index of the robot in the pool.
+ * @param page Page the sheet is for.
+ * @param user_data Unused.
+ * @return 0 to continue, -1 if the input ended (the robot leaves the pool).
+ */
+int change_robot_sheet(int robot, int page, void *user_data) {
+    (void)user_data;
+    printf("Robot %d: load a sheet for page %d and press Enter to continue\n", robot + 1, page);
+    if (skip_rest_of_line() != 0) {
+        printf("No more input: robot %d stops\n", robot + 1);
+        return -1;
+    }
+    return 0;
 }
 
 /**
- * Processes the text file and sends G-code commands to the robot.
- * @param text_filename The name of the text file to process.
- * @param scale_factor The scale factor for the text size.
+ * Attaches metrics to a robot's transport when --metrics is given.
+ * @param transport Transport of the robot.
+ * @param robot Index of the robot (one Metrics each).
+ * @param port Port of the robot, for the label.
+ * @param job Job about to run, labelled by its cache key; NULL for the daemon.
  */
-void process_text(const char *text_filename, float scale_factor) {
-    DEBUG_LOG("Processing text file: %s\n", text_filename);
-    process_text_file(text_filename, scale_factor);
+void start_metrics(Transport *transport, int robot, int port, const JobSpec *job) {
+    char robot_label[16], job_label[32] = "daemon";
+    uint64_t key;
+    if (!metrics_enabled) {
+        return;
+    }
+    if (job) {
+        if (strcmp(job->text_filename, "-") != 0 && compute_job_key(job, &key) == 0) {
+            snprintf(job_label, sizeof(job_label), "%016llx", (unsigned long long)key);
+        } else {
+            snprintf(job_label, sizeof(job_label), "stdin");
+        }
+    }
+    snprintf(robot_label, sizeof(robot_label), "com%d", port + 1);
+    metrics_init(&robot_metrics[robot], robot_label, job_label, 1);
+    transport->metrics = &robot_metrics[robot];
+}
+
+/**
+ * Writes the final metrics export, prints a summary and detaches the metrics.
+ * @param transport Transport of the robot.
+ */
+void finish_metrics(Transport *transport) {
+    if (!transport->metrics) {
+        return;
+    }
+    if (metrics_export(transport->metrics) != 0) {
+        printf("Could not write metrics to %s\n", METRICS_DIR);
+    }
+    metrics_print_summary(transport->metrics);
+    transport->metrics = NULL;
+}
+
+/**
+ * Prints a robot's flow control summary when --flow is given.
+ * @param robot Index of the robot (one FlowTransport each).
+ * @param port Port of the robot, for the label.
+ */
+void finish_flow(int robot, int port) {
+    char label[16];
+    if (!flow_enabled) {
+        return;
+    }
+    snprintf(label, sizeof(label), "com%d", port + 1);
+    flow_print_summary(&robot_flows[robot], label);
+}
+
+/**
+ * Closes the session log when --record-session is given.
+ * @param path Session log, or NULL if not recording.
+ */
+void finish_recording(const char *path) {
+    if (!path) {
+        return;
+    }
+    if (session_record_stop() == 0) {
+        printf("Serial session recorded to %s\n", path);
+    } else {
+        printf("Could not write the session log %s\n", path);
+    }
+}
+
+/**
+ * Writes the trace file when --trace is given.
+ * @param path Trace file, or NULL if tracing is off.
+ */
+void finish_trace(const char *path) {
+    if (!path) {
+        return;
+    }
+    if (trace_write(path) == 0) {
+        printf("Trace written to %s (open in chrome://tracing or ui.perfetto.dev)\n", path);
+    } else {
+        printf("Could not write trace to %s\n", path);
+    }
+}
+
+// Run a G-code file on the simulator and print what it draws
+static int simulate_one(Simulator *sim, const char *path) {
+    sim_init(sim);
+    if (sim_file(sim, path) != 0) {
+        printf("Could not simulate %s\n", path);
+        return -1;
+    }
+    printf("%s: %lu lines (%lu not understood), %d page(s), %.1f mm drawn, %.1f mm pen-up travel\n",
+           path, sim->lines, sim->rejected, sim->page, sim->draw_length, sim->travel_length);
+    return 0;
+}
+
+/**
+ * Simulates a G-code file and compares its drawing with another's when --compare-with is given.
+ * @param path G-code file, or "-" for standard input.
+ * @param compare_path G-code file to compare with, or NULL.
+ * @param tolerance Comparison tolerance and image pixel size in mm.
+ * @param image_prefix Writes PREFIX-N.pgm for every page of the first file, or NULL.
+ * @return 0 if the file ran (and the drawings match), -1 otherwise.
+ */
+int simulate_gcode(const char *path, const char *compare_path, double tolerance, const char *image_prefix) {
+    Simulator sims[2];
+    int result = simulate_one(&sims[0], path);
+
+    for (int page = 1; result == 0 && image_prefix && page <= sims[0].page; page++) {
+        char image[512];
+        snprintf(image, sizeof(image), "%s-%d.pgm", image_prefix, page);
+        if (sim_write_image(&sims[0], page, tolerance, image) == 0) {
+            printf("Page %d drawn to %s\n", page, image);
+        }
+    }
+    if (result == 0 && compare_path) {
+        SimComparison comparison;
+        result = simulate_one(&sims[1], compare_path);
+        if (result == 0) {
+            result = sim_compare(&sims[0], &sims[1], tolerance, &comparison);
+        }
+        if (result == 0) {
+            printf("Drawings match within %.3f mm\n", tolerance);
+        } else if (result > 0) {
+            printf("Drawings differ: %lu of %lu cells only in the first, %lu of %lu only in the second;\n"
+                   "first difference on page %d near (%.3f, %.3f)\n", comparison.only_a, comparison.cells_a,
+                   comparison.only_b, comparison.cells_b, comparison.first_page, comparison.first_x,
+                   comparison.first_y);
+            result = -1;
+        }
+        sim_free(&sims[1]);
+    }
+    sim_free(&sims[0]);
+    return result;
+}
+
+/**
+ * Loads the font jobs use: the --font of the font registry if one is given,
+ * otherwise SingleStrokeFont.txt.
+ * @return 0 on success, -1 if the font could not be loaded.
+ */
+int load_fonts(void) {
+    if (!font_registry_path) {
+        return load_font_file("SingleStrokeFont.txt");
+    }
+    if (font_registry_open(&font_registry, font_registry_path) != 0) {
+        printf("Could not open font registry %s\n", font_registry_path);
+        return -1;
+    }
+    const Font *font = font_registry_find(&font_registry, font_name);
+    if (!font) {
+        printf("No font %s in %s\n", font_name, font_registry_path);
+        font_registry_close(&font_registry);
+        return -1;
+    }
+    use_font(font);
+    set_daemon_fonts(&font_registry);
+    DEBUG_LOG("Using font %s of %s (%d glyphs)\n", font_name ? font_name : font_registry.entries[0].name,
+              font_registry_path, font->glyph_count);
+    return 0;
+}
+
+/**
+ * Compiles font files into a font registry (--build-font-registry).
+ * @param path Registry file to write.
+ * @param list Comma-separated NAME=FILE pairs; modified while parsing.
+ * @return 0 on success, -1 otherwise.
+ */
+int build_font_registry(const char *path, char *list) {
+    const char *names[FONT_REGISTRY_MAX_FONTS];
+    Font *fonts[FONT_REGISTRY_MAX_FONTS];
+    int count = 0, result = 0;
+    for (char *pair = strtok(list, ","); pair && result == 0; pair = strtok(NULL, ",")) {
+        char *file = strchr(pair, '=');
+        if (!file || count == FONT_REGISTRY_MAX_FONTS) {
+            printf("Invalid font list entry: %s (at most %d NAME=FILE pairs)\n", pair, FONT_REGISTRY_MAX_FONTS);
+            result = -1;
+            break;
+        }
+        *file++ = '\0';
+        names[count] = pair;
+        fonts[count] = font_load(file);
+        if (!fonts[count]) {
+            printf("Could not load font %s\n", file);
+            result = -1;
+            break;
+        }
+        printf("%s: %d glyphs, %lu bytes\n", pair, fonts[count]->glyph_count,
+               (unsigned long)fonts[count]->image->size);
+        count++;
+    }
+    if (result == 0 && font_registry_build(path, names, (const Font *const *)fonts, count) != 0) {
+        printf("Could not write font registry %s\n", path);
+        result = -1;
+    }
+    for (int i = 0; i < count; i++) {
+        font_free(fonts[i]);
+    }
+    return result;
 }
 
 void SendCommands (char *buffer )
 {
-    PrintBuffer (&buffer[0]);
-    WaitForReply();
+    transport_send(robot_transport, buffer);
     //Sleep(100); // Can omit this when using the writing robot but has minimal effect
     // getch(); // Omit this once basic testing with emulator has taken place
 }
\ No newline at end of file
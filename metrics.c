@@ -0,0 +1,246 @@
+// metrics.c
+#include <stdio.h>
+#include <string.h>
+#include "metrics.h"
+#include "platform.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#define make_directory(path) _mkdir(path)
+#else
+#include <sys/stat.h>
+#define make_directory(path) mkdir(path, 0777)
+#endif
+
+static const char *const phase_names[METRICS_PHASES] = { "write", "ack", "total" };
+static const char *const incident_names[METRICS_INCIDENTS] = { "timeout", "error", "alarm", "recovery", "skip" };
+
+void metrics_init(Metrics *metrics, const char *robot, const char *job, int export_enabled) {
+    memset(metrics, 0, sizeof(*metrics));
+    snprintf(metrics->robot, sizeof(metrics->robot), "%s", robot);
+    snprintf(metrics->job, sizeof(metrics->job), "%s", job);
+    metrics->started_ns = metrics->last_export_ns = monotonic_ns();
+    metrics->export_enabled = export_enabled;
+}
+
+// Values below METRICS_SUB_BUCKETS are exact; above, each power of two has METRICS_SUB_BUCKETS buckets
+static int bucket_index(uint64_t value) {
+    if (value >= (1ULL << METRICS_MAX_BITS)) {
+        return METRICS_BUCKETS - 1;
+    }
+    if (value < METRICS_SUB_BUCKETS) {
+        return (int)value;
+    }
+    int top = 63;
+    while (!(value >> top)) {
+        top--;
+    }
+    int shift = top - METRICS_SUB_BUCKET_BITS;
+    return METRICS_SUB_BUCKETS + shift * METRICS_SUB_BUCKETS + (int)((value >> shift) - METRICS_SUB_BUCKETS);
+}
+
+// Midpoint of a bucket
+static uint64_t bucket_value(int index) {
+    if (index < METRICS_SUB_BUCKETS) {
+        return (uint64_t)index;
+    }
+    int shift = (index - METRICS_SUB_BUCKETS) / METRICS_SUB_BUCKETS;
+    uint64_t lower = (uint64_t)(METRICS_SUB_BUCKETS + (index - METRICS_SUB_BUCKETS) % METRICS_SUB_BUCKETS) << shift;
+    return lower + ((1ULL << shift) >> 1);
+}
+
+void histogram_record(LatencyHistogram *histogram, uint64_t value_ns) {
+    atomic_fetch_add_explicit(&histogram->counts[bucket_index(value_ns)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->sum_ns, value_ns, memory_order_relaxed);
+    uint64_t max = atomic_load_explicit(&histogram->max_ns, memory_order_relaxed);
+    while (value_ns > max &&
+           !atomic_compare_exchange_weak_explicit(&histogram->max_ns, &max, value_ns,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+uint64_t histogram_quantile(const LatencyHistogram *histogram, double quantile) {
+    uint64_t count = atomic_load_explicit(&histogram->count, memory_order_relaxed);
+    if (count == 0) {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(quantile * (double)(count - 1)) + 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < METRICS_BUCKETS; i++) {
+        seen += atomic_load_explicit(&histogram->counts[i], memory_order_relaxed);
+        if (seen >= rank) {
+            uint64_t max = atomic_load_explicit(&histogram->max_ns, memory_order_relaxed);
+            uint64_t value = bucket_value(i);
+            return value < max ? value : max;
+        }
+    }
+    return atomic_load_explicit(&histogram->max_ns, memory_order_relaxed);
+}
+
+static void add(_Atomic uint64_t *counter, uint64_t value) {
+    atomic_fetch_add_explicit(counter, value, memory_order_relaxed);
+}
+
+void metrics_record_command(Metrics *metrics, const char *command, uint64_t enqueued_ns,
+                            uint64_t acked_ns, int result) {
+    // Transports that do not report the write are treated as writing instantly
+    uint64_t written_ns = metrics->written_ns;
+    if (written_ns < enqueued_ns || written_ns > acked_ns) {
+        written_ns = enqueued_ns;
+    }
+    metrics->written_ns = 0;
+
+    if (result != 0) {
+        add(&metrics->failures, 1);
+    } else {
+        uint64_t ack_ns = acked_ns - written_ns;
+        histogram_record(&metrics->latency[METRICS_WRITE], written_ns - enqueued_ns);
+        histogram_record(&metrics->latency[METRICS_ACK], ack_ns);
+        histogram_record(&metrics->latency[METRICS_TOTAL], acked_ns - enqueued_ns);
+        add(&metrics->commands, 1);
+        add(&metrics->bytes, strlen(command));
+        if (command[0] == 'S' && command[1] == '0' && (command[2] < '0' || command[2] > '9')) {
+            add(&metrics->pen_lifts, 1);
+        }
+        if (ack_ns > METRICS_STALL_MS * 1000000ULL) {
+            add(&metrics->stall_ns, ack_ns - METRICS_STALL_MS * 1000000ULL);
+        }
+    }
+
+    if (metrics->export_enabled && acked_ns - metrics->last_export_ns >= METRICS_EXPORT_INTERVAL_MS * 1000000ULL) {
+        metrics_export(metrics);
+    }
+}
+
+void metrics_count_retry(Metrics *metrics) {
+    if (metrics) {
+        add(&metrics->retries, 1);
+    }
+}
+
+void metrics_count_incident(Metrics *metrics, MetricsIncident incident) {
+    if (metrics) {
+        add(&metrics->incidents[incident], 1);
+    }
+}
+
+static uint64_t load(const _Atomic uint64_t *counter) {
+    return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+static int write_json(Metrics *metrics, FILE *file, double elapsed_s) {
+    fprintf(file, "{\"robot\": \"%s\", \"job\": \"%s\", \"elapsed_s\": %.3f, \"commands\": %llu, "
+            "\"bytes\": %llu, \"pen_lifts\": %llu, \"retries\": %llu, \"failures\": %llu, \"stall_s\": %.3f,\n"
+            " \"latency_us\": {", metrics->robot, metrics->job, elapsed_s,
+            (unsigned long long)load(&metrics->commands), (unsigned long long)load(&metrics->bytes),
+            (unsigned long long)load(&metrics->pen_lifts), (unsigned long long)load(&metrics->retries),
+            (unsigned long long)load(&metrics->failures), (double)load(&metrics->stall_ns) / 1e9);
+    for (int p = 0; p < METRICS_PHASES; p++) {
+        const LatencyHistogram *histogram = &metrics->latency[p];
+        uint64_t count = load(&histogram->count);
+        fprintf(file, "%s\n  \"%s\": {\"count\": %llu, \"mean\": %.1f, \"p50\": %.1f, \"p90\": %.1f, "
+                "\"p99\": %.1f, \"p999\": %.1f, \"max\": %.1f}", p ? "," : "", phase_names[p],
+                (unsigned long long)count, count ? (double)load(&histogram->sum_ns) / (double)count / 1e3 : 0.0,
+                histogram_quantile(histogram, 0.5) / 1e3, histogram_quantile(histogram, 0.9) / 1e3,
+                histogram_quantile(histogram, 0.99) / 1e3, histogram_quantile(histogram, 0.999) / 1e3,
+                load(&histogram->max_ns) / 1e3);
+    }
+    fprintf(file, "},\n \"incidents\": {");
+    for (int i = 0; i < METRICS_INCIDENTS; i++) {
+        fprintf(file, "%s\"%s\": %llu", i ? ", " : "", incident_names[i],
+                (unsigned long long)load(&metrics->incidents[i]));
+    }
+    return fprintf(file, "}}\n") < 0 ? -1 : 0;
+}
+
+static int write_prometheus(Metrics *metrics, FILE *file) {
+    static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+    char labels[96];
+    snprintf(labels, sizeof(labels), "robot=\"%s\",job=\"%s\"", metrics->robot, metrics->job);
+
+    fprintf(file, "# TYPE robotwriter_commands_total counter\nrobotwriter_commands_total{%s} %llu\n",
+            labels, (unsigned long long)load(&metrics->commands));
+    fprintf(file, "# TYPE robotwriter_bytes_total counter\nrobotwriter_bytes_total{%s} %llu\n",
+            labels, (unsigned long long)load(&metrics->bytes));
+    fprintf(file, "# TYPE robotwriter_pen_lifts_total counter\nrobotwriter_pen_lifts_total{%s} %llu\n",
+            labels, (unsigned long long)load(&metrics->pen_lifts));
+    fprintf(file, "# TYPE robotwriter_retries_total counter\nrobotwriter_retries_total{%s} %llu\n",
+            labels, (unsigned long long)load(&metrics->retries));
+    fprintf(file, "# TYPE robotwriter_failures_total counter\nrobotwriter_failures_total{%s} %llu\n",
+            labels, (unsigned long long)load(&metrics->failures));
+    fprintf(file, "# TYPE robotwriter_stall_seconds_total counter\nrobotwriter_stall_seconds_total{%s} %.6f\n",
+            labels, (double)load(&metrics->stall_ns) / 1e9);
+    fprintf(file, "# TYPE robotwriter_incidents_total counter\n");
+    for (int i = 0; i < METRICS_INCIDENTS; i++) {
+        fprintf(file, "robotwriter_incidents_total{%s,kind=\"%s\"} %llu\n", labels, incident_names[i],
+                (unsigned long long)load(&metrics->incidents[i]));
+    }
+
+    fprintf(file, "# TYPE robotwriter_command_latency_seconds summary\n");
+    for (int p = 0; p < METRICS_PHASES; p++) {
+        const LatencyHistogram *histogram = &metrics->latency[p];
+        for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++) {
+            fprintf(file, "robotwriter_command_latency_seconds{%s,phase=\"%s\",quantile=\"%g\"} %.9f\n",
+                    labels, phase_names[p], quantiles[q], histogram_quantile(histogram, quantiles[q]) / 1e9);
+        }
+        fprintf(file, "robotwriter_command_latency_seconds_sum{%s,phase=\"%s\"} %.9f\n",
+                labels, phase_names[p], (double)load(&histogram->sum_ns) / 1e9);
+        fprintf(file, "robotwriter_command_latency_seconds_count{%s,phase=\"%s\"} %llu\n",
+                labels, phase_names[p], (unsigned long long)load(&histogram->count));
+    }
+    return ferror(file) ? -1 : 0;
+}
+
+// Write one export file through a temporary name
+static int export_file(Metrics *metrics, const char *extension, double elapsed_s) {
+    char path[256], temp_path[264];
+    snprintf(path, sizeof(path), "%s/%s_%s.%s", METRICS_DIR, metrics->robot, metrics->job, extension);
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+
+    FILE *file = fopen(temp_path, "w");
+    if (!file) {
+        return -1;
+    }
+    int result = strcmp(extension, "json") == 0 ? write_json(metrics, file, elapsed_s) : write_prometheus(metrics, file);
+    if (fclose(file) != 0) {
+        result = -1;
+    }
+    if (result == 0) {
+        remove(path);
+        result = rename(temp_path, path) == 0 ? 0 : -1;
+    }
+    if (result != 0) {
+        remove(temp_path);
+    }
+    return result;
+}
+
+int metrics_export(Metrics *metrics) {
+    uint64_t now = monotonic_ns();
+    metrics->last_export_ns = now;
+    make_directory(METRICS_DIR);
+    double elapsed_s = (double)(now - metrics->started_ns) / 1e9;
+    int json = export_file(metrics, "json", elapsed_s);
+    int prometheus = export_file(metrics, "prom", elapsed_s);
+    return json == 0 && prometheus == 0 ? 0 : -1;
+}
+
+void metrics_print_summary(const Metrics *metrics) {
+    const LatencyHistogram *ack = &metrics->latency[METRICS_ACK];
+    printf("%s: %llu commands, %llu bytes, %llu pen lifts, %llu retries, %.1f s stalled; "
+           "ack latency p50 %.2f ms, p99 %.2f ms, max %.2f ms\n", metrics->robot,
+           (unsigned long long)load(&metrics->commands), (unsigned long long)load(&metrics->bytes),
+           (unsigned long long)load(&metrics->pen_lifts), (unsigned long long)load(&metrics->retries),
+           (double)load(&metrics->stall_ns) / 1e9, histogram_quantile(ack, 0.5) / 1e6,
+           histogram_quantile(ack, 0.99) / 1e6, load(&ack->max_ns) / 1e6);
+    if (load(&metrics->incidents[METRICS_TIMEOUT]) || load(&metrics->incidents[METRICS_ERROR]) ||
+        load(&metrics->incidents[METRICS_ALARM])) {
+        printf("%s: %llu timeouts, %llu controller errors, %llu alarms (%llu recovered), %llu commands skipped\n",
+               metrics->robot, (unsigned long long)load(&metrics->incidents[METRICS_TIMEOUT]),
+               (unsigned long long)load(&metrics->incidents[METRICS_ERROR]),
+               (unsigned long long)load(&metrics->incidents[METRICS_ALARM]),
+               (unsigned long long)load(&metrics->incidents[METRICS_RECOVERY]),
+               (unsigned long long)load(&metrics->incidents[METRICS_SKIP]));
+    }
+}
@@ -0,0 +1,166 @@
+/**
+ * @file metrics.h
+ * @brief Per-command latency histograms and counters with a file export
+ *
+ * Every command sent through an instrumented transport is timestamped when
+ * it is handed to the transport, when its bytes are written and when the
+ * controller acknowledges it. The intervals go into log-linear histograms
+ * (16 buckets per power of two, so any value is within 6.25% of its bucket)
+ * updated with relaxed atomic increments: the sending thread never takes a
+ * lock, and a reader can export a consistent-enough snapshot at any time.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+/**
+ * @brief Histogram resolution and range
+ */
+#define METRICS_SUB_BUCKET_BITS 4                           // 16 buckets per power of two
+#define METRICS_SUB_BUCKETS (1 << METRICS_SUB_BUCKET_BITS)
+#define METRICS_MAX_BITS 40                                 // Values up to 2^40 ns (about 18 minutes)
+#define METRICS_BUCKETS (METRICS_SUB_BUCKETS * (METRICS_MAX_BITS - METRICS_SUB_BUCKET_BITS + 1))
+
+/**
+ * @brief An acknowledgement slower than this counts as a stall
+ */
+#define METRICS_STALL_MS 250
+
+/**
+ * @brief Minimum time between periodic exports
+ */
+#define METRICS_EXPORT_INTERVAL_MS 1000
+
+/**
+ * @brief Directory holding the exported "<robot>_<job>.json" and ".prom" files
+ */
+#define METRICS_DIR "metrics"
+
+/**
+ * @brief Lock-free latency histogram in nanoseconds
+ */
+typedef struct {
+    _Atomic uint64_t counts[METRICS_BUCKETS];
+    _Atomic uint64_t count;
+    _Atomic uint64_t sum_ns;
+    _Atomic uint64_t max_ns;
+} LatencyHistogram;
+
+/**
+ * @brief Command phases measured for every command
+ */
+typedef enum {
+    METRICS_WRITE = 0,      // Handed to the transport until its bytes are written
+    METRICS_ACK,            // Written until the controller acknowledged it
+    METRICS_TOTAL,          // Handed to the transport until acknowledged
+    METRICS_PHASES
+} MetricsPhase;
+
+/**
+ * @brief Transport incidents (see recovery.h)
+ */
+typedef enum {
+    METRICS_TIMEOUT = 0,    // No reply within the acknowledgement timeout
+    METRICS_ERROR,          // "error:N" reply
+    METRICS_ALARM,          // "ALARM:N", or a command refused while locked
+    METRICS_RECOVERY,       // Alarm recovered and the command sent again
+    METRICS_SKIP,           // Command left out after the controller refused it
+    METRICS_INCIDENTS
+} MetricsIncident;
+
+/**
+ * @brief Instrumentation of one robot running one job
+ */
+typedef struct {
+    char robot[32];                         // Label, e.g. "com6"
+    char job[32];                           // Label, e.g. the job key
+    LatencyHistogram latency[METRICS_PHASES];
+    _Atomic uint64_t commands;
+    _Atomic uint64_t bytes;
+    _Atomic uint64_t pen_lifts;
+    _Atomic uint64_t retries;
+    _Atomic uint64_t failures;
+    _Atomic uint64_t stall_ns;              // Acknowledgement time beyond METRICS_STALL_MS
+    _Atomic uint64_t incidents[METRICS_INCIDENTS];
+    uint64_t started_ns;
+    uint64_t written_ns;                    // Set by the transport once the current command is written
+    uint64_t last_export_ns;
+    int export_enabled;
+} Metrics;
+
+/**
+ * @brief Clears a Metrics and sets its labels
+ *
+ * @param metrics Metrics to initialise
+ * @param robot Robot label
+ * @param job Job label
+ * @param export_enabled Non-zero to write METRICS_DIR files periodically
+ */
+void metrics_init(Metrics *metrics, const char *robot, const char *job, int export_enabled);
+
+/**
+ * @brief Adds one value to a histogram
+ *
+ * @param histogram Histogram to update
+ * @param value_ns Value in nanoseconds
+ */
+void histogram_record(LatencyHistogram *histogram, uint64_t value_ns);
+
+/**
+ * @brief Returns an estimate of a quantile of a histogram
+ *
+ * @param histogram Histogram to read
+ * @param quantile Quantile between 0 and 1
+ * @return uint64_t Value in nanoseconds, 0 if the histogram is empty
+ */
+uint64_t histogram_quantile(const LatencyHistogram *histogram, double quantile);
+
+/**
+ * @brief Records one finished command
+ *
+ * @param metrics Metrics to update
+ * @param command Command that was sent
+ * @param enqueued_ns When it was handed to the transport
+ * @param acked_ns When the transport returned
+ * @param result Transport result, 0 on success
+ */
+void metrics_record_command(Metrics *metrics, const char *command, uint64_t enqueued_ns,
+                            uint64_t acked_ns, int result);
+
+/**
+ * @brief Counts a command that had to be sent again
+ *
+ * @param metrics Metrics to update, may be NULL
+ */
+void metrics_count_retry(Metrics *metrics);
+
+/**
+ * @brief Counts a transport incident
+ *
+ * @param metrics Metrics to update, may be NULL
+ * @param incident What happened
+ */
+void metrics_count_incident(Metrics *metrics, MetricsIncident incident);
+
+/**
+ * @brief Writes METRICS_DIR/<robot>_<job>.json and .prom (Prometheus text format)
+ *
+ * Files are written under a temporary name and renamed, so a scraper never
+ * reads a partial file.
+ *
+ * @param metrics Metrics to export
+ * @return int 0 on success, -1 on failure
+ */
+int metrics_export(Metrics *metrics);
+
+/**
+ * @brief Prints a one-line latency summary to standard output
+ *
+ * @param metrics Metrics to summarise
+ */
+void metrics_print_summary(const Metrics *metrics);
+
+#endif // METRICS_H
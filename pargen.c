@@ -0,0 +1,346 @@
+// pargen.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "pargen.h"
+#include "trace.h"
+#include "debug.h"
+
+typedef struct {
+    size_t first;           // Recorded glyphs [first, end)
+    size_t end;
+    int page_start;         // Starts a page, so the generator state at its start is known
+    int next_page;          // Page break after the chunk, 0 if none
+    MotionOp *ops;
+    size_t op_count;
+    size_t op_capacity;
+    float chosen_travel;
+    float forward_travel;
+    unsigned long joins;
+    unsigned long culled_glyphs;
+    unsigned long clipped_strokes;
+    unsigned long dropped_strokes;
+    int overflowed;
+    float overflow_x;
+    float overflow_y;
+    int failed;
+    int done;
+} Chunk;
+
+typedef struct {
+    Generator *parent;
+    Chunk *chunks;
+    size_t chunk_count;
+    size_t next_chunk;      // Next chunk to generate
+    size_t merged;          // Chunks handed to the sink so far
+    size_t ahead;           // Chunks that may be generated past the merge
+    int stop;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+} ParallelRun;
+
+typedef struct {
+    ParallelRun *run;
+    int index;
+} GeneratorThread;
+
+// Machine state as seen by the merged stream
+typedef struct {
+    int pen;
+    int32_t feed;           // 0 until the first feed
+    int32_t x;
+    int32_t y;
+    int held;               // A pen-up move is held back, it may collapse with the next one
+    int check_held;         // The held move may go nowhere and must then be dropped
+    MotionOp travel;
+    int failed;
+} Merge;
+
+static int add_chunk(ParallelRun *run, size_t *capacity, size_t first, size_t end, int page_start, int next_page) {
+    if (run->chunk_count == *capacity) {
+        size_t grown = *capacity ? *capacity * 2 : 64;
+        Chunk *chunks = realloc(run->chunks, grown * sizeof(*chunks));
+        if (!chunks) {
+            return -1;
+        }
+        run->chunks = chunks;
+        *capacity = grown;
+    }
+    Chunk *chunk = &run->chunks[run->chunk_count++];
+    memset(chunk, 0, sizeof(*chunk));
+    chunk->first = first;
+    chunk->end = end;
+    chunk->page_start = page_start;
+    chunk->next_page = next_page;
+    return 0;
+}
+
+// Cut the recording at page breaks, and in plain order also at line ends
+static int split_chunks(ParallelRun *run) {
+    const Generator *parent = run->parent;
+    const GlyphPlacement *glyphs = parent->recorded;
+    size_t capacity = 0, first = 0, mark = 0;
+    int page_start = 1;
+
+    for (size_t i = 0; i <= parent->recorded_count; i++) {
+        while (mark < parent->page_mark_count && parent->page_marks[mark].glyph_index == i) {
+            if (add_chunk(run, &capacity, first, i, page_start, parent->page_marks[mark].next_page) != 0) {
+                return -1;
+            }
+            first = i;
+            page_start = 1;
+            mark++;
+        }
+        if (i == parent->recorded_count) {
+            break;
+        }
+        if (!parent->boustrophedon && i - first >= PARGEN_CHUNK_GLYPHS && glyphs[i].y_offset != glyphs[i - 1].y_offset) {
+            if (add_chunk(run, &capacity, first, i, page_start, 0) != 0) {
+                return -1;
+            }
+            first = i;
+            page_start = 0;
+        }
+    }
+    if (first < parent->recorded_count) {
+        return add_chunk(run, &capacity, first, parent->recorded_count, page_start, 0);
+    }
+    return 0;
+}
+
+static int chunk_emit(void *user_data, const MotionOp *op) {
+    Chunk *chunk = user_data;
+    if (chunk->op_count == chunk->op_capacity) {
+        size_t grown = chunk->op_capacity ? chunk->op_capacity * 2 : 1024;
+        MotionOp *ops = realloc(chunk->ops, grown * sizeof(*ops));
+        if (!ops) {
+            return -1;
+        }
+        chunk->ops = ops;
+        chunk->op_capacity = grown;
+    }
+    chunk->ops[chunk->op_count++] = *op;
+    return 0;
+}
+
+static void generate_chunk(const Generator *parent, Chunk *chunk) {
+    OpSink sink = { chunk_emit, chunk };
+    Generator generator;
+
+    TRACE_BEGIN("generate_chunk");
+    generator_init(&generator, parent->font, &sink);
+    generator_set_boustrophedon(&generator, parent->boustrophedon);
+    generator_set_feed_limits(&generator, &parent->feed_limits);
+    generator_set_join_distance(&generator, parent->join_distance);
+    generator_set_work_area(&generator, &parent->work_area);
+    generator_start(&generator);
+    if (!chunk->page_start) {
+        // Where the previous chunk ended is not known here: always send the first
+        // pen-up move and let the merge drop it if it goes nowhere
+        generator.pen_x = generator.pen_y = NAN;
+    }
+    for (size_t i = chunk->first; i < chunk->end; i++) {
+        const GlyphPlacement *glyph = &parent->recorded[i];
+        generator_place_glyph(&generator, glyph->code, glyph->scale_factor,
+                              glyph->x_offset, glyph->y_offset);
+    }
+    if (chunk->next_page) {
+        generator_page_break(&generator, chunk->next_page);
+    } else {
+        generator_flush(&generator);
+    }
+    chunk->chosen_travel = generator.chosen_travel;
+    chunk->forward_travel = generator.forward_travel;
+    chunk->joins = generator.joins;
+    chunk->culled_glyphs = generator.culled_glyphs;
+    chunk->clipped_strokes = generator.clipped_strokes;
+    chunk->dropped_strokes = generator.dropped_strokes;
+    chunk->overflowed = generator.overflowed;
+    chunk->overflow_x = generator.overflow_x;
+    chunk->overflow_y = generator.overflow_y;
+    chunk->failed = generator.sink_failed;
+    generator_free(&generator);
+    TRACE_END("generate_chunk");
+}
+
+static void *generator_main(void *arg) {
+    GeneratorThread *thread = arg;
+    ParallelRun *run = thread->run;
+    char name[32];
+
+    snprintf(name, sizeof(name), "generator %d", thread->index + 1);
+    trace_set_thread_name(name);
+
+    pthread_mutex_lock(&run->lock);
+    for (;;) {
+        while (!run->stop && run->next_chunk < run->chunk_count && run->next_chunk >= run->merged + run->ahead) {
+            pthread_cond_wait(&run->changed, &run->lock);
+        }
+        if (run->stop || run->next_chunk == run->chunk_count) {
+            break;
+        }
+        Chunk *chunk = &run->chunks[run->next_chunk++];
+        pthread_mutex_unlock(&run->lock);
+
+        generate_chunk(run->parent, chunk);
+
+        pthread_mutex_lock(&run->lock);
+        chunk->done = 1;
+        pthread_cond_broadcast(&run->changed);
+    }
+    pthread_mutex_unlock(&run->lock);
+    return NULL;
+}
+
+// Through the parent generator, which adds the pen dwells to the merged stream
+static void merge_send(Merge *merge, Generator *generator, const MotionOp *op) {
+    if (generator_send_op(generator, op) != 0) {
+        merge->failed = 1;
+    }
+}
+
+static void merge_flush_travel(Merge *merge, Generator *generator) {
+    if (merge->held && (!merge->check_held || merge->travel.x != merge->x || merge->travel.y != merge->y)) {
+        merge_send(merge, generator, &merge->travel);
+        merge->x = merge->travel.x;
+        merge->y = merge->travel.y;
+    }
+    merge->held = 0;
+}
+
+// Append a chunk to the merged stream, fixing up the pen state and travel at its start
+static void merge_chunk(Merge *merge, Generator *generator, const Chunk *chunk) {
+    int leading = 1;
+    for (size_t i = 0; i < chunk->op_count && !merge->failed; i++) {
+        const MotionOp *op = &chunk->ops[i];
+        switch (op->code) {
+        case IR_PEN:
+            if (op->x == merge->pen) {
+                continue;
+            }
+            merge_flush_travel(merge, generator);
+            merge_send(merge, generator, op);
+            merge->pen = op->x;
+            break;
+        case IR_FEED:
+            // Each chunk sets its first feed, which the previous chunk may have left in place
+            if (op->x == merge->feed) {
+                continue;
+            }
+            merge_flush_travel(merge, generator);
+            merge_send(merge, generator, op);
+            merge->feed = op->x;
+            break;
+        case IR_TRAVEL:
+            // A move still held from the previous chunk collapses into this one
+            merge->check_held = merge->held || (leading && !chunk->page_start);
+            merge->held = 1;
+            merge->travel = *op;
+            break;
+        case IR_PAGE:
+            merge_flush_travel(merge, generator);
+            merge_send(merge, generator, op);
+            merge->pen = -1;
+            merge->x = merge->y = 0;
+            break;
+        default:
+            merge_flush_travel(merge, generator);
+            merge_send(merge, generator, op);
+            if (op->code == IR_DRAW) {
+                merge->x = op->x;
+                merge->y = op->y;
+            }
+            break;
+        }
+        leading = 0;
+    }
+}
+
+int generate_recorded_glyphs(Generator *generator) {
+    ParallelRun run;
+    memset(&run, 0, sizeof(run));
+    run.parent = generator;
+    if (split_chunks(&run) != 0) {
+        free(run.chunks);
+        return -1;
+    }
+
+    int threads = generator->threads;
+    if (threads > PARGEN_MAX_THREADS) {
+        threads = PARGEN_MAX_THREADS;
+    }
+    if ((size_t)threads > run.chunk_count) {
+        threads = (int)run.chunk_count;
+    }
+    run.ahead = (size_t)threads * PARGEN_CHUNKS_AHEAD;
+    pthread_mutex_init(&run.lock, NULL);
+    pthread_cond_init(&run.changed, NULL);
+
+    GeneratorThread thread_args[PARGEN_MAX_THREADS];
+    pthread_t ids[PARGEN_MAX_THREADS];
+    int started = 0;
+    for (int t = 0; t < threads; t++) {
+        thread_args[t].run = &run;
+        thread_args[t].index = t;
+        if (pthread_create(&ids[t], NULL, generator_main, &thread_args[t]) != 0) {
+            break;
+        }
+        started++;
+    }
+    DEBUG_LOG("Generating %lu glyphs in %lu chunks on %d threads\n", (unsigned long)generator->recorded_count,
+              (unsigned long)run.chunk_count, started);
+
+    Merge merge = { -1, 0, 0, 0, 0, 0, { IR_TRAVEL, 0, 0 }, 0 };
+    for (size_t i = 0; i < run.chunk_count && !merge.failed; i++) {
+        Chunk *chunk = &run.chunks[i];
+        if (started == 0) {
+            // No thread could be started: generate in order on this one
+            generate_chunk(generator, chunk);
+        } else {
+            pthread_mutex_lock(&run.lock);
+            while (!chunk->done) {
+                pthread_cond_wait(&run.changed, &run.lock);
+            }
+            pthread_mutex_unlock(&run.lock);
+        }
+
+        merge.failed = chunk->failed;
+        merge_chunk(&merge, generator, chunk);
+        generator->chosen_travel += chunk->chosen_travel;
+        generator->forward_travel += chunk->forward_travel;
+        generator->joins += chunk->joins;
+        generator->culled_glyphs += chunk->culled_glyphs;
+        generator->clipped_strokes += chunk->clipped_strokes;
+        generator->dropped_strokes += chunk->dropped_strokes;
+        if (chunk->overflowed && !generator->overflowed) {
+            generator->overflowed = 1;
+            generator->overflow_x = chunk->overflow_x;
+            generator->overflow_y = chunk->overflow_y;
+        }
+        free(chunk->ops);
+        chunk->ops = NULL;
+
+        pthread_mutex_lock(&run.lock);
+        run.merged = i + 1;
+        pthread_cond_broadcast(&run.changed);
+        pthread_mutex_unlock(&run.lock);
+    }
+    merge_flush_travel(&merge, generator);
+
+    pthread_mutex_lock(&run.lock);
+    run.stop = 1;
+    pthread_cond_broadcast(&run.changed);
+    pthread_mutex_unlock(&run.lock);
+    for (int t = 0; t < started; t++) {
+        pthread_join(ids[t], NULL);
+    }
+    for (size_t i = 0; i < run.chunk_count; i++) {
+        free(run.chunks[i].ops);
+    }
+    free(run.chunks);
+    pthread_cond_destroy(&run.changed);
+    pthread_mutex_destroy(&run.lock);
+    return merge.failed ? -1 : 0;
+}
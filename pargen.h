@@ -0,0 +1,48 @@
+/**
+ * @file pargen.h
+ * @brief Parallel motion generation with an ordered merge
+ *
+ * Once layout has placed every glyph, the glyphs of different lines no
+ * longer depend on each other. A generator in parallel mode records the
+ * placements; at the end of the job the document is cut into chunks of
+ * whole lines (whole pages in serpentine order, where each line's direction
+ * depends on where the previous one ended), each chunk is generated by a
+ * private Generator on a thread pool, and the chunks are handed to the sink
+ * in document order. At chunk boundaries the merge drops the pen change, the
+ * feed and the pen-up move a sequential generator would not have sent, so
+ * the output is the same as with one thread.
+ */
+
+#ifndef PARGEN_H
+#define PARGEN_H
+
+#include "font.h"
+
+/**
+ * @brief Thread pool limit
+ */
+#define PARGEN_MAX_THREADS 64
+
+/**
+ * @brief A chunk ends at the first line end after this many glyphs
+ */
+#define PARGEN_CHUNK_GLYPHS 512
+
+/**
+ * @brief Chunks a thread may generate ahead of the merge, bounding the memory held
+ */
+#define PARGEN_CHUNKS_AHEAD 4
+
+/**
+ * @brief Generates the glyphs and page breaks recorded by a generator
+ *
+ * Called by generator_finish() for a generator with more than one thread.
+ * The operations go to the generator's sink and the serpentine travel and
+ * stroke joining statistics are added to the generator.
+ *
+ * @param generator Generator in parallel mode
+ * @return int 0 on success, -1 if the sink failed or memory ran out
+ */
+int generate_recorded_glyphs(Generator *generator);
+
+#endif // PARGEN_H
@@ -0,0 +1,96 @@
+// pen.c
+#include <stdio.h>
+#include <math.h>
+#include "pen.h"
+#include "scheduler.h"
+
+void pen_timing_init(PenTiming *timing) {
+    timing->enabled = 0;
+    timing->lift_ms = PEN_LIFT_MS_DEFAULT;
+    timing->drop_ms = PEN_DROP_MS_DEFAULT;
+    timing->contact_ms = PEN_CONTACT_MS_DEFAULT;
+}
+
+int parse_pen_timing(const char *text, PenTiming *timing) {
+    float lift, drop, contact = timing->contact_ms;
+    int fields = sscanf(text, "%f,%f,%f", &lift, &drop, &contact);
+    if (fields < 2 || drop < 0.0f || contact < 0.0f || contact > lift) {
+        return -1;
+    }
+    timing->enabled = 1;
+    timing->lift_ms = lift;
+    timing->drop_ms = drop;
+    timing->contact_ms = contact;
+    return 0;
+}
+
+void pen_timer_start(PenTimer *timer, const PenTiming *timing) {
+    timer->timing = *timing;
+    timer->pen = -1;
+    timer->raised_ms = timing->lift_ms;
+    timer->x = timer->y = 0;
+}
+
+// Rapid move of distance mm from rest to rest, with trapezoidal acceleration
+static float travel_ms(float distance) {
+    float speed = SCHEDULER_RAPID_FEED / 60.0f;
+    float ramp = speed * speed / PEN_ACCELERATION;
+    if (distance < ramp) {
+        return 2000.0f * sqrtf(distance / PEN_ACCELERATION);
+    }
+    return 1000.0f * (distance / speed + speed / PEN_ACCELERATION);
+}
+
+// Whole milliseconds, rounded up so the pen has always settled
+static int32_t dwell_ms(float ms) {
+    return ms > 0.0f ? (int32_t)ceilf(ms) : 0;
+}
+
+int32_t pen_timer_dwell(PenTimer *timer, const MotionOp *op) {
+    const PenTiming *timing = &timer->timing;
+    float dwell = 0.0f;
+
+    switch (op->code) {
+    case IR_PEN:
+        if (op->x == timer->pen) {
+            break;
+        }
+        if (op->x) {
+            // Fall from the height reached since the lift; unknown counts as fully up
+            float rise = timing->lift_ms - timing->contact_ms;
+            float height = 1.0f;
+            if (timer->pen == 0 && rise > 0.0f) {
+                height = (timer->raised_ms - timing->contact_ms) / rise;
+                height = height < 0.0f ? 0.0f : height > 1.0f ? 1.0f : height;
+            }
+            dwell = timing->drop_ms * height;
+        } else {
+            // The travel may start while the tip is still on the paper, as long as it moves less than PEN_SMEAR_MM
+            dwell = timing->contact_ms - 1000.0f * sqrtf(2.0f * PEN_SMEAR_MM / PEN_ACCELERATION);
+            timer->raised_ms = 0.0f;
+        }
+        timer->pen = op->x;
+        break;
+    case IR_TRAVEL:
+    case IR_DRAW:
+        if (op->code == IR_TRAVEL && timer->pen == 0) {
+            timer->raised_ms += travel_ms(hypotf((float)(op->x - timer->x), (float)(op->y - timer->y)) / 1000.0f);
+        }
+        timer->x = op->x;
+        timer->y = op->y;
+        break;
+    case IR_DWELL:
+        // Including the dwells this timer asked for
+        timer->raised_ms += (float)op->x;
+        break;
+    case IR_PAGE:
+        // The page-change hook parks the robot at the origin with the pen up
+        timer->pen = 0;
+        timer->raised_ms = timing->lift_ms;
+        timer->x = timer->y = 0;
+        break;
+    default:
+        break;
+    }
+    return dwell_ms(dwell);
+}
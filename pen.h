@@ -0,0 +1,98 @@
+/**
+ * @file pen.h
+ * @brief Pen servo timing model and the dwells it requires
+ *
+ * The controller changes the pen servo's setpoint once the previous move has
+ * stopped and starts the next move straight away, so a drop that has not
+ * settled smears the start of the stroke and a lift that has not left the
+ * paper drags a tail behind the travel. The pen timer follows the motion
+ * stream and says how long to dwell (G4) after each pen change:
+ *
+ * - after a lift, only until the tip leaves the paper, less the time the
+ *   following travel needs to accelerate over PEN_SMEAR_MM; the rest of the
+ *   rise overlaps with the travel;
+ * - after a drop, only as long as the fall from the height the pen reached
+ *   takes: a short hop between two strokes leaves the pen low, so it lands
+ *   sooner than after a long travel.
+ *
+ * Since the controller only changes the setpoint once motion has stopped,
+ * the lift cannot overlap the deceleration of the stroke before it; it
+ * overlaps with the travel after it instead.
+ */
+
+#ifndef PEN_H
+#define PEN_H
+
+#include <stdint.h>
+#include "ir.h"
+
+/**
+ * @brief Default servo timing, in ms from the S command
+ */
+#define PEN_LIFT_MS_DEFAULT 150.0f      // S0 until the pen is fully up
+#define PEN_DROP_MS_DEFAULT 120.0f      // S1000 from fully up until the pen has settled on the paper
+#define PEN_CONTACT_MS_DEFAULT 40.0f    // S0 until the tip leaves the paper
+
+/**
+ * @brief Motion model
+ */
+#define PEN_ACCELERATION 500.0f         // mm/s^2, as set with Grbl's $120/$121
+#define PEN_SMEAR_MM 0.05f              // Travel allowed while the tip still touches the paper
+
+/**
+ * @brief Servo timing settings
+ */
+typedef struct {
+    int enabled;            // 0: pen changes are sent without dwells
+    float lift_ms;
+    float drop_ms;
+    float contact_ms;
+} PenTiming;
+
+/**
+ * @brief Follows pen state and pen-up travel through a motion stream
+ */
+typedef struct {
+    PenTiming timing;
+    int pen;                // -1 unknown, 0 up, 1 down
+    float raised_ms;        // Time the pen has been rising since the last lift
+    int32_t x;              // Position in micrometres
+    int32_t y;
+} PenTimer;
+
+/**
+ * @brief Fills timing with dwells disabled and the default servo times
+ *
+ * @param timing Timing to fill
+ */
+void pen_timing_init(PenTiming *timing);
+
+/**
+ * @brief Parses "LIFT,DROP" or "LIFT,DROP,CONTACT" in ms and enables dwells
+ *
+ * @param text Times, e.g. "150,120"
+ * @param timing Receives the times; CONTACT keeps its value if not given
+ * @return int 0 on success, -1 unless 0 <= CONTACT <= LIFT and DROP >= 0
+ */
+int parse_pen_timing(const char *text, PenTiming *timing);
+
+/**
+ * @brief Starts a timer with the pen fully up at the origin
+ *
+ * @param timer Timer to start
+ * @param timing Servo timing to copy
+ */
+void pen_timer_start(PenTimer *timer, const PenTiming *timing);
+
+/**
+ * @brief Follows one operation and returns the dwell required after it
+ *
+ * The dwell must be sent, and passed to the timer, before the next operation.
+ *
+ * @param timer Running timer
+ * @param op Operation just sent
+ * @return int32_t Dwell in ms, 0 for none
+ */
+int32_t pen_timer_dwell(PenTimer *timer, const MotionOp *op);
+
+#endif // PEN_H
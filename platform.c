@@ -0,0 +1,56 @@
+// platform.c
+#include "platform.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <time.h>
+#include <unistd.h>
+#endif
+
+uint64_t monotonic_ns(void) {
+#ifdef _WIN32
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    if (frequency.QuadPart == 0) {
+        QueryPerformanceFrequency(&frequency);
+    }
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000000ULL +
+           (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000000ULL / (uint64_t)frequency.QuadPart;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+#endif
+}
+
+void sleep_ms(unsigned int milliseconds) {
+#ifdef _WIN32
+    Sleep(milliseconds);
+#else
+    usleep(milliseconds * 1000);
+#endif
+}
+
+void sleep_until_ns(uint64_t deadline_ns) {
+    uint64_t now;
+    while ((now = monotonic_ns()) < deadline_ns) {
+        uint64_t left_ms = (deadline_ns - now) / 1000000ULL;
+        if (left_ms > 2) {
+            sleep_ms((unsigned int)(left_ms - 2));
+        }
+    }
+}
+
+int sync_file(FILE *file) {
+    if (fflush(file) != 0) {
+        return -1;
+    }
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0 ? 0 : -1;
+#else
+    return fsync(fileno(file)) == 0 ? 0 : -1;
+#endif
+}
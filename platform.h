@@ -0,0 +1,44 @@
+/**
+ * @file platform.h
+ * @brief Small portability layer for timing and durable file writes
+ */
+
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/**
+ * @brief Reads a monotonic clock
+ *
+ * @return uint64_t Nanoseconds since an arbitrary fixed point
+ */
+uint64_t monotonic_ns(void);
+
+/**
+ * @brief Suspends the calling thread
+ *
+ * @param milliseconds Time to sleep
+ */
+void sleep_ms(unsigned int milliseconds);
+
+/**
+ * @brief Waits until the monotonic clock reaches a deadline
+ *
+ * Sleeps while more than a couple of milliseconds remain, then spins, so
+ * short waits keep sub-millisecond accuracy.
+ *
+ * @param deadline_ns Time as returned by monotonic_ns()
+ */
+void sleep_until_ns(uint64_t deadline_ns);
+
+/**
+ * @brief Flushes a stream and forces its data to stable storage
+ *
+ * @param file Stream to sync
+ * @return int 0 on success, -1 on failure
+ */
+int sync_file(FILE *file);
+
+#endif // PLATFORM_H
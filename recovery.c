@@ -0,0 +1,151 @@
+// recovery.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "recovery.h"
+
+static RecoveryPolicy current_policy = { RECOVERY_ACK_TIMEOUT_MS, RECOVERY_RETRIES, 1 };
+
+void recovery_policy_init(RecoveryPolicy *policy) {
+    policy->ack_timeout_ms = RECOVERY_ACK_TIMEOUT_MS;
+    policy->retries = RECOVERY_RETRIES;
+    policy->rehome = 1;
+}
+
+void set_recovery_policy(const RecoveryPolicy *policy) {
+    current_policy = *policy;
+}
+
+const RecoveryPolicy *get_recovery_policy(void) {
+    return &current_policy;
+}
+
+ReplyClass classify_reply(const char *reply, int *code) {
+    *code = 0;
+    if (strncmp(reply, "ok", 2) == 0) {
+        return REPLY_OK;
+    }
+    if (strncmp(reply, "error:", 6) == 0) {
+        *code = atoi(reply + 6);
+        // Grbl refuses G-code while an alarm locks it
+        return *code == 9 ? REPLY_ALARM : REPLY_ERROR;
+    }
+    if (strncmp(reply, "ALARM:", 6) == 0) {
+        *code = atoi(reply + 6);
+        return REPLY_ALARM;
+    }
+    // Anything else that ends a command is treated as a rejection
+    return REPLY_ERROR;
+}
+
+int error_is_transient(int code) {
+    switch (code) {
+    case 1:     // Expected command letter
+    case 2:     // Bad number format
+    case 20:    // Unsupported command
+    case 23:    // Integer value required
+    case 25:    // Repeated word
+    case 26:    // No axis words
+    case 28:    // Value word missing
+    case 36:    // Unused words
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+int command_is_idempotent(const char *command) {
+    // Relative moves and coordinate offsets add up when repeated
+    if (strstr(command, "G91") || strstr(command, "G92")) {
+        return 0;
+    }
+    switch (toupper((unsigned char)command[0])) {
+    case 'G':
+        return (command[1] == '0' || command[1] == '1' || command[1] == '4') && !isdigit((unsigned char)command[2]);
+    case 'F':
+    case 'S':
+        return 1;
+    case 'M':
+        return (command[1] == '3' || command[1] == '5') && !isdigit((unsigned char)command[2]);
+    default:
+        return 0;
+    }
+}
+
+void machine_state_init(MachineState *state) {
+    memset(state, 0, sizeof(*state));
+}
+
+void machine_state_update(MachineState *state, const char *command) {
+    if (strcmp(command, RECOVERY_HOME_COMMAND) == 0) {
+        state->positioned = 1;
+        state->x = state->y = 0.0;
+        return;
+    }
+    if (command[0] == '$') {
+        return;
+    }
+
+    const char *p = command;
+    int move = 0;
+    double x = state->x, y = state->y;
+    while (*p) {
+        char letter = (char)toupper((unsigned char)*p);
+        if (!isalpha((unsigned char)letter)) {
+            p++;
+            continue;
+        }
+        char *end;
+        double value = strtod(p + 1, &end);
+        switch (letter) {
+        case 'G':
+            move |= value == 0.0 || value == 1.0;
+            break;
+        case 'X':
+            x = value;
+            break;
+        case 'Y':
+            y = value;
+            break;
+        case 'F':
+            state->feed = (long)value;
+            break;
+        case 'S':
+            state->pen = (int)value;
+            break;
+        case 'M':
+            if (value == 3.0 || value == 5.0) {
+                state->spindle = value == 3.0;
+            }
+            break;
+        default:
+            break;
+        }
+        p = end > p + 1 ? end : p + 1;
+    }
+    if (move) {
+        state->x = x;
+        state->y = y;
+        state->positioned = 1;
+    }
+}
+
+int machine_state_restore(const MachineState *state, char lines[RECOVERY_MAX_RESTORE_LINES][64]) {
+    int count = 0;
+    if (state->spindle) {
+        snprintf(lines[count++], 64, "M3\n");
+    }
+    // Travel with the pen up
+    snprintf(lines[count++], 64, "S0\n");
+    if (state->feed > 0) {
+        snprintf(lines[count++], 64, "F%ld\n", state->feed);
+    }
+    if (state->positioned) {
+        snprintf(lines[count++], 64, "G0 X%.3f Y%.3f\n", state->x, state->y);
+    }
+    if (state->pen != 0) {
+        snprintf(lines[count++], 64, "S%d\n", state->pen);
+    }
+    return count;
+}
@@ -0,0 +1,141 @@
+/**
+ * @file recovery.h
+ * @brief Acknowledgement timeouts, controller error classes and alarm recovery
+ *
+ * The serial transports wait at most ack_timeout_ms for each reply. A command
+ * that times out, or that the controller rejects with an error a corrupted
+ * line can cause, is sent again when sending it twice is harmless: absolute
+ * moves, feeds, pen changes and dwells. A command rejected for any other
+ * reason is left out and the job goes on.
+ *
+ * An alarm, or a line refused because the controller is locked, resets the
+ * controller, unlocks it ($X) and re-homes it ($H). The transport then lifts
+ * the pen, restores the feed, travels back to the position of the last
+ * acknowledged command, puts the pen back and sends the command again. A
+ * command that raises a second alarm is left out after recovering.
+ *
+ * A controller that stops answering fails the job instead of hanging it; the
+ * checkpoint (see checkpoint.h) lets --resume continue it later.
+ */
+
+#ifndef RECOVERY_H
+#define RECOVERY_H
+
+/**
+ * @brief Defaults and limits
+ */
+#define RECOVERY_ACK_TIMEOUT_MS 10000   // Longest wait for "ok"; a full planner holds it back for a whole move
+#define RECOVERY_HOME_TIMEOUT_MS 60000  // Longest wait for reset, unlock and homing
+#define RECOVERY_RETRIES 3              // Further attempts of an idempotent command
+#define RECOVERY_RESYNC_TIMEOUT_MS 1000 // Longest wait for the status report that re-aligns replies after a timeout
+#define RECOVERY_MAX_RESTORE_LINES 5    // Commands that restore the machine state
+
+/**
+ * @brief Commands of the recovery path
+ */
+#define RECOVERY_RESET_CHAR '\x18'      // Grbl soft reset (Ctrl-X), clears the alarm's halt
+#define RECOVERY_UNLOCK_COMMAND "$X\n"
+#define RECOVERY_HOME_COMMAND "$H\n"
+
+/**
+ * @brief What a controller reply means for the command it answers
+ */
+typedef enum {
+    REPLY_OK = 0,
+    REPLY_ERROR,            // "error:N": the command was rejected
+    REPLY_ALARM,            // "ALARM:N", or a command refused while locked
+    REPLY_TIMEOUT           // No reply within the timeout
+} ReplyClass;
+
+/**
+ * @brief Recovery settings
+ */
+typedef struct {
+    int ack_timeout_ms;
+    int retries;
+    int rehome;             // 0: unlock only, for machines without homing switches
+} RecoveryPolicy;
+
+/**
+ * @brief Machine state after the last acknowledged command
+ */
+typedef struct {
+    int spindle;            // M3 is on
+    int pen;                // Last S value
+    long feed;              // Last F value, 0 if none
+    int positioned;         // A move or homing was acknowledged
+    double x;               // Position in mm
+    double y;
+} MachineState;
+
+/**
+ * @brief Sets the default policy
+ *
+ * @param policy Policy to initialise
+ */
+void recovery_policy_init(RecoveryPolicy *policy);
+
+/**
+ * @brief Sets the policy used by every serial and streaming transport
+ *
+ * @param policy Policy to copy
+ */
+void set_recovery_policy(const RecoveryPolicy *policy);
+
+/**
+ * @brief Returns the policy set with set_recovery_policy()
+ *
+ * @return const RecoveryPolicy* Current policy
+ */
+const RecoveryPolicy *get_recovery_policy(void);
+
+/**
+ * @brief Classifies a reply line
+ *
+ * @param reply Reply without its line end
+ * @param code Receives the error or alarm number, 0 if none
+ * @return ReplyClass REPLY_OK, REPLY_ERROR or REPLY_ALARM; error:9 (locked) is an alarm
+ */
+ReplyClass classify_reply(const char *reply, int *code);
+
+/**
+ * @brief Says whether an error may come from a line corrupted on the wire
+ *
+ * @param code Grbl error number
+ * @return int 1 for parse errors worth sending the line again for, 0 otherwise
+ */
+int error_is_transient(int code);
+
+/**
+ * @brief Says whether sending a command twice has the same effect as once
+ *
+ * @param command Command line
+ * @return int 1 for absolute moves, feeds, pen, spindle and dwell commands
+ */
+int command_is_idempotent(const char *command);
+
+/**
+ * @brief Clears a machine state
+ *
+ * @param state State to initialise
+ */
+void machine_state_init(MachineState *state);
+
+/**
+ * @brief Applies an acknowledged command to a machine state
+ *
+ * @param state State to update
+ * @param command Command line
+ */
+void machine_state_update(MachineState *state, const char *command);
+
+/**
+ * @brief Builds the commands that bring a re-homed machine back to a state
+ *
+ * @param state State to restore
+ * @param lines Receives the command lines
+ * @return int Number of lines
+ */
+int machine_state_restore(const MachineState *state, char lines[RECOVERY_MAX_RESTORE_LINES][64]);
+
+#endif // RECOVERY_H
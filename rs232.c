@@ -39,11 +39,9 @@
 #define RS232_PORTNR  38
 
 
-int Cport[RS232_PORTNR],
-    error;
+int Cport[RS232_PORTNR];
 
-struct termios new_port_settings,
-           old_port_settings[RS232_PORTNR];
+struct termios old_port_settings[RS232_PORTNR];
 
 char *comports[RS232_PORTNR]= {"/dev/ttyS0","/dev/ttyS1","/dev/ttyS2","/dev/ttyS3","/dev/ttyS4","/dev/ttyS5",
                                "/dev/ttyS6","/dev/ttyS7","/dev/ttyS8","/dev/ttyS9","/dev/ttyS10","/dev/ttyS11",
@@ -58,7 +56,9 @@ char *comports[RS232_PORTNR]= {"/dev/ttyS0","/dev/ttyS1","/dev/ttyS2","/dev/ttyS
 int RS232_OpenComport(int comport_number, int baudrate, const char *mode)
 {
     int baudr,
-        status;
+        status,
+        error;
+    struct termios new_port_settings;
 
     if((comport_number>=RS232_PORTNR)||(comport_number<0))
     {
@@ -324,6 +324,21 @@ int RS232_PollComport(int comport_number, unsigned char *buf, int size)
 }
 
 
+/* waits up to timeout_ms for the first byte instead of returning at once */
+int RS232_PollComportTimeout(int comport_number, unsigned char *buf, int size, int timeout_ms)
+{
+    struct pollfd fd;
+
+    fd.fd = Cport[comport_number];
+    fd.events = POLLIN;
+
+    if(poll(&fd, 1, timeout_ms) <= 0)
+        return 0;
+
+    return RS232_PollComport(comport_number, buf, size);
+}
+
+
 int RS232_SendByte(int comport_number, unsigned char byte)
 {
     int n = write(Cport[comport_number], &byte, 1);
@@ -544,11 +559,10 @@ char *comports[RS232_PORTNR]= {"\\\\.\\COM1",  "\\\\.\\COM2",  "\\\\.\\COM3",  "
                                "\\\\.\\COM13", "\\\\.\\COM14", "\\\\.\\COM15", "\\\\.\\COM16"
                               };
 
-char mode_str[128];
-
-
 int RS232_OpenComport(int comport_number, int baudrate, const char *mode)
 {
+    char mode_str[128];
+
     if((comport_number>=RS232_PORTNR)||(comport_number<0))
     {
         printf("illegal comport number\n");
@@ -740,6 +754,31 @@ int RS232_PollComport(int comport_number, unsigned char *buf, int size)
 }
 
 
+/* waits up to timeout_ms for the first byte instead of returning at once */
+int RS232_PollComportTimeout(int comport_number, unsigned char *buf, int size, int timeout_ms)
+{
+    int n = 0;
+    COMMTIMEOUTS polling, waiting;
+
+    if(!GetCommTimeouts(Cport[comport_number], &polling))
+        return(0);
+
+    /* MAXDWORD interval and multiplier: return as soon as a byte arrives */
+    waiting = polling;
+    waiting.ReadIntervalTimeout        = MAXDWORD;
+    waiting.ReadTotalTimeoutMultiplier = MAXDWORD;
+    waiting.ReadTotalTimeoutConstant   = timeout_ms > 0 ? timeout_ms : 1;
+
+    if(SetCommTimeouts(Cport[comport_number], &waiting))
+    {
+        ReadFile(Cport[comport_number], buf, size, (LPDWORD)((void *)&n), NULL);
+        SetCommTimeouts(Cport[comport_number], &polling);
+    }
+
+    return(n);
+}
+
+
 int RS232_SendByte(int comport_number, unsigned char byte)
 {
     int n;
@@ -53,6 +53,7 @@ extern "C" {
 #include <limits.h>
 #include <sys/file.h>
 #include <errno.h>
+#include <poll.h>
 
 #else
 
@@ -62,6 +63,7 @@ extern "C" {
 
 int RS232_OpenComport(int, int, const char *);
 int RS232_PollComport(int, unsigned char *, int);
+int RS232_PollComportTimeout(int, unsigned char *, int, int);
 int RS232_SendByte(int, unsigned char);
 int RS232_SendBuf(int, unsigned char *, int);
 void RS232_CloseComport(int);
@@ -0,0 +1,372 @@
+// scheduler.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "scheduler.h"
+#include "job.h"
+#include "platform.h"
+#include "trace.h"
+#include "debug.h"
+
+typedef struct {
+    Scheduler *scheduler;
+    int index;
+} RobotThread;
+
+typedef struct {
+    double estimate_ms;
+    size_t unit;
+} UnitOrder;
+
+// Guards the robots' queues and statistics while the pool runs
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Runs sheet changes one robot at a time
+static pthread_mutex_t sheet_lock = PTHREAD_MUTEX_INITIALIZER;
+
+double estimate_ops_ms(const MotionOp *ops, size_t count, int32_t feed) {
+    double draw_feed = feed > 0 ? (double)feed : SCHEDULER_DRAW_FEED;
+    double x = 0.0, y = 0.0, total = 0.0;
+
+    for (size_t i = 0; i < count; i++) {
+        const MotionOp *op = &ops[i];
+        switch (op->code) {
+        case IR_PEN:
+            total += SCHEDULER_PEN_CHANGE_MS;
+            break;
+        case IR_TRAVEL:
+        case IR_DRAW: {
+            // Micrometres over mm/min gives minutes / 1000
+            double distance = hypot(op->x - x, op->y - y);
+            double speed = op->code == IR_DRAW ? draw_feed : SCHEDULER_RAPID_FEED;
+            total += distance / speed * 60.0;
+            x = op->x;
+            y = op->y;
+            break;
+        }
+        case IR_FEED:
+            draw_feed = op->x > 0 ? (double)op->x : draw_feed;
+            break;
+        case IR_DWELL:
+            total += op->x;
+            break;
+        default:
+            break;
+        }
+    }
+    return total + hypot(x, y) / SCHEDULER_RAPID_FEED * 60.0;
+}
+
+// Close the unit that ends before op index end, dropping empty pages
+static int end_unit(Scheduler *scheduler, size_t *capacity, int page, size_t first, size_t end, int32_t feed) {
+    if (end == first) {
+        return 0;
+    }
+    if (scheduler->unit_count == *capacity) {
+        size_t grown = *capacity ? *capacity * 2 : 16;
+        WorkUnit *units = realloc(scheduler->units, grown * sizeof(*units));
+        if (!units) {
+            return -1;
+        }
+        scheduler->units = units;
+        *capacity = grown;
+    }
+    WorkUnit *unit = &scheduler->units[scheduler->unit_count++];
+    unit->page = page;
+    unit->first_op = first;
+    unit->op_count = end - first;
+    unit->feed = feed;
+    unit->estimate_ms = estimate_ops_ms(&scheduler->ops[first], end - first, feed);
+    return 0;
+}
+
+int scheduler_load(Scheduler *scheduler, const char *ir_path) {
+    memset(scheduler, 0, sizeof(*scheduler));
+
+    IrReader reader;
+    if (ir_reader_open(&reader, ir_path) != 0) {
+        DEBUG_LOG("Error: Could not open IR file %s\n", ir_path);
+        return -1;
+    }
+    scheduler->ops = malloc((reader.op_count ? reader.op_count : 1) * sizeof(MotionOp));
+    if (!scheduler->ops) {
+        ir_reader_close(&reader);
+        return -1;
+    }
+
+    size_t unit_capacity = 0, first = 0;
+    int page = 1, status;
+    int32_t feed = 0, unit_feed = 0;
+    MotionOp op;
+    while ((status = ir_read_op(&reader, &op)) > 0) {
+        if (op.code == IR_PAGE) {
+            // Page breaks only separate units; each unit ends at the origin anyway
+            if (end_unit(scheduler, &unit_capacity, page, first, scheduler->op_count, unit_feed) != 0) {
+                status = -1;
+                break;
+            }
+            page = op.x;
+            first = scheduler->op_count;
+            unit_feed = feed;
+            continue;
+        }
+        if (op.code == IR_FEED) {
+            feed = op.x;
+        }
+        scheduler->ops[scheduler->op_count++] = op;
+    }
+    ir_reader_close(&reader);
+    if (status == 0) {
+        status = end_unit(scheduler, &unit_capacity, page, first, scheduler->op_count, unit_feed);
+    }
+    if (status != 0) {
+        scheduler_free(scheduler);
+        return -1;
+    }
+    DEBUG_LOG("Split %s into %lu units\n", ir_path, (unsigned long)scheduler->unit_count);
+    return 0;
+}
+
+// Write one unit so that it is independent of whatever the robot did before
+static int write_unit(RobotWorker *robot, const MotionOp *ops, const WorkUnit *unit) {
+    Executor executor;
+    executor_init(&executor, robot->transport, NULL, NULL);
+
+    MotionOp pen_up = { IR_PEN, 0, 0 };
+    MotionOp feed = { IR_FEED, unit->feed, 0 };
+    MotionOp origin = { IR_TRAVEL, 0, 0 };
+    if (executor_emit(&executor, &pen_up) != 0 ||
+        (unit->feed > 0 && executor_emit(&executor, &feed) != 0)) {
+        return -1;
+    }
+    for (size_t i = 0; i < unit->op_count; i++) {
+        if (executor_emit(&executor, &ops[unit->first_op + i]) != 0) {
+            return -1;
+        }
+    }
+    if (executor_emit(&executor, &pen_up) != 0 || executor_emit(&executor, &origin) != 0) {
+        return -1;
+    }
+    return transport_drain(robot->transport);
+}
+
+// Next unit for a robot: the front of its own queue, else the back of the fullest other queue
+static int take_unit(Scheduler *scheduler, int index, size_t *unit) {
+    RobotWorker *robot = &scheduler->robots[index];
+    if (robot->head < robot->tail) {
+        *unit = robot->queue[robot->head++];
+        robot->queued_ms -= scheduler->units[*unit].estimate_ms;
+        return 1;
+    }
+
+    RobotWorker *victim = NULL;
+    for (int i = 0; i < scheduler->robot_count; i++) {
+        RobotWorker *other = &scheduler->robots[i];
+        if (other->head < other->tail && (!victim || other->queued_ms > victim->queued_ms)) {
+            victim = other;
+        }
+    }
+    if (!victim) {
+        return 0;
+    }
+    *unit = victim->queue[--victim->tail];
+    victim->queued_ms -= scheduler->units[*unit].estimate_ms;
+    robot->units_stolen++;
+    return 1;
+}
+
+// Puts back a unit the robot will not write, at the front of its queue where the others can steal it
+static void return_unit(Scheduler *scheduler, int index, size_t unit) {
+    RobotWorker *robot = &scheduler->robots[index];
+    if (robot->head > 0) {
+        robot->queue[--robot->head] = unit;
+    } else {
+        robot->queue[robot->tail++] = unit;
+    }
+    robot->queued_ms += scheduler->units[unit].estimate_ms;
+}
+
+static int change_sheet(Scheduler *scheduler, int index, int page) {
+    pthread_mutex_lock(&sheet_lock);
+    int result = scheduler->on_sheet_change(index, page, scheduler->user_data);
+    pthread_mutex_unlock(&sheet_lock);
+    return result;
+}
+
+static void *robot_main(void *arg) {
+    RobotThread *thread = arg;
+    Scheduler *scheduler = thread->scheduler;
+    RobotWorker *robot = &scheduler->robots[thread->index];
+    size_t unit;
+    int sheets = 0;         // Pages written on this robot so far
+    char name[32];
+
+    snprintf(name, sizeof(name), "robot %d", thread->index + 1);
+    trace_set_thread_name(name);
+
+    for (;;) {
+        pthread_mutex_lock(&queue_lock);
+        int found = take_unit(scheduler, thread->index, &unit);
+        pthread_mutex_unlock(&queue_lock);
+        if (!found) {
+            break;
+        }
+
+        const WorkUnit *work = &scheduler->units[unit];
+        // The first sheet is loaded before the job starts; every later page needs a fresh one
+        if (sheets > 0 && scheduler->on_sheet_change && change_sheet(scheduler, thread->index, work->page) != 0) {
+            pthread_mutex_lock(&queue_lock);
+            return_unit(scheduler, thread->index, unit);
+            pthread_mutex_unlock(&queue_lock);
+            printf("Robot %d left the pool before page %d\n", thread->index + 1, work->page);
+            break;
+        }
+        if (scheduler->on_unit_start) {
+            scheduler->on_unit_start(thread->index, work->page, scheduler->user_data);
+        }
+        uint64_t start = monotonic_ns();
+        TRACE_BEGIN("write_unit");
+        int result = write_unit(robot, scheduler->ops, work);
+        TRACE_END("write_unit");
+        sheets++;
+        double elapsed = (double)(monotonic_ns() - start) / 1e6;
+
+        pthread_mutex_lock(&queue_lock);
+        robot->busy_ms += elapsed;
+        if (result == 0) {
+            robot->units_done++;
+            robot->estimated_ms += work->estimate_ms;
+        } else {
+            scheduler->failed = 1;
+        }
+        pthread_mutex_unlock(&queue_lock);
+
+        // A robot that failed stops; the others steal what was queued for it
+        if (result != 0) {
+            printf("Robot %d failed on page %d\n", thread->index + 1, work->page);
+            break;
+        }
+    }
+    return NULL;
+}
+
+static int compare_estimates(const void *a, const void *b) {
+    const UnitOrder *first = a, *second = b;
+    if (first->estimate_ms != second->estimate_ms) {
+        return first->estimate_ms < second->estimate_ms ? 1 : -1;
+    }
+    return first->unit < second->unit ? -1 : first->unit > second->unit;
+}
+
+static int compare_indexes(const void *a, const void *b) {
+    size_t first = *(const size_t *)a, second = *(const size_t *)b;
+    return first < second ? -1 : first > second;
+}
+
+// Longest units first, each to the robot with the least work so far; then page order per robot
+static int deal_units(Scheduler *scheduler) {
+    UnitOrder *order = malloc((scheduler->unit_count ? scheduler->unit_count : 1) * sizeof(*order));
+    if (!order) {
+        return -1;
+    }
+    for (size_t i = 0; i < scheduler->unit_count; i++) {
+        order[i].estimate_ms = scheduler->units[i].estimate_ms;
+        order[i].unit = i;
+    }
+    qsort(order, scheduler->unit_count, sizeof(*order), compare_estimates);
+
+    for (size_t i = 0; i < scheduler->unit_count; i++) {
+        RobotWorker *least = &scheduler->robots[0];
+        for (int r = 1; r < scheduler->robot_count; r++) {
+            if (scheduler->robots[r].queued_ms < least->queued_ms) {
+                least = &scheduler->robots[r];
+            }
+        }
+        least->queue[least->tail++] = order[i].unit;
+        least->queued_ms += order[i].estimate_ms;
+    }
+    for (int r = 0; r < scheduler->robot_count; r++) {
+        qsort(scheduler->robots[r].queue, scheduler->robots[r].tail, sizeof(size_t), compare_indexes);
+    }
+    free(order);
+    return 0;
+}
+
+int scheduler_run(Scheduler *scheduler, Transport **transports, int robot_count,
+                  UnitStartHook on_unit_start, SheetChangeHook on_sheet_change, void *user_data) {
+    if (robot_count < 1 || robot_count > SCHEDULER_MAX_ROBOTS) {
+        return -1;
+    }
+
+    size_t capacity = scheduler->unit_count ? scheduler->unit_count : 1;
+    size_t *queues = malloc((size_t)robot_count * capacity * sizeof(size_t));
+    if (!queues) {
+        return -1;
+    }
+    memset(scheduler->robots, 0, sizeof(scheduler->robots));
+    for (int r = 0; r < robot_count; r++) {
+        scheduler->robots[r].transport = transports[r];
+        scheduler->robots[r].queue = queues + (size_t)r * capacity;
+    }
+    scheduler->robot_count = robot_count;
+    scheduler->on_unit_start = on_unit_start;
+    scheduler->on_sheet_change = on_sheet_change;
+    scheduler->user_data = user_data;
+    scheduler->failed = 0;
+    if (deal_units(scheduler) != 0) {
+        free(queues);
+        return -1;
+    }
+
+    RobotThread threads[SCHEDULER_MAX_ROBOTS];
+    pthread_t ids[SCHEDULER_MAX_ROBOTS];
+    int started = 0;
+    uint64_t start = monotonic_ns();
+    for (int r = 0; r < robot_count; r++) {
+        threads[r].scheduler = scheduler;
+        threads[r].index = r;
+        if (pthread_create(&ids[r], NULL, robot_main, &threads[r]) != 0) {
+            break;
+        }
+        started++;
+    }
+    if (started == 0) {
+        free(queues);
+        return -1;
+    }
+    for (int r = 0; r < started; r++) {
+        pthread_join(ids[r], NULL);
+    }
+    double elapsed = (double)(monotonic_ns() - start) / 1e6;
+
+    double total_estimate = 0.0;
+    unsigned long units_done = 0;
+    for (size_t i = 0; i < scheduler->unit_count; i++) {
+        total_estimate += scheduler->units[i].estimate_ms;
+    }
+    for (int r = 0; r < robot_count; r++) {
+        const RobotWorker *robot = &scheduler->robots[r];
+        units_done += robot->units_done;
+        printf("Robot %d: %lu pages (%lu stolen), estimated %.1f s, busy %.1f s\n", r + 1,
+               robot->units_done, robot->units_stolen, robot->estimated_ms / 1000.0, robot->busy_ms / 1000.0);
+    }
+    printf("Pool wrote %lu of %lu pages in %.1f s (%.1f s estimated on one robot)\n", units_done,
+           (unsigned long)scheduler->unit_count, elapsed / 1000.0, total_estimate / 1000.0);
+
+    free(queues);
+    for (int r = 0; r < robot_count; r++) {
+        scheduler->robots[r].queue = NULL;
+    }
+    return scheduler->failed || units_done != scheduler->unit_count ? -1 : 0;
+}
+
+void scheduler_free(Scheduler *scheduler) {
+    free(scheduler->ops);
+    free(scheduler->units);
+    scheduler->ops = NULL;
+    scheduler->units = NULL;
+    scheduler->op_count = 0;
+    scheduler->unit_count = 0;
+}
@@ -0,0 +1,139 @@
+/**
+ * @file scheduler.h
+ * @brief Work-stealing scheduler that writes one job on a pool of robots
+ *
+ * A compiled job is split at its page breaks into work units. Each unit is
+ * self-contained: it starts with the pen up and the feed restored, and ends
+ * back at the origin, so any robot can write any page on its own sheet.
+ * Between two pages on the same robot, that robot waits parked for a fresh
+ * sheet (SheetChangeHook) while the others keep writing.
+ * Units are dealt to the robots by estimated writing time (longest first, to
+ * the least loaded robot) and a robot that runs out of work steals the last
+ * queued unit of the robot with the most estimated work left.
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stddef.h>
+#include "ir.h"
+#include "transport.h"
+
+/**
+ * @brief Pool size limit
+ */
+#define SCHEDULER_MAX_ROBOTS 16
+
+/**
+ * @brief Machine model used to estimate writing time
+ */
+#define SCHEDULER_DRAW_FEED 1000.0f     // Pen-down feed in mm/min until the job sets one (initialize_robot)
+#define SCHEDULER_RAPID_FEED 3000.0f    // Pen-up (G0) speed in mm/min
+#define SCHEDULER_PEN_CHANGE_MS 100.0f  // Time for the pen to rise or fall
+
+/**
+ * @brief One page of a job
+ */
+typedef struct {
+    int page;               // Page number, from 1
+    size_t first_op;        // Index of the unit's first operation in Scheduler.ops
+    size_t op_count;        // Operations in the unit
+    int32_t feed;           // Feed in effect when the unit starts, 0 if none set yet
+    double estimate_ms;     // Estimated writing time
+} WorkUnit;
+
+/**
+ * @brief Called on the robot's thread before it starts a unit
+ *
+ * @param robot Index of the robot in the pool
+ * @param page Page about to be written
+ * @param user_data Pointer registered with the scheduler
+ */
+typedef void (*UnitStartHook)(int robot, int page, void *user_data);
+
+/**
+ * @brief Called on the robot's thread before each of its pages but the first
+ *
+ * The robot is parked at the origin with the pen up. The hook waits until a
+ * fresh sheet is on that robot, put there by the operator or a feeder. Sheet
+ * changes run one at a time, so prompts of different robots do not mix.
+ *
+ * @param robot Index of the robot in the pool
+ * @param page Page the new sheet is for
+ * @param user_data Pointer registered with the scheduler
+ * @return int 0 once the sheet is in place, -1 to take the robot out of the pool (the page goes back to its queue)
+ */
+typedef int (*SheetChangeHook)(int robot, int page, void *user_data);
+
+/**
+ * @brief A robot of the pool and its queue of units
+ */
+typedef struct {
+    Transport *transport;
+    size_t *queue;              // Unit indexes; [head, tail) are still queued
+    size_t head;
+    size_t tail;
+    double queued_ms;           // Estimated time of the queued units
+    unsigned long units_done;
+    unsigned long units_stolen; // Units taken from other robots' queues
+    double estimated_ms;        // Estimated time of the units it wrote
+    double busy_ms;             // Measured time spent writing
+} RobotWorker;
+
+/**
+ * @brief A job split into units and the pool that writes it
+ */
+typedef struct {
+    MotionOp *ops;
+    size_t op_count;
+    WorkUnit *units;
+    size_t unit_count;
+    RobotWorker robots[SCHEDULER_MAX_ROBOTS];
+    int robot_count;
+    UnitStartHook on_unit_start;    // May be NULL
+    SheetChangeHook on_sheet_change;    // May be NULL
+    void *user_data;
+    int failed;                     // Set once a robot's transport fails
+} Scheduler;
+
+/**
+ * @brief Estimates how long a run of operations takes to write
+ *
+ * @param ops Operations, starting with the robot at the origin
+ * @param count Number of operations
+ * @param feed Feed in effect at the start, 0 for SCHEDULER_DRAW_FEED
+ * @return double Estimated time in ms, including the travel back to the origin
+ */
+double estimate_ops_ms(const MotionOp *ops, size_t count, int32_t feed);
+
+/**
+ * @brief Loads a compiled job and splits it into one unit per page
+ *
+ * @param scheduler Scheduler to initialise
+ * @param ir_path Compiled job
+ * @return int 0 on success, -1 on a bad file or out of memory
+ */
+int scheduler_load(Scheduler *scheduler, const char *ir_path);
+
+/**
+ * @brief Writes every unit on the pool and waits until all are done
+ *
+ * @param scheduler Loaded scheduler
+ * @param transports One transport per robot
+ * @param robot_count Number of robots, 1 to SCHEDULER_MAX_ROBOTS
+ * @param on_unit_start Hook run before each unit, may be NULL
+ * @param on_sheet_change Hook run between two units on the same robot, may be NULL
+ * @param user_data Passed to the hooks
+ * @return int 0 on success, -1 if a robot failed or pages were left unwritten (the others finish their units)
+ */
+int scheduler_run(Scheduler *scheduler, Transport **transports, int robot_count,
+                  UnitStartHook on_unit_start, SheetChangeHook on_sheet_change, void *user_data);
+
+/**
+ * @brief Releases the memory held by a scheduler
+ *
+ * @param scheduler Scheduler to free
+ */
+void scheduler_free(Scheduler *scheduler);
+
+#endif // SCHEDULER_H
@@ -3,6 +3,8 @@
 
 #include "serial.h"
 #include "rs232.h"
+#include "session.h"
+#include "platform.h"
 
 
 //#define Serial_Mode
@@ -10,10 +12,10 @@
 #ifdef Serial_Mode
 
 // Open port with checking
-int CanRS232PortBeOpened ( void )
+int CanPortBeOpened (int port)
 {
     char mode[]= {'8','N','1',0};
-    if(RS232_OpenComport(cport_nr, bdrate, mode))
+    if(RS232_OpenComport(port, bdrate, mode))
     {
         printf("Can not open comport\n");
 
@@ -23,15 +25,19 @@ int CanRS232PortBeOpened ( void )
 }
 
 // Function to close the COM port
-void CloseRS232Port (void)
+void ClosePort (int port)
 {
-    RS232_CloseComport(cport_nr);
+    RS232_CloseComport(port);
 }
 
 // Write text out via the serial port
-int PrintBuffer (char *buffer)
+int PrintBufferToPort (int port, char *buffer)
 {
-    RS232_cputs(cport_nr, buffer);
+    RS232_cputs(port, buffer);
+    session_record(port, SESSION_SENT, buffer, strlen(buffer));
+    // Only label output for ports other than the default one
+    if (port != cport_nr)
+        printf("[%d] ", port + 1);
     printf("sent: %s\n", buffer);
 
     return (0);
@@ -39,91 +45,118 @@ int PrintBuffer (char *buffer)
 }
 
 
-int WaitForDollar (void)
+// Read one reply line, skipping what is not a complete line yet; 1 when a line is in line, 0 if none arrived in time
+static int ReadLineOnPort (int port, uint64_t deadline, char *line, int size)
 {
+    int n, length = 0;
+    unsigned char c;
+    uint64_t now;
 
-
-    int i, n;
-
-    unsigned char buf[4096];
-
-    while(1)
+    while((now = monotonic_ns()) < deadline)
     {
-        printf (".");
-        n = RS232_PollComport(cport_nr, buf, 4095);
+        // Sleep in the driver until a byte arrives, and read one at a time so the bytes
+        // after this line stay for the next call
+        n = RS232_PollComportTimeout(port, &c, 1, (int)((deadline - now + 999999) / 1000000));
 
         if(n > 0)
         {
-            printf ("RCVD: N = %d ", n);
-            buf[n] = 0;   /* always put a "null" at the end of a string! */
-
-            for(i=0; i < n; i++)
+            if(c == '\n')
             {
-                if(buf[i] == '$')  /* replace unreadable control-codes by dots */
-                {
-                    printf("received %i bytes: %s \n", n, (char *)buf);
-                    printf("\nSaw the Dollar");
-                    return 0;
-                }
+                line[length] = '\n';
+                session_record(port, SESSION_RECEIVED, line, length + 1);
+                line[length] = 0;
+                printf("received: %s\n", line);
+                return 1;
             }
-
-            printf("received %i bytes: %s \n", n, (char *)buf);
-
-
-            if ( (buf[0] == 'o') && (buf[1] == 'k') )
-                return 0;
+            if(c != '\r' && length < size - 2)
+                line[length++] = c;
         }
-
-
-        Sleep(100);
-
     }
-
-    return(0);
-
+    return 0;
 }
 
 
-int WaitForReply (void)
+int WaitForBannerOnPort (int port, int timeout_ms, char *answer, int size)
 {
+    char line[256];
+    uint64_t deadline = monotonic_ns() + (uint64_t)timeout_ms * 1000000ULL;
 
-
-    int i, n;
-
-    unsigned char buf[4096];
-
-    while(1)
+    while(ReadLineOnPort(port, deadline, line, sizeof(line)))
     {
-        printf (".");
-        n = RS232_PollComport(cport_nr, buf, 4095);
-
-        if(n > 0)
+        // "Grbl 1.1h ['$' for help]", or the answer of a controller that was already running
+        if(strchr(line, '$') || strncmp(line, "ok", 2) == 0 ||
+           strncmp(line, "error", 5) == 0 || strncmp(line, "ALARM", 5) == 0)
         {
-            printf ("RCVD: N = %d ", n);
-            buf[n] = 0;   /* always put a "null" at the end of a string! */
+            snprintf(answer, size, "%s", line);
+            return 0;
+        }
+    }
+    return(-1);
+}
 
-            for(i=0; i < n; i++)
-            {
-                if(buf[i] < 32)  /* replace unreadable control-codes by dots */
-                {
-                    buf[i] = '.';
-                }
-            }
 
-            printf("received %i bytes: %s\n", n, (char *)buf);
+int QueryPort (int port, const char *query, const char *prefix, char *answer, int size, int timeout_ms)
+{
+    char line[256];
+    int length = (int)strlen(query), found = 0;
+    uint64_t deadline = monotonic_ns() + (uint64_t)timeout_ms * 1000000ULL;
 
+    if (WriteToPort(port, query, length) != 0)
+        return(-1);
 
-            if ( (buf[0] == 'o') && (buf[1] == 'k') )
+    while(ReadLineOnPort(port, deadline, line, sizeof(line)))
+    {
+        if(!found && strncmp(line, prefix, strlen(prefix)) == 0)
+        {
+            snprintf(answer, size, "%s", line);
+            found = 1;
+            // A real-time query has no "ok" to wait for
+            if(length == 1)
                 return 0;
         }
+        else if(found && strncmp(line, "ok", 2) == 0)
+            return 0;
+        // Anything else, such as a late "ok" before the report, is skipped
+    }
+    return(-1);
+}
 
 
-        Sleep(100);
+int ReadReplyOnPort (int port, int timeout_ms, char *reply, int size)
+{
+    char line[256];
+    uint64_t deadline = monotonic_ns() + (uint64_t)timeout_ms * 1000000ULL;
 
+    while(ReadLineOnPort(port, deadline, line, sizeof(line)))
+    {
+        // Status reports, [MSG:...] and the banner do not end a command
+        if(strncmp(line, "ok", 2) == 0 || strncmp(line, "error", 5) == 0 || strncmp(line, "ALARM", 5) == 0)
+        {
+            snprintf(reply, size, "%s", line);
+            return 0;
+        }
     }
 
-    return(0);
+    printf("\nNo reply after %d ms\n", timeout_ms);
+    return(-1);
+}
 
+// Write raw bytes without waiting for a reply (streaming)
+int WriteToPort (int port, const char *data, int length)
+{
+    if (RS232_SendBuf(port, (unsigned char *)data, length) != length)
+        return (-1);
+    session_record(port, SESSION_SENT, data, length);
+    return (0);
+}
+
+// Read whatever the controller has sent so far, without waiting
+int ReadFromPort (int port, unsigned char *buf, int size)
+{
+    int n = RS232_PollComport(port, buf, size);
+    if (n > 0)
+        session_record(port, SESSION_RECEIVED, buf, n);
+    return (n);
 }
 
 // Error was here - this should be 'ELSE' not 'ELSEIF'
@@ -132,38 +165,151 @@ int WaitForReply (void)
 
 
 // Open port with checking
-int CanRS232PortBeOpened ( void )
+int CanPortBeOpened (int port)
 {
+    (void)port;
     return (0);      // Success
 }
 
 // Function to close the COM port
-void CloseRS232Port (void)
+void ClosePort (int port)
 {
+    (void)port;
     return;
 }
 
 // JIB: you MUST specify variable types in function definitions
-int PrintBuffer (char *buffer)
+int PrintBufferToPort (int port, char *buffer)
 {
+    // Only label output for ports other than the default one
+    if (port != cport_nr)
+        printf("[%d] ", port + 1);
     printf("%s \n",buffer);
+    session_record(port, SESSION_SENT, buffer, strlen(buffer));
     return (0);
 }
 
 
-int WaitForReply (void)
+// The operator answers for the controller: Enter is "ok"; error:N and ALARM:N are passed on,
+// any other text is a reply that never arrived
+int ReadReplyOnPort (int port, int timeout_ms, char *reply, int size)
 {
-    char c;
-    c = getchar();
+    char line[128], answer[132];
+    (void)timeout_ms;
+    if (!fgets(line, sizeof(line), stdin) || line[0] == '\n' || line[0] == '\r')
+        snprintf(line, sizeof(line), "ok");
+    line[strcspn(line, "\r\n")] = 0;
+    if (strncmp(line, "ok", 2) != 0 && strncmp(line, "error:", 6) != 0 && strncmp(line, "ALARM:", 6) != 0)
+        return (-1);
+
+    // Record what a controller would have answered
+    session_record(port, SESSION_RECEIVED, answer, snprintf(answer, sizeof(answer), "%s\r\n", line));
+    snprintf(reply, size, "%s", line);
     return (0);
 }
 
-int WaitForDollar (void)
+// Each keypress stands for the start-up banner
+int WaitForBannerOnPort (int port, int timeout_ms, char *answer, int size)
 {
-    char c;
-    c = getchar();
+    (void)timeout_ms;
+    getchar();
+    session_record(port, SESSION_RECEIVED, "$\r\n", 3);
+    snprintf(answer, size, "$");
     return (0);
 }
 
+// Nobody reports state here, so startup sends every initialisation command
+int QueryPort (int port, const char *query, const char *prefix, char *answer, int size, int timeout_ms)
+{
+    (void)port;
+    (void)query;
+    (void)prefix;
+    (void)answer;
+    (void)size;
+    (void)timeout_ms;
+    return (-1);
+}
+
+int WriteToPort (int port, const char *data, int length)
+{
+    // Nobody answers real-time status requests here
+    if (length == 1 && data[0] == '?')
+        return (0);
+    if (length == 1 && data[0] == '\x18')
+    {
+        printf("(reset)\n");
+        session_record(port, SESSION_SENT, data, length);
+        return (0);
+    }
+    if (port != cport_nr)
+        printf("[%d] ", port + 1);
+    printf("%.*s", length, data);
+    session_record(port, SESSION_SENT, data, length);
+    return (0);
+}
+
+// Each keypress acknowledges one streamed line
+int ReadFromPort (int port, unsigned char *buf, int size)
+{
+    if (size < 4)
+        return (0);
+    getchar();
+    memcpy(buf, "ok\r\n", 4);
+    session_record(port, SESSION_RECEIVED, buf, 4);
+    return (4);
+}
+
 
 #endif // SM
+
+// The start-up banner, or "ok" from a controller that was already running
+int WaitForDollarOnPort (int port)
+{
+    char answer[256];
+    if (WaitForBannerOnPort(port, dollar_timeout_ms, answer, sizeof(answer)) != 0)
+    {
+        printf("\nNo start-up banner after %d ms\n", dollar_timeout_ms);
+        return (-1);
+    }
+    if (strchr(answer, '$'))
+    {
+        printf("\nSaw the Dollar");
+        return (0);
+    }
+    return strncmp(answer, "ok", 2) == 0 ? 0 : -1;
+}
+
+// Anything but "ok", or no reply in time, is a failure
+int WaitForReplyOnPort (int port)
+{
+    char reply[128];
+    if (ReadReplyOnPort(port, reply_timeout_ms, reply, sizeof(reply)) != 0)
+        return (-1);
+    return strncmp(reply, "ok", 2) == 0 ? 0 : -1;
+}
+
+// The single-robot functions use the port configured in serial.h
+int CanRS232PortBeOpened ( void )
+{
+    return CanPortBeOpened(cport_nr);
+}
+
+void CloseRS232Port (void)
+{
+    ClosePort(cport_nr);
+}
+
+int PrintBuffer (char *buffer)
+{
+    return PrintBufferToPort(cport_nr, buffer);
+}
+
+int WaitForReply (void)
+{
+    return WaitForReplyOnPort(cport_nr);
+}
+
+int WaitForDollar (void)
+{
+    return WaitForDollarOnPort(cport_nr);
+}
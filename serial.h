@@ -8,6 +8,8 @@
 
 #define cport_nr    5                  /* COM number minus 1 */
 #define bdrate      115200              /* 115200  */
+#define dollar_timeout_ms   10000       /* Longest wait for the start-up banner */
+#define reply_timeout_ms    10000       /* Longest wait for "ok" in WaitForReply */
 
 int PrintBuffer (char *buffer);                 //JIB: Needed to match the function
 int WaitForReply (void);                        // Wait for OK function
@@ -15,4 +17,27 @@ int WaitForDollar (void);                       // Wait for '$' function (for st
 int CanRS232PortBeOpened ( void );              // Port open check
 void CloseRS232Port (void);
 
+// Same operations on an explicit port (COM number minus 1), for driving several robots
+int CanPortBeOpened (int port);
+void ClosePort (int port);
+int PrintBufferToPort (int port, char *buffer);
+int WaitForReplyOnPort (int port);
+int WaitForDollarOnPort (int port);
+
+// Wait for the line that ends a command (ok, error:N or ALARM:N), skipping status and
+// message lines; 0 with the line in reply, -1 if none arrives within timeout_ms
+int ReadReplyOnPort (int port, int timeout_ms, char *reply, int size);
+
+// Wait for the controller to speak after a wake-up or reset: the banner, "ok" or an error or
+// alarm line; 0 with the line in answer, -1 if nothing arrives within timeout_ms
+int WaitForBannerOnPort (int port, int timeout_ms, char *answer, int size);
+
+// Send a query ("?" or "$G\n") and wait for the report line starting with prefix (and the "ok"
+// after it); 0 with the line in answer, -1 if none arrives within timeout_ms
+int QueryPort (int port, const char *query, const char *prefix, char *answer, int size, int timeout_ms);
+
+// Raw streaming I/O: write without waiting for a reply, read what has arrived (see flow.h)
+int WriteToPort (int port, const char *data, int length);
+int ReadFromPort (int port, unsigned char *buf, int size);
+
 #endif // SERIAL_H_INCLUDED
\ No newline at end of file
@@ -0,0 +1,299 @@
+// session.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+#include "session.h"
+#include "hash.h"
+#include "platform.h"
+#include "debug.h"
+
+// The running recording, shared by every port and thread
+static pthread_mutex_t record_lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE *record_file = NULL;
+static uint64_t record_start_ns;
+static uint64_t record_last_us;
+static int record_failed;
+
+static void put_varint(FILE *file, uint64_t value) {
+    while (value >= 0x80) {
+        fputc((int)(value & 0x7f) | 0x80, file);
+        value >>= 7;
+    }
+    fputc((int)value, file);
+}
+
+static int get_varint(FILE *file, uint64_t *value) {
+    *value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = fgetc(file);
+        if (c == EOF) {
+            return -1;
+        }
+        *value |= (uint64_t)(c & 0x7f) << shift;
+        if (!(c & 0x80)) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int session_record_start(const char *path) {
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        return -1;
+    }
+    unsigned char header[8] = { 0 };
+    memcpy(header, SESSION_MAGIC, 4);
+    header[4] = SESSION_VERSION;
+    if (fwrite(header, 1, sizeof(header), file) != sizeof(header)) {
+        fclose(file);
+        return -1;
+    }
+
+    pthread_mutex_lock(&record_lock);
+    record_file = file;
+    record_start_ns = monotonic_ns();
+    record_last_us = 0;
+    record_failed = 0;
+    pthread_mutex_unlock(&record_lock);
+    return 0;
+}
+
+void session_record(int port, SessionDirection direction, const void *data, size_t length) {
+    uint64_t now = monotonic_ns();
+    if (length > SESSION_MAX_RECORD) {
+        length = SESSION_MAX_RECORD;
+    }
+
+    pthread_mutex_lock(&record_lock);
+    if (record_file) {
+        uint64_t time_us = (now - record_start_ns) / 1000;
+        // Records from other threads may have been stamped later but locked first
+        uint64_t delta = time_us > record_last_us ? time_us - record_last_us : 0;
+        record_last_us += delta;
+        put_varint(record_file, delta);
+        fputc(port & 0xff, record_file);
+        put_varint(record_file, (uint64_t)length << 1 | (uint64_t)direction);
+        if (fwrite(data, 1, length, record_file) != length) {
+            record_failed = 1;
+        }
+    }
+    pthread_mutex_unlock(&record_lock);
+}
+
+int session_record_stop(void) {
+    pthread_mutex_lock(&record_lock);
+    FILE *file = record_file;
+    int failed = record_failed;
+    record_file = NULL;
+    pthread_mutex_unlock(&record_lock);
+
+    if (!file) {
+        return 0;
+    }
+    if (ferror(file)) {
+        failed = 1;
+    }
+    return fclose(file) == 0 && !failed ? 0 : -1;
+}
+
+int session_reader_open(SessionReader *reader, const char *path) {
+    unsigned char header[8];
+    reader->file = fopen(path, "rb");
+    reader->time_us = 0;
+    if (!reader->file) {
+        return -1;
+    }
+    if (fread(header, 1, sizeof(header), reader->file) != sizeof(header) ||
+        memcmp(header, SESSION_MAGIC, 4) != 0 || header[4] != SESSION_VERSION) {
+        DEBUG_LOG("Error: %s is not a session log\n", path);
+        fclose(reader->file);
+        reader->file = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+int session_read_record(SessionReader *reader, SessionRecord *record) {
+    uint64_t delta, tag;
+    int port;
+    if (get_varint(reader->file, &delta) != 0 || (port = fgetc(reader->file)) == EOF ||
+        get_varint(reader->file, &tag) != 0 || (tag >> 1) > SESSION_MAX_RECORD) {
+        return 0;
+    }
+    record->length = (size_t)(tag >> 1);
+    if (fread(record->data, 1, record->length, reader->file) != record->length) {
+        return 0;
+    }
+    reader->time_us += delta;
+    record->time_us = reader->time_us;
+    record->port = port;
+    record->direction = (SessionDirection)(tag & 1);
+    return 1;
+}
+
+void session_reader_close(SessionReader *reader) {
+    if (reader->file) {
+        fclose(reader->file);
+        reader->file = NULL;
+    }
+}
+
+static int is_blank(const unsigned char *data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        if (!isspace(data[i])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int replay_send_command(Transport *transport, const char *command) {
+    ReplayTransport *replay = transport->state;
+    uint64_t now = monotonic_ns();
+    size_t length = strlen(command);
+
+    if (replay->replayed.commands == 0) {
+        replay->start_ns = now;
+    } else {
+        uint64_t gap_us = (now - replay->last_ack_ns) / 1000;
+        replay->replayed.host_us += gap_us;
+        replay->replayed.host_stalls += gap_us > SESSION_HOST_STALL_MS * 1000ULL;
+    }
+    replay->replayed.commands++;
+    replay->replayed.bytes += length;
+    transport_mark_written(transport);
+
+    if (replay->next < replay->count) {
+        const SessionExchange *exchange = &replay->exchanges[replay->next++];
+        if (exchange->length != length || exchange->hash != hash_bytes(HASH_INIT, command, length)) {
+            replay->mismatches++;
+        }
+        // The controller answers as long after the command as it did in the recording
+        sleep_until_ns(now + (uint64_t)((double)(exchange->acked_us - exchange->sent_us) * 1000.0 / replay->speed));
+    } else {
+        replay->unrecorded++;
+    }
+
+    replay->last_ack_ns = monotonic_ns();
+    replay->replayed.duration_us = (replay->last_ack_ns - replay->start_ns) / 1000;
+    return 0;
+}
+
+int replay_transport_open(ReplayTransport *replay, const char *path, int port, double speed) {
+    SessionReader reader;
+    memset(replay, 0, sizeof(*replay));
+    if (speed <= 0.0 || session_reader_open(&reader, path) != 0) {
+        return -1;
+    }
+
+    SessionRecord record;
+    size_t capacity = 0;
+    int open = 0, result = 0;
+    while (session_read_record(&reader, &record)) {
+        if (port < 0) {
+            port = record.port;
+        }
+        if (record.port != port) {
+            continue;
+        }
+        if (record.direction == SESSION_RECEIVED) {
+            if (open) {
+                replay->exchanges[replay->count - 1].acked_us = record.time_us;
+            }
+            continue;
+        }
+
+        // A command: the answers that follow belong to it
+        open = !is_blank(record.data, record.length);
+        if (!open) {
+            continue;
+        }
+        if (replay->count == capacity) {
+            size_t grown = capacity ? capacity * 2 : 1024;
+            SessionExchange *exchanges = realloc(replay->exchanges, grown * sizeof(*exchanges));
+            if (!exchanges) {
+                result = -1;
+                break;
+            }
+            replay->exchanges = exchanges;
+            capacity = grown;
+        }
+        SessionExchange *exchange = &replay->exchanges[replay->count++];
+        exchange->sent_us = exchange->acked_us = record.time_us;
+        exchange->length = (uint32_t)record.length;
+        exchange->hash = hash_bytes(HASH_INIT, record.data, record.length);
+    }
+    session_reader_close(&reader);
+    if (result != 0 || replay->count == 0) {
+        replay_transport_close(replay);
+        return -1;
+    }
+
+    replay->transport.send_command = replay_send_command;
+    replay->transport.state = replay;
+    replay->transport.metrics = NULL;
+    replay->transport.drain = NULL;
+    replay->transport.pending = NULL;
+    replay->speed = speed;
+    DEBUG_LOG("Replaying %lu exchanges of port %d from %s\n", (unsigned long)replay->count, port + 1, path);
+    return 0;
+}
+
+// The recording over the exchanges that were replayed
+static void summarise_recording(const ReplayTransport *replay, SessionSummary *summary) {
+    memset(summary, 0, sizeof(*summary));
+    size_t count = replay->next;
+    for (size_t i = 0; i < count; i++) {
+        const SessionExchange *exchange = &replay->exchanges[i];
+        summary->commands++;
+        summary->bytes += exchange->length;
+        if (i > 0) {
+            uint64_t gap_us = exchange->sent_us - replay->exchanges[i - 1].acked_us;
+            summary->host_us += gap_us;
+            summary->host_stalls += gap_us > SESSION_HOST_STALL_MS * 1000ULL;
+        }
+    }
+    if (count > 0) {
+        summary->duration_us = replay->exchanges[count - 1].acked_us - replay->exchanges[0].sent_us;
+    }
+}
+
+static double percent_change(double before, double after) {
+    return before > 0.0 ? (after - before) / before * 100.0 : 0.0;
+}
+
+void replay_transport_report(const ReplayTransport *replay) {
+    SessionSummary recorded;
+    const SessionSummary *replayed = &replay->replayed;
+    summarise_recording(replay, &recorded);
+
+    double recorded_s = recorded.duration_us / 1e6, replayed_s = replayed->duration_us / 1e6;
+    double recorded_rate = recorded_s > 0.0 ? recorded.commands / recorded_s : 0.0;
+    double replayed_rate = replayed_s > 0.0 ? replayed->commands / replayed_s : 0.0;
+    double recorded_bytes = recorded_s > 0.0 ? recorded.bytes / recorded_s : 0.0;
+    double replayed_bytes = replayed_s > 0.0 ? replayed->bytes / replayed_s : 0.0;
+    double recorded_gap = recorded.commands > 1 ? recorded.host_us / 1e3 / (recorded.commands - 1) : 0.0;
+    double replayed_gap = replayed->commands > 1 ? replayed->host_us / 1e3 / (replayed->commands - 1) : 0.0;
+
+    printf("Session replay at %.2fx: %lu commands (%lu differ from the recording, %lu past its end)\n",
+           replay->speed, replayed->commands, replay->mismatches, replay->unrecorded);
+    printf("                 recorded    replayed    change\n");
+    printf("  duration s   %10.3f  %10.3f  %+7.1f%%\n", recorded_s, replayed_s,
+           percent_change(recorded_s, replayed_s));
+    printf("  commands/s   %10.1f  %10.1f  %+7.1f%%\n", recorded_rate, replayed_rate,
+           percent_change(recorded_rate, replayed_rate));
+    printf("  bytes/s      %10.0f  %10.0f  %+7.1f%%\n", recorded_bytes, replayed_bytes,
+           percent_change(recorded_bytes, replayed_bytes));
+    printf("  host gap ms  %10.3f  %10.3f  %+7.1f%%\n", recorded_gap, replayed_gap,
+           percent_change(recorded_gap, replayed_gap));
+    printf("  host stalls  %10lu  %10lu\n", recorded.host_stalls, replayed->host_stalls);
+}
+
+void replay_transport_close(ReplayTransport *replay) {
+    free(replay->exchanges);
+    replay->exchanges = NULL;
+    replay->count = replay->next = 0;
+}
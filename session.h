@@ -0,0 +1,185 @@
+/**
+ * @file session.h
+ * @brief Serial session recording and replay against recorded controller timing
+ *
+ * The recorder logs every buffer written to a robot port and every chunk read
+ * back from it, with monotonic timestamps, to a compact binary file. The
+ * replay transport plays the controller side of such a log back: each command
+ * is acknowledged after the delay the controller took in the recording,
+ * optionally scaled, so a new build of the sender can be timed against a
+ * session recorded on the real robot. At the end it compares throughput and
+ * host stalls with the recording.
+ *
+ * File layout: SESSION_MAGIC, a version byte and three reserved bytes, then
+ * one record per buffer: varint microseconds since the previous record, port
+ * byte, varint (length << 1 | direction), data.
+ */
+
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "transport.h"
+
+#define SESSION_MAGIC "RWSL"
+#define SESSION_VERSION 1
+
+/**
+ * @brief Longest buffer kept in one record
+ */
+#define SESSION_MAX_RECORD 4096
+
+/**
+ * @brief A gap longer than this between an acknowledgement and the next command is a host stall
+ */
+#define SESSION_HOST_STALL_MS 20
+
+/**
+ * @brief Direction of a recorded buffer
+ */
+typedef enum {
+    SESSION_SENT = 0,       // Host to controller
+    SESSION_RECEIVED = 1    // Controller to host
+} SessionDirection;
+
+/**
+ * @brief One buffer read back from a log
+ */
+typedef struct {
+    uint64_t time_us;       // Since the start of the session
+    int port;               // COM number minus 1
+    SessionDirection direction;
+    size_t length;
+    unsigned char data[SESSION_MAX_RECORD];
+} SessionRecord;
+
+/**
+ * @brief Sequential reader of a session log
+ */
+typedef struct {
+    FILE *file;
+    uint64_t time_us;
+} SessionReader;
+
+/**
+ * @brief One command and the controller's answer to it
+ */
+typedef struct {
+    uint64_t sent_us;       // When the command was written
+    uint64_t acked_us;      // When the last byte of the answer arrived
+    uint32_t length;        // Command length in bytes
+    uint64_t hash;          // Hash of the command, to spot a sender that diverged
+} SessionExchange;
+
+/**
+ * @brief Throughput of a run of exchanges
+ */
+typedef struct {
+    unsigned long commands;
+    uint64_t bytes;
+    uint64_t duration_us;       // First command written to last acknowledgement
+    uint64_t host_us;           // Time from each acknowledgement to the next command
+    unsigned long host_stalls;  // Gaps above SESSION_HOST_STALL_MS
+} SessionSummary;
+
+/**
+ * @brief Transport that acknowledges commands with recorded timing
+ */
+typedef struct {
+    Transport transport;
+    SessionExchange *exchanges;     // Recorded exchanges of one port
+    size_t count;
+    size_t next;
+    double speed;                   // 2.0 replays twice as fast as recorded
+    unsigned long mismatches;       // Commands that differ from the recording
+    unsigned long unrecorded;       // Commands sent after the recording ran out
+    SessionSummary replayed;
+    uint64_t start_ns;
+    uint64_t last_ack_ns;
+} ReplayTransport;
+
+/**
+ * @brief Starts recording serial traffic to a file
+ *
+ * @param path Log file, overwritten
+ * @return int 0 on success, -1 if the file cannot be created
+ */
+int session_record_start(const char *path);
+
+/**
+ * @brief Records one buffer if a recording is running; safe from any thread
+ *
+ * @param port COM number minus 1
+ * @param direction Which way the bytes went
+ * @param data Bytes
+ * @param length Number of bytes, truncated to SESSION_MAX_RECORD
+ */
+void session_record(int port, SessionDirection direction, const void *data, size_t length);
+
+/**
+ * @brief Stops recording and closes the log
+ *
+ * @return int 0 on success or if nothing was recorded, -1 on a write error
+ */
+int session_record_stop(void);
+
+/**
+ * @brief Opens a session log for reading
+ *
+ * @param reader Reader to initialise
+ * @param path Log file
+ * @return int 0 on success, -1 if missing or not a session log
+ */
+int session_reader_open(SessionReader *reader, const char *path);
+
+/**
+ * @brief Reads the next record
+ *
+ * A record cut short by a crash ends the log.
+ *
+ * @param reader Open reader
+ * @param record Receives the record
+ * @return int 1 if a record was read, 0 at the end of the log
+ */
+int session_read_record(SessionReader *reader, SessionRecord *record);
+
+/**
+ * @brief Closes a reader
+ *
+ * @param reader Reader to close
+ */
+void session_reader_close(SessionReader *reader);
+
+/**
+ * @brief Loads the exchanges of one port for replay
+ *
+ * Commands that are only whitespace (the wake-up newline) are left out, since
+ * a replayed run does not wake the robot.
+ *
+ * @param replay Transport to initialise
+ * @param path Session log
+ * @param port Port to replay, -1 for the first port in the log
+ * @param speed Time scale, above 0
+ * @return int 0 on success, -1 on a bad log, no exchanges or out of memory
+ */
+int replay_transport_open(ReplayTransport *replay, const char *path, int port, double speed);
+
+/**
+ * @brief Prints the replayed throughput and stalls next to the recorded ones
+ *
+ * The recording is summarised over as many exchanges as were replayed.
+ *
+ * @param replay Transport after the run
+ */
+void replay_transport_report(const ReplayTransport *replay);
+
+/**
+ * @brief Releases a replay transport
+ *
+ * @param replay Transport to close
+ */
+void replay_transport_close(ReplayTransport *replay);
+
+#endif // SESSION_H
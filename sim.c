@@ -0,0 +1,503 @@
+// sim.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <math.h>
+#include "sim.h"
+#include "debug.h"
+
+#define SIM_PI 3.14159265358979323846
+
+#define GRID_TILE_BITS 6     // Tiles of 64 x 64 cells, allocated when first inked
+
+// Pen-down area of one page on a grid; each cell holds a bit per stream
+typedef struct {
+    double cell;
+    double origin_x;        // Lower-left corner of cell (0, 0)
+    double origin_y;
+    int width;
+    int height;
+    int tiles_x;
+    int tiles_y;
+    unsigned char **tiles;  // Row-major, NULL until inked
+    int failed;
+} Grid;
+
+typedef struct {
+    double min_x, min_y;
+    double max_x, max_y;
+    int empty;
+} Bounds;
+
+void sim_init(Simulator *sim) {
+    memset(sim, 0, sizeof(*sim));
+    sim->units = 1.0;
+    sim->absolute = 1;
+    sim->spindle = 1;
+    sim->page = 1;
+}
+
+void sim_free(Simulator *sim) {
+    free(sim->segments);
+    sim->segments = NULL;
+    sim->segment_count = sim->segment_capacity = 0;
+}
+
+void sim_page(Simulator *sim) {
+    sim->page++;
+}
+
+static int pen_down(const Simulator *sim) {
+    return sim->s > 0.0 && sim->spindle;
+}
+
+static void add_segment(Simulator *sim, double x, double y) {
+    if (sim->segment_count == sim->segment_capacity) {
+        size_t capacity = sim->segment_capacity ? sim->segment_capacity * 2 : 4096;
+        SimSegment *segments = realloc(sim->segments, capacity * sizeof(*segments));
+        if (!segments) {
+            sim->failed = 1;
+            return;
+        }
+        sim->segments = segments;
+        sim->segment_capacity = capacity;
+    }
+    SimSegment segment = { sim->x, sim->y, x, y, sim->page };
+    sim->segments[sim->segment_count++] = segment;
+}
+
+// Straight move to machine position (x, y); a rapid with the pen down still draws
+static void move_to(Simulator *sim, double x, double y) {
+    double length = hypot(x - sim->x, y - sim->y);
+    if (pen_down(sim)) {
+        if (length > 0.0) {
+            add_segment(sim, x, y);
+        }
+        sim->draw_length += length;
+    } else {
+        sim->travel_length += length;
+    }
+    sim->x = x;
+    sim->y = y;
+}
+
+// G2/G3 to machine position (x, y) around the centre (cx, cy), drawn as chords
+static void arc_to(Simulator *sim, int clockwise, double x, double y, double cx, double cy) {
+    double radius = hypot(sim->x - cx, sim->y - cy);
+    double start = atan2(sim->y - cy, sim->x - cx);
+    double sweep = atan2(y - cy, x - cx) - start;
+    // Same end as start is a full circle, as on Grbl
+    if (clockwise && sweep >= -1e-9) {
+        sweep -= 2.0 * SIM_PI;
+    } else if (!clockwise && sweep <= 1e-9) {
+        sweep += 2.0 * SIM_PI;
+    }
+
+    int steps = 1;
+    if (radius > SIM_ARC_TOLERANCE_MM) {
+        steps = (int)ceil(fabs(sweep) / (2.0 * acos(1.0 - SIM_ARC_TOLERANCE_MM / radius)));
+    }
+    for (int k = 1; k < steps; k++) {
+        double angle = start + sweep * k / steps;
+        move_to(sim, cx + radius * cos(angle), cy + radius * sin(angle));
+    }
+    move_to(sim, x, y);
+}
+
+// Centre of an R-format arc from the current position to (x, y), as Grbl finds it
+static int radius_centre(const Simulator *sim, int clockwise, double x, double y, double r, double *cx, double *cy) {
+    double dx = x - sim->x, dy = y - sim->y;
+    double h = 4.0 * r * r - dx * dx - dy * dy;
+    if (h < 0.0 || (dx == 0.0 && dy == 0.0)) {
+        return -1;
+    }
+    h = -sqrt(h) / hypot(dx, dy);
+    if (!clockwise) {
+        h = -h;
+    }
+    if (r < 0.0) {
+        h = -h;
+    }
+    *cx = sim->x + 0.5 * (dx - dy * h);
+    *cy = sim->y + 0.5 * (dy + dx * h);
+    return 0;
+}
+
+int sim_line(Simulator *sim, const char *line) {
+    double values[26];
+    int seen[26] = { 0 };
+    int g[8], m[8], g_count = 0, m_count = 0, unknown = 0;
+    const char *p = line;
+
+    sim->lines++;
+    while (isspace((unsigned char)*p)) {
+        p++;
+    }
+    if (*p == '$') {
+        if (toupper((unsigned char)p[1]) == 'H') {
+            move_to(sim, 0.0, 0.0);
+        }
+        return 0;
+    }
+
+    while (*p && *p != ';') {
+        if (*p == '(') {
+            while (*p && *p != ')') {
+                p++;
+            }
+            p += *p == ')';
+            continue;
+        }
+        if (!isalpha((unsigned char)*p)) {
+            p++;
+            continue;
+        }
+        int letter = toupper((unsigned char)*p) - 'A';
+        char *end;
+        double value = strtod(p + 1, &end);
+        if (end == p + 1) {
+            unknown = 1;
+            p++;
+            continue;
+        }
+        p = end;
+        if (letter == 'G' - 'A' && g_count < 8) {
+            g[g_count++] = (int)lround(value * 10.0);
+        } else if (letter == 'M' - 'A' && m_count < 8) {
+            m[m_count++] = (int)lround(value);
+        } else {
+            values[letter] = value;
+            seen[letter] = 1;
+        }
+    }
+    for (int i = 0; i < 26; i++) {
+        // Line numbers, feeds, dwell times and tools do not change the drawing
+        if (seen[i] && !strchr("XYZIJRSFPNT", 'A' + i)) {
+            unknown = 1;
+        }
+    }
+
+    // Modal settings before the move, in Grbl's order
+    int set_offset = 0, page = 0;
+    if (seen['S' - 'A']) {
+        sim->s = values['S' - 'A'];
+    }
+    for (int i = 0; i < m_count; i++) {
+        switch (m[i]) {
+        case 3:
+        case 4:
+            sim->spindle = 1;
+            break;
+        case 5:
+            sim->spindle = 0;
+            break;
+        case 0:
+        case 1:
+            page = 1;
+            break;
+        case 2:
+        case 8:
+        case 9:
+        case 30:
+            break;
+        default:
+            unknown = 1;
+            break;
+        }
+    }
+    for (int i = 0; i < g_count; i++) {
+        switch (g[i]) {
+        case 0:
+        case 10:
+        case 20:
+        case 30:
+            sim->motion = g[i] / 10;
+            break;
+        case 200:
+        case 210:
+            sim->units = g[i] == 200 ? 25.4 : 1.0;
+            break;
+        case 900:
+        case 910:
+            sim->absolute = g[i] == 900;
+            break;
+        case 920:
+            set_offset = 1;
+            break;
+        case 40:    // Dwell
+        case 170:   // XY plane
+        case 540:   // Work coordinates
+        case 940:   // Feed per minute
+        case 911:   // Incremental arc centres, the only kind Grbl has
+            break;
+        default:
+            unknown = 1;
+            break;
+        }
+    }
+
+    int has_x = seen['X' - 'A'], has_y = seen['Y' - 'A'];
+    double work_x = sim->x - sim->offset_x, work_y = sim->y - sim->offset_y;
+    double x = has_x ? values['X' - 'A'] * sim->units : 0.0;
+    double y = has_y ? values['Y' - 'A'] * sim->units : 0.0;
+    if (set_offset) {
+        // G92: the current position takes the given work coordinates
+        if (has_x) {
+            sim->offset_x = sim->x - x;
+        }
+        if (has_y) {
+            sim->offset_y = sim->y - y;
+        }
+    } else if (has_x || has_y || (sim->motion >= 2 && (seen['I' - 'A'] || seen['J' - 'A'] || seen['R' - 'A']))) {
+        double target_x = (has_x ? (sim->absolute ? x : work_x + x) : work_x) + sim->offset_x;
+        double target_y = (has_y ? (sim->absolute ? y : work_y + y) : work_y) + sim->offset_y;
+        if (sim->motion < 2) {
+            move_to(sim, target_x, target_y);
+        } else {
+            int clockwise = sim->motion == 2;
+            double cx, cy;
+            if (seen['R' - 'A']) {
+                if (radius_centre(sim, clockwise, target_x, target_y, values['R' - 'A'] * sim->units, &cx, &cy) != 0) {
+                    DEBUG_LOG("Simulator: impossible arc radius on line %lu\n", sim->lines);
+                    unknown = 1;
+                    cx = target_x;
+                    cy = target_y;
+                }
+            } else {
+                cx = sim->x + (seen['I' - 'A'] ? values['I' - 'A'] * sim->units : 0.0);
+                cy = sim->y + (seen['J' - 'A'] ? values['J' - 'A'] * sim->units : 0.0);
+            }
+            if (cx == target_x && cy == target_y) {
+                move_to(sim, target_x, target_y);
+            } else {
+                arc_to(sim, clockwise, target_x, target_y, cx, cy);
+            }
+        }
+    }
+    if (page) {
+        sim_page(sim);
+    }
+    if (unknown) {
+        sim->rejected++;
+    }
+    return unknown || sim->failed ? -1 : 0;
+}
+
+int sim_file(Simulator *sim, const char *path) {
+    FILE *file = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    char line[512];
+    if (!file) {
+        DEBUG_LOG("Error: Could not open %s\n", path);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), file) != NULL && !sim->failed) {
+        // Lines the model does not know are counted and skipped
+        sim_line(sim, line);
+    }
+    int result = ferror(file) || sim->failed ? -1 : 0;
+    if (file != stdin) {
+        fclose(file);
+    }
+    return result;
+}
+
+// Segments of one page; pages only ever grow, so they are contiguous
+static size_t page_range(const Simulator *sim, int page, size_t *end) {
+    size_t first = 0;
+    while (first < sim->segment_count && sim->segments[first].page < page) {
+        first++;
+    }
+    *end = first;
+    while (*end < sim->segment_count && sim->segments[*end].page == page) {
+        (*end)++;
+    }
+    return first;
+}
+
+static void add_bounds(Bounds *bounds, const Simulator *sim, size_t first, size_t end) {
+    for (size_t i = first; i < end; i++) {
+        const SimSegment *s = &sim->segments[i];
+        if (bounds->empty) {
+            bounds->min_x = bounds->max_x = s->x0;
+            bounds->min_y = bounds->max_y = s->y0;
+            bounds->empty = 0;
+        }
+        bounds->min_x = fmin(bounds->min_x, fmin(s->x0, s->x1));
+        bounds->max_x = fmax(bounds->max_x, fmax(s->x0, s->x1));
+        bounds->min_y = fmin(bounds->min_y, fmin(s->y0, s->y1));
+        bounds->max_y = fmax(bounds->max_y, fmax(s->y0, s->y1));
+    }
+}
+
+// A grid over the bounds with a free cell all round
+static int grid_init(Grid *grid, const Bounds *bounds, double cell) {
+    double width = (bounds->max_x - bounds->min_x) / cell + 3.0;
+    double height = (bounds->max_y - bounds->min_y) / cell + 3.0;
+    if (width * height > SIM_MAX_GRID_CELLS) {
+        double grow = sqrt(width * height / SIM_MAX_GRID_CELLS);
+        DEBUG_LOG("Simulator: grid cells enlarged from %.3f to %.3f mm\n", cell, cell * grow);
+        cell *= grow;
+        width = (bounds->max_x - bounds->min_x) / cell + 3.0;
+        height = (bounds->max_y - bounds->min_y) / cell + 3.0;
+    }
+    grid->cell = cell;
+    grid->origin_x = bounds->min_x - cell;
+    grid->origin_y = bounds->min_y - cell;
+    grid->width = (int)width;
+    grid->height = (int)height;
+    grid->tiles_x = (grid->width >> GRID_TILE_BITS) + 1;
+    grid->tiles_y = (grid->height >> GRID_TILE_BITS) + 1;
+    grid->tiles = calloc((size_t)grid->tiles_x * (size_t)grid->tiles_y, sizeof(*grid->tiles));
+    grid->failed = 0;
+    return grid->tiles ? 0 : -1;
+}
+
+static void grid_free(Grid *grid) {
+    for (size_t i = 0; i < (size_t)grid->tiles_x * (size_t)grid->tiles_y; i++) {
+        free(grid->tiles[i]);
+    }
+    free(grid->tiles);
+}
+
+static unsigned char grid_get(const Grid *grid, int cx, int cy) {
+    const unsigned char *tile = grid->tiles[(size_t)(cy >> GRID_TILE_BITS) * grid->tiles_x + (cx >> GRID_TILE_BITS)];
+    int mask = (1 << GRID_TILE_BITS) - 1;
+    return tile ? tile[((cy & mask) << GRID_TILE_BITS) + (cx & mask)] : 0;
+}
+
+static void grid_set(Grid *grid, int cx, int cy, unsigned char bit) {
+    unsigned char **tile = &grid->tiles[(size_t)(cy >> GRID_TILE_BITS) * grid->tiles_x + (cx >> GRID_TILE_BITS)];
+    int mask = (1 << GRID_TILE_BITS) - 1;
+    if (!*tile && !(*tile = calloc(1, 1 << (2 * GRID_TILE_BITS)))) {
+        grid->failed = 1;
+        return;
+    }
+    (*tile)[((cy & mask) << GRID_TILE_BITS) + (cx & mask)] |= bit;
+}
+
+// Mark every cell a segment passes through, sampled at half a cell
+static void grid_mark(Grid *grid, const Simulator *sim, size_t first, size_t end, unsigned char bit) {
+    for (size_t i = first; i < end; i++) {
+        const SimSegment *s = &sim->segments[i];
+        int steps = (int)ceil(hypot(s->x1 - s->x0, s->y1 - s->y0) * 2.0 / grid->cell) + 1;
+        for (int k = 0; k <= steps; k++) {
+            double t = (double)k / steps;
+            grid_set(grid, (int)((s->x0 + (s->x1 - s->x0) * t - grid->origin_x) / grid->cell),
+                     (int)((s->y0 + (s->y1 - s->y0) * t - grid->origin_y) / grid->cell), bit);
+        }
+    }
+}
+
+// Whether any cell next to (cx, cy), or the cell itself, has the bit
+static int near_bit(const Grid *grid, int cx, int cy, unsigned char bit) {
+    for (int y = cy - 1; y <= cy + 1; y++) {
+        for (int x = cx - 1; x <= cx + 1; x++) {
+            if (grid_get(grid, x, y) & bit) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// Count the inked cells of one page grid, and those with nothing of the other stream in reach
+static void compare_grid(const Grid *grid, int page, SimComparison *comparison) {
+    int size = 1 << GRID_TILE_BITS;
+    for (int ty = 0; ty < grid->tiles_y; ty++) {
+        for (int tx = 0; tx < grid->tiles_x; tx++) {
+            const unsigned char *tile = grid->tiles[(size_t)ty * grid->tiles_x + tx];
+            for (int i = 0; tile && i < size * size; i++) {
+                uint64_t word;
+                if ((i & 7) == 0) {
+                    // Most of a tile is paper: skip it eight cells at a time
+                    memcpy(&word, tile + i, sizeof(word));
+                    if (word == 0) {
+                        i += 7;
+                        continue;
+                    }
+                }
+                unsigned char cell = tile[i];
+                if (cell == 0) {
+                    continue;
+                }
+                int cx = (tx << GRID_TILE_BITS) + (i & (size - 1)), cy = (ty << GRID_TILE_BITS) + (i >> GRID_TILE_BITS);
+                // A cell both streams ink needs no search
+                int missing_b = cell == 1 && !near_bit(grid, cx, cy, 2);
+                int missing_a = cell == 2 && !near_bit(grid, cx, cy, 1);
+                comparison->cells_a += cell & 1;
+                comparison->cells_b += (cell & 2) >> 1;
+                comparison->only_a += missing_b;
+                comparison->only_b += missing_a;
+                if ((missing_a || missing_b) && comparison->first_page == 0) {
+                    comparison->first_page = page;
+                    comparison->first_x = grid->origin_x + (cx + 0.5) * grid->cell;
+                    comparison->first_y = grid->origin_y + (cy + 0.5) * grid->cell;
+                }
+            }
+        }
+    }
+}
+
+int sim_compare(const Simulator *a, const Simulator *b, double tolerance, SimComparison *comparison) {
+    memset(comparison, 0, sizeof(*comparison));
+    comparison->pages_a = a->page;
+    comparison->pages_b = b->page;
+    int pages = a->page > b->page ? a->page : b->page;
+
+    for (int page = 1; page <= pages; page++) {
+        size_t end_a, end_b;
+        size_t first_a = page_range(a, page, &end_a), first_b = page_range(b, page, &end_b);
+        Bounds bounds = { 0.0, 0.0, 0.0, 0.0, 1 };
+        add_bounds(&bounds, a, first_a, end_a);
+        add_bounds(&bounds, b, first_b, end_b);
+        if (bounds.empty) {
+            continue;
+        }
+        Grid grid;
+        if (grid_init(&grid, &bounds, tolerance) != 0) {
+            return -1;
+        }
+        grid_mark(&grid, a, first_a, end_a, 1);
+        grid_mark(&grid, b, first_b, end_b, 2);
+        if (!grid.failed) {
+            compare_grid(&grid, page, comparison);
+        }
+        grid_free(&grid);
+        if (grid.failed) {
+            return -1;
+        }
+    }
+    return comparison->first_page ? 1 : 0;
+}
+
+int sim_write_image(const Simulator *sim, int page, double cell, const char *path) {
+    size_t end;
+    size_t first = page_range(sim, page, &end);
+    Bounds bounds = { 0.0, 0.0, 0.0, 0.0, 1 };
+    add_bounds(&bounds, sim, first, end);
+    Grid grid;
+    if (bounds.empty || grid_init(&grid, &bounds, cell) != 0) {
+        return -1;
+    }
+    grid_mark(&grid, sim, first, end, 1);
+
+    FILE *file = grid.failed ? NULL : fopen(path, "wb");
+    if (!file) {
+        grid_free(&grid);
+        return -1;
+    }
+    fprintf(file, "P5\n%d %d\n255\n", grid.width, grid.height);
+    unsigned char *row = malloc((size_t)grid.width);
+    for (int cy = grid.height - 1; row && cy >= 0; cy--) {
+        for (int cx = 0; cx < grid.width; cx++) {
+            row[cx] = grid_get(&grid, cx, cy) ? 0 : 255;
+        }
+        fwrite(row, 1, (size_t)grid.width, file);
+    }
+    int result = row && !ferror(file) ? 0 : -1;
+    free(row);
+    grid_free(&grid);
+    return fclose(file) == 0 ? result : -1;
+}
@@ -0,0 +1,144 @@
+/**
+ * @file sim.h
+ * @brief Offline G-code simulator and drawing comparison
+ *
+ * Runs a G-code stream on a model of the robot (G0/G1/G2/G3, G90/G91,
+ * G20/G21, G92 and the S pen value) and keeps every pen-down path. Two runs
+ * are compared by rasterising each page onto a coverage grid with cells one
+ * tolerance wide: ink of one stream with no ink of the other within a cell
+ * of it is a difference. Reordered strokes, merged segments, split or joined
+ * moves, changed feeds and different travel therefore compare equal, and
+ * anything that adds, drops or moves ink by more than the tolerance does not.
+ *
+ * The pen is down while the last S value is above zero and the spindle has
+ * not been switched off with M5. sim_page(), or an M0/M1 pause in the
+ * stream, starts a new page; pages are compared one to one.
+ */
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stddef.h>
+
+/**
+ * @brief Defaults and limits
+ */
+#define SIM_TOLERANCE_MM 0.1            // Default comparison tolerance
+#define SIM_ARC_TOLERANCE_MM 0.005      // Largest distance of an arc from the chords it is drawn with
+#define SIM_MAX_GRID_CELLS 50000000     // Largest page grid; beyond it the cells are made larger
+
+/**
+ * @brief One pen-down straight move, in mm
+ */
+typedef struct {
+    double x0, y0;
+    double x1, y1;
+    int page;               // From 1
+} SimSegment;
+
+/**
+ * @brief Machine model and the pen-down paths of one stream
+ */
+typedef struct {
+    double x;               // Machine position in mm
+    double y;
+    double offset_x;        // G92 offset: work position = machine position - offset
+    double offset_y;
+    double units;           // mm per unit, 1 (G21) or 25.4 (G20)
+    int absolute;           // G90
+    int motion;             // Modal motion: 0, 1, 2 or 3
+    double s;               // Last S value
+    int spindle;            // 0 after M5
+    int page;
+    double draw_length;     // Pen-down distance in mm
+    double travel_length;   // Pen-up distance in mm
+    unsigned long lines;    // Lines run
+    unsigned long rejected; // Lines with a word the model does not know
+    int failed;             // Out of memory
+    SimSegment *segments;
+    size_t segment_count;
+    size_t segment_capacity;
+} Simulator;
+
+/**
+ * @brief Result of comparing two streams
+ */
+typedef struct {
+    int pages_a;
+    int pages_b;
+    unsigned long cells_a;      // Grid cells the first stream inks
+    unsigned long cells_b;
+    unsigned long only_a;       // Inked by the first stream with nothing of the second in reach
+    unsigned long only_b;
+    int first_page;             // First page that differs, 0 if none
+    double first_x;             // A difference on that page, in mm
+    double first_y;
+} SimComparison;
+
+/**
+ * @brief Starts a simulation with the robot at the origin, pen up, absolute mm
+ *
+ * @param sim Simulator to initialise
+ */
+void sim_init(Simulator *sim);
+
+/**
+ * @brief Releases the paths of a simulation
+ *
+ * @param sim Simulator to free
+ */
+void sim_free(Simulator *sim);
+
+/**
+ * @brief Runs one G-code line
+ *
+ * Comments in parentheses or after ';', and '$' commands other than $H,
+ * are ignored.
+ *
+ * @param sim Simulator
+ * @param line Line, with or without its line end
+ * @return int 0 on success, -1 if the line had a word the model does not know or memory ran out
+ */
+int sim_line(Simulator *sim, const char *line);
+
+/**
+ * @brief Starts the next page (a sheet change)
+ *
+ * @param sim Simulator
+ */
+void sim_page(Simulator *sim);
+
+/**
+ * @brief Runs a G-code file
+ *
+ * @param sim Simulator
+ * @param path G-code file, or "-" for standard input
+ * @return int 0 on success, -1 if the file could not be read or memory ran out
+ */
+int sim_file(Simulator *sim, const char *path);
+
+/**
+ * @brief Compares the drawings of two simulations page by page
+ *
+ * @param a First simulation
+ * @param b Second simulation
+ * @param tolerance Grid cell size in mm
+ * @param comparison Receives the differences
+ * @return int 0 if the drawings are the same, 1 if they differ, -1 if memory ran out
+ */
+int sim_compare(const Simulator *a, const Simulator *b, double tolerance, SimComparison *comparison);
+
+/**
+ * @brief Writes the coverage grid of one page as a binary PGM image
+ *
+ * Ink is black on white, x to the right and y up.
+ *
+ * @param sim Simulation
+ * @param page Page number, from 1
+ * @param cell Grid cell size in mm, one pixel each
+ * @param path Image file to create
+ * @return int 0 on success, -1 if the page has no ink or the file could not be written
+ */
+int sim_write_image(const Simulator *sim, int page, double cell, const char *path);
+
+#endif // SIM_H
@@ -0,0 +1,373 @@
+// stamp.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "stamp.h"
+#include "debug.h"
+
+// Replays block operations at an origin, dropping what the previous copy already did
+typedef struct {
+    const OpSink *sink;
+    PenTimer timer;
+    int timing;
+    int pen;                // -1 unknown, 0 up, 1 down
+    int32_t feed;
+    int32_t x;              // Machine position in micrometres
+    int32_t y;
+    int travel_pending;
+    int32_t travel_x;
+    int32_t travel_y;
+    unsigned long operations;
+    int failed;
+} Stamper;
+
+static double distance_mm(int32_t x0, int32_t y0, int32_t x1, int32_t y1) {
+    return hypot((double)x1 - x0, (double)y1 - y0) / 1000.0;
+}
+
+int stamp_grid(const PageSetup *page, int columns, int rows, float pitch_x, float pitch_y, StampOrigin *origins) {
+    if (columns < 1 || rows < 1 || columns > STAMP_MAX_ORIGINS / rows) {
+        return -1;
+    }
+    int count = 0;
+    for (int r = 0; r < rows; r++) {
+        for (int c = 0; c < columns; c++) {
+            origins[count].x = mm_to_microns(page->margin_left + (float)c * pitch_x);
+            origins[count].y = -mm_to_microns(page->margin_top + (float)r * pitch_y);
+            count++;
+        }
+    }
+    return count;
+}
+
+int stamp_read_origins(const char *path, StampOrigin *origins, int max_origins) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        DEBUG_LOG("Error: Could not open origins file %s\n", path);
+        return -1;
+    }
+
+    char line[256];
+    int count = 0, result = 0;
+    while (result == 0 && fgets(line, sizeof(line), file)) {
+        const char *start = line + strspn(line, " \t");
+        if (*start == '#' || *start == '\n' || *start == '\r' || *start == '\0') {
+            continue;
+        }
+        float x, y;
+        if (count == max_origins || (sscanf(start, "%f , %f", &x, &y) != 2 && sscanf(start, "%f %f", &x, &y) != 2)) {
+            DEBUG_LOG("Error: Bad origin in %s: %s", path, line);
+            result = -1;
+            break;
+        }
+        origins[count].x = mm_to_microns(x);
+        origins[count].y = -mm_to_microns(y);
+        count++;
+    }
+    if (ferror(file)) {
+        result = -1;
+    }
+    fclose(file);
+    return result == 0 ? count : -1;
+}
+
+static int block_emit(void *user_data, const MotionOp *op) {
+    StampBlock *block = user_data;
+    if (block->count == block->capacity) {
+        size_t grown = block->capacity ? block->capacity * 2 : 1024;
+        MotionOp *ops = realloc(block->ops, grown * sizeof(*ops));
+        if (!ops) {
+            block->failed = 1;
+            return -1;
+        }
+        block->ops = ops;
+        block->capacity = grown;
+    }
+    block->ops[block->count++] = *op;
+    return 0;
+}
+
+// Entry and exit points and extent of the strokes, for ordering the copies
+static void measure_block(StampBlock *block) {
+    int32_t x = 0, y = 0;
+    int drawn = 0;
+    block->entry_x = block->entry_y = block->exit_x = block->exit_y = 0;
+    block->width = block->height = 0;
+    for (size_t i = 0; i < block->count; i++) {
+        const MotionOp *op = &block->ops[i];
+        if (op->code == IR_TRAVEL) {
+            x = op->x;
+            y = op->y;
+        } else if (op->code == IR_DRAW) {
+            if (!drawn) {
+                block->entry_x = x;
+                block->entry_y = y;
+                drawn = 1;
+            }
+            x = block->exit_x = op->x;
+            y = block->exit_y = op->y;
+            if (x > block->width) {
+                block->width = x;
+            }
+            if (-y > block->height) {
+                block->height = -y;
+            }
+        }
+    }
+}
+
+int stamp_compile(StampBlock *block, const JobSpec *spec, float width) {
+    memset(block, 0, sizeof(*block));
+    JobSpec block_spec = *spec;
+    PageSetup page = { width, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+    block_spec.page = page;
+    block_spec.pen.enabled = 0;
+    block_spec.work_area.enabled = 0;      // The block is placed later; the copies are checked instead
+
+    OpSink sink = { block_emit, block };
+    int result;
+    char ir_path[512];
+    if (block_spec.use_cache && strcmp(block_spec.text_filename, "-") != 0 &&
+        compile_job(&block_spec, ir_path, sizeof(ir_path)) >= 0) {
+        // Labels printed again come straight from the cache
+        IrReader reader;
+        MotionOp op;
+        result = ir_reader_open(&reader, ir_path);
+        if (result == 0) {
+            int status;
+            while ((status = ir_read_op(&reader, &op)) > 0 && block_emit(block, &op) == 0) {
+            }
+            result = status == 0 ? 0 : -1;
+            ir_reader_close(&reader);
+        }
+    } else {
+        result = check_page_setup(&block_spec.page) == 0 ? generate_job(&block_spec, &sink, block_spec.threads) : -1;
+    }
+    if (result != 0 || block->failed) {
+        stamp_block_free(block);
+        return -1;
+    }
+    measure_block(block);
+    DEBUG_LOG("Stamp block: %lu operations, %d x %d um\n", (unsigned long)block->count, (int)block->width,
+              (int)block->height);
+    return 0;
+}
+
+void stamp_block_free(StampBlock *block) {
+    free(block->ops);
+    block->ops = NULL;
+    block->count = block->capacity = 0;
+}
+
+// Pen-up travel from the end of the copy at a to the start of the copy at b
+static double hop_mm(const StampBlock *block, const StampOrigin *a, const StampOrigin *b) {
+    return distance_mm(a->x + block->exit_x, a->y + block->exit_y, b->x + block->entry_x, b->y + block->entry_y);
+}
+
+// Travel from the sheet origin through the copies in order
+static double route_mm(const StampBlock *block, const StampOrigin *origins, int count) {
+    if (count == 0) {
+        return 0.0;
+    }
+    double total = distance_mm(0, 0, origins[0].x + block->entry_x, origins[0].y + block->entry_y);
+    for (int i = 1; i < count; i++) {
+        total += hop_mm(block, &origins[i - 1], &origins[i]);
+    }
+    return total;
+}
+
+// Nearest neighbour from the sheet origin
+static void order_nearest(const StampBlock *block, StampOrigin *origins, int count) {
+    StampOrigin here = { -block->exit_x, -block->exit_y };     // Ends at the sheet origin
+    for (int i = 0; i < count; i++) {
+        int best = i;
+        double best_mm = hop_mm(block, &here, &origins[i]);
+        for (int j = i + 1; j < count; j++) {
+            double mm = hop_mm(block, &here, &origins[j]);
+            if (mm < best_mm) {
+                best = j;
+                best_mm = mm;
+            }
+        }
+        StampOrigin chosen = origins[best];
+        origins[best] = origins[i];
+        origins[i] = chosen;
+        here = chosen;
+    }
+}
+
+static void sum_hops(const StampBlock *block, const StampOrigin *origins, int count, double *forward,
+                     double *backward) {
+    forward[0] = backward[0] = 0.0;
+    for (int k = 1; k < count; k++) {
+        forward[k] = forward[k - 1] + hop_mm(block, &origins[k - 1], &origins[k]);
+        backward[k] = backward[k - 1] + hop_mm(block, &origins[k], &origins[k - 1]);
+    }
+}
+
+// 2-opt: reverse runs of the order while that shortens the route. Hops are
+// not symmetric (exit to entry), so a reversed run costs its backward hops;
+// prefix sums of the forward and backward hops (count each) price each reversal in O(1).
+static void order_improve(const StampBlock *block, StampOrigin *origins, int count, double *forward,
+                          double *backward) {
+    StampOrigin start = { -block->exit_x, -block->exit_y };
+
+    for (int pass = 0; pass < STAMP_IMPROVE_PASSES; pass++) {
+        int improved = 0;
+        sum_hops(block, origins, count, forward, backward);
+        for (int i = 0; i < count - 1; i++) {
+            for (int j = i + 1; j < count; j++) {
+                const StampOrigin *before = i > 0 ? &origins[i - 1] : &start;
+                double old_mm = hop_mm(block, before, &origins[i]) + forward[j] - forward[i];
+                double new_mm = hop_mm(block, before, &origins[j]) + backward[j] - backward[i];
+                if (j + 1 < count) {
+                    old_mm += hop_mm(block, &origins[j], &origins[j + 1]);
+                    new_mm += hop_mm(block, &origins[i], &origins[j + 1]);
+                }
+                if (new_mm < old_mm - 1e-6) {
+                    for (int a = i, b = j; a < b; a++, b--) {
+                        StampOrigin swap = origins[a];
+                        origins[a] = origins[b];
+                        origins[b] = swap;
+                    }
+                    sum_hops(block, origins, count, forward, backward);
+                    improved = 1;
+                }
+            }
+        }
+        if (!improved) {
+            break;
+        }
+    }
+}
+
+static void stamper_send(Stamper *stamper, const MotionOp *op) {
+    if (stamper->failed) {
+        return;
+    }
+    if (stamper->sink->emit(stamper->sink->user_data, op) != 0) {
+        stamper->failed = 1;
+        return;
+    }
+    stamper->operations++;
+    if (stamper->timing) {
+        MotionOp dwell = { IR_DWELL, pen_timer_dwell(&stamper->timer, op), 0 };
+        if (dwell.x > 0) {
+            stamper_send(stamper, &dwell);
+        }
+    }
+}
+
+static void stamper_op(Stamper *stamper, int code, int32_t x, int32_t y) {
+    MotionOp op = { code, x, y };
+    stamper_send(stamper, &op);
+}
+
+// Send the pen-up move to the start of the next stroke, if it goes anywhere
+static void stamper_flush_travel(Stamper *stamper) {
+    if (stamper->travel_pending && (stamper->travel_x != stamper->x || stamper->travel_y != stamper->y)) {
+        stamper_op(stamper, IR_TRAVEL, stamper->travel_x, stamper->travel_y);
+        stamper->x = stamper->travel_x;
+        stamper->y = stamper->travel_y;
+    }
+    stamper->travel_pending = 0;
+}
+
+static void stamp_one(Stamper *stamper, const StampBlock *block, const StampOrigin *origin) {
+    if (stamper->pen == 1) {
+        stamper_op(stamper, IR_PEN, 0, 0);
+        stamper->pen = 0;
+    }
+    for (size_t i = 0; i < block->count && !stamper->failed; i++) {
+        const MotionOp *op = &block->ops[i];
+        switch (op->code) {
+        case IR_PEN:
+            if (op->x != stamper->pen) {
+                if (op->x) {
+                    stamper_flush_travel(stamper);
+                }
+                stamper_op(stamper, IR_PEN, op->x, 0);
+                stamper->pen = op->x;
+            }
+            break;
+        case IR_TRAVEL:
+            // Only the last of a run of moves is sent, so copies are joined by one move
+            stamper->travel_pending = 1;
+            stamper->travel_x = origin->x + op->x;
+            stamper->travel_y = origin->y + op->y;
+            break;
+        case IR_DRAW:
+            stamper_flush_travel(stamper);
+            stamper_op(stamper, IR_DRAW, origin->x + op->x, origin->y + op->y);
+            stamper->x = origin->x + op->x;
+            stamper->y = origin->y + op->y;
+            break;
+        case IR_FEED:
+            if (op->x != stamper->feed) {
+                stamper_op(stamper, IR_FEED, op->x, 0);
+                stamper->feed = op->x;
+            }
+            break;
+        default:
+            // Dwells are worked out again for the stamped stream; a block has no pages
+            break;
+        }
+    }
+}
+
+int stamp_copies(const StampBlock *block, const StampOrigin *origins, int origin_count, unsigned long copies,
+                 const PenTiming *pen, const OpSink *sink, StampReport *report) {
+    if (origin_count < 1 || origin_count > STAMP_MAX_ORIGINS) {
+        return -1;
+    }
+    // One sheet's origins in writing order, and the prefix sums of order_improve()
+    StampOrigin *sheet = malloc((size_t)origin_count * sizeof(*sheet));
+    double *hops = malloc(2 * (size_t)origin_count * sizeof(*hops));
+    if (!sheet || !hops) {
+        free(sheet);
+        free(hops);
+        return -1;
+    }
+
+    Stamper stamper;
+    memset(&stamper, 0, sizeof(stamper));
+    stamper.sink = sink;
+    stamper.timing = pen->enabled;
+    pen_timer_start(&stamper.timer, pen);
+    stamper.pen = -1;
+
+    double travel_mm = 0.0, given_mm = 0.0;
+    int sheets = 0;
+    for (unsigned long done = 0; done < copies && !stamper.failed; sheets++) {
+        int count = copies - done < (unsigned long)origin_count ? (int)(copies - done) : origin_count;
+        if (sheets > 0) {
+            // The page-change hook leaves the robot at the origin with the pen up
+            stamper.travel_pending = 0;
+            stamper_op(&stamper, IR_PAGE, sheets + 1, 0);
+            stamper.pen = -1;
+            stamper.x = stamper.y = 0;
+        }
+
+        memcpy(sheet, origins, (size_t)count * sizeof(*sheet));
+        given_mm += route_mm(block, sheet, count);
+        order_nearest(block, sheet, count);
+        order_improve(block, sheet, count, hops, hops + origin_count);
+        travel_mm += route_mm(block, sheet, count);
+        for (int i = 0; i < count && !stamper.failed; i++) {
+            stamp_one(&stamper, block, &sheet[i]);
+        }
+        done += (unsigned long)count;
+    }
+
+    if (report) {
+        report->copies = copies;
+        report->sheets = sheets;
+        report->operations = stamper.operations;
+        report->travel_mm = travel_mm;
+        report->given_travel_mm = given_mm;
+    }
+    free(sheet);
+    free(hops);
+    return stamper.failed ? -1 : 0;
+}
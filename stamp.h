@@ -0,0 +1,137 @@
+/**
+ * @file stamp.h
+ * @brief Multi-copy labels: a block generated once and stamped at many origins
+ *
+ * A sheet of labels repeats the same short text at different places. The
+ * block is laid out and generated once, relative to its own top-left corner,
+ * and its operations are replayed at each origin with the coordinates moved:
+ * generation cost does not depend on the number of copies. Between copies
+ * only a pen-up move is sent; the repeated pen lift, feed and travel at the
+ * start of each copy are dropped.
+ *
+ * The copies of a sheet are ordered for the least pen-up travel: nearest
+ * neighbour from the sheet origin, then improved by reversing runs of the
+ * order (2-opt) while that shortens it. More copies than origins continue on
+ * further sheets, with a page break in between.
+ */
+
+#ifndef STAMP_H
+#define STAMP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ir.h"
+#include "job.h"
+#include "pen.h"
+
+/**
+ * @brief Limits
+ */
+#define STAMP_MAX_ORIGINS 1024      // Copies on one sheet
+#define STAMP_IMPROVE_PASSES 20     // Passes of the 2-opt improvement at most
+
+/**
+ * @brief Top-left corner of one copy, in micrometres (y negative down the page)
+ */
+typedef struct {
+    int32_t x;
+    int32_t y;
+} StampOrigin;
+
+/**
+ * @brief Operations of the block, relative to its top-left corner
+ */
+typedef struct {
+    MotionOp *ops;
+    size_t count;
+    size_t capacity;
+    int32_t entry_x;            // Where the first stroke starts
+    int32_t entry_y;
+    int32_t exit_x;             // Where the last stroke ends
+    int32_t exit_y;
+    int32_t width;              // Extent of the strokes right of and below the corner
+    int32_t height;
+    int failed;                 // Out of memory
+} StampBlock;
+
+/**
+ * @brief What stamp_copies() sent
+ */
+typedef struct {
+    unsigned long copies;
+    int sheets;
+    unsigned long operations;   // Operations sent, dwells included
+    double travel_mm;           // Pen-up travel from each sheet origin to its first copy and between copies
+    double given_travel_mm;     // The same in the order the origins were given
+} StampReport;
+
+/**
+ * @brief Fills origins with a grid of cells starting at the top-left margin corner
+ *
+ * Origins run row by row, left to right.
+ *
+ * @param page Page whose margins place the grid
+ * @param columns Cells across
+ * @param rows Cells down
+ * @param pitch_x Distance between columns in mm
+ * @param pitch_y Distance between rows in mm
+ * @param origins Receives columns * rows origins
+ * @return int Number of origins, or -1 if the grid is empty or has more than STAMP_MAX_ORIGINS cells
+ */
+int stamp_grid(const PageSetup *page, int columns, int rows, float pitch_x, float pitch_y, StampOrigin *origins);
+
+/**
+ * @brief Reads origins from a text file
+ *
+ * One "X,Y" (or "X Y") per line, in mm from the top-left corner of the page
+ * with y down the page. Blank lines and lines starting with '#' are skipped.
+ *
+ * @param path File to read
+ * @param origins Receives the origins
+ * @param max_origins Capacity of origins
+ * @return int Number of origins, or -1 if the file could not be read, a line is not a position or there are too many
+ */
+int stamp_read_origins(const char *path, StampOrigin *origins, int max_origins);
+
+/**
+ * @brief Lays out and generates the block once
+ *
+ * The job's text is laid out on a single unlimited page width mm wide with
+ * no margins, using its layout, feed and joining options; pen dwells are
+ * left to stamp_copies(), since they depend on the travel between copies.
+ * A text file goes through the job cache unless spec->use_cache is off.
+ *
+ * @param block Receives the operations (free with stamp_block_free())
+ * @param spec Text, font, height and options of the block
+ * @param width Line width of the block in mm
+ * @return int 0 on success, -1 on bad options, an unreadable file or running out of memory
+ */
+int stamp_compile(StampBlock *block, const JobSpec *spec, float width);
+
+/**
+ * @brief Releases the operations of a block
+ *
+ * @param block Block to free
+ */
+void stamp_block_free(StampBlock *block);
+
+/**
+ * @brief Sends copies of the block to a sink
+ *
+ * Each sheet gets the next origin_count copies (the last one those left),
+ * ordered for the least pen-up travel, and sheets are separated by IR_PAGE
+ * operations. The stream ends after the last stroke, without a travel back.
+ *
+ * @param block Compiled block
+ * @param origins Origins of one sheet
+ * @param origin_count Number of origins, 1 to STAMP_MAX_ORIGINS
+ * @param copies Number of copies in all
+ * @param pen Servo timing for the dwells after pen changes
+ * @param sink Where the operations go
+ * @param report Receives what was sent, may be NULL
+ * @return int 0 on success, -1 on bad arguments, out of memory or a sink failure
+ */
+int stamp_copies(const StampBlock *block, const StampOrigin *origins, int origin_count, unsigned long copies,
+                 const PenTiming *pen, const OpSink *sink, StampReport *report);
+
+#endif // STAMP_H
@@ -0,0 +1,182 @@
+// startup.c
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "startup.h"
+#include "serial.h"
+#include "platform.h"
+#include "debug.h"
+
+// What initialize_robot() has always sent
+static const char *const init_commands[STARTUP_COMMANDS] = { "G1 X0 Y0 F1000\n", "M3\n", "S0\n" };
+
+static const char *const wake_names[] = { "banner", "already running", "soft reset" };
+
+int parse_status_report(const char *line, ControllerState *state) {
+    double x, y, offset_x = 0.0, offset_y = 0.0;
+    const char *field;
+    size_t length = strcspn(line + 1, "|,:>");
+    if (line[0] != '<' || length == 0 || length >= sizeof(state->state)) {
+        return -1;
+    }
+
+    if ((field = strstr(line, "WPos:")) && sscanf(field + 5, "%lf,%lf", &x, &y) == 2) {
+        // Work position reported directly
+    } else if ((field = strstr(line, "MPos:")) && sscanf(field + 5, "%lf,%lf", &x, &y) == 2) {
+        if ((field = strstr(line, "WCO:"))) {
+            sscanf(field + 4, "%lf,%lf", &offset_x, &offset_y);
+        }
+        x -= offset_x;
+        y -= offset_y;
+    } else {
+        return -1;
+    }
+    memcpy(state->state, line + 1, length);
+    state->state[length] = '\0';
+    state->machine.x = x;
+    state->machine.y = y;
+    state->machine.positioned = 1;
+    state->status_known = 1;
+    return 0;
+}
+
+int parse_parser_state(const char *line, ControllerState *state) {
+    // "[GC:G0 ...]" from Grbl 1.1, "[G0 ...]" from 0.9
+    const char *words = strncmp(line, "[GC:", 4) == 0 ? line + 4 : line + 1;
+    if (line[0] != '[' || words[0] != 'G') {
+        return -1;
+    }
+    MachineState parsed;
+    machine_state_init(&parsed);
+    machine_state_update(&parsed, words);
+    state->machine.spindle = parsed.spindle;
+    state->machine.feed = parsed.feed;
+    state->machine.pen = parsed.pen;
+    state->parser_known = 1;
+    return 0;
+}
+
+int startup_commands(const ControllerState *state, char lines[STARTUP_COMMANDS][64]) {
+    const MachineState *machine = &state->machine;
+    int count = 0;
+    if (!state->status_known || !state->parser_known || fabs(machine->x) > 0.0005 || fabs(machine->y) > 0.0005 ||
+        machine->feed != STARTUP_FEED) {
+        snprintf(lines[count++], 64, "%s", init_commands[0]);
+    }
+    if (!state->parser_known || !machine->spindle) {
+        snprintf(lines[count++], 64, "%s", init_commands[1]);
+    }
+    if (!state->parser_known || machine->pen != 0) {
+        snprintf(lines[count++], 64, "%s", init_commands[2]);
+    }
+    return count;
+}
+
+// Soft-reset and wait for the banner, skipping answers to what was sent before
+static int reset_controller(int port) {
+    char reset = RECOVERY_RESET_CHAR, answer[256];
+    uint64_t deadline = monotonic_ns() + dollar_timeout_ms * 1000000ULL, now;
+
+    if (WriteToPort(port, &reset, 1) != 0) {
+        return -1;
+    }
+    while ((now = monotonic_ns()) < deadline) {
+        if (WaitForBannerOnPort(port, (int)((deadline - now) / 1000000) + 1, answer, sizeof(answer)) != 0) {
+            break;
+        }
+        if (strchr(answer, '$')) {
+            return 0;
+        }
+    }
+    printf("\nNo start-up banner after a reset\n");
+    return -1;
+}
+
+int startup_wake(int port, StartupReport *report) {
+    char buffer[] = "\n", answer[256];
+
+    report->woken_ns = monotonic_ns();
+    PrintBufferToPort(port, buffer);
+    if (WaitForBannerOnPort(port, STARTUP_WAKE_MS, answer, sizeof(answer)) == 0 &&
+        (strchr(answer, '$') || strncmp(answer, "ok", 2) == 0)) {
+        report->wake = strchr(answer, '$') ? WAKE_BANNER : WAKE_ANSWERED;
+    } else {
+        // Silent, or answering with an error or alarm: start again from a known state
+        if (reset_controller(port) != 0) {
+            return -1;
+        }
+        report->wake = WAKE_RESET;
+    }
+    report->ready_ns = monotonic_ns();
+    return 0;
+}
+
+// Fill in what the controller reports about itself; unreported fields stay unknown
+static void query_state(int port, ControllerState *state) {
+    char answer[256];
+    memset(state, 0, sizeof(*state));
+    machine_state_init(&state->machine);
+    if (QueryPort(port, "?", "<", answer, sizeof(answer), STARTUP_QUERY_MS) == 0) {
+        parse_status_report(answer, state);
+    }
+    // Also consumes an "ok" left over from the wake-up
+    if (QueryPort(port, "$G\n", "[G", answer, sizeof(answer), STARTUP_QUERY_MS) == 0) {
+        parse_parser_state(answer, state);
+    }
+}
+
+int startup_initialise(Transport *transport, int port, MachineState *machine, StartupReport *report) {
+    ControllerState state;
+    char lines[STARTUP_COMMANDS][64];
+
+    report->initialising_ns = monotonic_ns();
+    if (port < 0) {
+        // Nobody to ask: send everything
+        memset(&state, 0, sizeof(state));
+    } else {
+        query_state(port, &state);
+    }
+    if (state.status_known && strcmp(state.state, "Idle") != 0 && report->wake != WAKE_RESET) {
+        // Running, held or locked from an earlier session
+        printf("Controller is in %s state: resetting\n", state.state);
+        if (reset_controller(port) != 0) {
+            return -1;
+        }
+        report->wake = WAKE_RESET;
+        query_state(port, &state);
+    }
+
+    int count = startup_commands(&state, lines);
+    for (int i = 0; i < count; i++) {
+        if (transport_send(transport, lines[i]) != 0) {
+            return -1;
+        }
+    }
+    if (machine) {
+        // The commands that were skipped hold as if they had been acknowledged
+        for (int i = 0; i < STARTUP_COMMANDS; i++) {
+            machine_state_update(machine, init_commands[i]);
+        }
+    }
+    report->commands_sent = count;
+    report->initialised_ns = monotonic_ns();
+    DEBUG_LOG("Initialisation sent %d of %d commands\n", count, STARTUP_COMMANDS);
+    return 0;
+}
+
+void startup_print_report(const StartupReport *report, const char *label, uint64_t job_started_ns,
+                          uint64_t first_stroke_ns) {
+    const char *separator = ":";
+    printf("%s", label);
+    if (report->woken_ns) {
+        printf(": controller ready %.0f ms after wake-up (%s), initialised in %.0f ms with %d of %d commands",
+               (report->ready_ns - report->woken_ns) / 1e6, wake_names[report->wake],
+               (report->initialised_ns - report->initialising_ns) / 1e6, report->commands_sent, STARTUP_COMMANDS);
+        separator = ";";
+    }
+    if (job_started_ns && first_stroke_ns) {
+        printf("%s first stroke %.0f ms after the job started, %.1f s after launch", separator,
+               (first_stroke_ns - job_started_ns) / 1e6, (first_stroke_ns - report->launched_ns) / 1e9);
+    }
+    printf("\n");
+}
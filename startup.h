@@ -0,0 +1,133 @@
+/**
+ * @file startup.h
+ * @brief Controller bring-up and time-to-first-stroke
+ *
+ * Bring-up used to send a newline, sleep, poll for the banner in 100 ms
+ * steps and then send all three initialisation commands. Now the port is
+ * read as bytes arrive, so the banner of a board reset by opening the port,
+ * or the "ok" of a controller that was already running, is seen at once. A
+ * controller that answers with an error or alarm, or stays silent for
+ * STARTUP_WAKE_MS, is soft-reset instead of waited on; one that answers but
+ * reports a state other than Idle is reset as well.
+ *
+ * The status report ('?') and parser state ($G) are then compared with what
+ * the initialisation sets up (origin, F1000, M3, S0), and only the commands
+ * that would change something are sent. Without reports (older firmware,
+ * emulation) all of them are sent.
+ */
+
+#ifndef STARTUP_H
+#define STARTUP_H
+
+#include <stdint.h>
+#include "transport.h"
+#include "recovery.h"
+
+/**
+ * @brief Bring-up timing
+ */
+#define STARTUP_WAKE_MS 2500            // Covers the bootloader delay of a board reset by opening the port
+#define STARTUP_QUERY_MS 500            // Longest wait for a status or parser state report
+
+/**
+ * @brief What the initialisation sets up
+ */
+#define STARTUP_FEED 1000               // mm/min
+#define STARTUP_COMMANDS 3              // Origin and feed, spindle on, pen up
+
+/**
+ * @brief How the controller came up
+ */
+typedef enum {
+    WAKE_BANNER = 0,        // Start-up banner, the board was reset by opening the port
+    WAKE_ANSWERED,          // "ok", it was already running
+    WAKE_RESET              // Soft reset from an unknown state
+} WakeKind;
+
+/**
+ * @brief Controller state from its status report and parser state
+ */
+typedef struct {
+    int status_known;       // A status report was parsed
+    int parser_known;       // A parser state was parsed
+    char state[16];         // "Idle", "Run", "Alarm", ...
+    MachineState machine;   // Work position, feed, spindle and S value
+} ControllerState;
+
+/**
+ * @brief Bring-up and first-stroke timestamps of one robot
+ */
+typedef struct {
+    uint64_t launched_ns;   // Program start
+    uint64_t woken_ns;      // Wake-up newline sent
+    uint64_t ready_ns;      // Controller answered
+    uint64_t initialising_ns;
+    uint64_t initialised_ns;
+    WakeKind wake;
+    int commands_sent;      // Initialisation commands sent, of STARTUP_COMMANDS
+} StartupReport;
+
+/**
+ * @brief Parses a status report, "<Idle|MPos:...|...>" (Grbl 1.1) or "<Idle,MPos:...,WPos:...>" (0.9)
+ *
+ * The work position comes from WPos, or from MPos less WCO; without WCO the
+ * work offset is taken as zero.
+ *
+ * @param line Report line
+ * @param state Receives the state name and position
+ * @return int 0 on success, -1 if the line is not a status report
+ */
+int parse_status_report(const char *line, ControllerState *state);
+
+/**
+ * @brief Parses a parser state report, "[GC:G0 G54 ... M5 M9 T0 F0 S0]"
+ *
+ * @param line Report line
+ * @param state Receives the spindle, feed and S value
+ * @return int 0 on success, -1 if the line is not a parser state report
+ */
+int parse_parser_state(const char *line, ControllerState *state);
+
+/**
+ * @brief Lists the initialisation commands that would change a controller state
+ *
+ * @param state Reported state; fields that were not reported count as different
+ * @param lines Receives the command lines
+ * @return int Number of lines
+ */
+int startup_commands(const ControllerState *state, char lines[STARTUP_COMMANDS][64]);
+
+/**
+ * @brief Wakes the controller on a port, resetting it if its state is unknown
+ *
+ * @param port COM number minus 1
+ * @param report Receives the wake kind and timestamps; launched_ns must be set
+ * @return int 0 once the controller is ready, -1 if it did not answer
+ */
+int startup_wake(int port, StartupReport *report);
+
+/**
+ * @brief Sends the initialisation commands the reported state still needs
+ *
+ * A controller that is not Idle is reset first, unless it was just reset.
+ *
+ * @param transport Transport of the robot
+ * @param port COM number minus 1, for the queries; -1 to send every command without asking
+ * @param machine State kept by the transport for recovery, updated with what was skipped; may be NULL
+ * @param report Receives the commands sent and timestamps
+ * @return int 0 on success, -1 if a command failed
+ */
+int startup_initialise(Transport *transport, int port, MachineState *machine, StartupReport *report);
+
+/**
+ * @brief Prints bring-up time, if the robot was woken, and time to the first stroke, if known
+ *
+ * @param report Report after startup_initialise()
+ * @param label Robot label
+ * @param job_started_ns When the job started, 0 if none ran
+ * @param first_stroke_ns When its first pen-down command was acknowledged, 0 if none was
+ */
+void startup_print_report(const StartupReport *report, const char *label, uint64_t job_started_ns,
+                          uint64_t first_stroke_ns);
+
+#endif // STARTUP_H
@@ -0,0 +1,275 @@
+// textreader.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "textreader.h"
+#include "debug.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// Byte classes: 1 for the whitespace characters fscanf("%s") splits on
+static const unsigned char space_class[256] = {
+    ['\t'] = 1, ['\n'] = 1, ['\v'] = 1, ['\f'] = 1, ['\r'] = 1, [' '] = 1
+};
+
+// Prepare a reader for chunked streaming from an already open stream
+static int open_stream(TextReader *reader, FILE *stream) {
+    reader->buffer = malloc(TEXT_READER_CHUNK_SIZE);
+    if (!reader->buffer) {
+        DEBUG_LOG("Error: Could not allocate text stream buffer\n");
+        if (stream != stdin) {
+            fclose(stream);
+        }
+        return -1;
+    }
+    reader->capacity = TEXT_READER_CHUNK_SIZE;
+    reader->stream = stream;
+    reader->data = reader->buffer;
+    DEBUG_LOG("Streaming text input in %d byte chunks\n", TEXT_READER_CHUNK_SIZE);
+    return 0;
+}
+
+// Try to map a regular file; returns 1 if mapped, 0 if it should be streamed instead
+static int map_file(TextReader *reader, const char *filename) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    LARGE_INTEGER size;
+    if (file == INVALID_HANDLE_VALUE) {
+        return 0;
+    }
+    if (GetFileType(file) != FILE_TYPE_DISK || !GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        return 0;
+    }
+    if (size.QuadPart == 0) {
+        CloseHandle(file);
+        reader->mapped = 1;
+        return 1;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping) {
+        CloseHandle(file);
+        return 0;
+    }
+    const void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return 0;
+    }
+    reader->file_handle = file;
+    reader->map_handle = mapping;
+    reader->data = view;
+    reader->size = (size_t)size.QuadPart;
+#else
+    int fd = open(filename, O_RDONLY);
+    struct stat st;
+    if (fd < 0) {
+        return 0;
+    }
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return 0;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        reader->mapped = 1;
+        return 1;
+    }
+    void *view = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED) {
+        return 0;
+    }
+    madvise(view, (size_t)st.st_size, MADV_SEQUENTIAL);
+    reader->data = view;
+    reader->size = (size_t)st.st_size;
+#endif
+    reader->mapped = 1;
+    return 1;
+}
+
+int text_reader_open(TextReader *reader, const char *filename) {
+    memset(reader, 0, sizeof(*reader));
+
+    if (strcmp(filename, "-") == 0) {
+        return open_stream(reader, stdin);
+    }
+
+    if (map_file(reader, filename)) {
+        reader->eof = 1;
+        DEBUG_LOG("Mapped text file %s (%lu bytes)\n", filename, (unsigned long)reader->size);
+        return 0;
+    }
+
+    FILE *stream = fopen(filename, "rb");
+    if (!stream) {
+        DEBUG_LOG("Error: Could not open text file %s\n", filename);
+        return -1;
+    }
+    return open_stream(reader, stream);
+}
+
+// Keep the unread tail starting at keep_from and append the next chunk of the stream
+static int refill(TextReader *reader, size_t keep_from) {
+    size_t kept = reader->size - keep_from;
+
+    if (kept == reader->capacity) {
+        // A single token fills the whole buffer: grow it rather than split the token
+        char *grown = realloc(reader->buffer, reader->capacity * 2);
+        if (!grown) {
+            DEBUG_LOG("Error: Could not grow text stream buffer\n");
+            return -1;
+        }
+        reader->buffer = grown;
+        reader->capacity *= 2;
+    }
+    memmove(reader->buffer, reader->buffer + keep_from, kept);
+
+    size_t got = fread(reader->buffer + kept, 1, reader->capacity - kept, reader->stream);
+    if (got == 0) {
+        if (ferror(reader->stream)) {
+            DEBUG_LOG("Error: Failed reading text stream\n");
+            return -1;
+        }
+        reader->eof = 1;
+    }
+    reader->data = reader->buffer;
+    reader->size = kept + got;
+    reader->pos = 0;
+    return 0;
+}
+
+int text_reader_next(TextReader *reader, TextToken *token) {
+    for (;;) {
+        const unsigned char *data = (const unsigned char *)reader->data;
+        size_t start = reader->pos;
+        size_t i = start;
+
+        if (i >= reader->size) {
+            if (reader->eof) {
+                token->type = TOKEN_END;
+                token->text = NULL;
+                token->length = 0;
+                return 0;
+            }
+            if (refill(reader, start) != 0) {
+                return -1;
+            }
+            continue;
+        }
+
+        if (space_class[data[i]]) {
+            int breaks = 0;
+            while (i < reader->size && space_class[data[i]]) {
+                // "\r\n" counts once; a lone '\r' is an old-style line break
+                if (data[i] == '\n' || (data[i] == '\r' && (i + 1 >= reader->size || data[i + 1] != '\n'))) {
+                    breaks++;
+                }
+                i++;
+            }
+            if (i == reader->size && !reader->eof) {
+                // The whitespace run may continue in the next chunk
+                if (refill(reader, start) != 0) {
+                    return -1;
+                }
+                continue;
+            }
+            token->type = breaks == 0 ? TOKEN_SPACE : (breaks == 1 ? TOKEN_NEWLINE : TOKEN_PARAGRAPH);
+            token->text = NULL;
+            token->length = 0;
+        } else {
+            while (i < reader->size && !space_class[data[i]]) {
+                i++;
+            }
+            if (i == reader->size && !reader->eof) {
+                // The word may continue in the next chunk
+                if (refill(reader, start) != 0) {
+                    return -1;
+                }
+                continue;
+            }
+            token->type = TOKEN_WORD;
+            token->text = reader->data + start;
+            token->length = i - start;
+        }
+
+        reader->pos = i;
+        return 1;
+    }
+}
+
+uint32_t text_decode_utf8(const char *text, size_t length, size_t *pos) {
+    const unsigned char *bytes = (const unsigned char *)text + *pos;
+    size_t left = length - *pos;
+    uint32_t code, min_code;
+    size_t count;
+
+    if (bytes[0] < 0x80) {
+        (*pos)++;
+        return bytes[0];
+    } else if ((bytes[0] & 0xe0) == 0xc0) {
+        code = bytes[0] & 0x1f;
+        count = 2;
+        min_code = 0x80;
+    } else if ((bytes[0] & 0xf0) == 0xe0) {
+        code = bytes[0] & 0x0f;
+        count = 3;
+        min_code = 0x800;
+    } else if ((bytes[0] & 0xf8) == 0xf0) {
+        code = bytes[0] & 0x07;
+        count = 4;
+        min_code = 0x10000;
+    } else {
+        (*pos)++;
+        return TEXT_REPLACEMENT_CHARACTER;
+    }
+
+    if (left < count) {
+        (*pos)++;
+        return TEXT_REPLACEMENT_CHARACTER;
+    }
+    for (size_t i = 1; i < count; i++) {
+        if ((bytes[i] & 0xc0) != 0x80) {
+            (*pos)++;
+            return TEXT_REPLACEMENT_CHARACTER;
+        }
+        code = (code << 6) | (bytes[i] & 0x3f);
+    }
+    if (code < min_code || code > 0x10ffff || (code >= 0xd800 && code <= 0xdfff)) {
+        (*pos)++;
+        return TEXT_REPLACEMENT_CHARACTER;
+    }
+    *pos += count;
+    return code;
+}
+
+void text_reader_close(TextReader *reader) {
+    if (reader->mapped) {
+#ifdef _WIN32
+        if (reader->data) {
+            UnmapViewOfFile(reader->data);
+            CloseHandle(reader->map_handle);
+            CloseHandle(reader->file_handle);
+        }
+#else
+        if (reader->data) {
+            munmap((void *)reader->data, reader->size);
+        }
+#endif
+    } else {
+        free(reader->buffer);
+        if (reader->stream && reader->stream != stdin) {
+            fclose(reader->stream);
+        }
+    }
+    memset(reader, 0, sizeof(*reader));
+}
@@ -0,0 +1,115 @@
+/**
+ * @file textreader.h
+ * @brief Streaming text reader for Robot Writer input files
+ *
+ * Maps the input file into memory, or streams it in large chunks when it
+ * cannot be mapped (pipes, stdin, special files), and splits it in a single
+ * pass into words, spaces, hard line breaks and paragraph breaks.
+ *
+ * Input is UTF-8. Words are returned as bytes (no UTF-8 sequence contains a
+ * whitespace byte, so they are never split inside a character) and decoded
+ * into code points with text_decode_utf8() as they are laid out.
+ */
+
+#ifndef TEXTREADER_H
+#define TEXTREADER_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Size of each read when the input is streamed rather than mapped
+ */
+#define TEXT_READER_CHUNK_SIZE (1024 * 1024)
+
+/**
+ * @brief Code point returned for bytes that are not valid UTF-8
+ */
+#define TEXT_REPLACEMENT_CHARACTER 0xFFFD
+
+/**
+ * @brief Kinds of token produced by the reader
+ */
+typedef enum {
+    TOKEN_END = 0,      // End of input
+    TOKEN_WORD,         // Run of printable characters
+    TOKEN_SPACE,        // Whitespace containing no line break
+    TOKEN_NEWLINE,      // Whitespace containing exactly one line break
+    TOKEN_PARAGRAPH     // Whitespace containing two or more line breaks
+} TokenType;
+
+/**
+ * @brief A single token returned by text_reader_next()
+ *
+ * For TOKEN_WORD, text points straight into the mapped file or the stream
+ * buffer and is NOT NUL-terminated. It stays valid until the next call to
+ * text_reader_next() (streamed input) or text_reader_close() (mapped input).
+ */
+typedef struct {
+    TokenType type;     // Kind of token
+    const char *text;   // First byte of the word (TOKEN_WORD only)
+    size_t length;      // Length of the word in bytes
+} TextToken;
+
+/**
+ * @brief Reader state for one open input
+ */
+typedef struct {
+    const char *data;       // Bytes currently available for scanning
+    size_t size;            // Number of valid bytes in data
+    size_t pos;             // Scan position within data
+    int mapped;             // 1 if data is a mapping of the whole file
+    int eof;                // 1 once no further bytes can be read
+    FILE *stream;           // Source for streamed input, NULL when mapped
+    char *buffer;           // Stream buffer (grows for words longer than a chunk)
+    size_t capacity;        // Allocated size of buffer
+#ifdef _WIN32
+    void *file_handle;      // Handles kept open for the lifetime of the mapping
+    void *map_handle;
+#endif
+} TextReader;
+
+/**
+ * @brief Opens a text file for tokenising
+ *
+ * Regular files are memory-mapped. Anything that cannot be mapped, and the
+ * name "-" (standard input), is streamed in TEXT_READER_CHUNK_SIZE reads.
+ *
+ * @param reader Reader to initialise
+ * @param filename Path to the text file, or "-" for standard input
+ * @return int 0 on success, -1 if the file could not be opened
+ */
+int text_reader_open(TextReader *reader, const char *filename);
+
+/**
+ * @brief Returns the next token from the input
+ *
+ * @param reader Open reader
+ * @param token Receives the token
+ * @return int 1 if a token was returned, 0 at end of input, -1 on read error
+ */
+int text_reader_next(TextReader *reader, TextToken *token);
+
+/**
+ * @brief Decodes the UTF-8 character at text[*pos] and moves *pos past it
+ *
+ * A byte that does not start a valid sequence (a stray continuation byte,
+ * an overlong form, a surrogate or a sequence cut short) decodes to
+ * TEXT_REPLACEMENT_CHARACTER and is skipped on its own.
+ *
+ * @param text Bytes of a word
+ * @param length Number of bytes in text
+ * @param pos Position of the character, below length; advanced past it
+ * @return uint32_t Code point
+ */
+uint32_t text_decode_utf8(const char *text, size_t length, size_t *pos);
+
+/**
+ * @brief Releases the mapping or stream buffer and closes the input
+ *
+ * @param reader Reader to close
+ */
+void text_reader_close(TextReader *reader);
+
+#endif // TEXTREADER_H
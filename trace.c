@@ -0,0 +1,144 @@
+// trace.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "trace.h"
+#include "platform.h"
+
+typedef struct {
+    const char *name;
+    uint64_t timestamp_ns;
+    char phase;
+} TraceEvent;
+
+typedef struct TraceChunk TraceChunk;
+struct TraceChunk {
+    TraceChunk *next;
+    size_t count;
+    TraceEvent events[TRACE_CHUNK_EVENTS];
+};
+
+// Events of one thread; only that thread appends, trace_write() reads them afterwards
+typedef struct TraceBuffer TraceBuffer;
+struct TraceBuffer {
+    TraceBuffer *next;
+    int thread_id;
+    char thread_name[32];
+    TraceChunk *first;
+    TraceChunk *last;
+    int dropped;            // Set if a chunk could not be allocated
+};
+
+int trace_enabled = 0;
+
+static uint64_t trace_start_ns = 0;
+static TraceBuffer *buffers = NULL;         // Every thread's buffer, newest first
+static int next_thread_id = 1;
+static pthread_mutex_t buffers_lock = PTHREAD_MUTEX_INITIALIZER;
+static _Thread_local TraceBuffer *thread_buffer = NULL;
+
+void trace_enable(void) {
+    trace_start_ns = monotonic_ns();
+    trace_enabled = 1;
+}
+
+// The calling thread's buffer, registered on first use
+static TraceBuffer *get_thread_buffer(void) {
+    if (thread_buffer) {
+        return thread_buffer;
+    }
+    TraceBuffer *buffer = calloc(1, sizeof(*buffer));
+    if (!buffer) {
+        return NULL;
+    }
+    pthread_mutex_lock(&buffers_lock);
+    buffer->thread_id = next_thread_id++;
+    snprintf(buffer->thread_name, sizeof(buffer->thread_name), "thread %d", buffer->thread_id);
+    buffer->next = buffers;
+    buffers = buffer;
+    pthread_mutex_unlock(&buffers_lock);
+    thread_buffer = buffer;
+    return buffer;
+}
+
+void trace_event(const char *name, char phase) {
+    TraceBuffer *buffer = get_thread_buffer();
+    if (!buffer) {
+        return;
+    }
+    TraceChunk *chunk = buffer->last;
+    if (!chunk || chunk->count == TRACE_CHUNK_EVENTS) {
+        TraceChunk *grown = malloc(sizeof(*grown));
+        if (!grown) {
+            buffer->dropped = 1;
+            return;
+        }
+        grown->next = NULL;
+        grown->count = 0;
+        if (chunk) {
+            chunk->next = grown;
+        } else {
+            buffer->first = grown;
+        }
+        buffer->last = chunk = grown;
+    }
+    TraceEvent *event = &chunk->events[chunk->count++];
+    event->name = name;
+    event->phase = phase;
+    event->timestamp_ns = monotonic_ns();
+}
+
+void trace_set_thread_name(const char *name) {
+    TraceBuffer *buffer = trace_enabled ? get_thread_buffer() : NULL;
+    if (buffer) {
+        snprintf(buffer->thread_name, sizeof(buffer->thread_name), "%s", name);
+    }
+}
+
+int trace_write(const char *path) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&buffers_lock);
+    fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    int first = 1;
+    for (TraceBuffer *buffer = buffers; buffer; buffer = buffer->next) {
+        fprintf(file, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, "
+                "\"args\": {\"name\": \"%s\"}}", first ? "" : ",\n", buffer->thread_id, buffer->thread_name);
+        first = 0;
+        for (TraceChunk *chunk = buffer->first; chunk; chunk = chunk->next) {
+            for (size_t i = 0; i < chunk->count; i++) {
+                const TraceEvent *event = &chunk->events[i];
+                fprintf(file, ",\n{\"name\": \"%s\", \"ph\": \"%c\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f}",
+                        event->name, event->phase, buffer->thread_id,
+                        (double)(event->timestamp_ns - trace_start_ns) / 1e3);
+            }
+        }
+        if (buffer->dropped) {
+            fprintf(stderr, "Trace of %s is incomplete: out of memory\n", buffer->thread_name);
+        }
+    }
+    fprintf(file, "\n]}\n");
+    int result = ferror(file) ? -1 : 0;
+    if (fclose(file) != 0) {
+        result = -1;
+    }
+
+    // Free everything; threads that trace again start new buffers
+    while (buffers) {
+        TraceBuffer *buffer = buffers;
+        buffers = buffer->next;
+        while (buffer->first) {
+            TraceChunk *chunk = buffer->first;
+            buffer->first = chunk->next;
+            free(chunk);
+        }
+        free(buffer);
+    }
+    thread_buffer = NULL;
+    pthread_mutex_unlock(&buffers_lock);
+    return result;
+}
@@ -0,0 +1,64 @@
+/**
+ * @file trace.h
+ * @brief Optional timeline tracing in Chrome trace-event format
+ *
+ * When enabled, the pipeline stages record begin/end events into buffers
+ * owned by the calling thread, so recording takes no lock. trace_write()
+ * turns them into a JSON file that chrome://tracing and Perfetto open, with
+ * one track per thread (main, pool robots, daemon worker).
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+/**
+ * @brief Events per buffer chunk; a thread allocates a new chunk when one fills up
+ */
+#define TRACE_CHUNK_EVENTS 65536
+
+/**
+ * @brief Non-zero once trace_enable() has been called
+ */
+extern int trace_enabled;
+
+/**
+ * @brief Records the start and end of a stage when tracing is on
+ *
+ * Names must be string literals (or otherwise outlive the trace).
+ */
+#define TRACE_BEGIN(name) do { if (trace_enabled) trace_event(name, 'B'); } while (0)
+#define TRACE_END(name) do { if (trace_enabled) trace_event(name, 'E'); } while (0)
+
+/**
+ * @brief Turns tracing on; call before any threads that should be traced start
+ */
+void trace_enable(void);
+
+/**
+ * @brief Records one event in the calling thread's buffer
+ *
+ * @param name Stage name
+ * @param phase 'B' for begin, 'E' for end
+ */
+void trace_event(const char *name, char phase);
+
+/**
+ * @brief Names the calling thread's track in the trace
+ *
+ * @param name Track name (copied)
+ */
+void trace_set_thread_name(const char *name);
+
+/**
+ * @brief Writes every recorded event as Chrome trace JSON and frees the buffers
+ *
+ * Call once the traced threads have finished.
+ *
+ * @param path Output file
+ * @return int 0 on success, -1 on failure
+ */
+int trace_write(const char *path);
+
+#endif // TRACE_H
@@ -0,0 +1,185 @@
+// transport.c
+#include <stdio.h>
+#include <string.h>
+#include "transport.h"
+#include "serial.h"
+#include "platform.h"
+#include "trace.h"
+
+// Send one line and classify the answer
+static ReplyClass exchange(Transport *transport, int port, const char *command, int timeout_ms, int *code) {
+    char buffer[100], reply[128];
+    snprintf(buffer, sizeof(buffer), "%s", command);
+    TRACE_BEGIN("PrintBuffer");
+    PrintBufferToPort(port, buffer);
+    TRACE_END("PrintBuffer");
+    transport_mark_written(transport);
+    TRACE_BEGIN("WaitForReply");
+    int result = ReadReplyOnPort(port, timeout_ms, reply, sizeof(reply));
+    TRACE_END("WaitForReply");
+    if (result != 0) {
+        *code = 0;
+        return REPLY_TIMEOUT;
+    }
+    return classify_reply(reply, code);
+}
+
+// After a timeout, a late "ok" would answer the next command and shift every reply after it. A status report
+// comes after every reply already on its way, and an idle controller owes none, so the next reply is our own
+static int resync_replies(int port) {
+    char answer[128];
+    if (QueryPort(port, "?", "<", answer, sizeof(answer), RECOVERY_RESYNC_TIMEOUT_MS) != 0) {
+        printf("No status report after the timeout\n");
+        return -1;
+    }
+    if (strncmp(answer, "<Idle", 5) != 0) {
+        printf("Controller busy after the timeout: %s\n", answer);
+        return -1;
+    }
+    return 0;
+}
+
+// Send a line, and again after a timeout or a transient error when that is harmless; alarms are left to the caller
+static ReplyClass send_with_retries(Transport *transport, int port, const char *command, int timeout_ms, int *code) {
+    const RecoveryPolicy *policy = get_recovery_policy();
+    int length = (int)strcspn(command, "\n");
+    for (int attempt = 0;; attempt++) {
+        ReplyClass reply = exchange(transport, port, command, timeout_ms, code);
+        if (reply == REPLY_OK || reply == REPLY_ALARM) {
+            return reply;
+        }
+        if (reply == REPLY_TIMEOUT) {
+            metrics_count_incident(transport->metrics, METRICS_TIMEOUT);
+            printf("No acknowledgement for %.*s after %d ms\n", length, command, timeout_ms);
+        } else {
+            metrics_count_incident(transport->metrics, METRICS_ERROR);
+            printf("Controller reported error:%d for %.*s\n", *code, length, command);
+            if (!error_is_transient(*code)) {
+                return reply;
+            }
+        }
+        if (attempt >= policy->retries || !command_is_idempotent(command) ||
+            (reply == REPLY_TIMEOUT && resync_replies(port) != 0)) {
+            return reply;
+        }
+        metrics_count_retry(transport->metrics);
+    }
+}
+
+// Reset, unlock and re-home the controller, then restore the state after the last acknowledged command
+static int recover(Transport *transport, int port, const MachineState *machine) {
+    const RecoveryPolicy *policy = get_recovery_policy();
+    char lines[RECOVERY_MAX_RESTORE_LINES][64];
+    char reset = RECOVERY_RESET_CHAR;
+    int code;
+
+    if (WriteToPort(port, &reset, 1) != 0 || WaitForDollarOnPort(port) != 0 ||
+        send_with_retries(transport, port, RECOVERY_UNLOCK_COMMAND, RECOVERY_HOME_TIMEOUT_MS, &code) != REPLY_OK ||
+        (policy->rehome &&
+         send_with_retries(transport, port, RECOVERY_HOME_COMMAND, RECOVERY_HOME_TIMEOUT_MS, &code) != REPLY_OK)) {
+        return -1;
+    }
+    int count = machine_state_restore(machine, lines);
+    for (int i = 0; i < count; i++) {
+        if (send_with_retries(transport, port, lines[i], policy->ack_timeout_ms, &code) != REPLY_OK) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int recovering_send(Transport *transport, int port, MachineState *machine, const char *command) {
+    const RecoveryPolicy *policy = get_recovery_policy();
+    int length = (int)strcspn(command, "\n");
+    for (int alarms = 0;; alarms++) {
+        int code;
+        ReplyClass reply = send_with_retries(transport, port, command, policy->ack_timeout_ms, &code);
+        if (reply == REPLY_OK) {
+            machine_state_update(machine, command);
+            return 0;
+        }
+        if (reply == REPLY_TIMEOUT) {
+            printf("The controller stopped answering\n");
+            return -1;
+        }
+        if (reply == REPLY_ALARM) {
+            metrics_count_incident(transport->metrics, METRICS_ALARM);
+            printf("Controller alarm %d on %.*s: recovering\n", code, length, command);
+            if (recover(transport, port, machine) != 0) {
+                printf("Recovery failed\n");
+                return -1;
+            }
+            metrics_count_incident(transport->metrics, METRICS_RECOVERY);
+            if (alarms == 0) {
+                continue;
+            }
+        }
+        // Leave out a command the controller keeps refusing rather than stop the job
+        metrics_count_incident(transport->metrics, METRICS_SKIP);
+        printf("Skipping %.*s\n", length, command);
+        return 0;
+    }
+}
+
+static int serial_send_command(Transport *transport, const char *command) {
+    return recovering_send(transport, cport_nr, transport->state, command);
+}
+
+static int port_send_command(Transport *transport, const char *command) {
+    PortTransport *port_transport = transport->state;
+    return recovering_send(transport, port_transport->port, &port_transport->machine, command);
+}
+
+static int stdout_send_command(Transport *transport, const char *command) {
+    (void)transport;
+    return fputs(command, stdout) < 0 ? -1 : 0;
+}
+
+static MachineState serial_machine;
+
+Transport serial_transport = { serial_send_command, &serial_machine, NULL, NULL, NULL };
+Transport stdout_transport = { stdout_send_command, NULL, NULL, NULL, NULL };
+
+void port_transport_init(PortTransport *port_transport, int port) {
+    port_transport->transport.send_command = port_send_command;
+    port_transport->transport.state = port_transport;
+    port_transport->transport.metrics = NULL;
+    port_transport->transport.drain = NULL;
+    port_transport->transport.pending = NULL;
+    port_transport->port = port;
+    machine_state_init(&port_transport->machine);
+}
+
+MachineState *transport_machine_state(Transport *transport) {
+    if (transport->send_command == serial_send_command) {
+        return transport->state;
+    }
+    if (transport->send_command == port_send_command) {
+        return &((PortTransport *)transport->state)->machine;
+    }
+    return NULL;
+}
+
+void transport_mark_written(Transport *transport) {
+    if (transport->metrics) {
+        transport->metrics->written_ns = monotonic_ns();
+    }
+}
+
+int transport_send(Transport *transport, const char *command) {
+    if (!transport->metrics) {
+        return transport->send_command(transport, command);
+    }
+    uint64_t enqueued = monotonic_ns();
+    int result = transport->send_command(transport, command);
+    metrics_record_command(transport->metrics, command, enqueued, monotonic_ns(), result);
+    return result;
+}
+
+size_t transport_pending(Transport *transport) {
+    return transport->pending ? transport->pending(transport) : 0;
+}
+
+int transport_drain(Transport *transport) {
+    return transport->drain ? transport->drain(transport) : 0;
+}
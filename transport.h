@@ -0,0 +1,103 @@
+/**
+ * @file transport.h
+ * @brief Destination for the G-code lines produced by the executor
+ *
+ * A transport sends one command line and waits until the controller has
+ * acknowledged it, or, for a streaming transport (flow.h), until the command
+ * is queued; transport_drain() then waits for everything queued. The serial
+ * transport drives the robot through serial.c, with the timeouts, retries and
+ * alarm recovery of recovery.h; other transports let jobs run without
+ * hardware.
+ */
+
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <stddef.h>
+#include "metrics.h"
+#include "recovery.h"
+
+/**
+ * @brief A command sink with its own state
+ */
+typedef struct Transport Transport;
+struct Transport {
+    int (*send_command)(Transport *transport, const char *command);    // 0 once acknowledged, -1 on failure
+    void *state;                                                        // Transport-specific data
+    Metrics *metrics;                                                   // Per-command instrumentation, NULL if off
+    int (*drain)(Transport *transport);                                 // Waits for queued commands, NULL if none are queued
+    size_t (*pending)(Transport *transport);                            // Commands not yet acknowledged, NULL if none are queued
+};
+
+/**
+ * @brief Transport that talks to the robot through serial.c (PrintBuffer/WaitForReply)
+ */
+extern Transport serial_transport;
+
+/**
+ * @brief Serial transport bound to one port, for driving several robots
+ */
+typedef struct {
+    Transport transport;
+    int port;                   // COM number minus 1, as cport_nr in serial.h
+    MachineState machine;       // Restored after an alarm
+} PortTransport;
+
+/**
+ * @brief Initialises a transport that talks to the robot on the given port
+ *
+ * @param port_transport Transport to initialise
+ * @param port COM number minus 1
+ */
+void port_transport_init(PortTransport *port_transport, int port);
+
+/**
+ * @brief Transport that prints each command to standard output and never waits
+ */
+extern Transport stdout_transport;
+
+/**
+ * @brief Returns the machine state a serial transport restores after an alarm
+ *
+ * @param transport Transport to look at
+ * @return MachineState* State of a serial or port transport, NULL for other transports
+ */
+MachineState *transport_machine_state(Transport *transport);
+
+/**
+ * @brief Called by a transport once the current command's bytes are written
+ *
+ * Splits the command's latency into write and acknowledgement time.
+ *
+ * @param transport Transport sending the command
+ */
+void transport_mark_written(Transport *transport);
+
+/**
+ * @brief Sends one command through a transport
+ *
+ * Records the command in transport->metrics when it is set.
+ *
+ * @param transport Transport to use
+ * @param command NUL-terminated command line including its newline
+ * @return int 0 once acknowledged, -1 on failure
+ */
+int transport_send(Transport *transport, const char *command);
+
+/**
+ * @brief Counts the commands a streaming transport has sent but the controller has not acknowledged
+ *
+ * @param transport Transport to look at
+ * @return size_t Commands in flight, 0 for a transport that waits for each acknowledgement
+ */
+size_t transport_pending(Transport *transport);
+
+/**
+ * @brief Waits until every command sent through a transport is acknowledged
+ *
+ * @param transport Transport to drain
+ * @return int 0 once drained, -1 on failure
+ */
+int transport_drain(Transport *transport);
+
+#endif // TRANSPORT_H
@@ -0,0 +1,104 @@
+// workarea.c
+#include <stdio.h>
+#include "workarea.h"
+
+// G-code is written in whole µm: a point less than half of one outside the area is written on its edge
+#define WORK_AREA_SLACK 0.0004f
+
+static WorkArea machine_area = { 0, 0, 0.0f, 0.0f, 0.0f, 0.0f };
+
+void work_area_init(WorkArea *area) {
+    area->enabled = 0;
+    area->fail = 0;
+    area->min_x = area->min_y = area->max_x = area->max_y = 0.0f;
+}
+
+int parse_work_area(const char *text, WorkArea *area) {
+    float width, height;
+    if (sscanf(text, "%fx%f", &width, &height) != 2 || width <= 0.0f || height <= 0.0f) {
+        return -1;
+    }
+    area->enabled = 1;
+    area->min_x = 0.0f;
+    area->min_y = -height;
+    area->max_x = width;
+    area->max_y = 0.0f;
+    return 0;
+}
+
+void set_machine_work_area(const WorkArea *area) {
+    machine_area = *area;
+}
+
+void get_machine_work_area(WorkArea *area) {
+    *area = machine_area;
+}
+
+int work_area_box(const WorkArea *area, float min_x, float min_y, float max_x, float max_y) {
+    float left = area->min_x - WORK_AREA_SLACK, right = area->max_x + WORK_AREA_SLACK;
+    float bottom = area->min_y - WORK_AREA_SLACK, top = area->max_y + WORK_AREA_SLACK;
+    if (max_x < left || min_x > right || max_y < bottom || min_y > top) {
+        return WORK_AREA_OUTSIDE;
+    }
+    if (min_x >= left && max_x <= right && min_y >= bottom && max_y <= top) {
+        return WORK_AREA_INSIDE;
+    }
+    return WORK_AREA_CLIPPED;
+}
+
+void work_area_clamp(const WorkArea *area, float *x, float *y) {
+    *x = *x < area->min_x ? area->min_x : *x > area->max_x ? area->max_x : *x;
+    *y = *y < area->min_y ? area->min_y : *y > area->max_y ? area->max_y : *y;
+}
+
+// Liang-Barsky: narrow the parameter range [t0, t1] of the segment against each edge in turn
+int work_area_clip(const WorkArea *area, float *x0, float *y0, float *x1, float *y1) {
+    float dx = *x1 - *x0, dy = *y1 - *y0;
+    const float p[4] = { -dx, dx, -dy, dy };
+    const float q[4] = { *x0 - area->min_x + WORK_AREA_SLACK, area->max_x + WORK_AREA_SLACK - *x0,
+                         *y0 - area->min_y + WORK_AREA_SLACK, area->max_y + WORK_AREA_SLACK - *y0 };
+    float t0 = 0.0f, t1 = 1.0f;
+
+    for (int edge = 0; edge < 4; edge++) {
+        if (p[edge] == 0.0f) {
+            // Parallel to the edge: wholly on one side of it
+            if (q[edge] < 0.0f) {
+                return WORK_AREA_OUTSIDE;
+            }
+            continue;
+        }
+        float t = q[edge] / p[edge];
+        if (p[edge] < 0.0f) {
+            if (t > t1) {
+                return WORK_AREA_OUTSIDE;
+            }
+            if (t > t0) {
+                t0 = t;
+            }
+        } else {
+            if (t < t0) {
+                return WORK_AREA_OUTSIDE;
+            }
+            if (t < t1) {
+                t1 = t;
+            }
+        }
+    }
+    if (t0 == 0.0f && t1 == 1.0f) {
+        return WORK_AREA_INSIDE;
+    }
+
+    // Rounding may leave a crossing point a hair outside; it belongs on the edge
+    float start_x = *x0, start_y = *y0;
+    if (t0 > 0.0f) {
+        *x0 = start_x + t0 * dx;
+        *y0 = start_y + t0 * dy;
+        work_area_clamp(area, x0, y0);
+    }
+    if (t1 < 1.0f) {
+        *x1 = start_x + t1 * dx;
+        *y1 = start_y + t1 * dy;
+        work_area_clamp(area, x1, y1);
+    }
+    return WORK_AREA_CLIPPED;
+}
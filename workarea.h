@@ -0,0 +1,107 @@
+/**
+ * @file workarea.h
+ * @brief Machine work area: the travel limits every generated move must stay inside
+ *
+ * The area is a rectangle in machine coordinates, from the origin W mm to the
+ * right and H mm down the page (y from -H to 0). The generator compares each
+ * glyph's bounding box, measured when the font is loaded, with the area:
+ *
+ * - a glyph wholly inside is generated as usual;
+ * - a glyph wholly outside is culled, without looking at its movements;
+ * - a glyph across the edge has its pen-down moves clipped exactly at the
+ *   boundary, moves wholly outside dropped, and its pen-up moves kept inside.
+ *
+ * With fail set, the first glyph that is not wholly inside stops the job
+ * instead, so an overflowing job fails while it is compiled rather than with
+ * a controller alarm in the middle of a page.
+ */
+
+#ifndef WORKAREA_H
+#define WORKAREA_H
+
+/**
+ * @brief Where a box or segment lies relative to the area
+ */
+#define WORK_AREA_OUTSIDE 0
+#define WORK_AREA_INSIDE 1
+#define WORK_AREA_CLIPPED 2         // Partly inside
+
+/**
+ * @brief Work area settings
+ */
+typedef struct {
+    int enabled;            // 0: no limits
+    int fail;               // 1: a job that leaves the area fails; 0: it is clipped
+    float min_x;            // mm, machine coordinates
+    float min_y;
+    float max_x;
+    float max_y;
+} WorkArea;
+
+/**
+ * @brief Fills area with no limits
+ *
+ * @param area Area to fill
+ */
+void work_area_init(WorkArea *area);
+
+/**
+ * @brief Parses "WxH" in mm and enables the area
+ *
+ * @param text Size, e.g. "200x280"
+ * @param area Receives the limits; fail keeps its value
+ * @return int 0 on success, -1 unless W and H are above 0
+ */
+int parse_work_area(const char *text, WorkArea *area);
+
+/**
+ * @brief Sets the work area of the machine, used by job_spec_init()
+ *
+ * @param area Area to copy
+ */
+void set_machine_work_area(const WorkArea *area);
+
+/**
+ * @brief Copies the work area of the machine
+ *
+ * @param area Receives the area, disabled unless set_machine_work_area() enabled it
+ */
+void get_machine_work_area(WorkArea *area);
+
+/**
+ * @brief Classifies a box against the area
+ *
+ * @param area Enabled area
+ * @param min_x Box in mm, min_x <= max_x and min_y <= max_y
+ * @param min_y
+ * @param max_x
+ * @param max_y
+ * @return int WORK_AREA_INSIDE, WORK_AREA_OUTSIDE, or WORK_AREA_CLIPPED if it crosses the edge
+ */
+int work_area_box(const WorkArea *area, float min_x, float min_y, float max_x, float max_y);
+
+/**
+ * @brief Clips a segment to the area
+ *
+ * An end inside the area is left exactly as it was; an end outside is moved
+ * along the segment to where it crosses the edge.
+ *
+ * @param area Enabled area
+ * @param x0 Start in mm, updated
+ * @param y0
+ * @param x1 End in mm, updated
+ * @param y1
+ * @return int WORK_AREA_INSIDE if unchanged, WORK_AREA_CLIPPED if an end moved, WORK_AREA_OUTSIDE if nothing is left
+ */
+int work_area_clip(const WorkArea *area, float *x0, float *y0, float *x1, float *y1);
+
+/**
+ * @brief Moves a point to the nearest point of the area
+ *
+ * @param area Enabled area
+ * @param x Point in mm, updated
+ * @param y
+ */
+void work_area_clamp(const WorkArea *area, float *x, float *y);
+
+#endif // WORKAREA_H